@@ -0,0 +1,122 @@
+/*
+ * ESP8266 Things Shell host node entry point
+ * Copyright (c) 2018 Denis Muratov <xeronm@gmail.com>.
+ * https://dtec.pro/gitbucket/git/esp8266/esp8266-tsh.git
+ *
+ * This file is part of ESP8266 Things Shell.
+ *
+ * ESP8266 Things Shell is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * ESP8266 Things Shell is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with ESP8266 Things Shell.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <signal.h>
+#include <unistd.h>
+#include "sysinit.h"
+#include "core/system.h"
+#include "core/logging.h"
+#include "system/comavp.h"
+#include "proto/dtlv.h"
+#include "system/services.h"
+#include "service/udpctl.h"
+
+#define HOST_SERVICE_NAME	"host"
+#define HOST_POLL_TIMEOUT_MS	1000
+#define HOST_CONF_SIZE		128
+
+LOCAL volatile sig_atomic_t host_stop = 0;
+
+LOCAL void      ICACHE_FLASH_ATTR
+host_signal (int signum)
+{
+    host_stop = 1;
+}
+
+LOCAL void      ICACHE_FLASH_ATTR
+host_usage (const char *name)
+{
+    fprintf (stderr, "usage: %s [-f flash_image] [-p udpctl_port] [-s udpctl_secret]" LINE_END, name);
+}
+
+/*
+ * [private] Apply udpctl listen port and secret
+ *  - port: listen port, 0 - keep configured
+ *  - secret: shared secret, NULL - keep configured
+ */
+LOCAL bool      ICACHE_FLASH_ATTR
+host_udpctl_setup (ip_port_t port, const char *secret)
+{
+    char            buf[HOST_CONF_SIZE];
+    dtlv_ctx_t      conf;
+    dtlv_ctx_init_encode (&conf, buf, sizeof (buf));
+
+    if ((secret && dtlv_avp_encode_octets (&conf, UDPCTL_AVP_SECRET, os_strlen (secret), secret))
+        || (port && dtlv_avp_encode_uint16 (&conf, COMMON_AVP_IP_PORT, port)))
+        return false;
+
+    dtlv_ctx_t      conf_in;
+    if (dtlv_ctx_init_decode (&conf_in, buf, conf.datalen))
+        return false;
+
+    return (svcctl_service_conf_set (UDPCTL_SERVICE_ID, &conf_in) == SVCS_ERR_SUCCESS);
+}
+
+int
+main (int argc, char **argv)
+{
+    const char     *flash_path = NULL;
+    const char     *secret = NULL;
+    ip_port_t       port = 0;
+
+    int             opt;
+    while ((opt = getopt (argc, argv, "f:p:s:")) != -1) {
+        switch (opt) {
+        case 'f':
+            flash_path = optarg;
+            break;
+        case 'p':
+            port = atoi (optarg);
+            break;
+        case 's':
+            secret = optarg;
+            break;
+        default:
+            host_usage (argv[0]);
+            return 1;
+        }
+    }
+
+    struct sigaction sa;
+    os_memset (&sa, 0, sizeof (sa));
+    sa.sa_handler = host_signal;
+    sigaction (SIGINT, &sa, NULL);
+    sigaction (SIGTERM, &sa, NULL);
+
+    fio_user_setup (flash_path, 0, true);
+    system_init ();
+
+    if ((port || secret) && !host_udpctl_setup (port, secret))
+        d_log_eprintf (HOST_SERVICE_NAME, "udpctl setup failed");
+
+    while (!host_stop) {
+        if (os_conn_poll (HOST_POLL_TIMEOUT_MS) < 0) {
+            d_log_eprintf (HOST_SERVICE_NAME, "poll failed");
+            break;
+        }
+    }
+
+    system_shutdown ();
+    fio_user_done ();
+
+    return 0;
+}
@@ -22,6 +22,15 @@
 
 #include <stdio.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
 #include "sysinit.h"
 
 //static time_t _start_time = 0;
@@ -40,10 +49,15 @@ system_get_free_heap_size (void)
     return 0;
 }
 
+/*
+    Microsecond monotonic clock, wraps like the ESP8266 system timer
+*/
 os_time_t       ICACHE_FLASH_ATTR
 system_get_time (void)
 {
-    return 0;
+    struct timespec ts;
+    clock_gettime (CLOCK_MONOTONIC, &ts);
+    return (os_time_t) ((uint64) ts.tv_sec * 1000000 + ts.tv_nsec / 1000);
 }
 
 uint32          ICACHE_FLASH_ATTR
@@ -52,46 +66,337 @@ system_rtc_clock_cali_proc (void)
     return 0;
 }
 
+/*
+    User data flash emulation. The image file is mapped into memory, writes follow the ESP8266 SPI flash rules:
+    sector is erased (all ones) before write and programming can only clear bits.
+*/
+#define FIO_USER_PATH_DEFAULT	"./flash_userdata.bin"
+#define FIO_USER_SIZE_DEFAULT	(2 * 1024 * 1024)       // 2 Mb
+
+typedef struct fio_user_data_s {
+    const char     *path;
+    uint32          size;
+    bool            opt_sync;
+    int             fd;
+    uint8          *mptr;
+    uint32         *erase_cnt;  // per sector erase counters
+} fio_user_data_t;
+
+LOCAL fio_user_data_t fdata = { FIO_USER_PATH_DEFAULT, FIO_USER_SIZE_DEFAULT, false, -1, NULL, NULL };
+
+LOCAL bool      ICACHE_FLASH_ATTR
+fio_user_map (void)
+{
+    if (fdata.mptr)
+        return true;
+
+    fdata.fd = open (fdata.path, O_RDWR | O_CREAT, 0644);
+    if (fdata.fd < 0)
+        return false;
+
+    struct stat     st;
+    if (fstat (fdata.fd, &st) || ((st.st_size < fdata.size) && ftruncate (fdata.fd, fdata.size))) {
+        close (fdata.fd);
+        fdata.fd = -1;
+        return false;
+    }
+
+    void           *mptr = mmap (NULL, fdata.size, PROT_READ | PROT_WRITE, MAP_SHARED, fdata.fd, 0);
+    if (mptr == MAP_FAILED) {
+        close (fdata.fd);
+        fdata.fd = -1;
+        return false;
+    }
+    fdata.mptr = mptr;
+    // extended part of image is erased flash
+    if (st.st_size < fdata.size)
+        memset (fdata.mptr + st.st_size, 0xFF, fdata.size - st.st_size);
+
+    fdata.erase_cnt = os_zalloc (sizeof (uint32) * (fdata.size / SPI_FLASH_SEC_SIZE));
+
+    return true;
+}
+
+LOCAL void      ICACHE_FLASH_ATTR
+fio_sector_erase (uint32 sec)
+{
+    memset (fdata.mptr + sec * SPI_FLASH_SEC_SIZE, 0xFF, SPI_FLASH_SEC_SIZE);
+    fdata.erase_cnt[sec]++;
+}
+
+LOCAL void      ICACHE_FLASH_ATTR
+fio_flash_write (uint32 addr, const uint8 * buffer, uint32 size)
+{
+    uint8          *dst = fdata.mptr + addr;
+    uint32          i;
+    for (i = 0; i < size; i++)
+        dst[i] &= buffer[i];
+}
+
+/*
+    Set user data image parameters, current image is unmapped
+      - path: image file path, NULL - default
+      - size: image size, rounded down to sectors, 0 - default
+      - opt_sync: synchronize image file on fio_user_sync
+*/
+void            ICACHE_FLASH_ATTR
+fio_user_setup (const char *path, uint32 size, bool opt_sync)
+{
+    fio_user_done ();
+    fdata.path = (path) ? path : FIO_USER_PATH_DEFAULT;
+    fdata.size = (size) ? size - size % SPI_FLASH_SEC_SIZE : FIO_USER_SIZE_DEFAULT;
+    fdata.opt_sync = opt_sync;
+}
+
+void            ICACHE_FLASH_ATTR
+fio_user_done (void)
+{
+    if (!fdata.mptr)
+        return;
+
+    if (fdata.opt_sync)
+        msync (fdata.mptr, fdata.size, MS_SYNC);
+    munmap (fdata.mptr, fdata.size);
+    close (fdata.fd);
+    os_free (fdata.erase_cnt);
+    fdata.mptr = NULL;
+    fdata.fd = -1;
+    fdata.erase_cnt = NULL;
+}
+
+uint32          ICACHE_FLASH_ATTR
+fio_user_erase_count (uint32 sec)
+{
+    if (!fdata.mptr || (sec >= fdata.size / SPI_FLASH_SEC_SIZE))
+        return 0;
+
+    return fdata.erase_cnt[sec];
+}
+
 size_t          ICACHE_FLASH_ATTR
 fio_user_format (uint32 size)
 {
-    FILE           *fp = fopen ("./flash_userdata.bin", "w+");
-    if (!fp)
+    if (!fio_user_map ())
         return 0;
 
-    fclose (fp);
+    uint32          data = ~0;
+    fio_sector_erase (0);
+    fio_flash_write (0, (uint8 *) & data, sizeof (uint32));
+
     return size;
 }
 
 size_t          ICACHE_FLASH_ATTR
 fio_user_read (uint32 addr, uint32 * buffer, uint32 size)
 {
-    FILE           *fp = fopen ("./flash_userdata.bin", "rb");
-    if (!fp || fseek (fp, addr, SEEK_SET))
+    if (!fio_user_map () || (addr + size > fdata.size))
         return 0;
-    size_t          res = fread (buffer, 1, size, fp);
-    fclose (fp);
 
-    return res;
+    memcpy (buffer, fdata.mptr + addr, size);
+
+    return size;
 }
 
 size_t          ICACHE_FLASH_ATTR
 fio_user_write (uint32 addr, uint32 * buffer, uint32 size)
 {
-    FILE           *fp = fopen ("./flash_userdata.bin", "rb+");
-    if ((!fp) && (errno == ENOENT))
-        fp = fopen ("./flash_userdata.bin", "wb+");
+    if (!fio_user_map () || (addr + size > fdata.size))
+        return 0;
 
-    if (!fp || fseek (fp, addr, SEEK_SET))
+    uint32          sec = addr / SPI_FLASH_SEC_SIZE;
+    if (sec != ((addr + size - 1) / SPI_FLASH_SEC_SIZE)) {
+        // not aligned write, more than one sector
         return 0;
-    size_t          res = fwrite (buffer, 1, size, fp);
-    fclose (fp);
+    }
 
-    return res;
+    uint32          addr_s0 = sec * SPI_FLASH_SEC_SIZE;
+    if (size < SPI_FLASH_SEC_SIZE) {
+        uint8           tmp_buffer[SPI_FLASH_SEC_SIZE];
+        memcpy (tmp_buffer, fdata.mptr + addr_s0, SPI_FLASH_SEC_SIZE);
+        memcpy (tmp_buffer + (addr - addr_s0), buffer, size);
+        fio_sector_erase (sec);
+        fio_flash_write (addr_s0, tmp_buffer, SPI_FLASH_SEC_SIZE);
+    }
+    else {
+        fio_sector_erase (sec);
+        fio_flash_write (addr_s0, (uint8 *) buffer, SPI_FLASH_SEC_SIZE);
+    }
+
+    return size;
 }
 
 size_t          ICACHE_FLASH_ATTR
 fio_user_size (void)
 {
-    return 2 * 1024 * 1024;     // 2 Mb
+    return fdata.size;
+}
+
+bool            ICACHE_FLASH_ATTR
+fio_user_sync (void)
+{
+    if (!fdata.mptr || !fdata.opt_sync)
+        return true;
+
+    return (msync (fdata.mptr, fdata.size, MS_SYNC) == 0);
+}
+
+/*
+    Random source
+*/
+int             ICACHE_FLASH_ATTR
+os_random_buffer (uint8 * buf, size_t len)
+{
+    static int      rnd_fd = -1;
+    if (rnd_fd < 0)
+        rnd_fd = open ("/dev/urandom", O_RDONLY | O_CLOEXEC);
+    if (rnd_fd < 0)
+        return -1;
+
+    while (len > 0) {
+        ssize_t         rlen = read (rnd_fd, buf, len);
+        if (rlen <= 0) {
+            if ((rlen < 0) && (errno == EINTR))
+                continue;
+            return -1;
+        }
+        buf += rlen;
+        len -= rlen;
+    }
+
+    return 0;
+}
+
+uint32          ICACHE_FLASH_ATTR
+os_random (void)
+{
+    uint32          res = 0;
+    os_random_buffer ((uint8 *) & res, sizeof (res));
+    return res;
+}
+
+/*
+    UDP transport. Connections are bound on the loopback interface and dispatched by os_conn_poll
+    from the host main loop, receive callbacks are called in the same way as espconn ones.
+*/
+#define OS_CONN_DATAGRAM_SIZE	2048
+
+LOCAL ip_conn_t *conns[OS_CONN_MAX];
+
+sint8           ICACHE_FLASH_ATTR
+os_conn_create (ip_conn_t * conn)
+{
+    int             i;
+    for (i = 0; i < OS_CONN_MAX; i++)
+        if (!conns[i])
+            break;
+    if (i == OS_CONN_MAX)
+        return 1;
+
+    int             fd = socket (AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+        return 1;
+
+    struct sockaddr_in sin;
+    memset (&sin, 0, sizeof (sin));
+    sin.sin_family = AF_INET;
+    sin.sin_addr.s_addr = htonl (INADDR_LOOPBACK);
+    sin.sin_port = htons (conn->local_port);
+    if (bind (fd, (struct sockaddr *) &sin, sizeof (sin))) {
+        close (fd);
+        return 1;
+    }
+
+    conn->fd = fd;
+    conn->remote_ip.addr = IPADDR_ANY;
+    conn->remote_port = 0;
+    conns[i] = conn;
+
+    return 0;
+}
+
+sint8           ICACHE_FLASH_ATTR
+os_conn_free (ip_conn_t * conn)
+{
+    int             i;
+    for (i = 0; i < OS_CONN_MAX; i++)
+        if (conns[i] == conn)
+            break;
+    if (i == OS_CONN_MAX)
+        return 1;
+
+    conns[i] = NULL;
+    close (conn->fd);
+    conn->fd = -1;
+
+    return 0;
+}
+
+sint8           ICACHE_FLASH_ATTR
+os_conn_set_recvcb (ip_conn_t * conn, os_conn_recv_cb recv_cb)
+{
+    conn->recv_cb = recv_cb;
+    return 0;
+}
+
+sint16          ICACHE_FLASH_ATTR
+os_conn_sent (ip_conn_t * conn, char *data, uint16 length)
+{
+    struct sockaddr_in sin;
+    memset (&sin, 0, sizeof (sin));
+    sin.sin_family = AF_INET;
+    sin.sin_addr.s_addr = conn->remote_ip.addr;
+    sin.sin_port = htons (conn->remote_port);
+
+    ssize_t         res = sendto (conn->fd, data, length, 0, (struct sockaddr *) &sin, sizeof (sin));
+    return (res == length) ? 0 : -1;
+}
+
+/*
+    Wait for datagrams on all created connections and dispatch them to receive callbacks
+      - timeout_ms: wait timeout, -1 - infinite
+      - result: count of dispatched datagrams, -1 on error
+*/
+int             ICACHE_FLASH_ATTR
+os_conn_poll (int timeout_ms)
+{
+    struct pollfd   pfds[OS_CONN_MAX];
+    ip_conn_t      *pconns[OS_CONN_MAX];
+    int             i;
+    int             cnt = 0;
+    for (i = 0; i < OS_CONN_MAX; i++) {
+        if (!conns[i])
+            continue;
+        pfds[cnt].fd = conns[i]->fd;
+        pfds[cnt].events = POLLIN;
+        pconns[cnt] = conns[i];
+        cnt++;
+    }
+
+    int             res = poll (pfds, cnt, timeout_ms);
+    if (res <= 0)
+        return (res < 0 && errno != EINTR) ? -1 : 0;
+
+    int             dispatched = 0;
+    for (i = 0; i < cnt; i++) {
+        if (!(pfds[i].revents & POLLIN))
+            continue;
+
+        ip_conn_t      *conn = pconns[i];
+        char            data[OS_CONN_DATAGRAM_SIZE];
+        while (conn->fd == pfds[i].fd) {
+            struct sockaddr_in sin;
+            socklen_t       sinlen = sizeof (sin);
+            ssize_t         len = recvfrom (conn->fd, data, sizeof (data), 0, (struct sockaddr *) &sin, &sinlen);
+            if (len < 0)
+                break;
+
+            conn->remote_ip.addr = sin.sin_addr.s_addr;
+            conn->remote_port = ntohs (sin.sin_port);
+            dispatched++;
+            if (conn->recv_cb)
+                conn->recv_cb (conn, data, (unsigned short) len);
+        }
+    }
+
+    return dispatched;
 }
@@ -179,6 +179,13 @@ fio_user_size (void)
     return (d_flash_user2_data_addr_end (fwmap) - d_flash_user2_data_addr (fwmap));
 }
 
+bool            ICACHE_FLASH_ATTR
+fio_user_sync (void)
+{
+    // SPI flash writes are synchronous
+    return true;
+}
+
 size_t          ICACHE_FLASH_ATTR
 fio_user_format (uint32 size)
 {
@@ -0,0 +1,182 @@
+/*
+ * ESP8266 Things Shell CRC benchmark
+ * Copyright (c) 2018 Denis Muratov <xeronm@gmail.com>.
+ * https://dtec.pro/gitbucket/git/esp8266/esp8266-tsh.git
+ *
+ * This file is part of ESP8266 Things Shell.
+ *
+ * ESP8266 Things Shell is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * ESP8266 Things Shell is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with ESP8266 Things Shell.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+/*
+ * Checks table-driven CRC against bitwise reference over random buffers, then compares throughput of bitwise,
+ * table-driven and incremental (changed range update with crc16_combine) block checksum calculation.
+ */
+
+#include "sysinit.h"
+#include "crypto/crc.h"
+#include "bench.h"
+
+#define CRC8_POLY		0xD5
+#define CRC16_POLY		0x1021
+
+#define CHECK_BUFFERS		3000
+#define BLOCK_SIZE		4096
+#define BLOCK_RANGES		16
+#define BLOCK_RANGE_SIZE	(BLOCK_SIZE / BLOCK_RANGES)
+#define BENCH_ROUNDS		20000
+
+LOCAL unsigned char block[BLOCK_SIZE];
+
+/*
+ * [private] CRC-8 ETSI bitwise reference
+ */
+LOCAL unsigned char ICACHE_FLASH_ATTR
+crc8_bitwise (const unsigned char *buf, size_t len)
+{
+    unsigned char   crc = 0x00;
+    int             i;
+    while (len--) {
+        crc ^= *buf++;
+        for (i = 0; i < 8; i++)
+            crc = crc & 0x80 ? (crc << 1) ^ CRC8_POLY : crc << 1;
+    }
+    return crc;
+}
+
+/*
+ * [private] CRC-16 CCIT bitwise reference
+ */
+LOCAL unsigned short ICACHE_FLASH_ATTR
+crc16_bitwise (const unsigned char *buf, size_t len)
+{
+    unsigned short  crc = CRC16_INIT;
+    int             i;
+    while (len--) {
+        crc ^= *buf++ << 8;
+        for (i = 0; i < 8; i++)
+            crc = crc & 0x8000 ? (crc << 1) ^ CRC16_POLY : crc << 1;
+    }
+    return crc;
+}
+
+/*
+ * [private] Compare table-driven, update and combine results with bitwise reference
+ *  - result: mismatch count
+ */
+LOCAL uint32    ICACHE_FLASH_ATTR
+crc_check (void)
+{
+    unsigned int    seed = 1;
+    uint32          errors = 0;
+    uint32          n;
+    for (n = 0; n < CHECK_BUFFERS; n++) {
+        size_t          len = bench_rand (&seed) % (BLOCK_SIZE + 1);
+        size_t          i;
+        for (i = 0; i < len; i++)
+            block[i] = bench_rand (&seed);
+        size_t          split = bench_rand (&seed) % (len + 1);
+
+        unsigned short  crc16v = crc16_bitwise (block, len);
+        if (crc8 (block, len) != crc8_bitwise (block, len))
+            errors++;
+        if (crc16 (block, len) != crc16v)
+            errors++;
+        if (crc16_update (crc16 (block, split), block + split, len - split) != crc16v)
+            errors++;
+        if (crc16_combine (crc16 (block, split), crc16 (block + split, len - split), len - split) != crc16v)
+            errors++;
+    }
+
+    return errors;
+}
+
+/*
+ * [private] Print block checksum timing
+ *  - name: calculation name
+ *  - elapsed: all rounds time, seconds
+ *  - base: bitwise calculation time, seconds
+ */
+LOCAL void      ICACHE_FLASH_ATTR
+bench_report (const char *name, double elapsed, double base)
+{
+    printf ("%-13s: %8.2f us/block, %8.1f MB/s, x%.1f" LINE_END, name, elapsed / BENCH_ROUNDS * 1e6,
+            (double) BLOCK_SIZE * BENCH_ROUNDS / elapsed / 1e6, base / elapsed);
+}
+
+int
+main (int argc, char **argv)
+{
+    uint32          errors = crc_check ();
+    printf ("check: %u buffers, crc8, crc16, crc16_update, crc16_combine, mismatches: %u" LINE_END, CHECK_BUFFERS,
+            errors);
+    if (errors)
+        return 1;
+
+    volatile unsigned int sink = 0;
+    unsigned short  range_crc[BLOCK_RANGES];
+    unsigned short  crc = 0;
+    uint32          i, k;
+
+    double          started = bench_time ();
+    for (i = 0; i < BENCH_ROUNDS; i++) {
+        block[i % BLOCK_SIZE] = i;
+        sink += crc16_bitwise (block, BLOCK_SIZE);
+    }
+    double          bitwise = bench_time () - started;
+
+    started = bench_time ();
+    for (i = 0; i < BENCH_ROUNDS; i++) {
+        block[i % BLOCK_SIZE] = i;
+        sink += crc8 (block, BLOCK_SIZE);
+    }
+    double          table8 = bench_time () - started;
+
+    started = bench_time ();
+    for (i = 0; i < BENCH_ROUNDS; i++) {
+        block[i % BLOCK_SIZE] = i;
+        sink += crc16 (block, BLOCK_SIZE);
+    }
+    double          table16 = bench_time () - started;
+
+    // block keeps CRC of every range, a write changes one range only
+    for (k = 0; k < BLOCK_RANGES; k++)
+        range_crc[k] = crc16 (block + k * BLOCK_RANGE_SIZE, BLOCK_RANGE_SIZE);
+
+    started = bench_time ();
+    for (i = 0; i < BENCH_ROUNDS; i++) {
+        uint32          range = i % BLOCK_RANGES;
+        block[range * BLOCK_RANGE_SIZE] = i;
+        range_crc[range] = crc16 (block + range * BLOCK_RANGE_SIZE, BLOCK_RANGE_SIZE);
+
+        crc = range_crc[0];
+        for (k = 1; k < BLOCK_RANGES; k++)
+            crc = crc16_combine (crc, range_crc[k], BLOCK_RANGE_SIZE);
+        sink += crc;
+    }
+    double          incremental = bench_time () - started;
+
+    if (crc != crc16 (block, BLOCK_SIZE)) {
+        fprintf (stderr, "incremental check failed" LINE_END);
+        return 1;
+    }
+
+    printf ("block: %u bytes, %u rounds, incremental: %u ranges" LINE_END, BLOCK_SIZE, BENCH_ROUNDS, BLOCK_RANGES);
+    bench_report ("crc16 bitwise", bitwise, bitwise);
+    bench_report ("crc8 table", table8, bitwise);
+    bench_report ("crc16 table", table16, bitwise);
+    bench_report ("crc16 incr", incremental, bitwise);
+    return 0;
+}
@@ -0,0 +1,139 @@
+/*
+ * ESP8266 Things Shell imdb free slot trace replay
+ * Copyright (c) 2018 Denis Muratov <xeronm@gmail.com>.
+ * https://dtec.pro/gitbucket/git/esp8266/esp8266-tsh.git
+ *
+ * This file is part of ESP8266 Things Shell.
+ *
+ * ESP8266 Things Shell is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * ESP8266 Things Shell is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with ESP8266 Things Shell.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+/*
+ * Replays a fixed mixed insert/delete trace against a variable size object class and reports
+ * free slot search statistics. Build with IMDB_DISABLE_SLOT_BUCKETS to get linear free slot walk figures.
+ */
+
+#include "sysinit.h"
+#include "core/utils.h"
+#include "system/imdb.h"
+#include "bench.h"
+
+#define TRACE_OPERATIONS	20000
+#define TRACE_LIVE_MAX		1500
+#define TRACE_DELETE_PCT	45
+#define TRACE_SMALL_PCT		70
+#define TRACE_SMALL_LEN		24
+#define TRACE_LARGE_LEN		300
+#define TRACE_BLOCK_SIZE	1024
+
+typedef struct trace_obj_s {
+    uint32          tag;
+    uint32          length;
+} trace_obj_t;
+
+/*
+ * [private] Check object payload is not damaged by neighbour slots
+ *  - fobj: fetched object
+ *  - data: found objects counter
+ */
+LOCAL imdb_errcode_t ICACHE_FLASH_ATTR
+trace_obj_check (imdb_fetch_obj_t * fobj, void *data)
+{
+    trace_obj_t    *obj = fobj->dataptr;
+    uint8          *payload = (uint8 *) (obj + 1);
+    uint32          i;
+    for (i = 0; i < obj->length - sizeof (trace_obj_t); i++)
+        if (payload[i] != (uint8) obj->tag)
+            return IMDB_INTERNAL_ERROR;
+
+    (*(uint32 *) data)++;
+    return IMDB_ERR_SUCCESS;
+}
+
+int
+main (int argc, char **argv)
+{
+    imdb_def_t      db_def = { TRACE_BLOCK_SIZE, BLOCK_CRC_NONE, false, 0, 0 };
+    imdb_class_def_t cdef = { "trace", false, true, false, 0, 16, 4, 0 };
+    imdb_hndlr_t    himdb;
+    imdb_hndlr_t    hclass;
+
+    if (imdb_init (&db_def, &himdb) || imdb_class_create (himdb, &cdef, &hclass)) {
+        fprintf (stderr, "imdb init failed" LINE_END);
+        return 1;
+    }
+
+    void           *live[TRACE_LIVE_MAX];
+    uint32          live_count = 0;
+    uint32          inserts = 0, deletes = 0, fails = 0;
+    unsigned int    seed = 12345;
+    uint32          i;
+
+    double          started = bench_time ();
+    for (i = 0; i < TRACE_OPERATIONS; i++) {
+        uint32          pct = bench_rand (&seed) % 100;
+        if (live_count && ((pct < TRACE_DELETE_PCT) || (live_count == TRACE_LIVE_MAX))) {
+            uint32          k = bench_rand (&seed) % live_count;
+            if (imdb_clsobj_delete (himdb, hclass, live[k])) {
+                fprintf (stderr, "delete failed at %u" LINE_END, i);
+                return 1;
+            }
+            live[k] = live[--live_count];
+            deletes++;
+        }
+        else {
+            size_t          length = (bench_rand (&seed) % 100 < TRACE_SMALL_PCT) ? TRACE_SMALL_LEN : TRACE_LARGE_LEN;
+            length = sizeof (trace_obj_t) + bench_rand (&seed) % length;
+            trace_obj_t    *obj;
+            if (imdb_clsobj_insert (himdb, hclass, (void **) &obj, length)) {
+                fails++;
+                continue;
+            }
+            obj->tag = i;
+            obj->length = length;
+            os_memset (obj + 1, (uint8) i, length - sizeof (trace_obj_t));
+            live[live_count++] = obj;
+            inserts++;
+        }
+    }
+    double          elapsed = bench_time () - started;
+
+    uint32          found = 0;
+    if (imdb_class_forall (himdb, hclass, &found, trace_obj_check) || (found != live_count)) {
+        fprintf (stderr, "trace check failed, live: %u, found: %u" LINE_END, live_count, found);
+        return 1;
+    }
+
+    imdb_info_t     info;
+    imdb_class_info_t cinfo;
+    imdb_info (himdb, &info, &cinfo, 1);
+
+#ifdef IMDB_DISABLE_SLOT_BUCKETS
+    printf ("free slots: linear walk" LINE_END);
+#else
+    printf ("free slots: segregated lists" LINE_END);
+#endif
+    printf ("operations: %u, inserts: %u, deletes: %u, fails: %u, live: %u" LINE_END,
+            TRACE_OPERATIONS, inserts, deletes, fails, live_count);
+    printf ("slot_data: %u, slot_skipscan: %u, slot_split: %u, slot_coalesce: %u" LINE_END,
+            info.stat.slot_data, info.stat.slot_skipscan, info.stat.slot_split, info.stat.slot_coalesce);
+    printf ("pages: %u, blocks: %u, slots_free: %u, slots_free_size: %u" LINE_END,
+            cinfo.pages, cinfo.blocks, cinfo.slots_free, (uint32) cinfo.slots_free_size);
+    printf ("elapsed: %.3f s, %.0f ops/s" LINE_END, elapsed, TRACE_OPERATIONS / elapsed);
+
+    imdb_class_destroy (himdb, hclass);
+    imdb_done (himdb);
+    return 0;
+}
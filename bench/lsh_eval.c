@@ -0,0 +1,143 @@
+/*
+ * ESP8266 Things Shell lsh statement evaluation benchmark
+ * Copyright (c) 2018 Denis Muratov <xeronm@gmail.com>.
+ * https://dtec.pro/gitbucket/git/esp8266/esp8266-tsh.git
+ *
+ * This file is part of ESP8266 Things Shell.
+ *
+ * ESP8266 Things Shell is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * ESP8266 Things Shell is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with ESP8266 Things Shell.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+/*
+ * Evaluates gpio/dht control scripts in a loop and reports evaluations per second.
+ * Build with LSH_DISABLE_COMPILED_EVAL to get bytecode interpreter figures.
+ */
+
+#include "sysinit.h"
+#include "core/utils.h"
+#include "system/imdb.h"
+#include "system/services.h"
+#include "service/lsh.h"
+#include "bench.h"
+
+#define BENCH_EVALS		200000
+#define BENCH_BLOCK_SIZE	2048
+
+LOCAL const char *bench_scripts[] = {
+    // humidity control: README example without print()
+    "## last_dt; ## last_ev; # sdt := sysctime(); (last_ev <= 0) ?? { gpio_set(0, 0); last_ev := 1; last_dt := sdt }; "
+        "# temp := 0; # hmd := 0; # res := ! dht_get(1, hmd, temp); "
+        "((last_ev != 2) && res && (hmd >= 3600) && (last_dt + 300 < sdt)) ?? { gpio_set(0, 0); last_ev := 2; last_dt := sdt }; "
+        "((last_ev = 2) && res && (hmd < 3600) && (last_dt + 300 < sdt)) ?? { gpio_set(0, 1); last_ev := 3; last_dt := sdt }; "
+        "((last_ev = 1) && (last_dt + 720 < sdt) || (last_ev = 2) && res && (hmd < 4500) && (last_dt + 1800 < sdt)) ?? "
+        "{ gpio_set(0, 1); last_ev := 4; last_dt := sdt }",
+    // power on once
+    "## last_ev; ((last_ev != 1) && (last_ev != 2)) ?? { last_ev := 1; gpio_set(0, 0) }",
+    // counter arithmetic
+    "## cnt; # x := 3 * 60 * 1000; # y := x / 10 + 5 - 2; (y > 100) ? { y := y - 1 } : { y := y + 1 }; "
+        "cnt := cnt + (y & 255) | 16; (cnt % 2 = 0) ? ret : cnt := cnt ^ 1",
+};
+
+LOCAL uint32    gpio_writes;
+LOCAL uint32    dht_reads;
+
+/*
+ * gpioctl gpio_set stub
+ *  - gpio_id:
+ *  - value:
+ */
+LOCAL void      ICACHE_FLASH_ATTR
+fn_gpio_set (sh_eval_ctx_t * evctx, sh_bc_arg_t * ret_arg, const arg_count_t arg_count, sh_bc_arg_type_t arg_type[],
+             sh_bc_arg_t * bc_args[])
+{
+    gpio_writes++;
+    ret_arg->arg.value = 0;
+}
+
+/*
+ * dhtxx dht_get stub, humidity walks over the control thresholds
+ *  - dht_id:
+ *  - humidity: output
+ *  - temperature: output
+ */
+LOCAL void      ICACHE_FLASH_ATTR
+fn_dht_get (sh_eval_ctx_t * evctx, sh_bc_arg_t * ret_arg, const arg_count_t arg_count, sh_bc_arg_type_t arg_type[],
+            sh_bc_arg_t * bc_args[])
+{
+    dht_reads++;
+    bc_args[1]->arg.value = 3000 + (dht_reads % 2000);
+    bc_args[2]->arg.value = 250;
+    ret_arg->arg.value = 0;
+}
+
+int
+main (int argc, char **argv)
+{
+    uint32          evals = (argc > 1) ? atoi (argv[1]) : BENCH_EVALS;
+
+    imdb_def_t      db_def = { BENCH_BLOCK_SIZE, BLOCK_CRC_NONE, false, 0, 0 };
+    imdb_class_def_t cdef = { "svcdata", false, true, false, 0, 4, 4, 0 };
+    svcs_resource_t svcres;
+    os_memset (&svcres, 0, sizeof (svcres));
+    if (imdb_init (&db_def, &svcres.hmdb) || imdb_class_create (svcres.hmdb, &cdef, &svcres.hdata)
+        || lsh_on_start (&svcres, NULL)) {
+        fprintf (stderr, "lsh start failed" LINE_END);
+        return 1;
+    }
+
+    static sh_func_entry_t fn_entries[2] = {
+        {0, false, false, 0, "gpio_set", {fn_gpio_set}},
+        {0, false, false, 0, "dht_get", {fn_dht_get}},
+    };
+    sh_func_register (&fn_entries[0]);
+    sh_func_register (&fn_entries[1]);
+
+#ifdef LSH_DISABLE_COMPILED_EVAL
+    printf ("eval: bytecode interpreter" LINE_END);
+#else
+    printf ("eval: compiled (LSH_COMPILED_EVAL)" LINE_END);
+#endif
+
+    double          total = 0;
+    uint32          i, k;
+    for (i = 0; i < sizeof (bench_scripts) / sizeof (bench_scripts[0]); i++) {
+        sh_hndlr_t      hstmt;
+        char            name[8];
+        os_sprintf (name, "s%u", i);
+        if (stmt_parse (bench_scripts[i], name, &hstmt)) {
+            fprintf (stderr, "script %u parse failed" LINE_END, i);
+            return 1;
+        }
+
+        sh_eval_ctx_t   evctx;
+        os_memset (&evctx, 0, sizeof (evctx));
+        double          started = bench_time ();
+        for (k = 0; k < evals; k++) {
+            if (stmt_eval (hstmt, &evctx)) {
+                fprintf (stderr, "script %u eval failed: %s" LINE_END, i, evctx.errmsg);
+                return 1;
+            }
+        }
+        double          elapsed = bench_time () - started;
+        total += elapsed;
+
+        printf ("script %u: %u bytes, %.0f evals/s, %.3f us/eval" LINE_END, i, evctx.stmt_info->length,
+                evals / elapsed, elapsed / evals * 1e6);
+        stmt_free (hstmt);
+    }
+    printf ("total: %.0f evals/s, gpio_set: %u, dht_get: %u" LINE_END, i * evals / total, gpio_writes, dht_reads);
+
+    return 0;
+}
@@ -0,0 +1,134 @@
+/*
+ * ESP8266 Things Shell lsh statement parse benchmark
+ * Copyright (c) 2018 Denis Muratov <xeronm@gmail.com>.
+ * https://dtec.pro/gitbucket/git/esp8266/esp8266-tsh.git
+ *
+ * This file is part of ESP8266 Things Shell.
+ *
+ * ESP8266 Things Shell is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * ESP8266 Things Shell is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with ESP8266 Things Shell.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+/*
+ * Parses every script of the corpus (one statement per line) in a loop and reports parse throughput
+ * and peak parse buffer usage (sh_stmt_info_t.scratch).
+ */
+
+#include "sysinit.h"
+#include "core/utils.h"
+#include "system/imdb.h"
+#include "system/services.h"
+#include "service/lsh.h"
+#include "bench.h"
+
+#define BENCH_ROUNDS		20000
+#define BENCH_BLOCK_SIZE	2048
+#define CORPUS_PATH		"./bench/lsh_corpus.txt"
+#define CORPUS_SCRIPTS_MAX	64
+#define CORPUS_SCRIPT_LEN	1024
+
+LOCAL char      corpus[CORPUS_SCRIPTS_MAX][CORPUS_SCRIPT_LEN];
+
+/*
+ * gpioctl/dhtxx functions stub, corpus scripts only have to resolve them
+ */
+LOCAL void      ICACHE_FLASH_ATTR
+fn_stub (sh_eval_ctx_t * evctx, sh_bc_arg_t * ret_arg, const arg_count_t arg_count, sh_bc_arg_type_t arg_type[],
+         sh_bc_arg_t * bc_args[])
+{
+    ret_arg->arg.value = 0;
+}
+
+/*
+ * [private] Load corpus, empty lines are skipped
+ *  - path: corpus file
+ *  - result: scripts count
+ */
+LOCAL uint32    ICACHE_FLASH_ATTR
+corpus_load (const char *path)
+{
+    FILE           *f = fopen (path, "r");
+    if (!f)
+        return 0;
+
+    uint32          count = 0;
+    while ((count < CORPUS_SCRIPTS_MAX) && fgets (corpus[count], CORPUS_SCRIPT_LEN, f)) {
+        corpus[count][strcspn (corpus[count], "\r\n")] = '\0';
+        if (corpus[count][0])
+            count++;
+    }
+    fclose (f);
+
+    return count;
+}
+
+int
+main (int argc, char **argv)
+{
+    uint32          count = corpus_load ((argc > 1) ? argv[1] : CORPUS_PATH);
+    uint32          rounds = (argc > 2) ? atoi (argv[2]) : BENCH_ROUNDS;
+    if (!count) {
+        fprintf (stderr, "usage: %s [corpus_file] [rounds]" LINE_END, argv[0]);
+        return 1;
+    }
+
+    imdb_def_t      db_def = { BENCH_BLOCK_SIZE, BLOCK_CRC_NONE, false, 0, 0 };
+    imdb_class_def_t cdef = { "svcdata", false, true, false, 0, 4, 4, 0 };
+    svcs_resource_t svcres;
+    os_memset (&svcres, 0, sizeof (svcres));
+    if (imdb_init (&db_def, &svcres.hmdb) || imdb_class_create (svcres.hmdb, &cdef, &svcres.hdata)
+        || lsh_on_start (&svcres, NULL)) {
+        fprintf (stderr, "lsh start failed" LINE_END);
+        return 1;
+    }
+
+    static sh_func_entry_t fn_entries[2] = {
+        {0, false, false, 0, "gpio_set", {fn_stub}},
+        {0, false, false, 0, "dht_get", {fn_stub}},
+    };
+    sh_func_register (&fn_entries[0]);
+    sh_func_register (&fn_entries[1]);
+
+    size_t          bytes = 0;
+    obj_size_t      scratch_peak = 0;
+    obj_size_t      length_peak = 0;
+    uint32          i, k;
+
+    double          started = bench_time ();
+    for (k = 0; k < rounds; k++) {
+        for (i = 0; i < count; i++) {
+            sh_hndlr_t      hstmt;
+            if (stmt_parse (corpus[i], "bench", &hstmt)) {
+                fprintf (stderr, "script %u parse failed" LINE_END, i);
+                return 1;
+            }
+            bytes += os_strlen (corpus[i]);
+
+            sh_stmt_info_t  info;
+            stmt_info (hstmt, &info);
+            if (info.scratch > scratch_peak)
+                scratch_peak = info.scratch;
+            if (info.length > length_peak)
+                length_peak = info.length;
+            stmt_free (hstmt);
+        }
+    }
+    double          elapsed = bench_time () - started;
+
+    printf ("corpus: %u scripts, %u rounds, %u bytes" LINE_END, count, rounds, (uint32) (bytes / rounds));
+    printf ("parse: %.0f bytes/s, %.0f parses/s" LINE_END, bytes / elapsed, count * rounds / elapsed);
+    printf ("peak: scratch %u bytes, bytecode %u bytes" LINE_END, scratch_peak, length_peak);
+
+    return 0;
+}
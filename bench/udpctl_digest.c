@@ -0,0 +1,164 @@
+/*
+ * ESP8266 Things Shell udpctl packet digest benchmark
+ * Copyright (c) 2018 Denis Muratov <xeronm@gmail.com>.
+ * https://dtec.pro/gitbucket/git/esp8266/esp8266-tsh.git
+ *
+ * This file is part of ESP8266 Things Shell.
+ *
+ * ESP8266 Things Shell is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * ESP8266 Things Shell is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with ESP8266 Things Shell.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+/*
+ * Compares udpctl per packet digest work: full hmac() calls with HMAC of the both digests before compare (before)
+ * and cached key schedule with hmacKeyed() and constant time compare (after). Results are scaled by CPU clock,
+ * taken from the first argument or /proc/cpuinfo.
+ */
+
+#include "sysinit.h"
+#include "crypto/sha.h"
+#include "service/udpctl.h"
+#include "bench.h"
+
+#define CHECK_ROUNDS		2000
+#define CHECK_KEY_LEN_MAX	150
+#define CHECK_TEXT_LEN_MAX	1500
+#define BENCH_BYTES		100000000
+#define BENCH_ANSWER_SIZE	64
+
+LOCAL const int bench_packet_sizes[] = { 64, 200, 1400 };
+
+LOCAL unsigned char bench_text[CHECK_TEXT_LEN_MAX];
+
+/*
+ * [private] Check hmacKeyed and hmacDigestCompare against hmac() with random keys (longer than block
+ * size too) and texts
+ *  - result: mismatch count
+ */
+LOCAL uint32    ICACHE_FLASH_ATTR
+digest_check (void)
+{
+    unsigned char   key[CHECK_KEY_LEN_MAX];
+    uint8_t         digest[USHAMaxHashSize];
+    uint8_t         digest_keyed[USHAMaxHashSize];
+    unsigned int    seed = 3;
+    uint32          errors = 0;
+    uint32          n;
+    int             i;
+    for (n = 0; n < CHECK_ROUNDS; n++) {
+        SHAversion      version = (n % 3 == 0) ? SHA1 : (n % 3 == 1) ? SHA224 : SHA256;
+        int             key_len = bench_rand (&seed) % CHECK_KEY_LEN_MAX;
+        int             text_len = bench_rand (&seed) % CHECK_TEXT_LEN_MAX;
+        for (i = 0; i < key_len; i++)
+            key[i] = bench_rand (&seed);
+        for (i = 0; i < text_len; i++)
+            bench_text[i] = bench_rand (&seed);
+
+        HMACKeyContext  kctx;
+        hmac (version, bench_text, text_len, key, key_len, digest);
+        if (hmacKeyReset (&kctx, version, key, key_len) || hmacKeyed (&kctx, bench_text, text_len, digest_keyed)
+            || hmacDigestCompare (digest, digest_keyed, USHAHashSize (version)))
+            errors++;
+
+        digest_keyed[n % USHAHashSize (version)] ^= 1 << (n % 8);
+        if (hmacDigestCompare (digest, digest_keyed, USHAHashSize (version)) == 0)
+            errors++;
+    }
+
+    return errors;
+}
+
+/*
+ * [private] CPU clock from /proc/cpuinfo
+ *  - result: MHz, 0 - unknown
+ */
+LOCAL double    ICACHE_FLASH_ATTR
+cpu_mhz (void)
+{
+    FILE           *f = fopen ("/proc/cpuinfo", "r");
+    if (!f)
+        return 0;
+
+    char            line[128];
+    double          mhz = 0;
+    while (fgets (line, sizeof (line), f))
+        if (sscanf (line, "cpu MHz : %lf", &mhz) == 1)
+            break;
+    fclose (f);
+
+    return mhz;
+}
+
+int
+main (int argc, char **argv)
+{
+    uint32          errors = digest_check ();
+    printf ("check: %u keys, hmacKeyed and hmacDigestCompare against hmac, mismatches: %u" LINE_END, CHECK_ROUNDS,
+            errors);
+    if (errors)
+        return 1;
+
+    double          mhz = (argc > 1) ? atof (argv[1]) : cpu_mhz ();
+    if (mhz <= 0) {
+        fprintf (stderr, "usage: %s [cpu_mhz]" LINE_END, argv[0]);
+        return 1;
+    }
+    printf ("cpu: %.0f MHz, answer: %u bytes, HMAC-SHA256" LINE_END, mhz, BENCH_ANSWER_SIZE);
+
+    udpctl_secret_t secret;
+    uint8_t         digest_in[USHAMaxHashSize];
+    uint8_t         digest_comp[USHAMaxHashSize];
+    uint8_t         digest_out[USHAMaxHashSize];
+    HMACKeyContext  kctx;
+    uint32          i;
+    os_memset (secret, 0x5A, sizeof (secret));
+    os_memset (digest_in, 1, sizeof (digest_in));
+    volatile uint32 matches = 0;
+
+    for (i = 0; i < sizeof (bench_packet_sizes) / sizeof (bench_packet_sizes[0]); i++) {
+        int             length = bench_packet_sizes[i];
+        uint32          packets = BENCH_BYTES / (length + BENCH_ANSWER_SIZE);
+        uint32          k;
+
+        // request check and answer sign as udpctl did before the key schedule cache
+        double          started = bench_time ();
+        for (k = 0; k < packets; k++) {
+            bench_text[0] = k;
+            hmac (SHA256, bench_text, length, secret, sizeof (secret), digest_comp);
+            hmac (SHA256, digest_comp, sizeof (udpctl_digest_t), secret, sizeof (secret), digest_comp);
+            hmac (SHA256, digest_in, sizeof (udpctl_digest_t), secret, sizeof (secret), digest_in);
+            if (os_strncmp ((char *) digest_comp, (char *) digest_in, sizeof (udpctl_digest_t)) == 0)
+                matches++;
+            hmac (SHA256, bench_text, BENCH_ANSWER_SIZE, secret, sizeof (secret), digest_out);
+        }
+        double          before = bench_time () - started;
+
+        started = bench_time ();
+        hmacKeyReset (&kctx, SHA256, secret, sizeof (secret));
+        for (k = 0; k < packets; k++) {
+            bench_text[0] = k;
+            hmacKeyed (&kctx, bench_text, length, digest_comp);
+            if (hmacDigestCompare (digest_comp, digest_in, sizeof (udpctl_digest_t)) == 0)
+                matches++;
+            hmacKeyed (&kctx, bench_text, BENCH_ANSWER_SIZE, digest_out);
+        }
+        double          after = bench_time () - started;
+
+        printf ("packet %4u bytes: before %8.0f pkt/s (%6.1f pkt/s/MHz), after %8.0f pkt/s (%6.1f pkt/s/MHz), x%.2f"
+                LINE_END, length, packets / before, packets / before / mhz, packets / after, packets / after / mhz,
+                before / after);
+    }
+
+    return 0;
+}
@@ -74,7 +74,10 @@ log_vprintf (const log_severity_t severity, const char *svc, const char *fmt, va
         return;
 
     log_print_prefix (severity, svc);
-    os_vprintf (fmt, al);
+    va_list         al1;
+    va_copy (al1, al);
+    os_vprintf (fmt, al1);
+    va_end (al1);
     os_printf (LINE_END);
 
 #ifndef DISABLE_SERVICE_SYSLOG
@@ -100,7 +103,10 @@ log_vbprintf (const log_severity_t severity, const char *svc, const char *buf, s
         return;
 
     log_print_prefix (severity, svc);
-    os_vprintf (fmt, al);
+    va_list         al1;
+    va_copy (al1, al);
+    os_vprintf (fmt, al1);
+    va_end (al1);
     os_printf (LINE_END);
     printb (buf, len);
     os_printf (LINE_END);
@@ -50,6 +50,7 @@ typedef struct system_data_s {
     os_timer_t      timer_overflow;
     os_timer_t      timer_softap;
     os_timer_t      timer_safemode;
+    os_timer_t      timer_flush;
     os_event_t      task_queue[TASK_QUEUE_LENGTH];
 #endif
 } system_data_t;
@@ -107,7 +108,8 @@ LOCAL imdb_def_t fdb_def RODATA = {
     BLOCK_CRC_META,
     true,
     SYSTEM_FDB_CACHE_BLOCKS,
-    SYSTEM_FDB_FILE_SIZE
+    SYSTEM_FDB_FILE_SIZE,
+    SYSTEM_FDB_READAHEAD_BLOCKS
 };
 
 LOCAL void      ICACHE_FLASH_ATTR
@@ -156,6 +158,21 @@ safemode_timeout (void *args)
 }
 
 #ifdef ARCH_XTENSA
+LOCAL void      ICACHE_FLASH_ATTR
+fdb_flush_timeout (void *args)
+{
+    imdb_flush_budget (sdata->hfdb, SYSTEM_FDB_FLUSH_BUDGET);
+    imdb_compact (sdata->hfdb, SYSTEM_FDB_COMPACT_BUDGET);
+}
+
+LOCAL void      ICACHE_FLASH_ATTR
+fdb_flush_setup (void)
+{
+    os_timer_disarm (&sdata->timer_flush);
+    os_timer_setfn (&sdata->timer_flush, fdb_flush_timeout, NULL);
+    os_timer_arm (&sdata->timer_flush, SYSTEM_FDB_FLUSH_INTERVAL_MSEC, true);
+}
+
 LOCAL void      ICACHE_FLASH_ATTR
 time_overflow_setup (void)
 {
@@ -281,8 +298,12 @@ system_init (void)
 
     svcctl_service_message (0, 0, NULL, SVCS_MSGTYPE_SYSTEM_START, NULL, NULL);
 
-    // flush all changed blocks
+    // startup restore and service configuration changes are made durable at once
     imdb_flush (sdata->hfdb);
+#ifdef ARCH_XTENSA
+    // blocks changed later are flushed incrementally by idle timer
+    fdb_flush_setup ();
+#endif
 }
 
 void            ICACHE_FLASH_ATTR
@@ -305,6 +326,7 @@ system_shutdown (void)
     os_timer_disarm (&sdata->timer_overflow);
     os_timer_disarm (&sdata->timer_softap);
     os_timer_disarm (&sdata->timer_safemode);
+    os_timer_disarm (&sdata->timer_flush);
 #endif
     st_free (sdata);
 
@@ -23,6 +23,82 @@
 #include "sysinit.h"
 #include "crypto/crc.h"
 
+#define CRC8_POLY	0xD5
+#define CRC16_POLY	0x1021
+
+#ifdef ARCH_XTENSA
+/*
+    Half-byte tables are used on the target to save RAM
+*/
+LOCAL const unsigned char crc8_ntable[16] = {
+    0x00, 0xD5, 0x7F, 0xAA, 0xFE, 0x2B, 0x81, 0x54, 0x29, 0xFC, 0x56, 0x83, 0xD7, 0x02, 0xA8, 0x7D
+};
+
+LOCAL const unsigned short crc16_ntable[16] = {
+    0x0000, 0x1021, 0x2042, 0x3063, 0x4084, 0x50A5, 0x60C6, 0x70E7,
+    0x8108, 0x9129, 0xA14A, 0xB16B, 0xC18C, 0xD1AD, 0xE1CE, 0xF1EF
+};
+
+#define d_crc8_byte(crc, b) \
+	{ \
+		(crc) = (unsigned char) (((crc) << 4) ^ crc8_ntable[((crc) ^ (b)) >> 4]); \
+		(crc) = (unsigned char) (((crc) << 4) ^ crc8_ntable[(((crc) >> 4) ^ (b)) & 0x0F]); \
+	}
+
+#define d_crc16_byte(crc, b) \
+	{ \
+		(crc) = (unsigned short) (((crc) << 4) ^ crc16_ntable[((crc) >> 12) ^ ((b) >> 4)]); \
+		(crc) = (unsigned short) (((crc) << 4) ^ crc16_ntable[(((crc) >> 12) ^ (b)) & 0x0F]); \
+	}
+
+#define d_crc_tables_init()
+
+#else
+/*
+    Slice-by-8 tables are used on the host: table[k][b] is CRC of byte b followed by k zero bytes
+*/
+#define CRC_SLICES	8
+
+LOCAL unsigned char crc8_table[CRC_SLICES][256];
+LOCAL unsigned short crc16_table[CRC_SLICES][256];
+LOCAL bool      crc_tables_ready = false;
+
+LOCAL void      ICACHE_FLASH_ATTR
+crc_tables_init (void)
+{
+    unsigned int    b;
+    unsigned int    k;
+    for (b = 0; b < 256; b++) {
+        unsigned char   crc8v = b;
+        unsigned short  crc16v = b << 8;
+        for (k = 0; k < 8; k++) {
+            crc8v = crc8v & 0x80 ? (crc8v << 1) ^ CRC8_POLY : crc8v << 1;
+            crc16v = crc16v & 0x8000 ? (crc16v << 1) ^ CRC16_POLY : crc16v << 1;
+        }
+        crc8_table[0][b] = crc8v;
+        crc16_table[0][b] = crc16v;
+    }
+
+    for (k = 1; k < CRC_SLICES; k++) {
+        for (b = 0; b < 256; b++) {
+            crc8_table[k][b] = crc8_table[0][crc8_table[k - 1][b]];
+            crc16_table[k][b] = (crc16_table[k - 1][b] << 8) ^ crc16_table[0][crc16_table[k - 1][b] >> 8];
+        }
+    }
+    crc_tables_ready = true;
+}
+
+#define d_crc8_byte(crc, b) \
+	{ (crc) = crc8_table[0][(crc) ^ (b)]; }
+
+#define d_crc16_byte(crc, b) \
+	{ (crc) = (unsigned short) (((crc) << 8) ^ crc16_table[0][((crc) >> 8) ^ (b)]); }
+
+#define d_crc_tables_init() \
+	{ if (!crc_tables_ready) crc_tables_init (); }
+
+#endif
+
 /*
 [public] CRC-8 ETSI
 	Polynom			: 0xD5	x^8 + x^7 + x^6 + x^4 + x^2 + 1
@@ -32,19 +108,24 @@ unsigned char   ICACHE_FLASH_ATTR
 crc8 (unsigned char *buf, size_t len)
 {
     unsigned char   crc = 0x00;
-    unsigned int    i;
+    d_crc_tables_init ();
 
+#ifndef ARCH_XTENSA
+    while (len >= CRC_SLICES) {
+        crc = crc8_table[7][buf[0] ^ crc] ^ crc8_table[6][buf[1]] ^ crc8_table[5][buf[2]] ^ crc8_table[4][buf[3]] ^
+            crc8_table[3][buf[4]] ^ crc8_table[2][buf[5]] ^ crc8_table[1][buf[6]] ^ crc8_table[0][buf[7]];
+        buf += CRC_SLICES;
+        len -= CRC_SLICES;
+    }
+#endif
     while (len--) {
-        crc ^= *buf++;
-
-        for (i = 0; i < 8; i++)
-            crc = crc & 0x80 ? (crc << 1) ^ 0xD5 : crc << 1;
+        d_crc8_byte (crc, *buf);
+        buf++;
     }
 
     return crc;
 }
 
-
 /*
 [public] CRC-16 CCIT
 	Polynom			: 0x1021	x^16 + x^12 + x^5 + 1
@@ -53,14 +134,76 @@ crc8 (unsigned char *buf, size_t len)
 unsigned short  ICACHE_FLASH_ATTR
 crc16 (unsigned char *buf, size_t len)
 {
-    unsigned short  crc = 0xFFFF;
-    unsigned char   i;
+    return crc16_update (CRC16_INIT, buf, len);
+}
 
-    while (len--) {
-        crc ^= *buf++ << 8;
+/*
+[public] Continue CRC-16 CCIT calculation
+  - crc: CRC of preceding data, CRC16_INIT for the data begin
+  - buf: next data
+  - len: next data length
+  - result: CRC of preceding and next data
+*/
+unsigned short  ICACHE_FLASH_ATTR
+crc16_update (unsigned short crc, const unsigned char *buf, size_t len)
+{
+    d_crc_tables_init ();
 
-        for (i = 0; i < 8; i++)
-            crc = crc & 0x8000 ? (crc << 1) ^ 0x1021 : crc << 1;
+#ifndef ARCH_XTENSA
+    while (len >= CRC_SLICES) {
+        crc = crc16_table[7][buf[0] ^ (crc >> 8)] ^ crc16_table[6][buf[1] ^ (crc & 0xFF)] ^
+            crc16_table[5][buf[2]] ^ crc16_table[4][buf[3]] ^ crc16_table[3][buf[4]] ^ crc16_table[2][buf[5]] ^
+            crc16_table[1][buf[6]] ^ crc16_table[0][buf[7]];
+        buf += CRC_SLICES;
+        len -= CRC_SLICES;
     }
+#endif
+    while (len--) {
+        d_crc16_byte (crc, *buf);
+        buf++;
+    }
+
     return crc;
 }
+
+/*
+[private] Multiply polynomials modulo CRC-16 CCIT polynom
+*/
+LOCAL unsigned short ICACHE_FLASH_ATTR
+crc16_gf2_mulmod (unsigned short a, unsigned short b)
+{
+    unsigned short  res = 0;
+    int             i;
+    for (i = 15; i >= 0; i--) {
+        res = res & 0x8000 ? (res << 1) ^ CRC16_POLY : res << 1;
+        if (b & (1 << i))
+            res ^= a;
+    }
+
+    return res;
+}
+
+/*
+[public] Combine CRC-16 CCIT of two adjacent data ranges. Unchanged ranges of the data
+  can keep own CRC, so only changed ranges are calculated again.
+  - crc1: CRC of the first range
+  - crc2: CRC of the second range
+  - len2: second range length
+  - result: CRC of the both ranges
+*/
+unsigned short  ICACHE_FLASH_ATTR
+crc16_combine (unsigned short crc1, unsigned short crc2, size_t len2)
+{
+    // shift first range by len2 zero bytes: multiply by x^(8*len2)
+    unsigned short  xpow = 0x0001;
+    unsigned short  xbase = 0x0100;
+    while (len2) {
+        if (len2 & 1)
+            xpow = crc16_gf2_mulmod (xpow, xbase);
+        xbase = crc16_gf2_mulmod (xbase, xbase);
+        len2 >>= 1;
+    }
+
+    // initial value is taken into account by the both ranges
+    return crc16_gf2_mulmod (crc1 ^ CRC16_INIT, xpow) ^ crc2;
+}
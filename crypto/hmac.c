@@ -245,3 +245,112 @@ hmacResult (HMACContext * ctx, uint8_t * digest)
         /* finish up 2nd pass */
         USHAResult (&ctx->shaContext, digest);
 }
+
+/*
+ *  hmacKeyReset
+ *
+ *  Description:
+ *      This function will precompute the HMAC key schedule: the
+ *      inner and outer SHA contexts with the padded key hashed.
+ *
+ *  Parameters:
+ *      kctx: [out]
+ *          The key schedule to initialize.
+ *      whichSha: [in]
+ *          One of SHA1, SHA224, SHA256, SHA384, SHA512
+ *      key: [in]
+ *          The secret shared key.
+ *      key_len: [in]
+ *          The length of the secret shared key.
+ *
+ *  Returns:
+ *      sha Error Code.
+ *
+ */
+int             ICACHE_FLASH_ATTR
+hmacKeyReset (HMACKeyContext * kctx, enum SHAversion whichSha, const unsigned char *key, int key_len)
+{
+    HMACContext     ctx;
+
+    if (!kctx)
+        return shaNull;
+
+    int             err = hmacReset (&ctx, whichSha, key, key_len);
+    if (err != shaSuccess)
+        return err;
+
+    kctx->whichSha = whichSha;
+    kctx->hashSize = ctx.hashSize;
+    os_memcpy (&kctx->innerContext, &ctx.shaContext, sizeof (USHAContext));
+
+    return USHAReset (&kctx->outerContext, whichSha) ||
+        USHAInput (&kctx->outerContext, ctx.k_opad, ctx.blockSize);
+}
+
+/*
+ *  hmacKeyed
+ *
+ *  Description:
+ *      This function will compute an HMAC message digest with
+ *      the precomputed key schedule.
+ *
+ *  Parameters:
+ *      kctx: [in]
+ *          The key schedule, see hmacKeyReset.
+ *      text: [in]
+ *          An array of characters representing the message.
+ *      text_len: [in]
+ *          The length of the message in text
+ *      digest: [out]
+ *          Where the digest is returned.
+ *
+ *  Returns:
+ *      sha Error Code.
+ *
+ */
+int             ICACHE_FLASH_ATTR
+hmacKeyed (const HMACKeyContext * kctx, const unsigned char *text, int text_len, uint8_t digest[USHAMaxHashSize])
+{
+    USHAContext     ctx;
+
+    if (!kctx)
+        return shaNull;
+
+    /* inner hash starts from the K XOR ipad state */
+    os_memcpy (&ctx, &kctx->innerContext, sizeof (USHAContext));
+    int             err = USHAInput (&ctx, text, text_len) || USHAResult (&ctx, digest);
+    if (err != shaSuccess)
+        return err;
+
+    /* outer hash starts from the K XOR opad state */
+    os_memcpy (&ctx, &kctx->outerContext, sizeof (USHAContext));
+    return USHAInput (&ctx, digest, kctx->hashSize) || USHAResult (&ctx, digest);
+}
+
+/*
+ *  hmacDigestCompare
+ *
+ *  Description:
+ *      This function will compare two digests in constant time,
+ *      the time does not depend on the position of first mismatch.
+ *
+ *  Parameters:
+ *      digest1, digest2: [in]
+ *          The digests to compare.
+ *      length: [in]
+ *          The length of digests.
+ *
+ *  Returns:
+ *      0 when digests are equal.
+ *
+ */
+int             ICACHE_FLASH_ATTR
+hmacDigestCompare (const uint8_t * digest1, const uint8_t * digest2, int length)
+{
+    uint8_t         diff = 0;
+    int             i;
+    for (i = 0; i < length; i++)
+        diff |= digest1[i] ^ digest2[i];
+
+    return diff;
+}
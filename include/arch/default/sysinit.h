@@ -56,7 +56,20 @@ struct ip_addr {
 typedef struct ip_addr ip_addr_t;
 
 typedef uint16  ip_port_t;
-typedef void   *ip_conn_t;
+
+typedef void    (*os_conn_recv_cb) (void *arg, char *pdata, unsigned short len);
+
+/*
+    Host UDP connection bound on the loopback interface, served by os_conn_poll.
+    Remote address is the originator of the last received datagram, answers are sent there.
+*/
+typedef struct ip_conn_s {
+    int             fd;
+    ip_port_t       local_port;
+    ipv4_addr_t     remote_ip;
+    ip_port_t       remote_port;
+    os_conn_recv_cb recv_cb;
+} ip_conn_t;
 
 #define IPADDR_NONE         ((uint32)0xffffffffUL)
 #define IPADDR_ANY          ((uint32)0x00000000UL)
@@ -79,6 +92,11 @@ size_t          fio_user_format (uint32 size);
 size_t          fio_user_read (uint32 addr, uint32 * buffer, uint32 size);
 size_t          fio_user_write (uint32 addr, uint32 * buffer, uint32 size);
 size_t          fio_user_size (void);
+bool            fio_user_sync (void);
+
+void            fio_user_setup (const char *path, uint32 size, bool opt_sync);
+void            fio_user_done (void);
+uint32          fio_user_erase_count (uint32 sec);
 
 #define os_printf	printf
 #define os_sprintf	sprintf
@@ -94,12 +112,13 @@ size_t          fio_user_size (void);
 #define os_strcmp	strcmp
 #define os_strncpy	strncpy
 #define os_memcpy	memcpy
+#define os_memmove	memmove
 #define os_memset	memset
 #define os_memcmp	memcmp
 
 #define os_halt()	exit(0)
 
-#define ALIGN_DATA	__attribute__ ((aligned (4)))
+#define ALIGN_DATA	__attribute__ ((aligned (sizeof (void *))))
 #define PACKED                  //__packed
 #define RODATA                  // ICACHE_RODATA_ATTR
 #define LOCAL       	static
@@ -118,14 +137,19 @@ size_t          fio_user_size (void);
                          ((uint32)((b) & 0xff) << 8)  | \
                           (uint32)((a) & 0xff)
 
-#define os_conn_remote_port(conn, port)		*(port) = 0;
-#define os_conn_remote_addr(conn, ipaddr)	IP4_ADDR(ipaddr, 192, 168, 1, 1);
-#define os_conn_sent(conn, data, length)	;       // espconn_sent((conn), (char *)(data), (length));
-#define os_conn_create(conn)			;
-#define os_conn_free(conn)			;
-#define os_conn_set_recvcb(conn, recv_cb)	;
+#define OS_CONN_MAX		4
+
+sint8           os_conn_create (ip_conn_t * conn);
+sint8           os_conn_free (ip_conn_t * conn);
+sint8           os_conn_set_recvcb (ip_conn_t * conn, os_conn_recv_cb recv_cb);
+sint16          os_conn_sent (ip_conn_t * conn, char *data, uint16 length);
+int             os_conn_poll (int timeout_ms);
+
+#define os_conn_remote_port(conn, port)		*(port) = (conn)->remote_port;
+#define os_conn_remote_addr(conn, ipaddr)	(ipaddr)->addr = (conn)->remote_ip.addr;
 
-#define os_random()				(0)
+uint32          os_random (void);
+int             os_random_buffer (uint8 * buf, size_t len);
 
 #define ip4_addr1(ipaddr) (((uint8*)(ipaddr))[0])
 #define ip4_addr2(ipaddr) (((uint8*)(ipaddr))[1])
@@ -102,6 +102,7 @@ size_t          fio_user_format (uint32 size);
 size_t          fio_user_read (uint32 addr, uint32 * buffer, uint32 size);
 size_t          fio_user_write (uint32 addr, uint32 * buffer, uint32 size);
 size_t          fio_user_size (void);
+bool            fio_user_sync (void);
 
 /*
    User Init
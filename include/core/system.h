@@ -29,6 +29,10 @@
 #define SYSTEM_FDB_BLOCK_SIZE	(SPI_FLASH_SEC_SIZE / 2)        // minmal write unit
 #define SYSTEM_FDB_FILE_SIZE	64
 #define SYSTEM_FDB_CACHE_BLOCKS	4
+#define SYSTEM_FDB_READAHEAD_BLOCKS	2
+#define SYSTEM_FDB_FLUSH_INTERVAL_MSEC	1000    // idle flush timer interval, after the full flush at startup
+#define SYSTEM_FDB_FLUSH_BUDGET	1       // blocks written per idle flush, dirty blocks are lost on power off until written
+#define SYSTEM_FDB_COMPACT_BUDGET	1       // pages moved per idle compaction
 #define TASK_QUEUE_LENGTH	4
 #define AP_SSID_PREFIX		"ESP_"
 #define SYSTEM_DESCRIPTION_LENGTH	80
@@ -58,6 +58,7 @@
 #define d_pointer_add(type, x, y)	( (type*) ((char*)(x) + (size_t)(y)) )
 #define d_pointer_as(type, x)		( (type*) ((char*)(x)) )
 #define d_pointer_equal(x, y)		( (void*)x == (void*)y )
+#define d_offsetof(type, field)		( (size_t) &(((type*) 0)->field) )
 
 // BIT buffer operations
 #define	d_bitbuf_get(buf, n)		( ((buf)[(n) >> 3] >> (7-((n) & 7))) & 0b1 )
@@ -1,8 +1,12 @@
 #ifndef CRC_H_
 #define CRC_H_ 1
 
+#define CRC16_INIT	0xFFFF
+
 unsigned char   crc8 (unsigned char *buf, size_t len);
 unsigned short  crc16 (unsigned char *buf, size_t len);
+unsigned short  crc16_update (unsigned short crc, const unsigned char *buf, size_t len);
+unsigned short  crc16_combine (unsigned short crc1, unsigned short crc2, size_t len2);
 
 
 #endif /* CRC_H_ */
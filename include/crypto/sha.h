@@ -170,6 +170,18 @@ typedef struct HMACContext {
     /* outer padding - key XORd with opad */
 } HMACContext;
 
+/*
+ *  This structure will hold the HMAC key schedule: SHA contexts
+ *  with the inner and outer padded key already hashed, so the
+ *  pads are not recomputed for every message.
+ */
+typedef struct HMACKeyContext {
+    int             whichSha;   /* which SHA is being used */
+    int             hashSize;   /* hash size of SHA being used */
+    USHAContext     innerContext;       /* SHA context after K XOR ipad */
+    USHAContext     outerContext;       /* SHA context after K XOR opad */
+} HMACKeyContext;
+
 /*
  *  Function Prototypes
  */
@@ -244,4 +256,12 @@ extern int      hmacInput (HMACContext * ctx, const unsigned char *text, int tex
 extern int      hmacFinalBits (HMACContext * ctx, const uint8_t bits, unsigned int bitcount);
 extern int      hmacResult (HMACContext * ctx, uint8_t digest[USHAMaxHashSize]);
 
+/*
+ * HMAC with precomputed key schedule, for all SHAs.
+ */
+extern int      hmacKeyReset (HMACKeyContext * kctx, enum SHAversion whichSha, const unsigned char *key, int key_len);
+extern int      hmacKeyed (const HMACKeyContext * kctx, const unsigned char *text, int text_len,
+                           uint8_t digest[USHAMaxHashSize]);
+extern int      hmacDigestCompare (const uint8_t * digest1, const uint8_t * digest2, int length);
+
 #endif /* _SHA_H_ */
@@ -107,6 +107,7 @@ typedef enum espadmin_avp_code_e {
     ESPADMIN_AVP_IMDB_FREE_SLOTS = 141,
     ESPADMIN_AVP_IMDB_FREE_SIZE = 142,
     ESPADMIN_AVP_IMDB_MEM_USED = 143,
+    ESPADMIN_AVP_IMDB_ROW_SCAN = 144,
     // Wireless
     ESPADMIN_AVP_WIFI_OPMODE = 145,
     ESPADMIN_AVP_WIFI_SSID = 146,
@@ -128,6 +129,15 @@ typedef enum espadmin_avp_code_e {
     ESPADMIN_AVP_FDB_DATA_SIZE = 192,
     ESPADMIN_AVP_FDB_FILE_SIZE = 193,
     ESPADMIN_AVP_FDB_FILE_HWM = 194,
+    ESPADMIN_AVP_FDB_CACHE_HIT = 195,
+    ESPADMIN_AVP_FDB_CACHE_MISS = 196,
+    ESPADMIN_AVP_FDB_CACHE_EVICT = 197,
+    ESPADMIN_AVP_FDB_FILE_FREE = 198,
+    ESPADMIN_AVP_FDB_PAGE_REUSE = 199,
+    ESPADMIN_AVP_FDB_PAGE_MOVE = 200,
+    ESPADMIN_AVP_FDB_BLOCK_TRIM = 201,
+    ESPADMIN_AVP_IMDB_ROW_FETCH = 202,
+    ESPADMIN_AVP_FDB_BLOCK_READAHEAD = 203,
 } espadmin_avp_code_t;
 
 //svcs_errcode_t  espadmin_on_msg_product (dtlv_ctx_t * msg_out);
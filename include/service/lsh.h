@@ -63,6 +63,7 @@ typedef enum sh_errcode_e {
     SH_STMT_NOT_EXISTS = 18,
     SH_FUNC_ERROR = 19,
     SH_STMT_SOURCE_NOT_EXISTS = 20,
+    SH_EVAL_YIELD = 21,
 } sh_errcode_t;
 
 typedef enum sh_msgtype_e {
@@ -73,6 +74,7 @@ typedef enum sh_msgtype_e {
     SH_MSGTYPE_STMT_SOURCE = 14,
     SH_MSGTYPE_STMT_LOAD = 15,
     SH_MSGTYPE_STMT_LIST = 16,
+    SH_MSGTYPE_STMT_PROFILE = 17,
 } sh_msgtype_t;
 
 typedef enum sh_avp_code_e {
@@ -89,12 +91,24 @@ typedef enum sh_avp_code_e {
     SH_AVP_STMT_EXITADDR = 112,
     SH_AVP_STMT_ADDR_START = 113,
     SH_AVP_STMT_ADDR_STOP = 114,
+    SH_AVP_STMT_PROFILE = 115,
+    SH_AVP_PROFILE_RESET = 116,
+    SH_AVP_EXEC_COUNT = 117,
+    SH_AVP_EXEC_TIME = 118,
+    SH_AVP_EXEC_TIME_MAX = 119,
+    SH_AVP_FUNC_CALL_COUNT = 120,
+    SH_AVP_FUNC_CALL_TIME = 121,
+    SH_AVP_OPER_PROFILE = 122,
+    SH_AVP_OPER_TYPE = 123,
+    SH_AVP_OPER_COUNT = 124,
 } sh_avp_code_t;
 
 typedef struct sh_stmt_info_s {
     sh_stmt_name_t  name;
     lt_time_t       parse_time;
     obj_size_t      length;
+    obj_size_t      saved;      // bytecode bytes saved by optimization
+    obj_size_t      scratch;    // parse buffer peak usage
 } sh_stmt_info_t;
 
 typedef struct sh_stmt_source_s {
@@ -110,6 +124,8 @@ typedef struct sh_eval_ctx_s {
     uint8           exitcode;
     sh_errcode_t    errcode;
     char            errmsg[80];
+    uint16          oper_budget;        // operators per evaluation slice, 0 - unlimited
+    uint32          time_budget;        // evaluation slice time (us), 0 - unlimited
 } sh_eval_ctx_t;
 
 typedef struct sh_bc_arg_s {
@@ -141,8 +157,11 @@ External function definition
   - service_id: owner service (default: 0)
   - func_name: the functon name (alias)
   - func_ptr: pointer to function
-  - opt_determ: deterministic flag
+  - opt_determ: deterministic flag, results are memoized by argument values during statement evaluation
   - opt_stmt: statement flag
+  - determ_ttl: deterministic result lifetime across evaluations, ms (default: 0 - single evaluation)
+Function used as FOREACH sequence "func(cursor, ...) @ { ... }" advances the cursor argument in place and
+returns 0 after the last item.
 */
 typedef struct sh_func_entry_s {
     service_ident_t service_id;
@@ -155,6 +174,7 @@ typedef struct sh_func_entry_s {
         sh_hndlr_t      hstmt;
         void           *ptr;
     } func;
+    uint16          determ_ttl;
 } sh_func_entry_t;
 
 sh_errcode_t    sh_func_get (const char *func_name, sh_func_entry_t ** entry);
@@ -165,6 +185,8 @@ sh_errcode_t    stmt_dump (const sh_hndlr_t hstmt, char *buf, size_t len, bool r
                            bytecode_size_t addr_stop);
 sh_errcode_t    stmt_info (const sh_hndlr_t hstmt, sh_stmt_info_t * info);
 sh_errcode_t    stmt_eval (const sh_hndlr_t hstmt, sh_eval_ctx_t * ctx);
+// continue evaluation suspended with SH_EVAL_YIELD from ctx->addr
+sh_errcode_t    stmt_resume (const sh_hndlr_t hstmt, sh_eval_ctx_t * ctx);
 sh_errcode_t    stmt_free (const sh_hndlr_t hstmt);
 
 sh_errcode_t    stmt_get (const char *stmt_name, sh_hndlr_t * hstmt);
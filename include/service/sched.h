@@ -37,6 +37,9 @@
 #define SCHEDULER_SZENTRY_MAX_LEN	80
 #define SCHEDULER_ENTRY_NAME_LEN	30
 
+#define SCHED_DEFAULT_STMT_TIME_QUOTA_US	10000   // statement evaluation slice, then yield to system tasks
+#define SCHED_DEFAULT_STMT_OPER_QUOTA		0       // operators per evaluation slice, 0 - unlimited
+
 typedef enum sched_errcode_e {
     SCHED_ERR_SUCCESS = 0,
     SCHED_INTERNAL_ERROR = 1,
@@ -77,6 +80,8 @@ typedef enum sched_avp_code_e {
     SCHED_AVP_FAIL_COUNT = 109,
     SCHED_AVP_PERSISTENT = 110,
     SCHED_AVP_ENTRY_SOURCE = 111,
+    SCHED_AVP_STMT_TIME_QUOTA = 112,
+    SCHED_AVP_STMT_OPER_QUOTA = 113,
 } sched_avp_code_t;
 
 typedef struct tsentry_s {
@@ -99,6 +104,7 @@ typedef struct sched_entry_s {
     uint16          run_count;
     uint16          fail_count;
     sched_entry_state_t state;
+    bytecode_size_t resume_addr;        // statement address to continue from, when state is QUEUE
     size_t          varlen;
     ALIGN_DATA char vardata[];
 } sched_entry_t;
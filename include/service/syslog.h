@@ -54,6 +54,7 @@ typedef enum PACKED syslog_avp_code_e {
     SYSLOG_AVP_LOG_TIMESTAMP = 104,
     SYSLOG_AVP_LOG_RECNO = 105,
     SYSLOG_AVP_LOG_SERVICE = 106,
+    SYSLOG_AVP_LOG_LIMIT = 107,
 } syslog_avp_code_t;
 
 // used by services
@@ -46,7 +46,7 @@
 	+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
 	|          Service-Id           |             Length            |
 	+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
-	|R S E x x x x x|    Cmd Code   |          Identifier           |
+	|R S E T F x x x|    Cmd Code   |          Identifier           |
 	+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
 	|                    Message Digest (256 bits)                  |
 	+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
@@ -94,6 +94,8 @@ typedef uint8   udpctl_secret_t[UDPCTL_SECRET_LEN];
 #define PACKET_FLAG_REQUEST	(1 << 7)
 #define PACKET_FLAG_SECURED	(1 << 6)
 #define PACKET_FLAG_ERROR	(1 << 5)
+#define PACKET_FLAG_STREAM	(1 << 4)        // request: answer may be streamed, answer: packet is a stream fragment
+#define PACKET_FLAG_FINAL	(1 << 3)        // last stream fragment
 
 typedef struct udpctl_packet_s {
     // 1-st 4 bytes
@@ -115,6 +117,14 @@ typedef struct udpctl_packet_auth_s {
     udpctl_digest_t auth;       // 32 bytes
 } udpctl_packet_auth_t;
 
+// follows packet header (and digest) in every stream fragment
+typedef struct udpctl_fragment_s {
+    uint16          sequence;   // fragment number, starts from 0
+    uint16          count;      // total fragments of the answer
+} udpctl_fragment_t;
+
+typedef sint16  (*udpctl_send_func) (void *arg, char *data, packet_size_t length);
+
 typedef enum udpctl_clnt_state_e {
     UCTL_CLNT_STATE_NONE = 0,
     UCTL_CLNT_STATE_FAIL,
@@ -144,6 +154,7 @@ typedef enum udpctl_cmd_code_e {
     UCTL_CMD_CODE_TERMINATE = 2,
     UCTL_CMD_CODE_SRVMSG = 3,
     UCTL_CMD_CODE_NTFMSG = 4,
+    UCTL_CMD_CODE_SRVMSG_BATCH = 5,
 } udpctl_cmd_code_t;
 
 typedef enum udpctl_msgtype_e {
@@ -163,6 +174,7 @@ typedef enum udpctl_avp_code_e {
     UDPCTL_AVP_CLIENT_FIRST_TIME = 109,
     UDPCTL_AVP_CLIENT_LAST_TIME = 110,
     UDPCTL_AVP_SURVEILLANCE_TIMEOUT = 111,
+    UDPCTL_AVP_MESSAGE_RESULT = 112,
 } udpctl_avp_code_t;
 
 typedef enum udpctl_result_code_e {
@@ -180,6 +192,9 @@ typedef struct udpctl_client_s {
     udpctl_digest_t auth;
     os_time_t       first_time;
     os_time_t       last_time;
+    os_time_t       expire_time;        // next state check by the expiry wheel
+    uint8           wheel_prev; // expiry wheel (or free list) links: slot index + 1, 0 - none
+    uint8           wheel_next;
 } udpctl_client_t;
 
 // used by services
@@ -196,6 +211,9 @@ svcs_errcode_t  udpctl_on_message (service_ident_t orig_id,
 udpctl_errcode_t udpctl_sync_request (ipv4_addr_t * addr, ip_port_t * port,
                                       char *data_in, packet_size_t length_in, char *data_out,
                                       packet_size_t * length_out);
+udpctl_errcode_t udpctl_stream_request (ipv4_addr_t * addr, ip_port_t * port,
+                                        char *data_in, packet_size_t length_in, udpctl_send_func send_func,
+                                        void *send_arg);
 
 #define d_udpctl_check_udpctl_error(ret) \
 	{ \
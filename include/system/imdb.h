@@ -21,10 +21,6 @@
  */
 
 
-/*
- * TODO: Should make hash-map storage and replace some heap storage, for example: functions, configurations, etc.
- */
-
 #ifndef _IMDB_H_
 #define _IMDB_H_ 1
 
@@ -74,8 +70,10 @@ typedef enum imdb_access_path_s {
 #define IMDB_CLASS_NAME_LEN	16      //
 #define IMDB_BLOCK_CRC
 #define IMDB_BLOCK_CRC_DEFAULT	0xFFFF
+#define IMDB_CLASS_INDEX_MAX	2       // secondary hash indexes per class
+#define IMDB_QUERY_PRED_MAX	4       // predicates per query
 
-#define IMDB_FILE_HEADER_VERSION	1
+#define IMDB_FILE_HEADER_VERSION	4
 
 typedef uint16  obj_size_t;     // aligned by IMDB_BLOCK_UNIT_ALIGN
 typedef uint16  block_size_t;   // aligned by IMDB_BLOCK_UNIT_ALIGN
@@ -92,6 +90,13 @@ typedef uint32  stat_count_t;
 
 typedef char    class_name_t[IMDB_CLASS_NAME_LEN];
 
+typedef uint8   imdb_index_id_t;
+
+typedef enum imdb_key_type_s {
+    KEY_TYPE_BINARY = 0,        // key compared by bytes
+    KEY_TYPE_STRING = 1,        // key compared as string limited by key length
+} imdb_key_type_t;
+
 /*
  * imdb statistics definition
  *   - mem_alloc  : total allocated memory in bytes
@@ -104,6 +109,17 @@ typedef char    class_name_t[IMDB_CLASS_NAME_LEN];
  *   - slot_split : total split free slot on data + free
  *   - slot_coalesce: total coalesce 2 free slots
  *   - slot_skipscan: total slot skip skan for find suitable free slot
+ *   - cache_hit  : total buffer cache hits (media storage)
+ *   - cache_miss : total buffer cache misses (media storage)
+ *   - cache_evict: total blocks evicted from buffer cache by CLOCK replacement
+ *   - page_reuse : total pages allocated from file free page list (media storage)
+ *   - page_move  : total pages moved down by compaction (media storage)
+ *   - block_trim : total blocks released from file high water mark (media storage)
+ *   - index_probe: total index entries probed by lookups
+ *   - index_rebuild: total index pages reallocated by growth
+ *   - row_scan   : total rows examined by cursors
+ *   - row_fetch  : total rows returned by cursors, after predicates
+ *   - block_readahead: total blocks loaded by read-ahead of sequential scans (media storage)
  */
 typedef struct imdb_stat_s {
     size_t          mem_alloc;
@@ -122,6 +138,17 @@ typedef struct imdb_stat_s {
     stat_count_t    slot_split;
     stat_count_t    slot_coalesce;
     stat_count_t    slot_skipscan;
+    stat_count_t    cache_hit;
+    stat_count_t    cache_miss;
+    stat_count_t    cache_evict;
+    stat_count_t    page_reuse;
+    stat_count_t    page_move;
+    stat_count_t    block_trim;
+    stat_count_t    index_probe;
+    stat_count_t    index_rebuild;
+    stat_count_t    row_scan;
+    stat_count_t    row_fetch;
+    stat_count_t    block_readahead;
 } imdb_stat_t;
 
 /*
@@ -137,6 +164,7 @@ typedef struct imdb_def_s {
     bool            opt_media:1;
     uint32          buffer_size;        //
     uint32          file_size;  // file size in blocks
+    uint16          readahead_size;     // read-ahead window in blocks, 0 - disabled
     imdb_hndlr_t    hcur;       // handler to cursor
 } imdb_def_t;
 
@@ -218,10 +246,71 @@ typedef struct imdb_fetch_obj_s {
     void           *dataptr;
 } imdb_fetch_obj_t;
 
+typedef enum imdb_pred_type_s {
+    PRED_TYPE_UINT8 = 0,
+    PRED_TYPE_UINT16 = 1,
+    PRED_TYPE_UINT32 = 2,
+    PRED_TYPE_SINT32 = 3,
+    PRED_TYPE_STRING = 4,       // compared as string limited by length
+    PRED_TYPE_BINARY = 5,       // compared by bytes
+} imdb_pred_type_t;
+
+typedef enum imdb_pred_op_s {
+    PRED_OP_EQ = 0,
+    PRED_OP_NE = 1,
+    PRED_OP_LT = 2,
+    PRED_OP_LE = 3,
+    PRED_OP_GT = 4,
+    PRED_OP_GE = 5,
+} imdb_pred_op_t;
+
+/*
+ * imdb query predicate: object field <op> constant
+ *   - offset : field offset in object
+ *   - length : field length, used by STRING and BINARY types
+ *   - type   : field type
+ *   - op     : comparator
+ *   - value  : constant, value.ptr for STRING and BINARY types must be valid until cursor closed
+ */
+typedef struct imdb_predicate_s {
+    obj_size_t      offset;
+    uint8           length;
+    imdb_pred_type_t type:4;
+    imdb_pred_op_t  op:4;
+    union {
+        uint32          uval;
+        sint32          sval;
+        const void     *ptr;
+    } value;
+} imdb_predicate_t;
+
+/*
+ * imdb query definition
+ *   - pred       : predicates, object is fetched when all of them are satisfied
+ *   - pred_count : predicates count
+ *   - proj_offset: projected part offset in object
+ *   - proj_length: projected part length, 0 - no projection
+ *   - proj_buffer: projection buffer for fetch count rows by proj_length bytes,
+ *                  fetched dataptr refers to the buffer
+ *   - rowid_start: scan start object (recycle scans only), block_id=0 - from the ring begin/end
+ *   - row_limit  : cursor rows limit, 0 - unlimited
+ */
+typedef struct imdb_query_s {
+    imdb_predicate_t pred[IMDB_QUERY_PRED_MAX];
+    uint8           pred_count;
+    obj_size_t      proj_offset;
+    obj_size_t      proj_length;
+    void           *proj_buffer;
+    imdb_rowid_t    rowid_start;
+    uint16          row_limit;
+} imdb_query_t;
+
 imdb_errcode_t  imdb_init (imdb_def_t * imdb_def, imdb_hndlr_t * himdb);
 imdb_errcode_t  imdb_done (imdb_hndlr_t hmdb);
 imdb_errcode_t  imdb_info (imdb_hndlr_t hmdb, imdb_info_t * imdb_info, imdb_class_info_t info_array[], uint8 array_len);
 imdb_errcode_t  imdb_flush (imdb_hndlr_t hmdb);
+imdb_errcode_t  imdb_flush_budget (imdb_hndlr_t hmdb, uint32 max_blocks);
+imdb_errcode_t  imdb_compact (imdb_hndlr_t hmdb, uint32 max_pages);
 
 imdb_errcode_t  imdb_class_find (imdb_hndlr_t hmdb, const char *name, imdb_hndlr_t * hclass);
 imdb_errcode_t  imdb_class_create (imdb_hndlr_t hmdb, imdb_class_def_t * class_def, imdb_hndlr_t * hclass);
@@ -229,20 +318,31 @@ imdb_errcode_t  imdb_class_destroy (imdb_hndlr_t hmdb, imdb_hndlr_t hclass);
 imdb_errcode_t  imdb_class_info (imdb_hndlr_t hmdb, imdb_hndlr_t hclass, imdb_class_info_t * class_info);
 
 imdb_errcode_t  imdb_clsobj_insert (imdb_hndlr_t hmdb, imdb_hndlr_t hclass, void **ptr, size_t length);
+imdb_errcode_t  imdb_clsobj_insert_commit (imdb_hndlr_t hmdb, imdb_hndlr_t hclass, void *ptr);
 imdb_errcode_t  imdb_clsobj_delete (imdb_hndlr_t hmdb, imdb_hndlr_t hclass, void *ptr);
 imdb_errcode_t  imdb_clsobj_resize (imdb_hndlr_t hmdb, imdb_hndlr_t hclass, void *ptr_old, void **ptr, size_t length);
 imdb_errcode_t  imdb_clsobj_length (imdb_hndlr_t hmdb, imdb_hndlr_t hclass, void *ptr, size_t * length);
+imdb_errcode_t  imdb_clsobj_length_max (imdb_hndlr_t hmdb, imdb_hndlr_t hclass, size_t * length);
 
 imdb_errcode_t  imdb_clsobj_update_init (imdb_hndlr_t hmdb, imdb_rowid_t * rowid, void **ptr);
 imdb_errcode_t  imdb_clsobj_update (imdb_hndlr_t hmdb, imdb_rowid_t * rowid, void **ptr);
 
 imdb_errcode_t  imdb_class_query (imdb_hndlr_t hmdb, imdb_hndlr_t hclass, imdb_access_path_t path, imdb_hndlr_t * hcur);
+imdb_errcode_t  imdb_class_query_ext (imdb_hndlr_t hmdb, imdb_hndlr_t hclass, imdb_access_path_t path,
+                                      const imdb_query_t * query, imdb_hndlr_t * hcur);
 imdb_errcode_t  imdb_class_fetch (imdb_hndlr_t hcur, uint16 count, uint16 * rowcount, imdb_fetch_obj_t fobj[]);
 imdb_errcode_t  imdb_class_close (imdb_hndlr_t hcur);
 
 typedef         imdb_errcode_t (*imdb_forall_func) (imdb_fetch_obj_t * fobj, void *data);
 imdb_errcode_t  imdb_class_forall (imdb_hndlr_t hmdb, imdb_hndlr_t hclass, void *data, imdb_forall_func forall_func);
 
+imdb_errcode_t  imdb_index_create (imdb_hndlr_t hmdb, imdb_hndlr_t hclass, obj_size_t key_offset, uint8 key_len,
+                                   imdb_key_type_t key_type, imdb_index_id_t * idx_id);
+imdb_errcode_t  imdb_index_find (imdb_hndlr_t hmdb, imdb_hndlr_t hclass, imdb_index_id_t idx_id, const void *key,
+                                 imdb_fetch_obj_t * fobj);
+imdb_errcode_t  imdb_index_forall (imdb_hndlr_t hmdb, imdb_hndlr_t hclass, imdb_index_id_t idx_id, const void *key,
+                                   void *data, imdb_forall_func forall_func);
+
 // forall helpers
 imdb_errcode_t  imdb_forall_count (imdb_fetch_obj_t * fobj, void *data);
 
@@ -252,9 +352,12 @@ typedef struct imdb_file_s {
     uint16          crc16;
     uint32          scn;
     block_size_t    block_size;
+    size_t          class_first;
     size_t          class_last;
     size_t          file_size;
     size_t          file_hwm;
+    size_t          page_fl_first;      // free page list, ordered by address
+    size_t          page_fl_blocks;     // total blocks in free page list
 } imdb_file_t;
 
 imdb_errcode_t  fdb_header_read (imdb_file_t * hdr_file);
@@ -0,0 +1,279 @@
+#!/usr/bin/python3
+# -*- coding: utf-8 -*-
+
+# udpctl load generator: opens authenticated sessions, sends service messages and reports
+# request latency percentiles and throughput.
+
+import argparse
+import hashlib
+import hmac
+import os
+import socket
+import struct
+import sys
+import threading
+import time
+
+PACKET_FLAG_REQUEST = 1 << 7
+PACKET_FLAG_SECURED = 1 << 6
+PACKET_FLAG_ERROR = 1 << 5
+PACKET_FLAG_STREAM = 1 << 4
+PACKET_FLAG_FINAL = 1 << 3
+
+UCTL_CMD_CODE_AUTH = 1
+UCTL_CMD_CODE_SRVMSG = 3
+UCTL_CMD_CODE_SRVMSG_BATCH = 5
+
+UDPCTL_SERVICE_ID = 4
+UDPCTL_MSGTYPE_INFO = 1
+UDPCTL_AVP_MESSAGE_RESULT = 112
+
+COMMON_AVP_RESULT_CODE = 3
+COMMON_AVP_SVC_MESSAGE = 10
+COMMON_AVP_SVC_MESSAGE_TYPE = 11
+
+RESULT_CODE_SUCCESS = 1
+
+DTLV_TYPE_OBJECT = 1
+DTLV_TYPE_INTEGER = 2
+
+HEADER = struct.Struct('>HHBBH')
+FRAGMENT = struct.Struct('>HH')
+DIGEST_SIZE = 32
+DATAGRAM_SIZE = 2048
+
+
+class ProtocolError(Exception):
+    pass
+
+
+def encodeAvp(ns, code, datatype, data):
+    length = 4 + len(data)
+    avp = struct.pack('>HH', (datatype << 14) | length, (ns << 10) | code) + data
+    return avp + b'\0' * (-len(avp) % 4)
+
+
+def decodeAvps(data):
+    avps = []
+    pos = 0
+    while pos + 4 <= len(data):
+        flags_and_length, ns_and_code = struct.unpack_from('>HH', data, pos)
+        length = flags_and_length & 0x1FFF
+        if length < 4 or pos + length > len(data):
+            raise ProtocolError('invalid AVP length %u' % length)
+        avps.append((ns_and_code >> 10, ns_and_code & 0x3FF, flags_and_length >> 14, data[pos + 4:pos + length]))
+        pos += (length + 3) & ~3
+    return avps
+
+
+def resultCode(body):
+    for ns, code, datatype, data in decodeAvps(body):
+        if code == COMMON_AVP_RESULT_CODE and datatype == DTLV_TYPE_INTEGER:
+            return int.from_bytes(data, 'big')
+    return None
+
+
+def batchResults(body):
+    return [resultCode(data) for ns, code, datatype, data in decodeAvps(body) if code == UDPCTL_AVP_MESSAGE_RESULT]
+
+
+def serviceMessage(service_id, msgtype):
+    msgtype_avp = encodeAvp(0, COMMON_AVP_SVC_MESSAGE_TYPE, DTLV_TYPE_INTEGER, struct.pack('>H', msgtype))
+    return encodeAvp(service_id, COMMON_AVP_SVC_MESSAGE, DTLV_TYPE_OBJECT, msgtype_avp)
+
+
+class Session(object):
+    """Authenticated udpctl session, every message digest is chained with the previous one"""
+
+    def __init__(self, host, port, secret, timeout):
+        self.addr = (host, port)
+        self.secret = secret
+        self.sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+        self.sock.settimeout(timeout)
+        self.auth = bytes(DIGEST_SIZE)
+        self.identifier = 0
+
+    def close(self):
+        self.sock.close()
+
+    def hmac(self, data):
+        return hmac.new(self.secret, data, hashlib.sha256).digest()
+
+    def sign(self, packet, chain):
+        hdrlen = HEADER.size
+        digest = self.hmac(packet[:hdrlen] + chain + packet[hdrlen + DIGEST_SIZE:])
+        return packet[:hdrlen] + digest + packet[hdrlen + DIGEST_SIZE:]
+
+    def verify(self, packet, chain):
+        hdrlen = HEADER.size
+        digest = packet[hdrlen:hdrlen + DIGEST_SIZE]
+        if not hmac.compare_digest(self.sign(packet, chain)[hdrlen:hdrlen + DIGEST_SIZE], digest):
+            raise ProtocolError('invalid answer digest')
+        return digest
+
+    def receive(self, identifier):
+        while True:
+            packet = self.sock.recv(DATAGRAM_SIZE)
+            if len(packet) < HEADER.size:
+                raise ProtocolError('short answer')
+            service_id, length, flags, code, answer_id = HEADER.unpack_from(packet)
+            if length != len(packet):
+                raise ProtocolError('answer length %u:%u' % (length, len(packet)))
+            if answer_id == identifier:
+                return packet, flags
+            # late answer of a timed out request
+
+    def request(self, service_id, code, body, stream=False):
+        flags = PACKET_FLAG_REQUEST | (PACKET_FLAG_STREAM if stream else 0)
+        hdrlen = HEADER.size
+        if self.secret:
+            flags |= PACKET_FLAG_SECURED
+            hdrlen += DIGEST_SIZE
+            if code == UCTL_CMD_CODE_AUTH:
+                body = self.hmac(os.urandom(DIGEST_SIZE)) + body
+
+        identifier = self.identifier
+        self.identifier = (self.identifier + 1) & 0xFFFF
+        packet = HEADER.pack(service_id, hdrlen + len(body), flags, code, identifier)
+        if self.secret:
+            packet = self.sign(packet + self.auth + body, self.auth)
+        else:
+            packet += body
+        self.sock.sendto(packet, self.addr)
+
+        chain = packet[HEADER.size:HEADER.size + DIGEST_SIZE]
+        parts = {}
+        while True:
+            answer, flags = self.receive(identifier)
+            if self.secret:
+                if not flags & PACKET_FLAG_SECURED:
+                    raise ProtocolError('answer is not secured')
+                chain = self.verify(answer, chain)
+
+            if not flags & PACKET_FLAG_STREAM:
+                body = answer[hdrlen + (DIGEST_SIZE if code == UCTL_CMD_CODE_AUTH and self.secret else 0):]
+                break
+
+            seq, count = FRAGMENT.unpack_from(answer, hdrlen)
+            parts[seq] = answer[hdrlen + FRAGMENT.size:]
+            if flags & PACKET_FLAG_FINAL:
+                if len(parts) != count:
+                    raise ProtocolError('stream fragments lost %u:%u' % (len(parts), count))
+                body = b''.join(parts[i] for i in range(count))
+                break
+
+        if self.secret:
+            self.auth = chain
+        return flags, body
+
+    def authenticate(self):
+        flags, body = self.request(UDPCTL_SERVICE_ID, UCTL_CMD_CODE_AUTH, b'')
+        if flags & PACKET_FLAG_ERROR or resultCode(body) != RESULT_CODE_SUCCESS:
+            raise ProtocolError('auth rejected')
+
+
+class Worker(threading.Thread):
+
+    def __init__(self, args, deadline):
+        threading.Thread.__init__(self)
+        self.args = args
+        self.deadline = deadline
+        self.latency = []
+        self.errors = 0
+        self.messages = 0
+        self.daemon = True
+
+    def run(self):
+        args = self.args
+        if args.batch > 1:
+            code = UCTL_CMD_CODE_SRVMSG_BATCH
+            body = serviceMessage(args.service, args.msgtype) * args.batch
+        else:
+            code = UCTL_CMD_CODE_SRVMSG
+            body = serviceMessage(args.service, args.msgtype)
+
+        session = None
+        done = 0
+        while done < args.requests and time.time() < self.deadline:
+            try:
+                if not session:
+                    session = Session(args.host, args.port, args.secret, args.timeout)
+                    session.authenticate()
+
+                started = time.perf_counter()
+                flags, answer = session.request(args.service, code, body, args.stream)
+                elapsed = time.perf_counter() - started
+                done += 1
+                if flags & PACKET_FLAG_ERROR or resultCode(answer) != RESULT_CODE_SUCCESS:
+                    self.errors += 1
+                    session.close()
+                    session = None
+                else:
+                    self.latency.append(elapsed)
+                    if code == UCTL_CMD_CODE_SRVMSG_BATCH:
+                        self.messages += batchResults(answer).count(RESULT_CODE_SUCCESS)
+                    else:
+                        self.messages += 1
+            except (socket.timeout, ProtocolError) as e:
+                done += 1
+                self.errors += 1
+                if args.verbose:
+                    print('error: %s' % e)
+                if session:
+                    session.close()
+                    session = None
+
+        if session:
+            session.close()
+
+
+def percentile(values, p):
+    if not values:
+        return 0.0
+    return values[min(len(values) - 1, int(len(values) * p / 100.0))]
+
+
+def main():
+    parser = argparse.ArgumentParser(description='udpctl load generator')
+    parser.add_argument('--host', default='127.0.0.1')
+    parser.add_argument('--port', type=int, default=3901)
+    parser.add_argument('--secret', default='', help='shared secret, empty - not secured node')
+    parser.add_argument('--clients', type=int, default=4, help='concurrent sessions (node limit is 16)')
+    parser.add_argument('--requests', type=int, default=1000, help='requests per session')
+    parser.add_argument('--duration', type=float, default=0, help='run time limit, seconds')
+    parser.add_argument('--service', type=int, default=UDPCTL_SERVICE_ID, help='target service identifier')
+    parser.add_argument('--msgtype', type=int, default=UDPCTL_MSGTYPE_INFO, help='service message type')
+    parser.add_argument('--batch', type=int, default=1, help='service messages per request (SRVMSG_BATCH)')
+    parser.add_argument('--stream', action='store_true', help='request streamed answers')
+    parser.add_argument('--timeout', type=float, default=1.0, help='answer timeout, seconds')
+    parser.add_argument('--verbose', action='store_true')
+    args = parser.parse_args()
+    args.secret = args.secret.encode()
+
+    deadline = time.time() + args.duration if args.duration > 0 else float('inf')
+    workers = [Worker(args, deadline) for i in range(args.clients)]
+
+    started = time.perf_counter()
+    for w in workers:
+        w.start()
+    for w in workers:
+        w.join()
+    elapsed = time.perf_counter() - started
+
+    latency = sorted(l for w in workers for l in w.latency)
+    errors = sum(w.errors for w in workers)
+    messages = sum(w.messages for w in workers)
+    total = len(latency) + errors
+
+    print('requests: %u, errors: %u, elapsed: %.3f s' % (total, errors, elapsed))
+    print('messages: %u, errors: %u' % (len(latency) * args.batch, len(latency) * args.batch - messages))
+    print('throughput: %.1f req/s, %.1f msg/s' % (len(latency) / elapsed, messages / elapsed))
+    print('latency ms: p50 %.3f, p90 %.3f, p99 %.3f, max %.3f' %
+          tuple(1000 * v for v in (percentile(latency, 50), percentile(latency, 90), percentile(latency, 99),
+                                   latency[-1] if latency else 0.0)))
+
+    return 1 if errors else 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
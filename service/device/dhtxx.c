@@ -87,7 +87,9 @@ typedef struct dht_data_s {
     dht_result_t    stat_last_result;
     uint8           stat_retry_count;
 
-    dht_hist_t      stat_hist;
+    dht_hist_t      stat_hist;  // EMA history, newest first
+    uint8           stat_hist_count;    // stored history items
+    uint8           stat_hist_tick;     // stat samples since last history flush
 #ifdef ARCH_XTENSA
     os_timer_t      stat_timer; // stat timer
     os_timer_t      stat_fail_timer;    // stat query fail timer
@@ -282,6 +284,15 @@ dht_hist_timeout (void *args)
         else
             os_memcpy (&sdata->stat_ema_value, &value, sizeof (dht_t));
 
+        sdata->stat_hist_tick++;
+        if ((!sdata->stat_ema_initcnt) && (sdata->stat_hist_tick >= sdata->conf.hist_interval)) {
+            sdata->stat_hist_tick = 0;
+            os_memmove (&sdata->stat_hist[1], &sdata->stat_hist[0], (DHT_HISTORY_LENGTH - 1) * sizeof (dht_t));
+            os_memcpy (&sdata->stat_hist[0], &sdata->stat_ema_value, sizeof (dht_t));
+            if (sdata->stat_hist_count < DHT_HISTORY_LENGTH)
+                sdata->stat_hist_count++;
+        }
+
         if (!sdata->stat_ema_initcnt) {
             if ((sdata->conf.thresh_high_signal) &&
                 (((prev_ema.hmdt < sdata->conf.thresh_high.hmdt)
@@ -359,6 +370,28 @@ fn_dht_get (sh_eval_ctx_t * evctx, sh_bc_arg_t * ret_arg, const arg_count_t arg_
     }
 }
 
+/*
+ * iterator over EMA history, newest first: dht_hist(idx, hmdt, temp) @ { ... }
+ * idx: history cursor, starts from 0, advanced by the call
+ * humidity: in 1/100-th of %
+ * temperature: in 1/100-th of C
+ * result: 1 - item is returned, 0 - end of history
+ */
+LOCAL void      ICACHE_FLASH_ATTR
+fn_dht_hist (sh_eval_ctx_t * evctx, sh_bc_arg_t * ret_arg, const arg_count_t arg_count, sh_bc_arg_type_t arg_type[],
+             sh_bc_arg_t * bc_args[])
+{
+    ret_arg->arg.value = 0;
+    if ((arg_count != 3) || (bc_args[0]->arg.value >= sdata->stat_hist_count))
+        return;
+
+    dht_t          *value = &sdata->stat_hist[bc_args[0]->arg.value];
+    bc_args[1]->arg.value = value->hmdt;
+    bc_args[2]->arg.value = value->temp;
+    bc_args[0]->arg.value++;
+    ret_arg->arg.value = 1;
+}
+
 svcs_errcode_t  ICACHE_FLASH_ATTR
 dht_on_start (const svcs_resource_t * svcres, dtlv_ctx_t * conf)
 {
@@ -379,14 +412,17 @@ dht_on_start (const svcs_resource_t * svcres, dtlv_ctx_t * conf)
     os_timer_setfn (&sdata->stat_fail_timer, dht_hist_timeout, NULL);
 #endif
     // register functions
-    sh_func_entry_t fn_entries[1] = {
-        {DHT_SERVICE_ID, false, false, 0, "dht_get", {fn_dht_get}
+    sh_func_entry_t fn_entries[2] = {
+        {DHT_SERVICE_ID, true, false, 0, "dht_get", {fn_dht_get}
+         }
+        ,
+        {DHT_SERVICE_ID, false, false, 0, "dht_hist", {fn_dht_hist}
          }
         ,
     };
 
     int             i;
-    for (i = 0; i < 1; i++)
+    for (i = 0; i < 2; i++)
         sh_func_register (&fn_entries[i]);
 
     return dht_on_cfgupd (conf);
@@ -553,6 +589,8 @@ dht_on_cfgupd (dtlv_ctx_t * conf)
     d_log_iprintf (DHT_SERVICE_NAME, "gpio:%u, timeout:%u", sdata->conf.gpio_id, sdata->conf.stat_timeout);
 
     os_memset (sdata->stat_hist, 0, sizeof (dht_hist_t));
+    sdata->stat_hist_count = 0;
+    sdata->stat_hist_tick = 0;
     os_memset (&sdata->stat_ema_value, 0, sizeof (dht_t));
     os_memset (&sdata->stat_last_value, 0, sizeof (dht_t));
     sdata->stat_retry_count = 0;
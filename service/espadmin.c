@@ -242,6 +242,25 @@ espadmin_info_xdb (dtlv_ctx_t * msg_out, imdb_hndlr_t hmdb)
                                  (msg_out, ESPADMIN_AVP_IMDB_BLOCK_SIZE, _imdb_info.db_def.block_size)
                                  || dtlv_avp_encode_uint32 (msg_out, ESPADMIN_AVP_IMDB_MEM_USED,
                                                             _imdb_info.stat.mem_alloc - _imdb_info.stat.mem_free)
+                                 || dtlv_avp_encode_uint32 (msg_out, ESPADMIN_AVP_IMDB_ROW_SCAN,
+                                                            _imdb_info.stat.row_scan)
+                                 || dtlv_avp_encode_uint32 (msg_out, ESPADMIN_AVP_IMDB_ROW_FETCH,
+                                                            _imdb_info.stat.row_fetch)
+                                 || (_imdb_info.db_def.opt_media ?
+                                     (dtlv_avp_encode_uint32 (msg_out, ESPADMIN_AVP_FDB_CACHE_HIT,
+                                                              _imdb_info.stat.cache_hit)
+                                      || dtlv_avp_encode_uint32 (msg_out, ESPADMIN_AVP_FDB_CACHE_MISS,
+                                                                 _imdb_info.stat.cache_miss)
+                                      || dtlv_avp_encode_uint32 (msg_out, ESPADMIN_AVP_FDB_CACHE_EVICT,
+                                                                 _imdb_info.stat.cache_evict)
+                                      || dtlv_avp_encode_uint32 (msg_out, ESPADMIN_AVP_FDB_PAGE_REUSE,
+                                                                 _imdb_info.stat.page_reuse)
+                                      || dtlv_avp_encode_uint32 (msg_out, ESPADMIN_AVP_FDB_PAGE_MOVE,
+                                                                 _imdb_info.stat.page_move)
+                                      || dtlv_avp_encode_uint32 (msg_out, ESPADMIN_AVP_FDB_BLOCK_READAHEAD,
+                                                                 _imdb_info.stat.block_readahead)
+                                      || dtlv_avp_encode_uint32 (msg_out, ESPADMIN_AVP_FDB_BLOCK_TRIM,
+                                                                 _imdb_info.stat.block_trim)) : false)
                                  || dtlv_avp_encode_list (msg_out, 0, ESPADMIN_AVP_IMDB_CLASS, DTLV_TYPE_OBJECT,
                                                           &gavp_in));
         int             i;
@@ -321,6 +340,8 @@ espadmin_on_msg_fdb (dtlv_ctx_t * msg_out)
                                                                hdr_file.file_size * hdr_file.block_size)
                                     || dtlv_avp_encode_uint32 (msg_out, ESPADMIN_AVP_FDB_FILE_HWM,
                                                                hdr_file.file_hwm * hdr_file.block_size)
+                                    || dtlv_avp_encode_uint32 (msg_out, ESPADMIN_AVP_FDB_FILE_FREE,
+                                                               hdr_file.page_fl_blocks * hdr_file.block_size)
             );
     }
     d_svcs_check_dtlv_error (dtlv_avp_encode_group_done (msg_out, gavp_in));
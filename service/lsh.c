@@ -56,6 +56,7 @@
 #include "core/logging.h"
 #include "core/system.h"
 #include "core/ltime.h"
+#include "core/config.h"
 #include "proto/dtlv.h"
 #include "system/comavp.h"
 #include "system/imdb.h"
@@ -70,23 +71,45 @@
 #define LSH_STMT_SRC_STORAGE_PAGES		4
 #define LSH_STMT_SRC_STORAGE_PAGE_BLOCKS	2
 
+#define LSH_STMT_IMG_STORAGE_PAGES		4
+#define LSH_STMT_IMG_STORAGE_PAGE_BLOCKS	2
+
 #define LSH_TOKENIDX_BUFFER_SIZE		512
 #define LSH_OPER_ARG_COUNT_MAX			14
+#define LSH_FUNC_MEMO_SIZE			4
+#define LSH_FUNC_MEMO_ARG_MAX			4
 
 #define LSH_IMDB_CLS_FUNC		"lsh$func"
 #define LSH_IMDB_CLS_STMT		"lsh$stmt"
 #define LSH_IMDB_CLS_STMT_SRC		"lsh$src"
+#define LSH_IMDB_CLS_STMT_IMG		"lsh$img"
+
+// compiled statement image format, increment on any change of bytecode layout
+#define LSH_STMT_IMAGE_VERSION		1
 
 #undef LSH_BUFFERS_IMDB
+// pre-decode bytecode into direct-threaded code after parse, costs heap up to LSH_CODE_HEAP_SIZE
+#ifndef LSH_DISABLE_COMPILED_EVAL
+#define LSH_COMPILED_EVAL
+#endif
+// memoize results of deterministic (opt_determ) external functions
+#define LSH_FUNC_MEMO
+// collect statement execution profile (SH_MSGTYPE_STMT_PROFILE), build with LSH_ENABLE_PROFILE
+// costs ~150 bytes of storage per statement and two time reads per evaluation
+#ifdef LSH_ENABLE_PROFILE
+#define LSH_PROFILE
+#endif
 
 #ifdef IMDB_SMALL_RAM
 #define LSH_STMT_PARSE_BUFFER_SIZE		512
 #define LSH_STMT_BUFFER_SIZE			1400
 #define LSH_STMT_VARIDX_BUFFER_SIZE		512
+#define LSH_CODE_HEAP_SIZE			3072
 #else
 #define LSH_STMT_PARSE_BUFFER_SIZE		1024
 #define LSH_STMT_BUFFER_SIZE			3936
 #define LSH_STMT_VARIDX_BUFFER_SIZE		1024
+#define LSH_CODE_HEAP_SIZE			16384
 #endif
 
 #define d_obj2hndlr(obj)		(sh_hndlr_t) (obj)
@@ -130,6 +153,7 @@ LOCAL const char *sz_sh_error[] RODATA = {
     "statement \"%s\" not exists",
     "function \"%s\" call error",
     "statement \"%s\" source not exists",
+    "statement \"%s\" suspended at %u",
 };
 
 typedef enum sh_oper_type_e {
@@ -165,8 +189,9 @@ typedef enum sh_oper_type_e {
     SH_OPER_ELSE = 29,
     SH_OPER_ARGLIST = 30,
     SH_OPER_RET = 31,
+    SH_OPER_LOOP = 32,
     //
-    SH_OPER_MAX = 32
+    SH_OPER_MAX = 33
 } sh_oper_type_t;
 
 typedef enum sh_operand_pos_s {
@@ -175,41 +200,170 @@ typedef enum sh_operand_pos_s {
     SH_OPERAND_MAND,
 } sh_operand_pos_t;
 
+#ifdef LSH_FUNC_MEMO
+/*
+ * memoized result of deterministic function call
+ * - entry: function entry, NULL - slot is empty
+ * - eval_seq: evaluation sequence, the call was made in
+ * - time: system time of the call, us
+ * - arg_count: argument count
+ * - result: function result
+ * - args_in: argument values before the call (key)
+ * - args_out: argument values after the call
+ */
+typedef struct sh_func_memo_s {
+    sh_func_entry_t *entry;
+    uint32          eval_seq;
+    uint32          time;
+    arg_count_t     arg_count;
+    uint32          result;
+    uint32          args_in[LSH_FUNC_MEMO_ARG_MAX];
+    uint32          args_out[LSH_FUNC_MEMO_ARG_MAX];
+} sh_func_memo_t;
+#endif
+
+typedef struct sh_parse_arena_s sh_parse_arena_t;
+
 typedef struct lsh_data_s {
     const svcs_resource_t *svcres;
     imdb_hndlr_t    hfunc;      // function storage
     imdb_hndlr_t    hstmt;      // parsed statement storage
     imdb_hndlr_t    hstmt_src;  // statement source storage
+    imdb_hndlr_t    hstmt_img;  // compiled statement image storage
+#ifdef LSH_COMPILED_EVAL
+    size_t          code_size;  // pre-decoded code heap usage, limited by LSH_CODE_HEAP_SIZE
+#endif
+    imdb_index_id_t idx_func;   // function name index
+    imdb_index_id_t idx_stmt;   // statement name index
+    imdb_index_id_t idx_stmt_src;       // statement source name index
+    imdb_index_id_t idx_stmt_img;       // compiled statement image name index
     char            token_idx[LSH_TOKENIDX_BUFFER_SIZE];        // hash map 
-    // Fixme: should make separate index segment in imdb
+    sh_parse_arena_t *arena;    // parse arena, reused by all parses
+#ifdef LSH_FUNC_MEMO
+    uint32          eval_seq;   // statement evaluation sequence
+    uint8           memo_next;  // next memo slot to replace
+    sh_func_memo_t  memo[LSH_FUNC_MEMO_SIZE];   // deterministic function results
+#endif
 } lsh_data_t;
 
 LOCAL lsh_data_t *sdata = NULL;
 
+typedef struct sh_code_s sh_code_t;
+
+#ifdef LSH_PROFILE
+/*
+ * statement execution profile, times are in microseconds
+ * - exec_count: count of evaluations
+ * - exec_time: total evaluation time
+ * - exec_time_max: maximum evaluation time
+ * - func_count: count of external function calls
+ * - func_time: total time spent in external functions
+ * - oper_count: count of executed operators by type
+ */
+typedef struct sh_stmt_profile_s {
+    uint32          exec_count;
+    uint32          exec_time;
+    uint32          exec_time_max;
+    uint32          func_count;
+    uint32          func_time;
+    uint32          oper_count[SH_OPER_MAX];
+} sh_stmt_profile_t;
+
+// call external function, accounting it in statement profile
+#define d_stmt_profile_func(evctx, _CALL_) \
+	{ \
+		sh_stmt_profile_t *prof = &d_pointer_as (sh_stmt_t, (evctx)->stmt_info)->profile; \
+		uint32 ts = system_get_time (); \
+		_CALL_; \
+		prof->func_time += system_get_time () - ts; \
+		prof->func_count++; \
+	}
+#else
+#define d_stmt_profile_func(evctx, _CALL_)	_CALL_
+#endif
+
+/*
+ * - info: statement info, must be first (evaluation context refers to statement by info)
+ * - code: pre-decoded code (heap), NULL - bytecode is interpreted
+ * - code_end: end of pre-decoded code
+ * - profile: execution profile
+ * - vardata: bytecode
+ */
 typedef struct sh_stmt_s {
     sh_stmt_info_t  info;
+    bool            suspended;  // evaluation yielded, locals are kept until resume
+#ifdef LSH_COMPILED_EVAL
+    sh_code_t      *code;
+    sh_code_t      *code_end;
+#endif
+#ifdef LSH_PROFILE
+    sh_stmt_profile_t profile;
+#endif
     ALIGN_DATA char vardata[];
 } sh_stmt_t;
 
-typedef struct sh_func_find_ctx_s {
-    const char     *func_name;
-    sh_func_entry_t *entry;
-} sh_func_find_ctx_t;
+#ifdef LSH_COMPILED_EVAL
+LOCAL void      stmt_code_create (sh_stmt_t * stmt);
+LOCAL void      stmt_code_free (sh_stmt_t * stmt);
+#endif
+
+/* global variable or function, shared by statements through token_idx */
+typedef struct sh_gvar_s {
+    sh_bc_arg_type_t type;
+    uint16          use_count;
+    sh_bc_arg_t     arg;
+} sh_gvar_t;
 
 /*
-[private]
-*/
-LOCAL imdb_errcode_t ICACHE_FLASH_ATTR
-sh_forall_func_find (imdb_fetch_obj_t * fobj, void *data)
-{
-    sh_func_entry_t *entry = d_pointer_as (sh_func_entry_t, fobj->dataptr);
-    sh_func_find_ctx_t *find_ctx = d_pointer_as (sh_func_find_ctx_t, data);
-    if (os_strncmp (entry->func_name, find_ctx->func_name, sizeof (sh_func_name_t)) == 0) {
-        find_ctx->entry = entry;
-        return IMDB_CURSOR_BREAK;
-    }
-    return IMDB_ERR_SUCCESS;
-}
+ * compiled statement image, stored in fdb next to the statement source
+ * - name: statement name
+ * - utime: update time of the source, image is compiled from
+ * - build: firmware build number
+ * - version: image format version
+ * - length: bytecode length
+ * - saved: bytecode bytes saved by optimization
+ * - reloc_length: relocation table length
+ * - vardata: bytecode, where global references are relocation table offsets (see d_stmt_image_reloc),
+ *            followed by relocation table of global names (sh_parse_arg_t)
+ */
+typedef struct sh_stmt_image_s {
+    sh_stmt_name_t  name;
+    lt_time_t       utime;
+    uint32          build;
+    uint16          version;
+    obj_size_t      length;
+    obj_size_t      saved;
+    obj_size_t      reloc_length;
+    ALIGN_DATA char vardata[];
+} sh_stmt_image_t;
+
+// relocation table offset is stored above SH_BYTECODE_SIZE_MAX, so the argument stays global
+#define d_stmt_image_reloc(offset)	((size_t) SH_BYTECODE_SIZE_MAX + 1 + (offset))
+
+#ifdef LSH_COMPILED_EVAL
+typedef sh_code_t *(*sh_code_exec_t) (sh_eval_ctx_t * ctx, sh_code_t * code);
+
+/*
+ * pre-decoded instruction
+ * - exec: operator handler
+ * - next: next instruction
+ * - jump: branch target (used by IF, IFRET, ELSE)
+ * - addr: bytecode address of operator
+ * - args: resolved operand pointers, result argument first;
+ *         for function call followed by the argument types
+ */
+struct sh_code_s {
+    sh_code_exec_t  exec;
+    sh_code_t      *next;
+    union sh_code_jump_u {
+        sh_code_t      *code;
+        bytecode_size_t addr;   // used while compiling
+    } jump;
+    bytecode_size_t addr;
+    arg_count_t     arg_count;
+    ALIGN_DATA sh_bc_arg_t *args[];
+};
+#endif
 
 /*
 [public] look for the external function by name, that may used in lsh
@@ -221,14 +375,12 @@ sh_func_get (const char *func_name, sh_func_entry_t ** entry)
 {
     d_check_init ();
 
-    sh_func_find_ctx_t find_ctx;
-    os_memset (&find_ctx, 0, sizeof (sh_func_find_ctx_t));
-    find_ctx.func_name = func_name;
-
-    d_sh_check_imdb_error (imdb_class_forall
-                           (sdata->svcres->hmdb, sdata->hfunc, (void *) &find_ctx, sh_forall_func_find));
+    imdb_fetch_obj_t fobj;
+    imdb_errcode_t  imdb_res = imdb_index_find (sdata->svcres->hmdb, sdata->hfunc, sdata->idx_func, func_name, &fobj);
+    if (imdb_res != IMDB_CURSOR_NO_DATA_FOUND)
+        d_sh_check_imdb_error (imdb_res);
 
-    *entry = find_ctx.entry;
+    *entry = d_pointer_as (sh_func_entry_t, fobj.dataptr);
     return (*entry) ? SH_ERR_SUCCESS : SH_FUNC_NOT_EXISTS;
 }
 
@@ -258,8 +410,15 @@ sh_func_register (sh_func_entry_t * func_entry)
 
     //os_memset(entry, 0, sizeof(sh_func_entry_t));
     os_memcpy (entry, func_entry, sizeof (sh_func_entry_t));
+    d_sh_check_imdb_error (imdb_clsobj_insert_commit (sdata->svcres->hmdb, sdata->hfunc, entry));
     d_log_dprintf (LSH_SERVICE_NAME, "register: func=%s, ptr=%p\n", entry->func_name, entry->func.ptr);
 
+    // relink: patch the function global, if the name is already known to parsed statements
+    sh_gvar_t      *gvar;
+    if ((ih_hash8_search (sdata->token_idx, entry->func_name, os_strnlen (entry->func_name, sizeof (sh_func_name_t)),
+                          (char **) &gvar) == IH_ERR_SUCCESS) && (gvar->type == SH_BC_ARG_FUNC))
+        gvar->arg.arg.ptr = entry;
+
     return SH_ERR_SUCCESS;
 }
 
@@ -307,6 +466,7 @@ LOCAL sh_oper_desc_t sh_oper_desc[] RODATA = {
     {13, false, true, false, SH_OPERAND_MAND, SH_OPERAND_MAND, ":", "\0"},      // ... ELSE ...
     {16, true, false, false, SH_OPERAND_MAND, SH_OPERAND_OPT, ",", "\0"},       // ... , ...
     {17, false, false, false, SH_OPERAND_NONE, SH_OPERAND_OPT, "ret", "\0"},    // return
+    {0, false, true, false, SH_OPERAND_NONE, SH_OPERAND_NONE, "loop", "\0"},    // end of FOREACH, serialized only
 };
 
 typedef enum sh_parse_assoc_type_e {
@@ -333,6 +493,13 @@ typedef struct sh_parse_arg_s {
     ALIGN_DATA char data[];
 } sh_parse_arg_t;
 
+/* constant condition of control operator, resolved at parse time */
+typedef enum sh_parse_cond_e {
+    SH_PARSE_COND_NONE = 0,     // evaluated at runtime
+    SH_PARSE_COND_LIVE,         // branch is always executed
+    SH_PARSE_COND_DEAD,         // branch is never executed
+} sh_parse_cond_t;
+
 /* used in parsing process */
 typedef struct sh_parse_oper_s {
     const char     *stmt_start;
@@ -340,18 +507,14 @@ typedef struct sh_parse_oper_s {
     sh_oper_type_t  optype:7;
     char            term;
     arg_count_t     arg_count;
+    sh_parse_cond_t cond:8;
+    bytecode_size_t bc_start;   // bytecode address, the right operand starts at
     sh_parse_arg_t *left_arg;
     struct sh_parse_oper_s *prev_oper;
     ALIGN_DATA char varargs[];
 } sh_parse_oper_t;
 
 
-typedef struct sh_parse_buffers_s {
-    char            bc[LSH_STMT_BUFFER_SIZE];
-    char            pbuf[LSH_STMT_PARSE_BUFFER_SIZE];
-    char            varmap[LSH_STMT_VARIDX_BUFFER_SIZE];
-} sh_parse_buffers_t;
-
 /*
  * - stmt_start: start of current parsing statement
  * - parse_buf: temporary parse buffer
@@ -362,18 +525,41 @@ typedef struct sh_parse_buffers_s {
  * - ret_state: return state
  * - errcode: result code
  * - errmsg: error text message
+ * - saved: bytecode bytes saved by optimization
+ * - bc_start: bytecode address, the current top-level statement starts at
+ * - bc_size: bytecode buffer size
+ * - scratch: parse buffer peak usage
  */
 typedef struct sh_parse_ctx_s {
     const char     *stmt_start;
     char           *parse_buf;
     char           *bc_buf;
+    bytecode_size_t bc_size;
     ih_hndlr_t      varmap;
     parse_depth_t   depth;
     sh_parse_oper_t *term_oper;
     sh_errcode_t    errcode;    //
     char            errmsg[ERROR_MESSAGE_LENGTH + 1];   //
+    bytecode_size_t saved;
+    bytecode_size_t bc_start;
+    parse_size_t    scratch;
 } sh_parse_ctx_t;
 
+/*
+ * parse arena, allocated by the first parse and reused until service stop,
+ * bytecode is inserted into statement storage by its exact length
+ * - ctx: parsing context
+ * - bc: bytecode buffer
+ * - pbuf: parse buffer
+ * - varmap: local variable index buffer
+ */
+struct sh_parse_arena_s {
+    sh_parse_ctx_t  ctx;
+    ALIGN_DATA char bc[LSH_STMT_BUFFER_SIZE];
+    char            pbuf[LSH_STMT_PARSE_BUFFER_SIZE];
+    char            varmap[LSH_STMT_VARIDX_BUFFER_SIZE];
+};
+
 /* used in bytecode */
 typedef struct sh_bc_oper_s {
     sh_oper_type_t  optype:8;
@@ -382,12 +568,6 @@ typedef struct sh_bc_oper_s {
     ALIGN_DATA char varargs[];
 } sh_bc_oper_t;
 
-typedef struct sh_gvar_s {
-    sh_bc_arg_type_t type;
-    uint16          use_count;
-    sh_bc_arg_t     arg;
-} sh_gvar_t;
-
 // check next operator char, used in parse_optype
 #define d_optype_check_next(szstr, char, _EXPR_) \
 		if (*(*(szstr) + 1) == (char)) { \
@@ -473,6 +653,9 @@ parse_optype (const char **szstr)
         d_optype_check_next (szstr, '=', optype = SH_OPER_ASSIGN);
         optype = SH_OPER_ELSE;
         break;
+    case '@':
+        optype = SH_OPER_FOREACH;
+        break;
     default:
         return SH_OPER_NONE;
     }
@@ -506,10 +689,20 @@ parse_optype (const char **szstr)
 		} \
 	}
 
+// track parse buffer peak usage, parse buffer is checked after the growth
+#define d_parse_buffer_check(ctx, pbuf_ptr) \
+	{ \
+		parse_size_t plen = d_pointer_diff(*(pbuf_ptr), (ctx)->parse_buf); \
+		if (plen > LSH_STMT_PARSE_BUFFER_SIZE) { \
+			d_stmt_err_ret((ctx), SH_PARSE_ERROR_OUTOFBUF, "parse", plen, LSH_STMT_PARSE_BUFFER_SIZE); \
+		} \
+		(ctx)->scratch = MAX((ctx)->scratch, plen); \
+	}
+
 #define d_bc_buffer_alloc(ctx, bc_ptr, length) \
 	{ \
 		bytecode_size_t blen = (length); \
-		bytecode_size_t bfree = LSH_STMT_BUFFER_SIZE - d_pointer_diff(*(bc_ptr), (ctx)->bc_buf); \
+		bytecode_size_t bfree = (ctx)->bc_size - d_pointer_diff(*(bc_ptr), (ctx)->bc_buf); \
 		if (bfree < blen) { \
 			d_stmt_err_ret((ctx), SH_PARSE_ERROR_OUTOFBUF, "bytecode", blen, bfree); \
 		} \
@@ -541,13 +734,18 @@ bc_global_add (sh_parse_arg_t * arg, sh_bc_arg_type_t type, sh_gvar_t ** gaddr)
     sh_gvar_t      *gvar;
     *gaddr = NULL;
     if (ih_hash8_search (sdata->token_idx, arg->data, arg->length - 1, (char **) &gvar) == IH_ENTRY_NOTFOUND) {
+        sh_func_entry_t *entry = NULL;
+        // link phase: function globals are bound to the entry once, eval never looks them up
+        if (type == SH_BC_ARG_FUNC)
+            d_sh_check_error (sh_func_get (arg->data, &entry));
+
         ih_hash8_add (sdata->token_idx, arg->data, arg->length - 1, (char **) &gvar, 0);
         gvar->type = type;
         gvar->use_count = 1;
 
         switch (type) {
-        case SH_ARG_FUNC:
-            gvar->arg.arg.ptr = 0;
+        case SH_BC_ARG_FUNC:
+            gvar->arg.arg.ptr = entry;
             break;
         default:
             gvar->arg.arg.value = 0;
@@ -604,7 +802,7 @@ bc_serialize_arg (sh_parse_ctx_t * ctx, char **bc_ptr, sh_bc_oper_t * bc_oper, s
             sh_gvar_t      *gaddr;
             sh_errcode_t    err = bc_global_add (arg, SH_BC_ARG_FUNC, &gaddr);
             if (err != SH_ERR_SUCCESS)
-                d_stmt_err_ret (ctx, err);
+                d_stmt_err_ret (ctx, err, arg->data);
             bc_arg->arg.ptr = gaddr;
             bc_oper->bitmask |= (0x3 << *bytepos);
             (*bytepos)++;
@@ -663,19 +861,36 @@ bc_serialize_oper_header (sh_parse_ctx_t * ctx, char **bc_ptr, sh_oper_type_t op
 *  - pbuf_ptr: current pointer to parsed stack buffer
 *  - arg: result pointer to jump pointer argument
 *  - optype: operator type
+*  - loop_addr: FOREACH condition start, the loop jumps back to
+*  - cond: result constant condition state
 */
 INLINED sh_errcode_t ICACHE_FLASH_ATTR
 bc_serialize_oper_ctl (sh_parse_ctx_t * ctx, char **bc_ptr, char **pbuf_ptr, sh_parse_arg_t ** arg,
-                       sh_oper_type_t optype)
+                       sh_oper_type_t optype, bytecode_size_t loop_addr, sh_parse_cond_t * cond)
 {
     d_log_dprintf (LSH_SERVICE_NAME, "serialize_oper_ctl: depth=%u, addr=%04x, optype=%u", ctx->depth,
                    *bc_ptr - ctx->bc_buf, optype);
-    sh_bc_oper_t   *bc_oper_ptr;
+    sh_bc_oper_t   *bc_oper_ptr = d_pointer_as (sh_bc_oper_t, *bc_ptr);
     uint8           bytepos = 0;
+
+    *cond = SH_PARSE_COND_NONE;
+    if (((optype == SH_OPER_IF) || (optype == SH_OPER_IFRET) || (optype == SH_OPER_ELSE))
+        && ((*arg)->type == SH_ARG_INT)) {
+        // ELSE branch is executed when IF condition is false
+        bool            live = (*d_pointer_as (uint32, (*arg)->data) != 0) != (optype == SH_OPER_ELSE);
+        *cond = (live) ? SH_PARSE_COND_LIVE : SH_PARSE_COND_DEAD;
+        if (live) {
+            // operator is not serialized, left_arg points to branch start
+            ctx->saved += sizeof (sh_bc_oper_t) + 2 * sizeof (sh_bc_arg_t);
+            bc_set_pointer_arg (ctx, pbuf_ptr, bc_oper_ptr, arg);
+            return SH_ERR_SUCCESS;
+        }
+    }
+
     bc_serialize_oper_header (ctx, bc_ptr, optype, 2, &bc_oper_ptr, &bytepos);
     d_stmt_check_err (ctx);
 
-    if (optype == SH_OPER_ELSE) {
+    if ((optype == SH_OPER_ELSE) && ((*arg)->type == SH_ARG_POINTER)) {
         bytecode_size_t *vptr = d_pointer_as (bytecode_size_t, &(*arg)->data);
         sh_bc_oper_t   *bc_oper0 = d_pointer_add (sh_bc_oper_t, ctx->bc_buf, *vptr);
         sh_bc_arg_t    *cond0_arg = d_pointer_add (sh_bc_arg_t, bc_oper0, sizeof (sh_bc_arg_t));
@@ -696,6 +911,9 @@ bc_serialize_oper_ctl (sh_parse_ctx_t * ctx, char **bc_ptr, char **pbuf_ptr, sh_
     sh_bc_arg_t    *bc_arg = d_pointer_as (sh_bc_arg_t, *bc_ptr);
     d_bc_buffer_alloc (ctx, bc_ptr, sizeof (sh_bc_arg_t));
     bc_arg->arg.ptr = 0;
+    // loop start is kept in jump arg until the loop body is closed
+    if (optype == SH_OPER_FOREACH)
+        bc_arg->arg.value = loop_addr;
 
     // set left_arg pointer to cond oper
     bc_set_pointer_arg (ctx, pbuf_ptr, bc_oper_ptr, arg);
@@ -703,6 +921,29 @@ bc_serialize_oper_ctl (sh_parse_ctx_t * ctx, char **bc_ptr, char **pbuf_ptr, sh_
     return SH_ERR_SUCCESS;
 }
 
+/*
+* [private] Serialize end of FOREACH body, jump back to the loop condition
+*  - bc_ptr: current pointer to bytecode buffer
+*  - loop_addr: loop condition start
+*/
+INLINED sh_errcode_t ICACHE_FLASH_ATTR
+bc_serialize_loop (sh_parse_ctx_t * ctx, char **bc_ptr, bytecode_size_t loop_addr)
+{
+    sh_bc_oper_t   *bc_oper_ptr = NULL;
+    uint8           bytepos = 0;
+    bc_serialize_oper_header (ctx, bc_ptr, SH_OPER_LOOP, 1, &bc_oper_ptr, &bytepos);
+    d_stmt_check_err (ctx);
+
+    // jump arg
+    bc_oper_ptr->bitmask |= (0x3 << bytepos);
+    sh_bc_arg_t    *bc_arg = d_pointer_as (sh_bc_arg_t, *bc_ptr);
+    d_bc_buffer_alloc (ctx, bc_ptr, sizeof (sh_bc_arg_t));
+    bc_arg->arg.ptr = 0;
+    bc_arg->arg.value = loop_addr;
+
+    return SH_ERR_SUCCESS;
+}
+
 /*
 * [private] Serialize variable to bytecode
 *  - bc_ptr: current pointer to bytecode buffer
@@ -787,6 +1028,254 @@ bc_serialize_foper (sh_parse_ctx_t * ctx, char **bc_ptr, sh_parse_oper_t * oper,
     return SH_ERR_SUCCESS;
 }
 
+/*
+* [private] Calculate operator on constant values, used for constant folding
+*  - optype: operator type
+*  - count: count of values
+*  - values: operand values
+*  - res: result value
+*  - return: false, when operator can not be calculated at parse time
+*/
+LOCAL bool      ICACHE_FLASH_ATTR
+bc_fold_values (sh_oper_type_t optype, arg_count_t count, uint32 values[], uint32 * res)
+{
+    switch (optype) {
+    case SH_OPER_NOT:
+        *res = !values[0];
+        return true;
+    case SH_OPER_BIT_NOT:
+        *res = ~values[0];
+        return true;
+    case SH_OPER_LT:
+    case SH_OPER_GT:
+    case SH_OPER_LTEQ:
+    case SH_OPER_GTEQ:
+    case SH_OPER_EQ:
+    case SH_OPER_NOTEQ:
+        if (count != 2)
+            return false;
+        break;
+    default:
+        if (!sh_oper_desc[optype].concat)
+            return false;
+    }
+
+    uint32          left = values[0];
+    arg_count_t     idx;
+    for (idx = 1; idx < count; idx++) {
+        uint32          right = values[idx];
+        switch (optype) {
+        case SH_OPER_LT:
+            left = left < right;
+            break;
+        case SH_OPER_GT:
+            left = left > right;
+            break;
+        case SH_OPER_LTEQ:
+            left = left <= right;
+            break;
+        case SH_OPER_GTEQ:
+            left = left >= right;
+            break;
+        case SH_OPER_EQ:
+            left = left == right;
+            break;
+        case SH_OPER_NOTEQ:
+            left = left != right;
+            break;
+        case SH_OPER_PLUS:
+            left += right;
+            break;
+        case SH_OPER_MINUS:
+            left -= right;
+            break;
+        case SH_OPER_MULTIPLY:
+            left *= right;
+            break;
+        case SH_OPER_DIV:
+            if (!right)
+                return false;   // keep runtime behaviour
+            left /= right;
+            break;
+        case SH_OPER_MOD:
+            if (!right)
+                return false;
+            left %= right;
+            break;
+        case SH_OPER_BIT_AND:
+            left &= right;
+            break;
+        case SH_OPER_BIT_SR:
+            left >>= right;
+            break;
+        case SH_OPER_BIT_SL:
+            left <<= right;
+            break;
+        case SH_OPER_BIT_OR:
+            left |= right;
+            break;
+        case SH_OPER_BIT_XOR:
+            left ^= right;
+            break;
+        case SH_OPER_AND:
+            left = left && right;
+            break;
+        case SH_OPER_OR:
+            left = left || right;
+            break;
+        default:
+            return false;
+        }
+    }
+
+    *res = left;
+    return true;
+}
+
+/*
+* [private] Fold operator with constant integer operands into constant argument
+*  - pbuf_ptr: in/out current pointer to parsed stack buffer
+*  - arg: result pointer to constant argument
+*  - oper: in/out pointer to parsed operator
+*  - return: true, when operator is folded
+*/
+INLINED bool    ICACHE_FLASH_ATTR
+bc_serialize_fold (sh_parse_ctx_t * ctx, char **pbuf_ptr, sh_parse_arg_t ** arg, sh_parse_oper_t ** oper)
+{
+    sh_parse_oper_t *oper_tmp = *oper;
+    if ((!sh_oper_desc[oper_tmp->optype].result) || (oper_tmp->optype == SH_OPER_FUNC) || (!oper_tmp->arg_count)
+        || (oper_tmp->arg_count > LSH_OPER_ARG_COUNT_MAX))
+        return false;
+
+    uint32          values[LSH_OPER_ARG_COUNT_MAX];
+    arg_count_t     arg_idx = 0;
+    if (oper_tmp->left_arg) {
+        if (oper_tmp->left_arg->type != SH_ARG_INT)
+            return false;
+        values[arg_idx++] = *d_pointer_as (uint32, oper_tmp->left_arg->data);
+    }
+
+    sh_parse_arg_t *arg_ptr = d_pointer_as (sh_parse_arg_t, oper_tmp->varargs);
+    while (arg_idx < oper_tmp->arg_count) {
+        if (arg_ptr->type != SH_ARG_NONE) {
+            if (arg_ptr->type != SH_ARG_INT)
+                return false;
+            values[arg_idx++] = *d_pointer_as (uint32, arg_ptr->data);
+        }
+        arg_ptr = d_pointer_add (sh_parse_arg_t, arg_ptr, sizeof (sh_parse_arg_t) + d_align (arg_ptr->length));
+    }
+
+    uint32          value;
+    if (!bc_fold_values (oper_tmp->optype, arg_idx, values, &value))
+        return false;
+
+    // result is placed like a pointer to bytecode operator
+    arg_ptr = (oper_tmp->left_arg) ? oper_tmp->left_arg : d_pointer_as (sh_parse_arg_t, oper_tmp);
+    arg_ptr->type = SH_ARG_INT;
+    arg_ptr->length = sizeof (uint32);
+    *d_pointer_as (uint32, arg_ptr->data) = value;
+    *pbuf_ptr = d_pointer_add (char, arg_ptr, sizeof (sh_parse_arg_t) + d_align (arg_ptr->length));
+
+    ctx->saved += sizeof (sh_bc_oper_t) + (arg_idx + 1) * sizeof (sh_bc_arg_t);
+    d_log_dprintf (LSH_SERVICE_NAME, "bc_serialize_fold: optype=%u, args=%u, value=%u", oper_tmp->optype, arg_idx,
+                   value);
+
+    *arg = arg_ptr;
+    *oper = oper_tmp->prev_oper;
+    ctx->depth--;
+    return true;
+}
+
+LOCAL void      ICACHE_FLASH_ATTR
+bc_var_range_cb (const char *key, ih_size_t keylen, const char *value, ih_size_t valuelen, void *data)
+{
+    bytecode_size_t *range = d_pointer_as (bytecode_size_t, data);
+    bytecode_size_t addr = *d_pointer_as (bytecode_size_t, value);
+    if ((addr >= range[0]) && (addr < range[1]))
+        range[2]++;
+}
+
+/*
+* [private] Check that bytecode range may be dropped, no variables declared in the range
+*  - addr_start: range start
+*  - addr_end: range end
+*/
+LOCAL bool      ICACHE_FLASH_ATTR
+bc_range_droppable (sh_parse_ctx_t * ctx, bytecode_size_t addr_start, bytecode_size_t addr_end)
+{
+    bytecode_size_t range[3] = { addr_start, addr_end, 0 };
+    ih_hash8_forall (ctx->varmap, bc_var_range_cb, range);
+    return (range[2] == 0);
+}
+
+/*
+* [private] Collapse "# var := <operator>", the operator result becomes the variable
+*   and the temporary value with the assignment are not serialized
+*  - bc_ptr: current pointer to bytecode buffer
+*  - pbuf_ptr: in/out current pointer to parsed stack buffer
+*  - arg: result pointer to variable argument
+*  - oper: in/out pointer to parsed assignment operator
+*  - return: true, when assignment is collapsed
+*/
+INLINED bool    ICACHE_FLASH_ATTR
+bc_serialize_collapse (sh_parse_ctx_t * ctx, char **bc_ptr, char **pbuf_ptr, sh_parse_arg_t ** arg,
+                       sh_parse_oper_t ** oper)
+{
+    sh_parse_oper_t *oper_tmp = *oper;
+    if ((oper_tmp->optype != SH_OPER_ASSIGN) || (oper_tmp->arg_count != 2) || (!oper_tmp->left_arg)
+        || (oper_tmp->left_arg->type != SH_ARG_POINTER))
+        return false;
+
+    sh_parse_arg_t *src_arg = d_pointer_as (sh_parse_arg_t, oper_tmp->varargs);
+    while (src_arg->type == SH_ARG_NONE)
+        src_arg = d_pointer_add (sh_parse_arg_t, src_arg, sizeof (sh_parse_arg_t) + d_align (src_arg->length));
+    if (src_arg->type != SH_ARG_POINTER)
+        return false;
+
+    // local variable declared right before the last serialized operator
+    bytecode_size_t var_addr = *d_pointer_as (bytecode_size_t, oper_tmp->left_arg->data);
+    bytecode_size_t src_addr = *d_pointer_as (bytecode_size_t, src_arg->data);
+    sh_bc_oper_t   *var_oper = d_pointer_add (sh_bc_oper_t, ctx->bc_buf, var_addr);
+    sh_bc_oper_t   *src_oper = d_pointer_add (sh_bc_oper_t, ctx->bc_buf, src_addr);
+    if ((var_oper->optype != SH_OPER_VAR) || (src_addr != var_addr + sizeof (sh_bc_oper_t) + sizeof (sh_bc_arg_t))
+        || (!sh_oper_desc[src_oper->optype].result) || (sh_oper_desc[src_oper->optype].control))
+        return false;
+
+    // operator must not read the variable
+    char           *ptr = d_pointer_add (char, src_oper, sizeof (sh_bc_oper_t));
+    uint16          mask = src_oper->bitmask;
+    arg_count_t     idx;
+    for (idx = 0; idx < src_oper->arg_count + 1; idx++) {
+        sh_bc_arg_t    *bc_arg = d_pointer_as (sh_bc_arg_t, ptr);
+        ptr += sizeof (sh_bc_arg_t);
+        switch (sh_pop_bcarg_type (&mask, bc_arg)) {
+        case SH_BC_ARG_CHAR:
+            ptr += d_align (bc_arg->arg.dlength);
+            break;
+        case SH_BC_ARG_LOCAL:
+            if (bc_arg->arg.vptr == var_addr)
+                return false;
+            break;
+        default:
+            break;
+        }
+    }
+    if (ptr != *bc_ptr)
+        return false;           // not the last operator
+
+    bytecode_size_t len = d_pointer_diff (ptr, src_oper);
+    os_memmove (var_oper, src_oper, len);
+    *bc_ptr = d_pointer_add (char, var_oper, len);
+    ctx->saved += (src_addr - var_addr) + sizeof (sh_bc_oper_t) + 2 * sizeof (sh_bc_arg_t);
+    d_log_dprintf (LSH_SERVICE_NAME, "bc_serialize_collapse: addr=%04x", var_addr);
+
+    *oper = oper_tmp->prev_oper;
+    *arg = oper_tmp->left_arg;
+    bc_set_pointer_arg (ctx, pbuf_ptr, var_oper, arg);
+    ctx->depth--;
+    return true;
+}
+
 /*
 * [private] Make forward optimization before serialize to bytecode
 *  - bc_ptr: current pointer to bytecode buffer
@@ -834,6 +1323,56 @@ bc_serialize_optimize (sh_parse_ctx_t * ctx, sh_parse_arg_t ** arg, sh_parse_ope
 }
 
 
+/*
+* [private] Close control operator with constant condition: dead branch is dropped
+*   when no variables are declared inside, constant condition is passed to ELSE operator
+*  - bc_ptr: current pointer to bytecode buffer
+*  - pbuf_ptr: in/out current pointer to parsed stack buffer
+*  - arg: result pointer to constant condition argument
+*  - oper: in/out pointer to parsed control operator
+*/
+LOCAL sh_errcode_t ICACHE_FLASH_ATTR
+bc_serialize_branch_const (sh_parse_ctx_t * ctx, char **bc_ptr, char **pbuf_ptr, sh_parse_arg_t ** arg,
+                           sh_parse_oper_t ** oper)
+{
+    sh_parse_oper_t *oper_tmp = *oper;
+    sh_parse_arg_t *arg_ptr = oper_tmp->left_arg;
+    // control operator address, or branch start when operator is not serialized
+    bytecode_size_t addr = *d_pointer_as (bytecode_size_t, arg_ptr->data);
+    bytecode_size_t addr_end = d_pointer_diff (*bc_ptr, ctx->bc_buf);
+    bool            live = (oper_tmp->cond == SH_PARSE_COND_LIVE);
+
+    if (!live && bc_range_droppable (ctx, addr, addr_end)) {
+        ctx->saved += addr_end - addr;
+        *bc_ptr = d_pointer_add (char, ctx->bc_buf, addr);
+        d_log_dprintf (LSH_SERVICE_NAME, "bc_serialize_branch_const: drop addr=%04x, len=%u", addr, addr_end - addr);
+    }
+    else {
+        if (oper_tmp->optype == SH_OPER_IFRET) {
+            sh_bc_oper_t   *bc_oper_ptr;
+            uint8           bytepos = 0;
+            bc_serialize_oper_header (ctx, bc_ptr, SH_OPER_RET, 0, &bc_oper_ptr, &bytepos);
+            d_stmt_check_err (ctx);
+        }
+        if (!live) {
+            // branch is kept, it is skipped at runtime
+            sh_bc_arg_t    *bc_arg =
+                d_pointer_add (sh_bc_arg_t, ctx->bc_buf, addr + sizeof (sh_bc_oper_t) + sizeof (sh_bc_arg_t));
+            bc_arg->arg.ptr = (void *) d_pointer_diff (*bc_ptr, ctx->bc_buf);
+        }
+    }
+
+    arg_ptr->type = SH_ARG_INT;
+    arg_ptr->length = sizeof (uint32);
+    *d_pointer_as (uint32, arg_ptr->data) = (live != (oper_tmp->optype == SH_OPER_ELSE));
+    *pbuf_ptr = d_pointer_add (char, arg_ptr, sizeof (sh_parse_arg_t) + d_align (arg_ptr->length));
+
+    *arg = arg_ptr;
+    *oper = oper_tmp->prev_oper;
+    ctx->depth--;
+    return SH_ERR_SUCCESS;
+}
+
 /*
 * [private] Serialize operation to bytecode
 *  - bc_ptr: current pointer to bytecode buffer
@@ -847,7 +1386,8 @@ bc_serialize_oper (sh_parse_ctx_t * ctx, char **bc_ptr, char **pbuf_ptr, sh_pars
     sh_parse_oper_t *oper_tmp = *oper;
 
     /* Optimization */
-    if (bc_serialize_optimize (ctx, arg, oper))
+    if (bc_serialize_optimize (ctx, arg, oper) || bc_serialize_fold (ctx, pbuf_ptr, arg, oper)
+        || bc_serialize_collapse (ctx, bc_ptr, pbuf_ptr, arg, oper))
         return SH_ERR_SUCCESS;
 
     sh_bc_oper_t   *bc_oper_ptr;
@@ -858,22 +1398,30 @@ bc_serialize_oper (sh_parse_ctx_t * ctx, char **bc_ptr, char **pbuf_ptr, sh_pars
     else if (oper_tmp->control) {
         d_log_dprintf (LSH_SERVICE_NAME, "bc_serialize_oper: control depth=%u, addr=%04x, " OP2T_STR " , args=%u",
                        ctx->depth, *bc_ptr - ctx->bc_buf, OP2T (ctx, oper_tmp), oper_tmp->arg_count);
-        if (oper_tmp->optype == SH_OPER_IFRET) {
-            sh_bc_oper_t   *bc_oper_ptr;
-            uint8           bytepos = 0;
-            bc_serialize_oper_header (ctx, bc_ptr, SH_OPER_RET, 0, &bc_oper_ptr, &bytepos);
-        }
-
         d_assert ((oper_tmp->left_arg), "left argument missed");
+        if (oper_tmp->cond != SH_PARSE_COND_NONE)
+            return bc_serialize_branch_const (ctx, bc_ptr, pbuf_ptr, arg, oper);
+
         bytecode_size_t *vptr = d_pointer_as (bytecode_size_t, &oper_tmp->left_arg->data);
         bc_oper_ptr = d_pointer_add (sh_bc_oper_t, ctx->bc_buf, *vptr);
         // use second arg for jump target
         sh_bc_arg_t    *bc_arg = d_pointer_add (sh_bc_arg_t, bc_oper_ptr, sizeof (sh_bc_oper_t) + sizeof (sh_bc_arg_t));
-        bc_arg->arg.ptr = (void *) d_pointer_diff (*bc_ptr, ctx->bc_buf);
 
-        d_log_dprintf (LSH_SERVICE_NAME, "bc_serialize_oper: ctl jump vptr=+0x%04x", bc_arg->arg.ptr);
-    }
-    else {
+        if (oper_tmp->optype == SH_OPER_IFRET) {
+            sh_bc_oper_t   *bc_oper_ptr;
+            uint8           bytepos = 0;
+            bc_serialize_oper_header (ctx, bc_ptr, SH_OPER_RET, 0, &bc_oper_ptr, &bytepos);
+        }
+        else if (oper_tmp->optype == SH_OPER_FOREACH) {
+            bc_serialize_loop (ctx, bc_ptr, bc_arg->arg.value);
+            d_stmt_check_err (ctx);
+        }
+
+        bc_arg->arg.ptr = (void *) d_pointer_diff (*bc_ptr, ctx->bc_buf);
+
+        d_log_dprintf (LSH_SERVICE_NAME, "bc_serialize_oper: ctl jump vptr=+0x%04x", bc_arg->arg.ptr);
+    }
+    else {
         d_log_dprintf (LSH_SERVICE_NAME, "bc_serialize_oper: depth=%u, addr=%04x, " OP2T_STR " , args=%u", ctx->depth,
                        *bc_ptr - ctx->bc_buf, OP2T (ctx, oper_tmp), oper_tmp->arg_count);
         if ((oper_tmp->optype == SH_OPER_VAR) || (oper_tmp->optype == SH_OPER_GVAR)) {
@@ -947,6 +1495,7 @@ stmt_parse_oper (sh_parse_ctx_t * ctx,
                 return SH_OPER_NONE;
             continue;
         case SH_PARSE_ASSOC_TYPE_CONCAT:
+            last_oper->bc_start = d_pointer_diff (*bc_ptr, ctx->bc_buf);
             *oper = last_oper;
             *arg = NULL;
             return optype;
@@ -972,8 +1521,11 @@ stmt_parse_oper (sh_parse_ctx_t * ctx,
 
 
     ctx->depth++;
+    sh_parse_cond_t cond = SH_PARSE_COND_NONE;
     if (opdesc->control && *arg) {
-        bc_serialize_oper_ctl (ctx, bc_ptr, pbuf_ptr, arg, optype);
+        // left operand is evaluated from the start of the prev operator right operand
+        bytecode_size_t loop_addr = (last_oper) ? last_oper->bc_start : ctx->bc_start;
+        bc_serialize_oper_ctl (ctx, bc_ptr, pbuf_ptr, arg, optype, loop_addr, &cond);
     }
     sh_parse_oper_t *oper_ptr = d_pointer_as (sh_parse_oper_t, *pbuf_ptr);
     (*pbuf_ptr) += sizeof (sh_parse_oper_t);
@@ -981,6 +1533,8 @@ stmt_parse_oper (sh_parse_ctx_t * ctx,
     oper_ptr->prev_oper = last_oper;
     oper_ptr->optype = optype;
     oper_ptr->control = opdesc->control;
+    oper_ptr->cond = cond;
+    oper_ptr->bc_start = d_pointer_diff (*bc_ptr, ctx->bc_buf);
     if (*arg) {
         oper_ptr->left_arg = *arg;
         oper_ptr->arg_count = 1;
@@ -1117,12 +1671,18 @@ stmt_parse_ext (sh_parse_ctx_t * ctx, const char **szstr, char **bc_ptr, char **
                     d_stmt_check_err (ctx);
                 }
             }
+            // next statement starts here
+            if (oper)
+                oper->bc_start = d_pointer_diff (*bc_ptr, ctx->bc_buf);
+            else
+                ctx->bc_start = d_pointer_diff (*bc_ptr, ctx->bc_buf);
             arg = NULL;
             continue;
         }
 
         // try parsing an operator
         if (stmt_parse_oper (ctx, szstr, bc_ptr, pbuf_ptr, &arg, &oper) != SH_OPER_NONE) {
+            d_parse_buffer_check (ctx, pbuf_ptr);
             continue;           // try parse term and operaror
         }
         d_stmt_check_err (ctx);
@@ -1130,6 +1690,7 @@ stmt_parse_ext (sh_parse_ctx_t * ctx, const char **szstr, char **bc_ptr, char **
         // try to parsing an argument
         stmt_parse_arg (ctx, szstr, pbuf_ptr, oper, &arg);
         d_stmt_check_err (ctx);
+        d_parse_buffer_check (ctx, pbuf_ptr);
         d_skip_space2 (*szstr);
 
         if (*szstr == ptr_start) {
@@ -1146,6 +1707,29 @@ stmt_parse_ext (sh_parse_ctx_t * ctx, const char **szstr, char **bc_ptr, char **
 }
 
 
+/*
+ * [private] return parse arena, it is allocated by the first call
+ * - result: parse arena or NULL on allocation error
+ */
+LOCAL sh_parse_arena_t *ICACHE_FLASH_ATTR
+stmt_parse_arena (void)
+{
+    if (sdata->arena)
+        return sdata->arena;
+
+#ifdef LSH_BUFFERS_IMDB
+    if (imdb_clsobj_insert (sdata->svcres->hmdb, sdata->svcres->hdata, (void **) &sdata->arena,
+                            sizeof (sh_parse_arena_t)) != IMDB_ERR_SUCCESS)
+        sdata->arena = NULL;
+#else
+    sdata->arena = os_malloc (sizeof (sh_parse_arena_t));
+#endif
+    if (!sdata->arena)
+        d_log_eprintf (LSH_SERVICE_NAME, sz_sh_error[SH_ALLOCATION_ERROR], sizeof (sh_parse_arena_t));
+
+    return sdata->arena;
+}
+
 sh_errcode_t    ICACHE_FLASH_ATTR
 stmt_parse (const char *szstr, const char *stmt_name, sh_hndlr_t * hstmt)
 {
@@ -1154,72 +1738,57 @@ stmt_parse (const char *szstr, const char *stmt_name, sh_hndlr_t * hstmt)
     const char     *ptr = szstr;
     char           *bc_ptr;
     char           *pbuf_ptr;
-    char           *varmap_ptr;
     d_log_dprintf (LSH_SERVICE_NAME, "parse: \"%s\"", ptr);
 
-    sh_parse_ctx_t  ctx;
-    os_memset (&ctx, 0, sizeof (sh_parse_ctx_t));
-    ctx.stmt_start = ptr;
-    ctx.errcode = SH_ERR_SUCCESS;
-
-#ifdef LSH_BUFFERS_IMDB
-    d_sh_check_imdb_error (imdb_clsobj_insert
-                           (sdata->svcres->hmdb, sdata->svcres->hdata, (void **) &bc_ptr, LSH_STMT_BUFFER_SIZE));
-    d_sh_check_imdb_error (imdb_clsobj_insert
-                           (sdata->svcres->hmdb, sdata->svcres->hdata, (void **) &pbuf_ptr,
-                            LSH_STMT_PARSE_BUFFER_SIZE));
-    d_sh_check_imdb_error (imdb_clsobj_insert
-                           (sdata->svcres->hmdb, sdata->svcres->hdata, (void **) &varmap_ptr,
-                            LSH_STMT_VARIDX_BUFFER_SIZE));
-#else
-    sh_parse_buffers_t *buffers = os_malloc (sizeof (sh_parse_buffers_t));
-    if (!buffers) {
-        d_log_eprintf (LSH_SERVICE_NAME, sz_sh_error[SH_ALLOCATION_ERROR], sizeof (sh_parse_buffers_t));
+    *hstmt = NULL;
+    sh_parse_arena_t *arena = stmt_parse_arena ();
+    if (!arena)
         return SH_ALLOCATION_ERROR;
-    }
-    bc_ptr = (char *) &buffers->bc;
-    pbuf_ptr = (char *) &buffers->pbuf;
-    varmap_ptr = (char *) &buffers->varmap;
-#endif
-
-    if (ih_init8 (varmap_ptr, LSH_STMT_VARIDX_BUFFER_SIZE, 16, 0, sizeof (bytecode_size_t), &ctx.varmap) !=
-        IH_ERR_SUCCESS) {
-        return SH_INTERNAL_ERROR;
-    }
 
-    ctx.bc_buf = bc_ptr;
-    ctx.parse_buf = pbuf_ptr;
+    sh_parse_ctx_t *ctx = &arena->ctx;
+    os_memset (ctx, 0, sizeof (sh_parse_ctx_t));
+    ctx->stmt_start = ptr;
+    ctx->errcode = SH_ERR_SUCCESS;
+    ctx->bc_buf = bc_ptr = arena->bc;
+    ctx->bc_size = LSH_STMT_BUFFER_SIZE;
+    ctx->parse_buf = pbuf_ptr = arena->pbuf;
 
-    sh_errcode_t    res = stmt_parse_ext (&ctx, &ptr, &bc_ptr, &pbuf_ptr);
+    sh_errcode_t    res = SH_INTERNAL_ERROR;
+    if (ih_init8 (arena->varmap, LSH_STMT_VARIDX_BUFFER_SIZE, 16, 0, sizeof (bytecode_size_t), &ctx->varmap) ==
+        IH_ERR_SUCCESS)
+        res = stmt_parse_ext (ctx, &ptr, &bc_ptr, &pbuf_ptr);
 
     sh_stmt_t      *stmt = NULL;
     imdb_errcode_t  imdb_res = IMDB_ERR_SUCCESS;
     if (res == SH_ERR_SUCCESS) {
-        bytecode_size_t len = bc_ptr - ctx.bc_buf;
+        bytecode_size_t len = bc_ptr - ctx->bc_buf;
         imdb_res = imdb_clsobj_insert (sdata->svcres->hmdb, sdata->hstmt, (void **) &stmt, sizeof (sh_stmt_t) + len);
         if (imdb_res == IMDB_ERR_SUCCESS) {
-            os_memset (&stmt->info, 0, sizeof (sh_stmt_info_t));
-
+            os_memset (stmt, 0, sizeof (sh_stmt_t));
+            os_memcpy (stmt->info.name, stmt_name, os_strnlen (stmt_name, sizeof (sh_stmt_name_t)));
             stmt->info.parse_time = lt_ctime ();
             stmt->info.length = len;
-            os_memcpy (stmt->info.name, stmt_name, os_strnlen (stmt_name, sizeof (sh_stmt_name_t)));
+            stmt->info.saved = ctx->saved;
+            stmt->info.scratch = ctx->scratch;
 
-            os_memcpy (stmt->vardata, ctx.bc_buf, len);
+            os_memcpy (stmt->vardata, ctx->bc_buf, len);
+            imdb_res = imdb_clsobj_insert_commit (sdata->svcres->hmdb, sdata->hstmt, stmt);
+        }
+        if (imdb_res == IMDB_ERR_SUCCESS) {
+#ifdef LSH_COMPILED_EVAL
+            stmt_code_create (stmt);
+#endif
+        }
+        else if (stmt) {
+            imdb_clsobj_delete (sdata->svcres->hmdb, sdata->hstmt, stmt);
+            stmt = NULL;
         }
     }
     else {
-        d_log_wprintf (LSH_SERVICE_NAME, "parse: error pos:%u, code:%u, msg:\"%s\"", ptr - ctx.stmt_start, ctx.errcode,
-                       ctx.errmsg);
+        d_log_wprintf (LSH_SERVICE_NAME, "parse: error pos:%u, code:%u, msg:\"%s\"", ptr - ctx->stmt_start,
+                       ctx->errcode, ctx->errmsg);
     }
 
-#ifdef LSH_BUFFERS_IMDB
-    d_sh_check_imdb_error (imdb_clsobj_delete (sdata->svcres->hmdb, sdata->hdata, varmap_ptr));
-    d_sh_check_imdb_error (imdb_clsobj_delete (sdata->svcres->hmdb, sdata->hdata, ctx.bc_buf));
-    d_sh_check_imdb_error (imdb_clsobj_delete (sdata->svcres->hmdb, sdata->hdata, ctx.parse_buf));
-#else
-    os_free (buffers);
-#endif
-
     d_sh_check_imdb_error (imdb_res);
 
     *hstmt = d_obj2hndlr (stmt);
@@ -1233,6 +1802,10 @@ stmt_free (const sh_hndlr_t hstmt)
 
     d_sh_check_hndlr (hstmt);
     sh_stmt_t      *stmt = d_hndlr2obj (sh_stmt_t, hstmt);
+#ifdef LSH_COMPILED_EVAL
+    if (stmt->code)
+        stmt_code_free (stmt);
+#endif
     d_sh_check_imdb_error (imdb_clsobj_delete (sdata->svcres->hmdb, sdata->hstmt, (void *) stmt));
     return SH_ERR_SUCCESS;
 }
@@ -1366,8 +1939,11 @@ stmt_dump (const sh_hndlr_t hstmt, char *buf, size_t len, bool resolve_glob, byt
             buf_ptr++;
         }
     }
-    if (dump_addr)
+    if (dump_addr) {
         buf_ptr += os_sprintf (buf_ptr, "\t%04x:\teof", bc_ptr - (char *) stmt->vardata);
+        if (stmt->info.saved)
+            buf_ptr += os_sprintf (buf_ptr, "\t// optimized: %u bytes saved", stmt->info.saved);
+    }
     *buf_ptr = '\0';
 
     return SH_ERR_SUCCESS;
@@ -1412,12 +1988,6 @@ stmt_eval_popvar (sh_stmt_t * stmt, char **bc_ptr, uint16 * mask, sh_bc_arg_t **
             if ((*bc_arg)->arg.vptr > SH_BYTECODE_SIZE_MAX) {
                 sh_gvar_t      *gvar = d_pointer_as (sh_gvar_t, (*bc_arg)->arg.ptr);
                 arg = &gvar->arg;
-
-                if ((gvar->type == SH_BC_ARG_FUNC) && (!arg->arg.ptr)) {
-                    const char     *func_name = ih_hash8_v2key (sdata->token_idx, (const char *) gvar);
-
-                    d_sh_check_error (sh_func_get (func_name, (sh_func_entry_t **) & (arg->arg.ptr)));
-                }
                 *arg_type = gvar->type;
             }
             else {
@@ -1463,6 +2033,84 @@ stmt_eval_assign (sh_stmt_t * stmt, sh_bc_oper_t * bc_oper, char **bc_ptr)
     return SH_ERR_SUCCESS;
 }
 
+#ifdef LSH_FUNC_MEMO
+/*
+ * [private] call deterministic external function, result is looked up in memo first
+ *   only integer arguments are memoized, output arguments are restored from memo
+ */
+LOCAL void      ICACHE_FLASH_ATTR
+sh_func_call_memo (sh_eval_ctx_t * evctx, sh_func_entry_t * entry, sh_bc_arg_t * ret_arg, const arg_count_t arg_count,
+                   sh_bc_arg_type_t arg_type[], sh_bc_arg_t * bc_args[])
+{
+    arg_count_t     idx;
+    bool            memoize = (arg_count <= LSH_FUNC_MEMO_ARG_MAX);
+    for (idx = 0; (idx < arg_count) && memoize; idx++)
+        memoize = (arg_type[idx] == SH_BC_ARG_INT);
+
+    if (!memoize) {
+        d_stmt_profile_func (evctx, entry->func.func (evctx, ret_arg, arg_count, arg_type, bc_args));
+        return;
+    }
+
+    uint32          now = system_get_time ();
+    sh_func_memo_t *slot = NULL;
+    int             i;
+    for (i = 0; i < LSH_FUNC_MEMO_SIZE; i++) {
+        sh_func_memo_t *memo = &sdata->memo[i];
+        if (!memo->entry || ((memo->eval_seq != sdata->eval_seq)
+                             && (now - memo->time >= (uint32) memo->entry->determ_ttl * 1000))) {
+            slot = (slot) ? slot : memo;
+            continue;
+        }
+        if ((memo->entry != entry) || (memo->arg_count != arg_count))
+            continue;
+
+        for (idx = 0; (idx < arg_count) && (memo->args_in[idx] == bc_args[idx]->arg.value); idx++);
+        if (idx < arg_count)
+            continue;
+
+        for (idx = 0; idx < arg_count; idx++)
+            bc_args[idx]->arg.value = memo->args_out[idx];
+        ret_arg->arg.value = memo->result;
+        return;
+    }
+
+    if (!slot) {
+        slot = &sdata->memo[sdata->memo_next];
+        sdata->memo_next = (sdata->memo_next + 1) % LSH_FUNC_MEMO_SIZE;
+    }
+
+    for (idx = 0; idx < arg_count; idx++)
+        slot->args_in[idx] = bc_args[idx]->arg.value;
+
+    d_stmt_profile_func (evctx, entry->func.func (evctx, ret_arg, arg_count, arg_type, bc_args));
+
+    slot->entry = entry;
+    slot->eval_seq = sdata->eval_seq;
+    slot->time = now;
+    slot->arg_count = arg_count;
+    slot->result = ret_arg->arg.value;
+    for (idx = 0; idx < arg_count; idx++)
+        slot->args_out[idx] = bc_args[idx]->arg.value;
+}
+#endif
+
+/*
+ * [private] call external function
+ */
+INLINED void    ICACHE_FLASH_ATTR
+sh_func_call (sh_eval_ctx_t * evctx, sh_func_entry_t * entry, sh_bc_arg_t * ret_arg, const arg_count_t arg_count,
+              sh_bc_arg_type_t arg_type[], sh_bc_arg_t * bc_args[])
+{
+#ifdef LSH_FUNC_MEMO
+    if (entry->opt_determ) {
+        sh_func_call_memo (evctx, entry, ret_arg, arg_count, arg_type, bc_args);
+        return;
+    }
+#endif
+    d_stmt_profile_func (evctx, entry->func.func (evctx, ret_arg, arg_count, arg_type, bc_args));
+}
+
 LOCAL sh_errcode_t ICACHE_FLASH_ATTR
 stmt_eval_func (sh_stmt_t * stmt, sh_eval_ctx_t * evctx, sh_bc_oper_t * bc_oper, char **bc_ptr)
 {
@@ -1486,7 +2134,7 @@ stmt_eval_func (sh_stmt_t * stmt, sh_eval_ctx_t * evctx, sh_bc_oper_t * bc_oper,
     }
 
     sh_func_entry_t *entry = func_arg->arg.ptr;
-    entry->func.func (evctx, res_arg, count, arg_types, bc_args);
+    sh_func_call (evctx, entry, res_arg, count, arg_types, bc_args);
 
     return SH_ERR_SUCCESS;
 }
@@ -1621,25 +2269,414 @@ stmt_eval_foper_concat (sh_stmt_t * stmt, sh_bc_oper_t * bc_oper, char **bc_ptr)
     return SH_ERR_SUCCESS;
 }
 
+#ifdef LSH_COMPILED_EVAL
 
-sh_errcode_t    ICACHE_FLASH_ATTR
-stmt_eval (const sh_hndlr_t hstmt, sh_eval_ctx_t * ctx)
+#define d_code_exec_unary(name, _EXPR_) \
+	LOCAL sh_code_t * ICACHE_FLASH_ATTR \
+	code_exec_##name (sh_eval_ctx_t * ctx, sh_code_t * code) \
+	{ \
+		uint32 left = code->args[1]->arg.value; \
+		code->args[0]->arg.value = (_EXPR_); \
+		return code->next; \
+	}
+
+#define d_code_exec_binary(name, _EXPR_) \
+	LOCAL sh_code_t * ICACHE_FLASH_ATTR \
+	code_exec_##name (sh_eval_ctx_t * ctx, sh_code_t * code) \
+	{ \
+		uint32 left = code->args[1]->arg.value; \
+		uint32 right = code->args[2]->arg.value; \
+		code->args[0]->arg.value = (_EXPR_); \
+		return code->next; \
+	}
+
+#define d_code_exec_concat(name, _EXPR_) \
+	LOCAL sh_code_t * ICACHE_FLASH_ATTR \
+	code_exec_##name (sh_eval_ctx_t * ctx, sh_code_t * code) \
+	{ \
+		uint32 res = code->args[1]->arg.value; \
+		arg_count_t idx; \
+		for (idx = 2; idx < code->arg_count; idx++) { \
+			uint32 value = code->args[idx]->arg.value; \
+			res = (_EXPR_); \
+		} \
+		code->args[0]->arg.value = res; \
+		return code->next; \
+	}
+
+d_code_exec_unary (not, !left)
+d_code_exec_unary (bit_not, ~left)
+d_code_exec_binary (lt, left < right)
+d_code_exec_binary (gt, left > right)
+d_code_exec_binary (lteq, left <= right)
+d_code_exec_binary (gteq, left >= right)
+d_code_exec_binary (eq, left == right)
+d_code_exec_binary (noteq, left != right)
+
+d_code_exec_concat (multiply, res * value)
+d_code_exec_concat (div, res / value)
+d_code_exec_concat (mod, res % value)
+d_code_exec_concat (plus, res + value)
+d_code_exec_concat (minus, res - value)
+d_code_exec_concat (bit_and, res & value)
+d_code_exec_concat (bit_sr, res >> value)
+d_code_exec_concat (bit_sl, res << value)
+d_code_exec_concat (bit_or, res | value)
+d_code_exec_concat (bit_xor, res ^ value)
+d_code_exec_concat (and, res && value)
+d_code_exec_concat (or, res || value)
+
+LOCAL sh_code_t *ICACHE_FLASH_ATTR
+code_exec_assign (sh_eval_ctx_t * ctx, sh_code_t * code)
 {
-    sh_stmt_t      *stmt = d_hndlr2obj (sh_stmt_t, hstmt);
+    code->args[0]->arg.value = code->args[1]->arg.value;
+    return code->next;
+}
+
+LOCAL sh_code_t *ICACHE_FLASH_ATTR
+code_exec_func (sh_eval_ctx_t * ctx, sh_code_t * code)
+{
+    sh_func_entry_t *entry = code->args[1]->arg.ptr;
+    sh_bc_arg_type_t *arg_types = d_pointer_as (sh_bc_arg_type_t, &code->args[code->arg_count]);
+    sh_func_call (ctx, entry, code->args[0], code->arg_count - 2, arg_types, &code->args[2]);
+    return code->next;
+}
+
+LOCAL sh_code_t *ICACHE_FLASH_ATTR
+code_exec_ret (sh_eval_ctx_t * ctx, sh_code_t * code)
+{
+    ctx->exitcode = 1;
+    ctx->addr = code->addr;
+    return code->next;
+}
+
+LOCAL sh_code_t *ICACHE_FLASH_ATTR
+code_exec_if (sh_eval_ctx_t * ctx, sh_code_t * code)
+{
+    return (code->args[0]->arg.value) ? code->next : code->jump.code;
+}
+
+LOCAL sh_code_t *ICACHE_FLASH_ATTR
+code_exec_else (sh_eval_ctx_t * ctx, sh_code_t * code)
+{
+    return (code->args[0]->arg.value) ? code->jump.code : code->next;
+}
+
+LOCAL sh_code_t *ICACHE_FLASH_ATTR
+code_exec_loop (sh_eval_ctx_t * ctx, sh_code_t * code)
+{
+    return code->jump.code;
+}
 
+// indexed by sh_oper_type_t, NULL - operator is not supported by pre-decoded code
+LOCAL const sh_code_exec_t sh_code_exec[] RODATA = {
+    NULL,                       // NONE
+    code_exec_func,
+    NULL,                       // BLOCK
+    code_exec_not,
+    code_exec_multiply,
+    code_exec_div,
+    code_exec_mod,
+    code_exec_plus,
+    code_exec_minus,
+    code_exec_bit_and,
+    code_exec_bit_not,
+    code_exec_bit_sr,
+    code_exec_bit_sl,
+    code_exec_bit_or,
+    code_exec_bit_xor,
+    code_exec_lt,
+    code_exec_gt,
+    code_exec_lteq,
+    code_exec_gteq,
+    code_exec_eq,
+    code_exec_noteq,
+    code_exec_and,
+    code_exec_or,
+    code_exec_assign,
+    NULL,                       // VAR
+    NULL,                       // GVAR
+    code_exec_if,
+    code_exec_if,               // IFRET
+    code_exec_if,               // FOREACH
+    code_exec_else,
+    NULL,                       // ARGLIST
+    code_exec_ret,
+    code_exec_loop,
+};
+
+/*
+ * [private] Pre-decode statement bytecode: operand masks, types and addresses are resolved once,
+ *   so evaluation is a plain call chain over operator handlers.
+ * - stmt: statement with bytecode
+ * - code: code buffer, when NULL only calculate the length
+ * - length: result length of code
+ * - returns: SH_INTERNAL_ERROR when bytecode can not be pre-decoded, then statement is interpreted
+ */
+LOCAL sh_errcode_t ICACHE_FLASH_ATTR
+stmt_compile (sh_stmt_t * stmt, sh_code_t * code, size_t * length)
+{
     char           *bc_ptr = stmt->vardata;
     char           *ptr_max = bc_ptr + stmt->info.length;
+    sh_code_t      *code_ptr = code;
+
+    *length = 0;
+    while (bc_ptr < ptr_max) {
+        sh_bc_oper_t   *bc_oper = d_pointer_as (sh_bc_oper_t, bc_ptr);
+        if (bc_oper->optype >= SH_OPER_MAX)
+            return SH_INTERNAL_ERROR;
+
+        sh_oper_desc_t *opdesc = &sh_oper_desc[bc_oper->optype];
+        bytecode_size_t addr = d_pointer_diff (bc_ptr, stmt->vardata);
+        bytecode_size_t jump_addr = 0;
+        bool            branch = (bc_oper->optype == SH_OPER_IF) || (bc_oper->optype == SH_OPER_IFRET)
+            || (bc_oper->optype == SH_OPER_FOREACH) || (bc_oper->optype == SH_OPER_ELSE);
+        bool            loop = (bc_oper->optype == SH_OPER_LOOP);
+
+        bc_ptr += sizeof (sh_bc_oper_t);
+        if (bc_ptr > ptr_max)
+            return SH_INTERNAL_ERROR;
+
+        uint16          mask = bc_oper->bitmask;
+        arg_count_t     count = bc_oper->arg_count + (opdesc->result ? 1 : 0);
+        arg_count_t     used = (branch) ? 1 : (loop) ? 0 : count;
+        sh_bc_arg_t    *args[LSH_OPER_ARG_COUNT_MAX + 2];
+        sh_bc_arg_type_t arg_types[LSH_OPER_ARG_COUNT_MAX + 2];
+        if ((count > LSH_OPER_ARG_COUNT_MAX + 2) || (branch && (count < 2)) || (loop && (count != 1)))
+            return SH_INTERNAL_ERROR;
+
+        arg_count_t     idx;
+        for (idx = 0; idx < count; idx++) {
+            if ((branch && (idx == 1)) || loop) {
+                sh_bc_arg_t    *jmp_arg = d_pointer_as (sh_bc_arg_t, bc_ptr);
+                sh_pop_bcarg_type (&mask, jmp_arg);
+                bc_ptr += sizeof (sh_bc_arg_t);
+                jump_addr = jmp_arg->arg.value;
+                continue;
+            }
+            d_sh_check_error (stmt_eval_popvar (stmt, &bc_ptr, &mask, &args[idx], &arg_types[idx]));
+        }
+
+        sh_code_exec_t  exec = sh_code_exec[bc_oper->optype];
+        switch (bc_oper->optype) {
+        case SH_OPER_VAR:
+        case SH_OPER_GVAR:
+            continue;
+        case SH_OPER_ASSIGN:
+            if (count != 2)
+                return SH_INTERNAL_ERROR;
+            break;
+        case SH_OPER_FUNC:
+            if ((count < 2) || (arg_types[1] != SH_BC_ARG_FUNC))
+                return SH_INTERNAL_ERROR;
+            break;
+        default:
+            if (!exec)
+                return SH_INTERNAL_ERROR;
+            if (opdesc->result) {
+                if ((count < 2) || ((!opdesc->concat) && (count > 3)))
+                    return SH_INTERNAL_ERROR;
+                if ((!opdesc->concat) && (count < 3) && (exec != code_exec_not) && (exec != code_exec_bit_not))
+                    return SH_INTERNAL_ERROR;
+                for (idx = 1; idx < count; idx++)
+                    if (arg_types[idx] != SH_BC_ARG_INT)
+                        return SH_INTERNAL_ERROR;
+            }
+            break;
+        }
+
+        size_t          code_len = sizeof (sh_code_t) + used * sizeof (sh_bc_arg_t *);
+        if (bc_oper->optype == SH_OPER_FUNC)
+            code_len += (used - 2) * sizeof (sh_bc_arg_type_t);
+        code_len = d_align (code_len);
+        *length += code_len;
+
+        if (!code)
+            continue;
+
+        code_ptr->exec = exec;
+        code_ptr->next = d_pointer_add (sh_code_t, code_ptr, code_len);
+        code_ptr->jump.addr = jump_addr;
+        code_ptr->addr = addr;
+        code_ptr->arg_count = used;
+        os_memcpy (code_ptr->args, args, used * sizeof (sh_bc_arg_t *));
+        if (bc_oper->optype == SH_OPER_FUNC)
+            os_memcpy (&code_ptr->args[used], &arg_types[2], (used - 2) * sizeof (sh_bc_arg_type_t));
+
+        code_ptr = code_ptr->next;
+    }
+
+    if (!code)
+        return SH_ERR_SUCCESS;
+
+    // resolve branch targets: the first instruction at or after the target address
+    sh_code_t      *code_end = code_ptr;
+    for (code_ptr = code; code_ptr < code_end; code_ptr = code_ptr->next) {
+        if ((code_ptr->exec != code_exec_if) && (code_ptr->exec != code_exec_else)
+            && (code_ptr->exec != code_exec_loop))
+            continue;
+
+        bytecode_size_t jump_addr = code_ptr->jump.addr;
+        // loop jumps back to its condition
+        sh_code_t      *target = (jump_addr > code_ptr->addr) ? code_ptr->next : code;
+        while ((target < code_end) && (target->addr < jump_addr))
+            target = target->next;
+        code_ptr->jump.code = target;
+    }
+
+    return SH_ERR_SUCCESS;
+}
+
+/*
+ * [private] Create pre-decoded code for the parsed statement, on failure statement stays interpreted
+ * - stmt: statement with bytecode
+ */
+LOCAL void      ICACHE_FLASH_ATTR
+stmt_code_create (sh_stmt_t * stmt)
+{
+    sh_code_t      *code = NULL;
+    size_t          code_len = 0;
+
+    stmt->code = NULL;
+    stmt->code_end = NULL;
+    if (stmt_compile (stmt, NULL, &code_len) != SH_ERR_SUCCESS) {
+        d_log_wprintf (LSH_SERVICE_NAME, "compile: \"%s\" is not pre-decoded", stmt->info.name);
+        return;
+    }
+    if (!code_len)
+        return;
+    // code is kept apart from service data storage, budget leaves heap for the other services
+    if ((sdata->code_size + code_len > LSH_CODE_HEAP_SIZE) || !(code = os_malloc (code_len))) {
+        d_log_wprintf (LSH_SERVICE_NAME, "compile: \"%s\" is not pre-decoded, code=%u, used=%u", stmt->info.name,
+                       code_len, sdata->code_size);
+        return;
+    }
+    sdata->code_size += code_len;
+
+    stmt_compile (stmt, code, &code_len);
+    stmt->code = code;
+    stmt->code_end = d_pointer_add (sh_code_t, code, code_len);
+    d_log_dprintf (LSH_SERVICE_NAME, "compile: \"%s\" bytecode=%u, code=%u", stmt->info.name, stmt->info.length,
+                   code_len);
+}
+
+/*
+ * [private] Release pre-decoded code of the statement
+ * - stmt: statement
+ */
+LOCAL void      ICACHE_FLASH_ATTR
+stmt_code_free (sh_stmt_t * stmt)
+{
+    sdata->code_size -= d_pointer_diff (stmt->code_end, stmt->code);
+    os_free (stmt->code);
+    stmt->code = NULL;
+    stmt->code_end = NULL;
+}
+
+/*
+ * [private] forall callback, releases pre-decoded code of every statement on service stop
+ */
+LOCAL imdb_errcode_t ICACHE_FLASH_ATTR
+stmt_code_free_forall (imdb_fetch_obj_t * fobj, void *data)
+{
+    sh_stmt_t      *stmt = d_pointer_as (sh_stmt_t, fobj->dataptr);
+    if (stmt->code)
+        stmt_code_free (stmt);
+    return IMDB_ERR_SUCCESS;
+}
+
+#endif
+
+
+/*
+ * [private] check evaluation slice budget, first operator of slice is always evaluated
+ * - opers: operators evaluated in current slice
+ * - ts: slice start time
+ */
+INLINED bool    ICACHE_FLASH_ATTR
+stmt_eval_budget_over (sh_eval_ctx_t * ctx, uint16 * opers, uint32 ts)
+{
+    if ((*opers)++ == 0)
+        return false;
+    if ((ctx->oper_budget) && (*opers > ctx->oper_budget))
+        return true;
+    return (ctx->time_budget) && (system_get_time () - ts >= ctx->time_budget);
+}
+
+/*
+ * [private] evaluate statement
+ * - stmt: statement
+ * - ctx: evaluation context
+ * - resume: continue suspended statement from ctx->addr
+ */
+INLINED sh_errcode_t ICACHE_FLASH_ATTR
+stmt_eval_ext (sh_stmt_t * stmt, sh_eval_ctx_t * ctx, bool resume)
+{
+    char           *bc_ptr = stmt->vardata;
+    char           *ptr_max = bc_ptr + stmt->info.length;
+    bool            budget = (ctx->oper_budget || ctx->time_budget);
+    uint16          opers = 0;
+    uint32          ts = (ctx->time_budget) ? system_get_time () : 0;
+
+    if (resume) {
+        if ((!stmt->suspended) || (ctx->addr > stmt->info.length))
+            return SH_INTERNAL_ERROR;
+        bc_ptr += ctx->addr;
+    }
+    else {
+        ctx->addr = 0;
+#ifdef LSH_FUNC_MEMO
+        sdata->eval_seq++;
+#endif
+    }
+    stmt->suspended = false;
     ctx->stmt_info = &stmt->info;
     ctx->exitcode = 0;
 
+#ifdef LSH_COMPILED_EVAL
+    if (stmt->code) {
+        sh_code_t      *code = stmt->code;
+        if (resume) {
+            while ((code < stmt->code_end) && (code->addr != ctx->addr))
+                code = code->next;
+            if ((code == stmt->code_end) && (ctx->addr != stmt->info.length))
+                return SH_INTERNAL_ERROR;
+        }
+
+        while ((code < stmt->code_end) && (ctx->exitcode == 0)) {
+            if (budget && stmt_eval_budget_over (ctx, &opers, ts)) {
+                ctx->addr = code->addr;
+                stmt->suspended = true;
+                return SH_EVAL_YIELD;
+            }
+#ifdef LSH_PROFILE
+            stmt->profile.oper_count[d_pointer_add (sh_bc_oper_t, stmt->vardata, code->addr)->optype]++;
+#endif
+            code = code->exec (ctx, code);
+        }
+        if (ctx->exitcode == 0)
+            ctx->addr = stmt->info.length;
+
+        return SH_ERR_SUCCESS;
+    }
+#endif
+
     ctx->addr = bc_ptr - stmt->vardata;
     while ((bc_ptr < ptr_max) && (ctx->exitcode == 0)) {
+        if (budget && stmt_eval_budget_over (ctx, &opers, ts)) {
+            stmt->suspended = true;
+            return SH_EVAL_YIELD;
+        }
+
         sh_bc_oper_t   *bc_oper_ptr = d_pointer_as (sh_bc_oper_t, bc_ptr);
         sh_oper_desc_t *opdesc = &sh_oper_desc[bc_oper_ptr->optype];
 
         bc_ptr += sizeof (sh_bc_oper_t);
         if (bc_ptr > ptr_max)
             return SH_INTERNAL_ERROR;
+#ifdef LSH_PROFILE
+        stmt->profile.oper_count[bc_oper_ptr->optype]++;
+#endif
 
         switch (bc_oper_ptr->optype) {
         case SH_OPER_VAR:
@@ -1667,6 +2704,7 @@ stmt_eval (const sh_hndlr_t hstmt, sh_eval_ctx_t * ctx)
             break;
         case SH_OPER_IF:
         case SH_OPER_IFRET:
+        case SH_OPER_FOREACH:
         case SH_OPER_ELSE:
             {
                 uint16          mask = bc_oper_ptr->bitmask;
@@ -1691,6 +2729,14 @@ stmt_eval (const sh_hndlr_t hstmt, sh_eval_ctx_t * ctx)
                 }
             }
             break;
+        case SH_OPER_LOOP:
+            {
+                uint16          mask = bc_oper_ptr->bitmask;
+                sh_bc_arg_t    *jmp_arg = d_pointer_as (sh_bc_arg_t, bc_ptr);
+                sh_pop_bcarg_type (&mask, jmp_arg);
+                bc_ptr = stmt->vardata + jmp_arg->arg.value;
+            }
+            break;
         default:
             if (opdesc->concat) {
                 d_sh_check_error (stmt_eval_foper_concat (stmt, bc_oper_ptr, &bc_ptr));
@@ -1708,6 +2754,53 @@ stmt_eval (const sh_hndlr_t hstmt, sh_eval_ctx_t * ctx)
     return SH_ERR_SUCCESS;
 }
 
+/*
+ * [private] evaluate one slice of statement, profile counts completed evaluations only
+ * - resume: continue from ctx->addr of suspended statement
+ */
+LOCAL sh_errcode_t ICACHE_FLASH_ATTR
+stmt_eval_slice (const sh_hndlr_t hstmt, sh_eval_ctx_t * ctx, bool resume)
+{
+    sh_stmt_t      *stmt = d_hndlr2obj (sh_stmt_t, hstmt);
+#ifdef LSH_PROFILE
+    uint32          ts = system_get_time ();
+    sh_errcode_t    res = stmt_eval_ext (stmt, ctx, resume);
+    ts = system_get_time () - ts;
+
+    if (res != SH_EVAL_YIELD)
+        stmt->profile.exec_count++;
+    stmt->profile.exec_time += ts;
+    if (ts > stmt->profile.exec_time_max)
+        stmt->profile.exec_time_max = ts;
+
+    return res;
+#else
+    return stmt_eval_ext (stmt, ctx, resume);
+#endif
+}
+
+/*
+ * [public] evaluate statement
+ * - ctx: oper_budget/time_budget limit the evaluation slice, when exhausted returns SH_EVAL_YIELD
+ *   and ctx->addr points to the next operator, local variables are kept by statement itself
+ */
+sh_errcode_t    ICACHE_FLASH_ATTR
+stmt_eval (const sh_hndlr_t hstmt, sh_eval_ctx_t * ctx)
+{
+    return stmt_eval_slice (hstmt, ctx, false);
+}
+
+/*
+ * [public] continue evaluation of statement suspended by SH_EVAL_YIELD
+ * - ctx: ctx->addr returned by the previous slice, budgets as for stmt_eval
+ * - returns: SH_INTERNAL_ERROR when statement was evaluated from start or reloaded meanwhile
+ */
+sh_errcode_t    ICACHE_FLASH_ATTR
+stmt_resume (const sh_hndlr_t hstmt, sh_eval_ctx_t * ctx)
+{
+    return stmt_eval_slice (hstmt, ctx, true);
+}
+
 LOCAL void      ICACHE_FLASH_ATTR
 fn_sysdate (sh_eval_ctx_t * evctx, sh_bc_arg_t * ret_arg, const arg_count_t arg_count, sh_bc_arg_type_t arg_type[],
             sh_bc_arg_t * bc_args[])
@@ -1748,40 +2841,6 @@ fn_print (sh_eval_ctx_t * evctx, sh_bc_arg_t * ret_arg, const arg_count_t arg_co
     d_log_iprintf (LSH_SERVICE_NAME, "%s out: %s", evctx->stmt_info->name, buffer);
 }
 
-typedef struct sh_find_ctx_s {
-    const char     *stmt_name;
-    sh_stmt_t      *stmt;
-    sh_stmt_source_t *stmt_src;
-} sh_find_ctx_t;
-
-/*
- * [private] imdb forall callback
- */
-LOCAL imdb_errcode_t ICACHE_FLASH_ATTR
-sh_forall_find (imdb_fetch_obj_t * fobj, void *data)
-{
-    sh_stmt_t      *stmt = d_pointer_as (sh_stmt_t, fobj->dataptr);
-    sh_find_ctx_t  *find_ctx = d_pointer_as (sh_find_ctx_t, data);
-    if (os_strncmp (stmt->info.name, find_ctx->stmt_name, sizeof (sh_stmt_name_t)) == 0) {
-        find_ctx->stmt = stmt;
-        return IMDB_CURSOR_BREAK;
-    }
-    return IMDB_ERR_SUCCESS;
-}
-
-LOCAL imdb_errcode_t ICACHE_FLASH_ATTR
-sh_forall_find_source (imdb_fetch_obj_t * fobj, void *data)
-{
-    sh_stmt_source_t *stmt_src = d_pointer_as (sh_stmt_source_t, fobj->dataptr);
-    sh_find_ctx_t  *find_ctx = d_pointer_as (sh_find_ctx_t, data);
-    if (os_strncmp (stmt_src->name, find_ctx->stmt_name, sizeof (sh_stmt_name_t)) == 0) {
-        find_ctx->stmt_src = stmt_src;
-        return IMDB_CURSOR_BREAK;
-    }
-    return IMDB_ERR_SUCCESS;
-}
-
-
 /*
  * [public] find statement by name
  * - stmt_name: statement name (safe to use char* and sh_stmt_name_t*)
@@ -1793,13 +2852,12 @@ stmt_get (const char *stmt_name, sh_hndlr_t * hstmt)
 {
     d_check_init ();
 
-    sh_find_ctx_t   find_ctx;
-    os_memset (&find_ctx, 0, sizeof (sh_find_ctx_t));
-    find_ctx.stmt_name = stmt_name;
-
-    d_sh_check_imdb_error (imdb_class_forall (sdata->svcres->hmdb, sdata->hstmt, (void *) &find_ctx, sh_forall_find));
+    imdb_fetch_obj_t fobj;
+    imdb_errcode_t  imdb_res = imdb_index_find (sdata->svcres->hmdb, sdata->hstmt, sdata->idx_stmt, stmt_name, &fobj);
+    if (imdb_res != IMDB_CURSOR_NO_DATA_FOUND)
+        d_sh_check_imdb_error (imdb_res);
 
-    *hstmt = d_obj2hndlr (find_ctx.stmt);
+    *hstmt = d_obj2hndlr (fobj.dataptr);
     return (*hstmt) ? SH_ERR_SUCCESS : SH_STMT_NOT_EXISTS;
 }
 
@@ -1813,16 +2871,252 @@ stmt_src_get (const char *stmt_name, sh_stmt_source_t ** stmt_src)
 {
     d_check_init ();
 
-    sh_find_ctx_t   find_ctx;
-    os_memset (&find_ctx, 0, sizeof (sh_find_ctx_t));
-    find_ctx.stmt_name = stmt_name;
-
-    imdb_class_forall (sdata->svcres->hfdb, sdata->hstmt_src, (void *) &find_ctx, sh_forall_find_source);
-    *stmt_src = find_ctx.stmt_src;
+    imdb_fetch_obj_t fobj;
+    *stmt_src = NULL;
+    if (imdb_index_find (sdata->svcres->hfdb, sdata->hstmt_src, sdata->idx_stmt_src, stmt_name, &fobj) ==
+        IMDB_ERR_SUCCESS)
+        *stmt_src = d_pointer_as (sh_stmt_source_t, fobj.dataptr);
 
     return (*stmt_src) ? SH_ERR_SUCCESS : SH_STMT_SOURCE_NOT_EXISTS;
 }
 
+typedef sh_errcode_t (*sh_bc_global_cb_t) (sh_bc_arg_t * bc_arg, void *data);
+
+/*
+ * [private] walk through bytecode and call callback for every global argument
+ * - vardata: bytecode
+ * - length: bytecode length
+ * - cb: callback, walking is stopped on error
+ * - data: callback data
+ */
+LOCAL sh_errcode_t ICACHE_FLASH_ATTR
+bc_global_walk (char *vardata, bytecode_size_t length, sh_bc_global_cb_t cb, void *data)
+{
+    char           *bc_ptr = vardata;
+    char           *ptr_max = vardata + length;
+
+    while (bc_ptr < ptr_max) {
+        sh_bc_oper_t   *bc_oper = d_pointer_as (sh_bc_oper_t, bc_ptr);
+        if (bc_oper->optype >= SH_OPER_MAX)
+            return SH_INTERNAL_ERROR;
+
+        bc_ptr += sizeof (sh_bc_oper_t);
+
+        arg_count_t     idx;
+        uint16          mask = bc_oper->bitmask;
+        arg_count_t     count = bc_oper->arg_count + (sh_oper_desc[bc_oper->optype].result ? 1 : 0);
+        for (idx = 0; idx < count; idx++) {
+            sh_bc_arg_t    *bc_arg = d_pointer_as (sh_bc_arg_t, bc_ptr);
+            bc_ptr += sizeof (sh_bc_arg_t);
+            if (bc_ptr > ptr_max)
+                return SH_INTERNAL_ERROR;
+
+            switch (sh_pop_bcarg_type (&mask, bc_arg)) {
+            case SH_BC_ARG_CHAR:
+                bc_ptr += d_align (bc_arg->arg.dlength);
+                break;
+            case SH_BC_ARG_GLOBAL:
+                d_sh_check_error (cb (bc_arg, data));
+                break;
+            default:
+                break;
+            }
+        }
+    }
+
+    return (bc_ptr == ptr_max) ? SH_ERR_SUCCESS : SH_INTERNAL_ERROR;
+}
+
+/*
+ * [private] find compiled statement image by name
+ * - stmt_name: statement name
+ * - image: result pointer to image
+ */
+LOCAL sh_errcode_t ICACHE_FLASH_ATTR
+stmt_image_get (const char *stmt_name, sh_stmt_image_t ** image)
+{
+    imdb_fetch_obj_t fobj;
+    *image = NULL;
+    if (imdb_index_find (sdata->svcres->hfdb, sdata->hstmt_img, sdata->idx_stmt_img, stmt_name, &fobj) ==
+        IMDB_ERR_SUCCESS)
+        *image = d_pointer_as (sh_stmt_image_t, fobj.dataptr);
+
+    return (*image) ? SH_ERR_SUCCESS : SH_STMT_NOT_EXISTS;
+}
+
+/*
+ * [private] delete compiled statement image, if exists
+ * - stmt_name: statement name
+ */
+LOCAL void      ICACHE_FLASH_ATTR
+stmt_image_delete (const char *stmt_name)
+{
+    sh_stmt_image_t *image;
+    if ((stmt_image_get (stmt_name, &image) == SH_ERR_SUCCESS)
+        && (imdb_clsobj_delete (sdata->svcres->hfdb, sdata->hstmt_img, image) != IMDB_ERR_SUCCESS))
+        d_log_eprintf (LSH_SERVICE_NAME, "image \"%s\" delete failed", stmt_name);
+}
+
+LOCAL sh_errcode_t ICACHE_FLASH_ATTR
+stmt_image_reloc_size_cb (sh_bc_arg_t * bc_arg, void *data)
+{
+    const char     *gname = ih_hash8_v2key (sdata->token_idx, (const char *) bc_arg->arg.ptr);
+    *d_pointer_as (size_t, data) += sizeof (sh_parse_arg_t) + d_align (os_strlen (gname) + 1);
+    return SH_ERR_SUCCESS;
+}
+
+LOCAL sh_errcode_t ICACHE_FLASH_ATTR
+stmt_image_unlink_cb (sh_bc_arg_t * bc_arg, void *data)
+{
+    sh_stmt_image_t *image = d_pointer_as (sh_stmt_image_t, data);
+    sh_gvar_t      *gvar = d_pointer_as (sh_gvar_t, bc_arg->arg.ptr);
+    const char     *gname = ih_hash8_v2key (sdata->token_idx, (const char *) gvar);
+    parse_size_t    glen = os_strlen (gname) + 1;
+    char           *reloc = d_pointer_add (char, image->vardata, image->length);
+
+    obj_size_t      offset = 0;
+    sh_parse_arg_t *entry;
+    while (offset < image->reloc_length) {
+        entry = d_pointer_add (sh_parse_arg_t, reloc, offset);
+        if ((entry->length == glen) && (os_memcmp (entry->data, gname, glen) == 0))
+            break;
+        offset += sizeof (sh_parse_arg_t) + d_align (entry->length);
+    }
+
+    if (offset == image->reloc_length) {
+        entry = d_pointer_add (sh_parse_arg_t, reloc, offset);
+        entry->type = (gvar->type == SH_BC_ARG_FUNC) ? SH_ARG_FUNC : SH_ARG_TOKEN;
+        entry->length = glen;
+        os_memcpy (entry->data, gname, glen);
+        image->reloc_length += sizeof (sh_parse_arg_t) + d_align (glen);
+    }
+
+    bc_arg->arg.vptr = d_stmt_image_reloc (offset);
+    return SH_ERR_SUCCESS;
+}
+
+LOCAL sh_errcode_t ICACHE_FLASH_ATTR
+stmt_image_link_cb (sh_bc_arg_t * bc_arg, void *data)
+{
+    sh_stmt_image_t *image = d_pointer_as (sh_stmt_image_t, data);
+    size_t          offset = bc_arg->arg.vptr - d_stmt_image_reloc (0);
+    if (offset + sizeof (sh_parse_arg_t) > image->reloc_length)
+        return SH_INTERNAL_ERROR;
+
+    sh_parse_arg_t *entry = d_pointer_add (sh_parse_arg_t, image->vardata, image->length + offset);
+    if ((entry->length < 2) || (offset + sizeof (sh_parse_arg_t) + entry->length > image->reloc_length)
+        || (entry->data[entry->length - 1] != '\0'))
+        return SH_INTERNAL_ERROR;
+
+    sh_gvar_t      *gvar;
+    d_sh_check_error (bc_global_add (entry, (entry->type == SH_ARG_FUNC) ? SH_BC_ARG_FUNC : SH_BC_ARG_INT, &gvar));
+    bc_arg->arg.ptr = gvar;
+
+    return SH_ERR_SUCCESS;
+}
+
+/*
+ * [private] store compiled statement image into fdb, existing image is replaced
+ * - stmt: parsed statement
+ * - utime: update time of the statement source
+ */
+LOCAL sh_errcode_t ICACHE_FLASH_ATTR
+stmt_image_store (sh_stmt_t * stmt, lt_time_t utime)
+{
+    size_t          reloc_size = 0;
+    d_sh_check_error (bc_global_walk (stmt->vardata, stmt->info.length, stmt_image_reloc_size_cb, &reloc_size));
+
+    // globals are deduplicated, so the image is built in temporary buffer and stored with exact size
+    size_t          blen = sizeof (sh_stmt_image_t) + stmt->info.length + reloc_size;
+    sh_stmt_image_t *buf = os_malloc (blen);
+    if (!buf) {
+        d_log_eprintf (LSH_SERVICE_NAME, sz_sh_error[SH_ALLOCATION_ERROR], blen);
+        return SH_ALLOCATION_ERROR;
+    }
+
+    os_memset (buf, 0, sizeof (sh_stmt_image_t));
+    os_memcpy (buf->name, stmt->info.name, sizeof (sh_stmt_name_t));
+    buf->utime = utime;
+    buf->build = BUILD_NUMBER;
+    buf->version = LSH_STMT_IMAGE_VERSION;
+    buf->length = stmt->info.length;
+    buf->saved = stmt->info.saved;
+    os_memcpy (buf->vardata, stmt->vardata, stmt->info.length);
+
+    sh_errcode_t    res = bc_global_walk (buf->vardata, buf->length, stmt_image_unlink_cb, buf);
+    if (res == SH_ERR_SUCCESS) {
+        stmt_image_delete (stmt->info.name);
+
+        sh_stmt_image_t *image;
+        blen = sizeof (sh_stmt_image_t) + buf->length + buf->reloc_length;
+        imdb_errcode_t  imdb_res =
+            imdb_clsobj_insert (sdata->svcres->hfdb, sdata->hstmt_img, (void **) &image, blen);
+        if (imdb_res == IMDB_ERR_SUCCESS) {
+            os_memcpy (image, buf, blen);
+            imdb_res = imdb_clsobj_insert_commit (sdata->svcres->hfdb, sdata->hstmt_img, image);
+        }
+        if (imdb_res == IMDB_ERR_SUCCESS) {
+            d_log_dprintf (LSH_SERVICE_NAME, "image \"%s\" stored, length:%u", stmt->info.name, blen);
+        }
+        else {
+            d_log_eprintf (LSH_SERVICE_NAME, "image \"%s\" store failed: %u", stmt->info.name, imdb_res);
+            res = SH_INTERNAL_ERROR;
+        }
+    }
+
+    os_free (buf);
+    return res;
+}
+
+/*
+ * [private] load statement from compiled image, globals are resolved by name
+ * - stmt_name: statement name
+ * - utime: update time of the statement source, stale image is not loaded
+ * - hstmt: result handler to statement
+ */
+LOCAL sh_errcode_t ICACHE_FLASH_ATTR
+stmt_image_load (const char *stmt_name, lt_time_t utime, sh_hndlr_t * hstmt)
+{
+    sh_stmt_image_t *image;
+    d_sh_check_error (stmt_image_get (stmt_name, &image));
+
+    size_t          olen = 0;
+    if ((imdb_clsobj_length (sdata->svcres->hfdb, sdata->hstmt_img, image, &olen) != IMDB_ERR_SUCCESS)
+        || (sizeof (sh_stmt_image_t) + image->length + image->reloc_length > olen)) {
+        d_log_eprintf (LSH_SERVICE_NAME, "image \"%s\" is corrupted", stmt_name);
+        return SH_INTERNAL_ERROR;
+    }
+    if ((image->version != LSH_STMT_IMAGE_VERSION) || (image->build != BUILD_NUMBER) || (image->utime != utime)) {
+        d_log_wprintf (LSH_SERVICE_NAME, "image \"%s\" is outdated", stmt_name);
+        return SH_STMT_NOT_EXISTS;
+    }
+
+    sh_stmt_t      *stmt = NULL;
+    d_sh_check_imdb_error (imdb_clsobj_insert
+                           (sdata->svcres->hmdb, sdata->hstmt, (void **) &stmt, sizeof (sh_stmt_t) + image->length));
+    os_memset (stmt, 0, sizeof (sh_stmt_t));
+
+    stmt->info.parse_time = lt_ctime ();
+    stmt->info.length = image->length;
+    stmt->info.saved = image->saved;
+    os_memcpy (stmt->info.name, image->name, sizeof (sh_stmt_name_t));
+    os_memcpy (stmt->vardata, image->vardata, image->length);
+
+    sh_errcode_t    res = bc_global_walk (stmt->vardata, stmt->info.length, stmt_image_link_cb, image);
+    if (res != SH_ERR_SUCCESS) {
+        d_log_wprintf (LSH_SERVICE_NAME, "image \"%s\" link failed: %u", stmt_name, res);
+        d_sh_check_imdb_error (imdb_clsobj_delete (sdata->svcres->hmdb, sdata->hstmt, stmt));
+        return res;
+    }
+    d_sh_check_imdb_error (imdb_clsobj_insert_commit (sdata->svcres->hmdb, sdata->hstmt, stmt));
+#ifdef LSH_COMPILED_EVAL
+    stmt_code_create (stmt);
+#endif
+
+    *hstmt = d_obj2hndlr (stmt);
+    return SH_ERR_SUCCESS;
+}
+
 /*
  * [public] find statement by name, if not exists try to load from source
  * - stmt_name: statement name (safe to use char* and sh_stmt_name_t*)
@@ -1836,6 +3130,17 @@ stmt_get_ext (const char *stmt_name, sh_hndlr_t * hstmt)
     if (res == SH_STMT_NOT_EXISTS) {
         sh_stmt_source_t *stmt_src;
         if (stmt_src_get (stmt_name, &stmt_src) == SH_ERR_SUCCESS) {
+            lt_time_t       utime = stmt_src->utime;
+            if (stmt_image_load (stmt_name, utime, hstmt) == SH_ERR_SUCCESS) {
+                d_log_iprintf (LSH_SERVICE_NAME, "load \"%s\" image", stmt_name);
+                return SH_ERR_SUCCESS;
+            }
+
+            // image lookup may release the source block
+            res = stmt_src_get (stmt_name, &stmt_src);
+            if (res != SH_ERR_SUCCESS)
+                return res;
+
             char           *stmt_text = NULL;
             dtlv_ctx_t      ctx;
 
@@ -1843,11 +3148,18 @@ stmt_get_ext (const char *stmt_name, sh_hndlr_t * hstmt)
             dtlv_seq_decode_begin (&ctx, LSH_SERVICE_ID);
             dtlv_seq_decode_ptr (SH_AVP_STMT_TEXT, stmt_text, char);
             dtlv_seq_decode_end (&ctx);
+            if (!stmt_text) {
+                d_log_eprintf (LSH_SERVICE_NAME, "source \"%s\" has no text", stmt_name);
+                return SH_STMT_SOURCE_NOT_EXISTS;
+            }
 
             res = stmt_parse (stmt_text, stmt_name, hstmt);
 
-            if (res == SH_ERR_SUCCESS)
+            if (res == SH_ERR_SUCCESS) {
                 d_log_iprintf (LSH_SERVICE_NAME, "load \"%s\"", stmt_name);
+                // image only caches the parsed source, it is written by the next flush
+                stmt_image_store (d_hndlr2obj (sh_stmt_t, *hstmt), utime);
+            }
         }
     }
 
@@ -1910,9 +3222,12 @@ sh_on_msg_stmt_add (dtlv_ctx_t * msg_in, dtlv_ctx_t * msg_out)
                     stmt_src->varlen = slen;
 
                     dtlv_ctx_t      ctx;
-                    imdb_res = dtlv_ctx_init_encode (&ctx, stmt_src->vardata, stmt_src->varlen)
+                    imdb_res = imdb_clsobj_insert_commit (sdata->svcres->hfdb, sdata->hstmt_src, stmt_src)
+                        || dtlv_ctx_init_encode (&ctx, stmt_src->vardata, stmt_src->varlen)
                         || dtlv_avp_encode_char (&ctx, SH_AVP_STMT_TEXT, stmt_text);
                     stmt_src->varlen = (imdb_res == IMDB_ERR_SUCCESS) ? ctx.datalen : 0;
+
+                    stmt_image_store (d_hndlr2obj (sh_stmt_t, hstmt), stmt_src->utime);
                 }
                 else
                     d_log_eprintf (LSH_SERVICE_NAME, "source \"%s\" store failed: %u", stmt_name, imdb_res);
@@ -1961,6 +3276,7 @@ sh_on_msg_stmt_remove (const char *stmt_name, dtlv_ctx_t * msg_out)
         if (imdb_res != IMDB_ERR_SUCCESS)
             d_log_eprintf (LSH_SERVICE_NAME, "source \"%s\" delete failed: %u", stmt_name, imdb_res);
 
+        stmt_image_delete (stmt_name);
         imdb_flush (sdata->svcres->hfdb);
     }
 
@@ -2127,7 +3443,14 @@ sh_on_msg_stmt_list (dtlv_ctx_t * msg_out)
 
     d_svcs_check_dtlv_error (dtlv_avp_encode_list (msg_out, 0, SH_AVP_STATEMENT_SOURCE, DTLV_TYPE_OBJECT, &gavp));
     imdb_hndlr_t    hcur;
-    d_svcs_check_imdb_error (imdb_class_query (sdata->svcres->hfdb, sdata->hstmt_src, PATH_NONE, &hcur));
+    // only fixed part is listed, copy it to fetch whole bulk from media
+    sh_stmt_source_t proj[LSH_FETCH_BULK_COUNT];
+    imdb_query_t    query;
+    os_memset (&query, 0, sizeof (imdb_query_t));
+    query.proj_length = sizeof (sh_stmt_source_t);
+    query.proj_buffer = proj;
+    d_svcs_check_imdb_error (imdb_class_query_ext
+                             (sdata->svcres->hfdb, sdata->hstmt_src, PATH_NONE, &query, &hcur));
 
     imdb_fetch_obj_t fobj[LSH_FETCH_BULK_COUNT];
     uint16          rowcount;
@@ -2155,6 +3478,110 @@ sh_on_msg_stmt_list (dtlv_ctx_t * msg_out)
     return SVCS_ERR_SUCCESS;
 }
 
+#ifdef LSH_PROFILE
+/*
+ * [private] encode statement profile
+ * - stmt: statement
+ * - oper_profile: encode per operator counts
+ * - reset: reset profile after encoding
+ */
+LOCAL svcs_errcode_t ICACHE_FLASH_ATTR
+sh_encode_stmt_profile (dtlv_ctx_t * msg_out, sh_stmt_t * stmt, bool oper_profile, bool reset)
+{
+    sh_stmt_profile_t *prof = &stmt->profile;
+    dtlv_avp_t     *gavp_in;
+    d_svcs_check_dtlv_error (dtlv_avp_encode_grouping (msg_out, 0, SH_AVP_STMT_PROFILE, &gavp_in)
+                             || dtlv_avp_encode_nchar (msg_out, SH_AVP_STMT_NAME, sizeof (sh_stmt_name_t),
+                                                       stmt->info.name)
+                             || dtlv_avp_encode_uint32 (msg_out, SH_AVP_EXEC_COUNT, prof->exec_count)
+                             || dtlv_avp_encode_uint32 (msg_out, SH_AVP_EXEC_TIME, prof->exec_time)
+                             || dtlv_avp_encode_uint32 (msg_out, SH_AVP_EXEC_TIME_MAX, prof->exec_time_max)
+                             || dtlv_avp_encode_uint32 (msg_out, SH_AVP_FUNC_CALL_COUNT, prof->func_count)
+                             || dtlv_avp_encode_uint32 (msg_out, SH_AVP_FUNC_CALL_TIME, prof->func_time));
+
+    if (oper_profile) {
+        dtlv_avp_t     *gavp;
+        d_svcs_check_dtlv_error (dtlv_avp_encode_list (msg_out, 0, SH_AVP_OPER_PROFILE, DTLV_TYPE_OBJECT, &gavp));
+
+        sh_oper_type_t  optype;
+        for (optype = SH_OPER_NONE; optype < SH_OPER_MAX; optype++) {
+            if (!prof->oper_count[optype])
+                continue;
+
+            dtlv_avp_t     *gavp_op;
+            d_svcs_check_dtlv_error (dtlv_avp_encode_grouping (msg_out, 0, SH_AVP_OPER_PROFILE, &gavp_op)
+                                     || dtlv_avp_encode_uint8 (msg_out, SH_AVP_OPER_TYPE, optype)
+                                     || dtlv_avp_encode_uint32 (msg_out, SH_AVP_OPER_COUNT, prof->oper_count[optype])
+                                     || dtlv_avp_encode_group_done (msg_out, gavp_op));
+        }
+        d_svcs_check_dtlv_error (dtlv_avp_encode_group_done (msg_out, gavp));
+    }
+
+    d_svcs_check_dtlv_error (dtlv_avp_encode_group_done (msg_out, gavp_in));
+
+    if (reset)
+        os_memset (prof, 0, sizeof (sh_stmt_profile_t));
+
+    return SVCS_ERR_SUCCESS;
+}
+
+/*
+ * [private] statement profile message, per operator counts are encoded only for the named statement
+ * - msg_in: optional statement name and reset flag
+ */
+LOCAL svcs_errcode_t ICACHE_FLASH_ATTR
+sh_on_msg_stmt_profile (dtlv_ctx_t * msg_in, dtlv_ctx_t * msg_out)
+{
+    const char     *stmt_name = NULL;
+    uint8           reset = 0;
+
+    if (msg_in) {
+        dtlv_seq_decode_begin (msg_in, LSH_SERVICE_ID);
+        dtlv_seq_decode_ptr (SH_AVP_STMT_NAME, stmt_name, char);
+        dtlv_seq_decode_uint8 (SH_AVP_PROFILE_RESET, &reset);
+        dtlv_seq_decode_end (msg_in);
+    }
+
+    dtlv_avp_t     *gavp;
+    if (stmt_name) {
+        sh_hndlr_t      hstmt;
+        sh_errcode_t    res = stmt_get (stmt_name, &hstmt);
+        if (res != SH_ERR_SUCCESS) {
+            d_log_wprintf (LSH_SERVICE_NAME, sz_sh_error[SH_STMT_NOT_EXISTS], stmt_name);
+            d_svcs_check_svcs_error (encode_service_result_ext (msg_out, res, NULL));
+            return SVCS_ERR_SUCCESS;
+        }
+
+        d_svcs_check_dtlv_error (dtlv_avp_encode_list (msg_out, 0, SH_AVP_STMT_PROFILE, DTLV_TYPE_OBJECT, &gavp));
+        d_svcs_check_svcs_error (sh_encode_stmt_profile (msg_out, d_hndlr2obj (sh_stmt_t, hstmt), true, reset));
+        d_svcs_check_dtlv_error (dtlv_avp_encode_group_done (msg_out, gavp));
+
+        return SVCS_ERR_SUCCESS;
+    }
+
+    d_svcs_check_dtlv_error (dtlv_avp_encode_list (msg_out, 0, SH_AVP_STMT_PROFILE, DTLV_TYPE_OBJECT, &gavp));
+    imdb_hndlr_t    hcur;
+    d_svcs_check_imdb_error (imdb_class_query (sdata->svcres->hmdb, sdata->hstmt, PATH_NONE, &hcur));
+
+    imdb_fetch_obj_t fobj[LSH_FETCH_BULK_COUNT];
+    uint16          rowcount;
+    d_svcs_check_imdb_error (imdb_class_fetch (hcur, LSH_FETCH_BULK_COUNT, &rowcount, fobj));
+
+    while (rowcount) {
+        int             i;
+        for (i = 0; i < rowcount; i++)
+            d_svcs_check_svcs_error (sh_encode_stmt_profile
+                                     (msg_out, d_pointer_as (sh_stmt_t, fobj[i].dataptr), false, reset));
+
+        d_svcs_check_imdb_error (imdb_class_fetch (hcur, LSH_FETCH_BULK_COUNT, &rowcount, fobj));
+    }
+    imdb_class_close (hcur);
+    d_svcs_check_dtlv_error (dtlv_avp_encode_group_done (msg_out, gavp));
+
+    return SVCS_ERR_SUCCESS;
+}
+#endif
+
 svcs_errcode_t  ICACHE_FLASH_ATTR
 lsh_on_message (service_ident_t orig_id,
                 service_msgtype_t msgtype, void *ctxdata, dtlv_ctx_t * msg_in, dtlv_ctx_t * msg_out)
@@ -2173,6 +3600,11 @@ lsh_on_message (service_ident_t orig_id,
     case SH_MSGTYPE_STMT_DUMP:
         res = sh_on_msg_stmt_dump (msg_in, msg_out);
         break;
+#ifdef LSH_PROFILE
+    case SH_MSGTYPE_STMT_PROFILE:
+        res = sh_on_msg_stmt_profile (msg_in, msg_out);
+        break;
+#endif
     case SH_MSGTYPE_STMT_RUN:
     case SH_MSGTYPE_STMT_LOAD:
     case SH_MSGTYPE_STMT_SOURCE:
@@ -2256,12 +3688,20 @@ lsh_on_start (const svcs_resource_t * svcres, dtlv_ctx_t * conf)
 sizeof (sh_func_entry_t) };
     d_svcs_check_imdb_error (imdb_class_create (svcres->hmdb, &cdef, &(tmp_sdata->hfunc))
         );
+    d_svcs_check_imdb_error (imdb_index_create
+                             (svcres->hmdb, tmp_sdata->hfunc, d_offsetof (sh_func_entry_t, func_name),
+                              sizeof (sh_func_name_t), KEY_TYPE_STRING, &tmp_sdata->idx_func)
+        );
 
     imdb_class_def_t cdef2 =
         { LSH_IMDB_CLS_STMT, false, true, false, 0, LSH_STMT_STORAGE_PAGES, LSH_STMT_STORAGE_PAGE_BLOCKS,
 sizeof (sh_stmt_t) };
     d_svcs_check_imdb_error (imdb_class_create (svcres->hmdb, &cdef2, &(tmp_sdata->hstmt))
         );
+    d_svcs_check_imdb_error (imdb_index_create
+                             (svcres->hmdb, tmp_sdata->hstmt, d_offsetof (sh_stmt_t, info.name),
+                              sizeof (sh_stmt_name_t), KEY_TYPE_STRING, &tmp_sdata->idx_stmt)
+        );
 
     ih_hndlr_t      varmap;
     if (ih_init8 (tmp_sdata->token_idx, LSH_TOKENIDX_BUFFER_SIZE, 16, 0, sizeof (sh_gvar_t), &varmap) != IH_ERR_SUCCESS) {
@@ -2277,6 +3717,23 @@ LSH_STMT_SRC_STORAGE_PAGE_BLOCKS, sizeof (sh_stmt_source_t) };
             d_svcs_check_imdb_error (imdb_class_create (svcres->hfdb, &cdef3, &(tmp_sdata->hstmt_src))
                 );
         }
+        d_svcs_check_imdb_error (imdb_index_create
+                                 (svcres->hfdb, tmp_sdata->hstmt_src, d_offsetof (sh_stmt_source_t, name),
+                                  sizeof (sh_stmt_name_t), KEY_TYPE_STRING, &tmp_sdata->idx_stmt_src)
+            );
+
+        imdb_class_find (svcres->hfdb, LSH_IMDB_CLS_STMT_IMG, &(tmp_sdata->hstmt_img));
+        if (!tmp_sdata->hstmt_img) {
+            imdb_class_def_t cdef4 =
+                { LSH_IMDB_CLS_STMT_IMG, false, true, false, 0, LSH_STMT_IMG_STORAGE_PAGES,
+LSH_STMT_IMG_STORAGE_PAGE_BLOCKS, sizeof (sh_stmt_image_t) };
+            d_svcs_check_imdb_error (imdb_class_create (svcres->hfdb, &cdef4, &(tmp_sdata->hstmt_img))
+                );
+        }
+        d_svcs_check_imdb_error (imdb_index_create
+                                 (svcres->hfdb, tmp_sdata->hstmt_img, d_offsetof (sh_stmt_image_t, name),
+                                  sizeof (sh_stmt_name_t), KEY_TYPE_STRING, &tmp_sdata->idx_stmt_img)
+            );
     }
 
     sdata = tmp_sdata;
@@ -2308,8 +3765,21 @@ lsh_on_stop (void)
         return SVCS_NOT_RUN;
     }
 
+#ifdef LSH_COMPILED_EVAL
+    imdb_class_forall (sdata->svcres->hmdb, sdata->hstmt, NULL, stmt_code_free_forall);
+#endif
+
     lsh_data_t     *tmp_sdata = sdata;
     sdata = NULL;
+    if (tmp_sdata->arena) {
+#ifdef LSH_BUFFERS_IMDB
+        d_svcs_check_imdb_error (imdb_clsobj_delete
+                                 (tmp_sdata->svcres->hmdb, tmp_sdata->svcres->hdata, tmp_sdata->arena)
+            );
+#else
+        os_free (tmp_sdata->arena);
+#endif
+    }
     d_svcs_check_imdb_error (imdb_class_destroy (tmp_sdata->svcres->hmdb, tmp_sdata->hfunc)
         );
 
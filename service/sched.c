@@ -44,15 +44,23 @@
 
 #define SCHED_MAX_TIMEOUT_SEC		3600
 
+typedef struct sched_conf_s {
+    uint32          stmt_time_quota;    // us
+    uint16          stmt_oper_quota;
+} sched_conf_t;
+
 typedef struct sched_data_s {
+    sched_conf_t    conf;
     const svcs_resource_t *svcres;
     imdb_hndlr_t    hentry;     // entry storage
     imdb_hndlr_t    hentry_src; // entry source storage
-    // Fixme: should make separate index segment in imdb
+    imdb_index_id_t idx_entry;  // entry name index
+    imdb_index_id_t idx_entry_src;      // entry source name index
 #ifdef ARCH_XTENSA
     os_timer_t      next_timer;
 #endif
     os_time_t       next_ctime;
+    bool            resume_posted;      // resume task of queued entries is posted
 } sched_data_t;
 
 LOCAL sched_data_t *sdata = NULL;
@@ -276,43 +284,41 @@ entry_set_next_time (sched_entry_t * entry)
     entry->next_ctime = curr_ctime + lt_mktime (&_tm, false) - posix_time;
 }
 
+LOCAL void      entry_resume_post (void);
 
+/*
+ * [private] evaluate one slice of entry statement within quota, entry yielded by the statement is queued
+ * and resumed by posted task
+ * - resume: continue statement from entry->resume_addr
+ */
 LOCAL sched_errcode_t ICACHE_FLASH_ATTR
-entry_run (sched_entry_t * entry)
+entry_eval (sched_entry_t * entry, bool resume)
 {
-    entry->state = SCHED_ENTRY_STATE_RUNNING;
-
-    entry->last_ctime = lt_ctime ();
-    entry->run_count++;
-
     sched_errcode_t res = SCHED_ERR_SUCCESS;
-    size_t          varlen = 0;
-    char           *vardata = NULL;
-    dtlv_davp_t     davp;
-    dtlv_ctx_t      vd_ctx;
-
-    dtlv_ctx_init_decode (&vd_ctx, entry->vardata, entry->varlen);
-
-    if (dtlv_avp_decode (&vd_ctx, &davp) != DTLV_ERR_SUCCESS) {
-        res = SCHED_INTERNAL_ERROR;
-        goto run_fail;
-    }
-    if (davp.havpd.nscode.comp.code == SCHED_AVP_STMT_ARGUMENTS) {
-        vardata = davp.avp->data;
-        varlen = d_avp_data_length (davp.havpd.length);
-    }
-
     sh_hndlr_t      hstmt;
     sh_errcode_t    rres = stmt_get_ext2 (&entry->stmt_name, &hstmt);
     if (rres == SH_ERR_SUCCESS) {
         sh_eval_ctx_t   evctx;
         os_memset (&evctx, 0, sizeof (sh_eval_ctx_t));
-        rres = stmt_eval (hstmt, &evctx);
+        evctx.time_budget = sdata->conf.stmt_time_quota;
+        evctx.oper_budget = sdata->conf.stmt_oper_quota;
+        if (resume) {
+            evctx.addr = entry->resume_addr;
+            rres = stmt_resume (hstmt, &evctx);
+        }
+        else
+            rres = stmt_eval (hstmt, &evctx);
+
+        entry->resume_addr = evctx.addr;
     }
 
     switch (rres) {
     case SH_ERR_SUCCESS:
         break;
+    case SH_EVAL_YIELD:
+        entry->state = SCHED_ENTRY_STATE_QUEUE;
+        entry_resume_post ();
+        return res;
     case SH_STMT_NOT_EXISTS:
         d_log_wprintf (SCHED_SERVICE_NAME, sz_sched_error[SCHED_STMT_NOTEXISTS], entry->entry_name, entry->stmt_name);
         res = SCHED_STMT_NOTEXISTS;
@@ -332,6 +338,79 @@ entry_run (sched_entry_t * entry)
     return res;
 }
 
+LOCAL sched_errcode_t ICACHE_FLASH_ATTR
+entry_run (sched_entry_t * entry)
+{
+    // previous run is not finished yet, continue it instead of restart
+    if (entry->state == SCHED_ENTRY_STATE_QUEUE)
+        return entry_eval (entry, true);
+
+    entry->state = SCHED_ENTRY_STATE_RUNNING;
+
+    entry->last_ctime = lt_ctime ();
+    entry->run_count++;
+
+    sched_errcode_t res = SCHED_ERR_SUCCESS;
+    size_t          varlen = 0;
+    char           *vardata = NULL;
+    dtlv_davp_t     davp;
+    dtlv_ctx_t      vd_ctx;
+
+    dtlv_ctx_init_decode (&vd_ctx, entry->vardata, entry->varlen);
+
+    if (dtlv_avp_decode (&vd_ctx, &davp) != DTLV_ERR_SUCCESS) {
+        res = SCHED_INTERNAL_ERROR;
+        goto run_fail;
+    }
+    if (davp.havpd.nscode.comp.code == SCHED_AVP_STMT_ARGUMENTS) {
+        vardata = davp.avp->data;
+        varlen = d_avp_data_length (davp.havpd.length);
+    }
+
+    return entry_eval (entry, false);
+
+  run_fail:
+    entry->state = SCHED_ENTRY_STATE_FAILED;
+    entry->fail_count++;
+    return res;
+}
+
+#ifdef ARCH_XTENSA
+LOCAL imdb_errcode_t ICACHE_FLASH_ATTR
+sched_forall_resume (imdb_fetch_obj_t * fobj, void *data)
+{
+    sched_entry_t  *entry = d_pointer_as (sched_entry_t, fobj->dataptr);
+
+    if (entry->state == SCHED_ENTRY_STATE_QUEUE)
+        entry_eval (entry, true);
+
+    return IMDB_ERR_SUCCESS;
+}
+
+/*
+ * [private] posted task, continue every queued entry by one slice
+ */
+LOCAL void      ICACHE_FLASH_ATTR
+entry_resume_task (void *args)
+{
+    if (!sdata)
+        return;
+
+    sdata->resume_posted = false;
+    imdb_class_forall (sdata->svcres->hmdb, sdata->hentry, NULL, sched_forall_resume);
+}
+#endif
+
+LOCAL void      ICACHE_FLASH_ATTR
+entry_resume_post (void)
+{
+    if (sdata->resume_posted)
+        return;
+#ifdef ARCH_XTENSA
+    // when not posted, queued entry is continued by its next run
+    sdata->resume_posted = system_post_delayed_cb (entry_resume_task, NULL);
+#endif
+}
 
 LOCAL void      next_timer_timeout (void *args);
 
@@ -428,42 +507,6 @@ next_timer_timeout (void *args)
     sched_setall_next_time (false);
 }
 
-typedef struct sched_find_ctx_s {
-    const char     *entry_name;
-    sched_entry_t  *entry;
-    sched_entry_source_t *entry_src;
-} sched_find_ctx_t;
-
-/*
- * [private] imdb forall callback
- */
-LOCAL imdb_errcode_t ICACHE_FLASH_ATTR
-sched_forall_find (imdb_fetch_obj_t * fobj, void *data)
-{
-    sched_entry_t  *entry = d_pointer_as (sched_entry_t, fobj->dataptr);
-    sched_find_ctx_t *find_ctx = d_pointer_as (sched_find_ctx_t, data);
-    if (os_strncmp (entry->entry_name, find_ctx->entry_name, sizeof (entry_name_t)) == 0) {
-        find_ctx->entry = entry;
-        return IMDB_CURSOR_BREAK;
-    }
-    return IMDB_ERR_SUCCESS;
-}
-
-/*
- * [private] imdb forall callback
- */
-LOCAL imdb_errcode_t ICACHE_FLASH_ATTR
-sched_forall_find_src (imdb_fetch_obj_t * fobj, void *data)
-{
-    sched_entry_source_t *entry_src = d_pointer_as (sched_entry_source_t, fobj->dataptr);
-    sched_find_ctx_t *find_ctx = d_pointer_as (sched_find_ctx_t, data);
-    if (os_strncmp (entry_src->name, find_ctx->entry_name, sizeof (entry_name_t)) == 0) {
-        find_ctx->entry_src = entry_src;
-        return IMDB_CURSOR_BREAK;
-    }
-    return IMDB_ERR_SUCCESS;
-}
-
 /*
  * [public] find task by name
  * - entry_name: entry name (safe to use char* and entry_name_t*)
@@ -472,14 +515,13 @@ sched_forall_find_src (imdb_fetch_obj_t * fobj, void *data)
 sched_errcode_t ICACHE_FLASH_ATTR
 sched_entry_get (const char *entry_name, sched_entry_t ** entry)
 {
-    sched_find_ctx_t find_ctx;
-    os_memset (&find_ctx, 0, sizeof (sched_find_ctx_t));
-    find_ctx.entry_name = entry_name;
+    imdb_fetch_obj_t fobj;
+    imdb_errcode_t  imdb_res =
+        imdb_index_find (sdata->svcres->hmdb, sdata->hentry, sdata->idx_entry, entry_name, &fobj);
+    if (imdb_res != IMDB_CURSOR_NO_DATA_FOUND)
+        d_sched_check_imdb_error (imdb_res);
 
-    d_sched_check_imdb_error (imdb_class_forall
-                              (sdata->svcres->hmdb, sdata->hentry, (void *) &find_ctx, sched_forall_find));
-
-    *entry = find_ctx.entry;
+    *entry = d_pointer_as (sched_entry_t, fobj.dataptr);
     return (*entry) ? SCHED_ERR_SUCCESS : SCHED_ENTRY_NOTEXISTS;
 }
 
@@ -491,14 +533,13 @@ sched_entry_get (const char *entry_name, sched_entry_t ** entry)
 sched_errcode_t ICACHE_FLASH_ATTR
 sched_entry_src_get (const char *entry_name, sched_entry_source_t ** entry_src)
 {
-    sched_find_ctx_t find_ctx;
-    os_memset (&find_ctx, 0, sizeof (sched_find_ctx_t));
-    find_ctx.entry_name = entry_name;
-
-    d_sched_check_imdb_error (imdb_class_forall
-                              (sdata->svcres->hfdb, sdata->hentry_src, (void *) &find_ctx, sched_forall_find_src));
+    imdb_fetch_obj_t fobj;
+    imdb_errcode_t  imdb_res =
+        imdb_index_find (sdata->svcres->hfdb, sdata->hentry_src, sdata->idx_entry_src, entry_name, &fobj);
+    if (imdb_res != IMDB_CURSOR_NO_DATA_FOUND)
+        d_sched_check_imdb_error (imdb_res);
 
-    *entry_src = find_ctx.entry_src;
+    *entry_src = d_pointer_as (sched_entry_source_t, fobj.dataptr);
     return (*entry_src) ? SCHED_ERR_SUCCESS : SCHED_ENTRY_SRC_NOTEXISTS;
 }
 
@@ -535,6 +576,7 @@ internal_entry_add (const char *entry_name, const char *sztsentry, const char *s
     os_memcpy (&entry->ts, &ts_entry, sizeof (tsentry_t));
     os_strncpy (entry->stmt_name, stmt_name, sizeof (sh_stmt_name_t));
     os_strncpy (entry->entry_name, entry_name, sizeof (entry_name_t));
+    d_sched_check_imdb_error (imdb_clsobj_insert_commit (sdata->svcres->hmdb, sdata->hentry, entry));
 
     dtlv_ctx_t      vd_ctx;
     d_sched_check_dtlv_error (dtlv_ctx_init_encode (&vd_ctx, entry->vardata, vd_len) || // MUST be the first AVP
@@ -594,7 +636,8 @@ sched_entry_add (const char *entry_name, bool persistent, const char *sztsentry,
                 entry_src->varlen = slen;
 
                 dtlv_ctx_t      ctx;
-                imdb_res = dtlv_ctx_init_encode (&ctx, entry_src->vardata, entry_src->varlen)
+                imdb_res = imdb_clsobj_insert_commit (sdata->svcres->hfdb, sdata->hentry_src, entry_src)
+                    || dtlv_ctx_init_encode (&ctx, entry_src->vardata, entry_src->varlen)
                     || dtlv_avp_encode_char (&ctx, SCHED_AVP_SCHEDULE_STRING, sztsentry)
                     || dtlv_avp_encode_nchar (&ctx, SCHED_AVP_STMT_NAME, sizeof (sh_stmt_name_t), stmt_name)
                     || dtlv_avp_encode_octets (&ctx, SCHED_AVP_STMT_ARGUMENTS, varlen, vardata);
@@ -662,6 +705,8 @@ sched_on_msg_info (dtlv_ctx_t * msg_out)
 {
     dtlv_avp_t     *gavp;
 
+    d_svcs_check_imdb_error (dtlv_avp_encode_uint32 (msg_out, SCHED_AVP_STMT_TIME_QUOTA, sdata->conf.stmt_time_quota) ||
+                             dtlv_avp_encode_uint16 (msg_out, SCHED_AVP_STMT_OPER_QUOTA, sdata->conf.stmt_oper_quota));
     d_svcs_check_imdb_error (((sdata->next_ctime != SCHED_NEXT_CTIME_NONE) ? dtlv_avp_encode_uint32 (msg_out,
                                                                                                      SCHED_AVP_NEXT_RUN_TIME,
                                                                                                      lt_time (&sdata->
@@ -717,7 +762,14 @@ sched_on_msg_entry_list (dtlv_ctx_t * msg_out)
 
     d_svcs_check_dtlv_error (dtlv_avp_encode_list (msg_out, 0, SCHED_AVP_ENTRY_SOURCE, DTLV_TYPE_OBJECT, &gavp));
     imdb_hndlr_t    hcur;
-    d_svcs_check_imdb_error (imdb_class_query (sdata->svcres->hfdb, sdata->hentry_src, PATH_NONE, &hcur));
+    // only fixed part is listed, copy it to fetch whole bulk from media
+    sched_entry_source_t proj[SCHED_FETCH_BULK_COUNT];
+    imdb_query_t    query;
+    os_memset (&query, 0, sizeof (imdb_query_t));
+    query.proj_length = sizeof (sched_entry_source_t);
+    query.proj_buffer = proj;
+    d_svcs_check_imdb_error (imdb_class_query_ext
+                             (sdata->svcres->hfdb, sdata->hentry_src, PATH_NONE, &query, &hcur));
 
     imdb_fetch_obj_t fobj[SCHED_FETCH_BULK_COUNT];
     uint16          rowcount;
@@ -847,6 +899,18 @@ sched_on_message (service_ident_t orig_id,
 svcs_errcode_t  ICACHE_FLASH_ATTR
 sched_on_cfgupd (dtlv_ctx_t * conf)
 {
+    os_memset (&sdata->conf, 0, sizeof (sched_conf_t));
+
+    sdata->conf.stmt_time_quota = SCHED_DEFAULT_STMT_TIME_QUOTA_US;
+    sdata->conf.stmt_oper_quota = SCHED_DEFAULT_STMT_OPER_QUOTA;
+
+    if (conf) {
+        dtlv_seq_decode_begin (conf, SCHED_SERVICE_ID);
+        dtlv_seq_decode_uint32 (SCHED_AVP_STMT_TIME_QUOTA, &sdata->conf.stmt_time_quota);
+        dtlv_seq_decode_uint16 (SCHED_AVP_STMT_OPER_QUOTA, &sdata->conf.stmt_oper_quota);
+        dtlv_seq_decode_end (conf);
+    }
+
     return SVCS_ERR_SUCCESS;
 }
 
@@ -923,6 +987,10 @@ sched_on_start (const svcs_resource_t * svcres, dtlv_ctx_t * conf)
 sizeof (sched_entry_t) };
     d_svcs_check_imdb_error (imdb_class_create (svcres->hmdb, &cdef, &(tmp_sdata->hentry))
         );
+    d_svcs_check_imdb_error (imdb_index_create
+                             (svcres->hmdb, tmp_sdata->hentry, d_offsetof (sched_entry_t, entry_name),
+                              sizeof (entry_name_t), KEY_TYPE_STRING, &tmp_sdata->idx_entry)
+        );
 
     if (svcres->hfdb) {
         imdb_class_find (svcres->hfdb, SCHED_IMDB_CLS_ENTRY_SRC, &(tmp_sdata->hentry_src));
@@ -933,6 +1001,10 @@ SCHED_ENTRY_SRC_STORAGE_PAGE_BLOCKS, sizeof (sched_entry_source_t) };
             d_svcs_check_imdb_error (imdb_class_create (svcres->hfdb, &cdef2, &(tmp_sdata->hentry_src))
                 );
         }
+        d_svcs_check_imdb_error (imdb_index_create
+                                 (svcres->hfdb, tmp_sdata->hentry_src, d_offsetof (sched_entry_source_t, name),
+                                  sizeof (entry_name_t), KEY_TYPE_STRING, &tmp_sdata->idx_entry_src)
+            );
     }
 
     sdata = tmp_sdata;
@@ -946,7 +1018,7 @@ SCHED_ENTRY_SRC_STORAGE_PAGE_BLOCKS, sizeof (sched_entry_source_t) };
     imdb_class_forall (sdata->svcres->hfdb, sdata->hentry_src, NULL, sched_forall_load);
     //sched_setall_next_time(true); do not set, wait ADJ_TIME event
 
-    return SVCS_ERR_SUCCESS;
+    return sched_on_cfgupd (conf);
 }
 
 svcs_errcode_t  ICACHE_FLASH_ATTR
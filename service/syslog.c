@@ -113,6 +113,7 @@ LOCAL svcs_errcode_t ICACHE_FLASH_ATTR
 syslog_on_msg_query (dtlv_ctx_t * msg_in, dtlv_ctx_t * msg_out)
 {
     uint16          rec_no = 0xFFFF;
+    uint16          limit = 0;
     if (msg_in) {
         dtlv_davp_t     davp;
         while (dtlv_avp_decode (msg_in, &davp) == DTLV_ERR_SUCCESS) {
@@ -123,6 +124,9 @@ syslog_on_msg_query (dtlv_ctx_t * msg_in, dtlv_ctx_t * msg_out)
             case SYSLOG_AVP_LOG_RECNO:
                 dtlv_avp_get_uint16 (&davp, &rec_no);
                 break;
+            case SYSLOG_AVP_LOG_LIMIT:
+                dtlv_avp_get_uint16 (&davp, &limit);
+                break;
             default:
                 continue;
             }
@@ -134,8 +138,17 @@ syslog_on_msg_query (dtlv_ctx_t * msg_in, dtlv_ctx_t * msg_out)
     d_svcs_check_imdb_error (dtlv_avp_encode_list (msg_out, 0, SYSLOG_AVP_LOG_ENTRY, DTLV_TYPE_OBJECT, &gavp));
 
     imdb_hndlr_t    hcur;
-
-    d_svcs_check_imdb_error (imdb_class_query (sdata->svcres->hmdb, sdata->hlogs, PATH_RECYCLE_SCAN_REW, &hcur));
+    imdb_query_t    query;
+    os_memset (&query, 0, sizeof (imdb_query_t));
+    query.pred_count = 1;
+    query.pred[0].offset = d_offsetof (syslog_logrec_t, rec_no);
+    query.pred[0].type = PRED_TYPE_UINT16;
+    query.pred[0].op = PRED_OP_LT;
+    query.pred[0].value.uval = rec_no;
+    query.row_limit = limit;
+
+    d_svcs_check_imdb_error (imdb_class_query_ext
+                             (sdata->svcres->hmdb, sdata->hlogs, PATH_RECYCLE_SCAN_REW, &query, &hcur));
 
     imdb_fetch_obj_t recs[LOG_FETCH_SIZE];
     uint16          rowcount;
@@ -148,23 +161,20 @@ syslog_on_msg_query (dtlv_ctx_t * msg_in, dtlv_ctx_t * msg_out)
             syslog_logrec_t *rec = d_pointer_as (syslog_logrec_t, recs[i].dataptr);
             //os_printf(" -- %u:%u %u - %u\n", i, rowcount, rec->rec_no, os_strlen(rec->vardata));
 
-            if (rec->rec_no < rec_no) {
-                if (d_ctx_left_size (msg_out) < DTLV_MIN_BUFFER_FIXED_LENGTH + os_strlen (rec->vardata)) {
-                    goto end_of_data;
-                }
-
-                dtlv_avp_t     *gavp_in;
-                d_svcs_check_imdb_error (dtlv_avp_encode_grouping (msg_out, 0, SYSLOG_AVP_LOG_ENTRY, &gavp_in) ||
-                                         dtlv_avp_encode_uint16 (msg_out, SYSLOG_AVP_LOG_RECNO, rec->rec_no) ||
-                                         dtlv_avp_encode_uint8 (msg_out, SYSLOG_AVP_LOG_SEVERITY, rec->severity) ||
-                                         dtlv_avp_encode_uint32 (msg_out, SYSLOG_AVP_LOG_TIMESTAMP,
-                                                                 lt_time (&rec->rec_ctime))
-                                         || dtlv_avp_encode_nchar (msg_out, COMMON_AVP_SERVICE_NAME,
-                                                                   sizeof (service_name_t), rec->service)
-                                         || dtlv_avp_encode_char (msg_out, SYSLOG_AVP_LOG_MESSAGE, rec->vardata)
-                                         || dtlv_avp_encode_group_done (msg_out, gavp_in));
-
+            if (d_ctx_left_size (msg_out) < DTLV_MIN_BUFFER_FIXED_LENGTH + os_strlen (rec->vardata)) {
+                goto end_of_data;
             }
+
+            dtlv_avp_t     *gavp_in;
+            d_svcs_check_imdb_error (dtlv_avp_encode_grouping (msg_out, 0, SYSLOG_AVP_LOG_ENTRY, &gavp_in) ||
+                                     dtlv_avp_encode_uint16 (msg_out, SYSLOG_AVP_LOG_RECNO, rec->rec_no) ||
+                                     dtlv_avp_encode_uint8 (msg_out, SYSLOG_AVP_LOG_SEVERITY, rec->severity) ||
+                                     dtlv_avp_encode_uint32 (msg_out, SYSLOG_AVP_LOG_TIMESTAMP,
+                                                             lt_time (&rec->rec_ctime))
+                                     || dtlv_avp_encode_nchar (msg_out, COMMON_AVP_SERVICE_NAME,
+                                                               sizeof (service_name_t), rec->service)
+                                     || dtlv_avp_encode_char (msg_out, SYSLOG_AVP_LOG_MESSAGE, rec->vardata)
+                                     || dtlv_avp_encode_group_done (msg_out, gavp_in));
         }
 
         d_svcs_check_imdb_error (imdb_class_fetch (hcur, LOG_FETCH_SIZE, &rowcount, recs));
@@ -202,7 +212,7 @@ syslog_query (imdb_hndlr_t * hcur)
         return SVCS_NOT_RUN;
     }
 
-    imdb_errcode_t  ret = imdb_class_query (sdata->svcres->hmdb, sdata->hlogs, true, hcur);
+    imdb_errcode_t  ret = imdb_class_query (sdata->svcres->hmdb, sdata->hlogs, PATH_RECYCLE_SCAN, hcur);
     d_svcs_check_imdb_error (ret);
 
     return SVCS_ERR_SUCCESS;
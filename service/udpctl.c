@@ -59,7 +59,10 @@
 #define UDPCTL_STORAGE_PAGES		1
 #define UDPCTL_STORAGE_PAGE_BLOCKS	1
 #define UDPCTL_MESSAGE_SIZE		1440    // should less than 1472, seems depends from MTU
-#define UDPCTL_CLIENTS_MAX		4
+#define UDPCTL_STREAM_SIZE		4096    // streamed answer buffer, allocated per request
+#define UDPCTL_CLIENTS_MAX		16
+#define UDPCTL_CLIENT_MAP_SIZE		32      // open addressed (ip, port) map, power of 2 and at least 2 * UDPCTL_CLIENTS_MAX
+#define UDPCTL_WHEEL_SIZE		64      // expiry wheel slots (one per second), power of 2
 
 /*
  * UDPCTL Configuration
@@ -89,13 +92,18 @@ typedef struct udpctl_conf_s {
 typedef struct udpctl_data_s {
     const svcs_resource_t *svcres;
     uint8           client_count;
+    uint8           client_free;        // free slots list head: slot index + 1, 0 - none
+    os_time_t       wheel_time; // last expiry wheel sweep time
     ip_conn_t       srvconn;
 #ifdef ARCH_XTENSA
     esp_udp         srvudp;
     os_timer_t      surveillance_timer;
 #endif
     udpctl_client_t clients[UDPCTL_CLIENTS_MAX];
+    uint8           client_map[UDPCTL_CLIENT_MAP_SIZE]; // slot index + 1, 0 - empty
+    uint8           wheel[UDPCTL_WHEEL_SIZE];   // expiry wheel list heads: slot index + 1, 0 - empty
     udpctl_conf_t   conf;
+    HMACKeyContext  hmac_key;   // secret key schedule, updated with configuration
 } udpctl_data_t;
 
 LOCAL udpctl_data_t *sdata = NULL;
@@ -111,6 +119,8 @@ typedef struct udpctl_msgctx_s {
     dtlv_ctx_t      decoder_in;
     size_t          length_in;
     size_t          length_out;
+    udpctl_send_func send_func; // stream answer fragments, when not NULL
+    void           *send_arg;
 } udpctl_msgctx_t;
 
 LOCAL const char *sz_udpctl_error[] RODATA = {
@@ -130,31 +140,166 @@ LOCAL const char *sz_udpctl_error[] RODATA = {
 };
 
 
-LOCAL bool      ICACHE_FLASH_ATTR
-udpctl_cli_check_state (udpctl_client_t * cli, os_time_t curr_time)
+#define d_udpctl_client_idx(cli)	((uint8) ((cli) - sdata->clients) + 1)
+#define d_udpctl_client_ptr(idx)	(&sdata->clients[(idx) - 1])
+
+/*
+ * [private] Client state timeout in seconds
+ */
+LOCAL os_time_t ICACHE_FLASH_ATTR
+udpctl_cli_timeout (udpctl_client_t * cli)
 {
-    os_time_t       timeout;
     switch (cli->state) {
+    case UCTL_CLNT_STATE_NONE:
     case UCTL_CLNT_STATE_AUTH:
-        timeout = sdata->conf.auth_tx;
-        break;
+        return sdata->conf.auth_tx;
     case UCTL_CLNT_STATE_OPEN:
-        timeout = sdata->conf.idle_tx;
-        break;
-    case UCTL_CLNT_STATE_NONE:
-        return false;
+        return sdata->conf.idle_tx;
     default:
-        timeout = sdata->conf.recycle_tx;
+        return sdata->conf.recycle_tx;
+    }
+}
+
+/*
+ * [private] Client map home position for addr:ip, multiplicative (Fibonacci) hashing
+ */
+LOCAL uint8     ICACHE_FLASH_ATTR
+udpctl_client_hash (ip_port_t remote_port, ipv4_addr_t * remote_ip)
+{
+    uint32          hash = (remote_ip->addr ^ ((uint32) remote_port << 16 | remote_port)) * 0x9E3779B1;
+    return (hash >> 24) & (UDPCTL_CLIENT_MAP_SIZE - 1);
+}
+
+/*
+ * [private] Find client map position for addr:ip, linear probing
+ *  - remote_port: Client Port
+ *  - remote_ip: Client IP Address
+ *  - return: position of the client or of the empty entry, where it should be placed
+ */
+LOCAL uint8     ICACHE_FLASH_ATTR
+udpctl_client_map_find (ip_port_t remote_port, ipv4_addr_t * remote_ip)
+{
+    uint8           pos = udpctl_client_hash (remote_port, remote_ip);
+    while (sdata->client_map[pos]) {
+        udpctl_client_t *cli = d_udpctl_client_ptr (sdata->client_map[pos]);
+        if ((cli->remote_ip.addr == remote_ip->addr) && (cli->remote_port == remote_port))
+            break;
+        pos = (pos + 1) & (UDPCTL_CLIENT_MAP_SIZE - 1);
     }
+    return pos;
+}
 
-    if (curr_time - cli->last_time > timeout) {
-        if (cli->state == UCTL_CLNT_STATE_TIMEOUT) {
-            cli->state = UCTL_CLNT_STATE_NONE;
-            return false;
+/*
+ * [private] Remove client map entry, shift back the probe chain instead of leaving tombstones
+ *  - pos: client map position
+ */
+LOCAL void      ICACHE_FLASH_ATTR
+udpctl_client_map_remove (uint8 pos)
+{
+    uint8           next = pos;
+    while (true) {
+        next = (next + 1) & (UDPCTL_CLIENT_MAP_SIZE - 1);
+        if (!sdata->client_map[next])
+            break;
+
+        udpctl_client_t *cli = d_udpctl_client_ptr (sdata->client_map[next]);
+        uint8           home = udpctl_client_hash (cli->remote_port, &cli->remote_ip);
+        // entry may move to the hole only when its home is not inside (pos, next]
+        if (((next - home) & (UDPCTL_CLIENT_MAP_SIZE - 1)) >= ((next - pos) & (UDPCTL_CLIENT_MAP_SIZE - 1))) {
+            sdata->client_map[pos] = sdata->client_map[next];
+            pos = next;
         }
-        cli->state = UCTL_CLNT_STATE_TIMEOUT;
     }
-    return true;
+    sdata->client_map[pos] = 0;
+}
+
+LOCAL void      ICACHE_FLASH_ATTR
+udpctl_wheel_unlink (udpctl_client_t * cli)
+{
+    uint8          *head = &sdata->wheel[cli->expire_time & (UDPCTL_WHEEL_SIZE - 1)];
+    if (cli->wheel_prev)
+        d_udpctl_client_ptr (cli->wheel_prev)->wheel_next = cli->wheel_next;
+    else if (*head == d_udpctl_client_idx (cli))
+        *head = cli->wheel_next;
+    if (cli->wheel_next)
+        d_udpctl_client_ptr (cli->wheel_next)->wheel_prev = cli->wheel_prev;
+    cli->wheel_prev = 0;
+    cli->wheel_next = 0;
+}
+
+/*
+ * [private] (Re)schedule client state check on the expiry wheel, by state and last activity time
+ */
+LOCAL void      ICACHE_FLASH_ATTR
+udpctl_wheel_schedule (udpctl_client_t * cli, os_time_t curr_time)
+{
+    udpctl_wheel_unlink (cli);
+    cli->expire_time = MAX (cli->last_time + udpctl_cli_timeout (cli) + 1, curr_time + 1);
+
+    uint8          *head = &sdata->wheel[cli->expire_time & (UDPCTL_WHEEL_SIZE - 1)];
+    cli->wheel_next = *head;
+    if (*head)
+        d_udpctl_client_ptr (*head)->wheel_prev = d_udpctl_client_idx (cli);
+    *head = d_udpctl_client_idx (cli);
+}
+
+/*
+ * [private] Release client slot to the free list
+ */
+LOCAL void      ICACHE_FLASH_ATTR
+udpctl_client_release (udpctl_client_t * cli)
+{
+    udpctl_wheel_unlink (cli);
+    udpctl_client_map_remove (udpctl_client_map_find (cli->remote_port, &cli->remote_ip));
+
+    cli->state = UCTL_CLNT_STATE_NONE;
+    cli->wheel_next = sdata->client_free;
+    sdata->client_free = d_udpctl_client_idx (cli);
+    sdata->client_count--;
+}
+
+/*
+ * [private] Sweep expiry wheel up to current time: expired clients go to TIMEOUT state,
+ *   timed out (or never authenticated) clients are released. Clients with later expire time
+ *   stay in the slot for the next wheel turn.
+ *  - curr_time: current time
+ */
+LOCAL void      ICACHE_FLASH_ATTR
+udpctl_wheel_sweep (os_time_t curr_time)
+{
+    os_time_t       steps = MIN (curr_time - sdata->wheel_time, UDPCTL_WHEEL_SIZE);
+    os_time_t       wtime = curr_time - steps;
+    while (steps--) {
+        wtime++;
+        uint8           idx = sdata->wheel[wtime & (UDPCTL_WHEEL_SIZE - 1)];
+        while (idx) {
+            udpctl_client_t *cli = d_udpctl_client_ptr (idx);
+            idx = cli->wheel_next;
+            if (cli->expire_time > curr_time)
+                continue;
+
+            if ((cli->state == UCTL_CLNT_STATE_TIMEOUT) || (cli->state == UCTL_CLNT_STATE_NONE)) {
+                udpctl_client_release (cli);
+            }
+            else {
+                cli->state = UCTL_CLNT_STATE_TIMEOUT;
+                udpctl_wheel_schedule (cli, curr_time);
+            }
+        }
+    }
+    sdata->wheel_time = curr_time;
+}
+
+/*
+ * [private] Reschedule client after request processing, release it when it has no state
+ */
+LOCAL void      ICACHE_FLASH_ATTR
+udpctl_client_update (udpctl_client_t * cli, os_time_t curr_time)
+{
+    if (cli->state == UCTL_CLNT_STATE_NONE)
+        udpctl_client_release (cli);
+    else
+        udpctl_wheel_schedule (cli, curr_time);
 }
 
 /*
@@ -162,57 +307,47 @@ udpctl_cli_check_state (udpctl_client_t * cli, os_time_t curr_time)
  *  - remote_port: Client Port
  *  - remote_ip: Client IP Address
  *  - cli: result pointer to udpctl_client_t slot
- *  - fupdate: update last time
+ *  - reuse_flag: reset existing client slot
  *  - curr_time: current time
  */
 LOCAL udpctl_errcode_t ICACHE_FLASH_ATTR
 udpctl_client_slot (ip_port_t remote_port, ipv4_addr_t * remote_ip, udpctl_client_t ** cli, bool reuse_flag,
                     os_time_t curr_time)
 {
-    int             i;
     *cli = NULL;
-    udpctl_client_t *cli_empty = NULL;
-    udpctl_client_t *cli_target = NULL;
-    for (i = 0; i < MIN (UDPCTL_CLIENTS_MAX, sdata->conf.clients_limit); i++) {
-        udpctl_client_t *cli0 = &sdata->clients[i];
-        if (!udpctl_cli_check_state (cli0, curr_time)) {
-            if ((!cli_empty) || (cli_empty->state != UCTL_CLNT_STATE_NONE))
-                cli_empty = cli0;
-            continue;
-        }
+    udpctl_wheel_sweep (curr_time);
 
-        if ((cli0->remote_ip.addr == remote_ip->addr) && (cli0->remote_port == remote_port)) {
-            cli_target = cli0;
+    uint8           pos = udpctl_client_map_find (remote_port, remote_ip);
+    udpctl_client_t *cli_target = NULL;
+    if (sdata->client_map[pos]) {
+        cli_target = d_udpctl_client_ptr (sdata->client_map[pos]);
+        if (!reuse_flag && (cli_target->state != UCTL_CLNT_STATE_NONE)) {
+            cli_target->last_time = curr_time;
+            *cli = cli_target;
+            return UDPCTL_ERR_SUCCESS;
         }
     }
-
-    if (cli_target && reuse_flag) {
-        cli_empty = cli_target;
-        cli_target = NULL;
-    }
-
-    if (cli_target) {
-        cli_target->last_time = curr_time;
-
-        *cli = cli_target;
-    }
-    else if (cli_empty) {
-        os_memset (cli_empty, 0, sizeof (udpctl_client_t));
-
-        cli_empty->state = UCTL_CLNT_STATE_NONE;
-        cli_empty->first_time = curr_time;
-        cli_empty->last_time = curr_time;
-        cli_empty->remote_ip.addr = remote_ip->addr;
-        cli_empty->remote_port = remote_port;
-
-        *cli = cli_empty;
-    }
     else {
-        return UDPCTL_CLIENTS_LIMIT_EXCEEDED;
+        if ((sdata->client_count >= MIN (UDPCTL_CLIENTS_MAX, sdata->conf.clients_limit)) || !sdata->client_free)
+            return UDPCTL_CLIENTS_LIMIT_EXCEEDED;
+
+        cli_target = d_udpctl_client_ptr (sdata->client_free);
+        sdata->client_free = cli_target->wheel_next;
+        sdata->client_count++;
+        sdata->client_map[pos] = d_udpctl_client_idx (cli_target);
+        cli_target->wheel_next = 0;
+        cli_target->remote_ip.addr = remote_ip->addr;
+        cli_target->remote_port = remote_port;
     }
-    d_assert (*cli, "client not NULL")
 
-        return UDPCTL_ERR_SUCCESS;
+    cli_target->state = UCTL_CLNT_STATE_NONE;
+    os_memset (cli_target->auth, 0, sizeof (udpctl_digest_t));
+    cli_target->first_time = curr_time;
+    cli_target->last_time = curr_time;
+    udpctl_wheel_schedule (cli_target, curr_time);
+
+    *cli = cli_target;
+    return UDPCTL_ERR_SUCCESS;
 }
 
 LOCAL udpctl_errcode_t ICACHE_FLASH_ATTR
@@ -224,15 +359,11 @@ udpctl_packet_check_digest (udpctl_client_t * client, udpctl_packet_sec_t * pack
     os_memcpy (digest_in, packet->digest, sizeof (udpctl_digest_t));
     os_memcpy (packet->digest, client->auth, sizeof (udpctl_digest_t));
 
-    hmac (SHA256, (unsigned char *) packet, length, sdata->conf.secret, sdata->conf.secret_len, digest_comp);
+    hmacKeyed (&sdata->hmac_key, (unsigned char *) packet, length, digest_comp);
 
     os_memcpy (packet->digest, digest_in, sizeof (udpctl_digest_t));
 
-    // HMAC before compare
-    hmac (SHA256, digest_comp, sizeof (udpctl_digest_t), sdata->conf.secret, sdata->conf.secret_len, digest_comp);
-    hmac (SHA256, digest_in, sizeof (udpctl_digest_t), sdata->conf.secret, sdata->conf.secret_len, digest_in);
-
-    if (os_strncmp ((char *) digest_comp, (char *) digest_in, sizeof (udpctl_digest_t)) == 0) {
+    if (hmacDigestCompare (digest_comp, digest_in, sizeof (udpctl_digest_t)) == 0) {
         return UDPCTL_ERR_SUCCESS;
     }
 
@@ -248,20 +379,18 @@ udpctl_packet_answer_digest (udpctl_client_t * client, udpctl_packet_sec_t * pac
         udpctl_packet_auth_t *auth_packet = d_pointer_as (udpctl_packet_auth_t, packet);
 
         udpctl_digest_t initial;
-#ifdef ARCH_XTENSA
         os_random_buffer (initial, sizeof (udpctl_digest_t));
-#endif
-        hmac (SHA256, initial, sizeof (udpctl_digest_t), sdata->conf.secret, sdata->conf.secret_len, auth_packet->auth);
+        hmacKeyed (&sdata->hmac_key, initial, sizeof (udpctl_digest_t), auth_packet->auth);
     }
 
     udpctl_digest_t digest_out;
     os_memcpy (packet->digest, req_auth, sizeof (udpctl_digest_t));
 
-    hmac (SHA256, (unsigned char *) packet, length, sdata->conf.secret, sdata->conf.secret_len, digest_out);
+    hmacKeyed (&sdata->hmac_key, (unsigned char *) packet, length, digest_out);
 
     os_memcpy (packet->digest, digest_out, sizeof (udpctl_digest_t));
 
-    if (client->state != UCTL_CLNT_STATE_FAIL)
+    if (client && (client->state != UCTL_CLNT_STATE_FAIL))
         // store as auth for next sequenced message
         os_memcpy (client->auth, digest_out, sizeof (udpctl_digest_t));
 
@@ -319,13 +448,11 @@ udpctl_notify_message (service_ident_t orig_id,
     if ((packet_out->flags & PACKET_FLAG_SECURED) == PACKET_FLAG_SECURED) {
         udpctl_packet_auth_t *packetsec_out = d_pointer_as (udpctl_packet_auth_t, packet_out);
         udpctl_digest_t initial;
-#ifdef ARCH_XTENSA
         os_random_buffer (initial, sizeof (udpctl_digest_t));
-#endif
-        hmac (SHA256, initial, sizeof (udpctl_digest_t), sdata->conf.secret, sdata->conf.secret_len, packetsec_out->auth);
+        hmacKeyed (&sdata->hmac_key, initial, sizeof (udpctl_digest_t), packetsec_out->auth);
 
         udpctl_digest_t digest_out;
-        hmac (SHA256, (unsigned char *) packet_out, length_out, sdata->conf.secret, sdata->conf.secret_len, digest_out);
+        hmacKeyed (&sdata->hmac_key, (unsigned char *) packet_out, length_out, digest_out);
         os_memcpy (packetsec_out->base_sec.digest, digest_out, sizeof (udpctl_digest_t));
     }
 
@@ -371,6 +498,61 @@ udpctl_answer_result (udpctl_msgctx_t * msgctx)
     return len;
 }
 
+/*
+ * [private] Split answer body into stream fragments and send them. Every fragment is digested
+ *   with the previous one (first - with request digest), the last digest is stored as client auth.
+ *  - msgctx: message processing context
+ *  - return: 0, nothing left to send
+ */
+LOCAL size_t    ICACHE_FLASH_ATTR
+udpctl_answer_stream (udpctl_msgctx_t * msgctx)
+{
+    size_t          hdrlen =
+        (msgctx->packet_out->flags & PACKET_FLAG_SECURED) ? sizeof (udpctl_packet_sec_t) : sizeof (udpctl_packet_t);
+    size_t          fragment_size = UDPCTL_MESSAGE_SIZE - hdrlen - sizeof (udpctl_fragment_t);
+    size_t          body_len = msgctx->encoder_out.datalen;
+    uint16          count = MAX (1, (body_len + fragment_size - 1) / fragment_size);
+
+    char            data_out[UDPCTL_MESSAGE_SIZE];
+    udpctl_packet_t *packet_out = d_pointer_as (udpctl_packet_t, data_out);
+    udpctl_fragment_t *fragment = d_pointer_add (udpctl_fragment_t, data_out, hdrlen);
+    udpctl_digest_t chain_digest;
+    if (msgctx->packet_out->flags & PACKET_FLAG_SECURED)
+        os_memcpy (chain_digest, d_pointer_as (udpctl_packet_sec_t, msgctx->packet_in)->digest,
+                   sizeof (udpctl_digest_t));
+
+    uint16          seq;
+    for (seq = 0; seq < count; seq++) {
+        size_t          offset = seq * fragment_size;
+        size_t          len = MIN (fragment_size, body_len - offset);
+
+        os_memcpy (data_out, msgctx->packet_out, hdrlen);
+        packet_out->flags |= PACKET_FLAG_STREAM | ((seq + 1 == count) ? PACKET_FLAG_FINAL : 0);
+        fragment->sequence = htobe16 (seq);
+        fragment->count = htobe16 (count);
+        os_memcpy (d_pointer_add (char, fragment, sizeof (udpctl_fragment_t)), msgctx->encoder_out.buf + offset, len);
+
+        len += hdrlen + sizeof (udpctl_fragment_t);
+        packet_out->length = htobe16 (len);
+        if (packet_out->flags & PACKET_FLAG_SECURED) {
+            udpctl_packet_answer_digest (msgctx->cli, d_pointer_as (udpctl_packet_sec_t, packet_out), len,
+                                         chain_digest);
+            os_memcpy (chain_digest, d_pointer_as (udpctl_packet_sec_t, packet_out)->digest, sizeof (udpctl_digest_t));
+        }
+
+        sint16          cres = msgctx->send_func (msgctx->send_arg, data_out, len);
+        if (cres) {
+            d_log_wprintf (UDPCTL_SERVICE_NAME, IPSTR ":%u fragment %u:%u sent failed:%u", IP2STR (&msgctx->raddr),
+                           msgctx->rport, seq, count, cres);
+            break;
+        }
+    }
+
+    d_log_dprintf (UDPCTL_SERVICE_NAME, IPSTR ":%u sent len:%u fragments:%u", IP2STR (&msgctx->raddr), msgctx->rport,
+                   body_len, count);
+    return 0;
+}
+
 /*
  * [private] Prepare ERR Response and send back
  *  - msgctx: message processing context
@@ -381,7 +563,8 @@ udpctl_answer_result (udpctl_msgctx_t * msgctx)
 LOCAL udpctl_errcode_t ICACHE_FLASH_ATTR
 udpctl_answer_err (udpctl_msgctx_t * msgctx, uint8 rescode, udpctl_errcode_t errcode, ...)
 {
-    msgctx->cli->state = UCTL_CLNT_STATE_FAIL;
+    if (msgctx->cli)
+        msgctx->cli->state = UCTL_CLNT_STATE_FAIL;
     msgctx->packet_out->flags |= PACKET_FLAG_ERROR;
 
     char            errmsg[128];
@@ -502,6 +685,98 @@ udpctl_init_message_context (udpctl_msgctx_t * msgctx, char *data_in, char *data
     return UDPCTL_ERR_SUCCESS;
 }
 
+/*
+ * [private] Decode Service-Message AVP: Message-Type must be first
+ *  - avp_msg: Service-Message AVP
+ *  - dtlv_ctx: result message decoder, positioned after Message-Type
+ *  - msgtype: result message type
+ *  - return: NULL when successed, otherwise error message
+ */
+LOCAL const char *ICACHE_FLASH_ATTR
+udpctl_srvmsg_decode (dtlv_davp_t * avp_msg, dtlv_ctx_t * dtlv_ctx, service_msgtype_t * msgtype)
+{
+    dtlv_ctx_init_decode (dtlv_ctx, avp_msg->avp->data, d_avp_data_length (avp_msg->havpd.length));
+
+    dtlv_davp_t     avp_msgtype;
+    if ((dtlv_avp_decode (dtlv_ctx, &avp_msgtype) != DTLV_ERR_SUCCESS) ||
+        (avp_msgtype.havpd.nscode.comp.code != COMMON_AVP_SVC_MESSAGE_TYPE))
+        return "AVP Message-Type must be first";
+    if (dtlv_avp_get_uint16 (&avp_msgtype, msgtype) != DTLV_ERR_SUCCESS)
+        return "AVP Message-Type is invalid";
+
+    return NULL;
+}
+
+/*
+ * [private] Dispatch one message of the batch and encode its Message-Result AVP:
+ *   Service-Message answer followed by Result-Code, Result-Ext-Code and Result-Message.
+ *   When the answer does not fit, it is replaced by the internal error result.
+ *  - msgctx: message processing context
+ *  - avp_msg: Service-Message AVP, namespace is the destination service (0 - packet Service-Id)
+ *  - return: UDPCTL_INTERNAL_ERROR when no room left for the result
+ */
+LOCAL udpctl_errcode_t ICACHE_FLASH_ATTR
+udpctl_srvmsg_batch_dispatch (udpctl_msgctx_t * msgctx, dtlv_davp_t * avp_msg)
+{
+    service_ident_t serv_id = avp_msg->havpd.nscode.comp.namespace_id;
+    if (!serv_id)
+        serv_id = htobe16 (msgctx->packet_in->service_id);
+    dtlv_ctx_t     *encoder = &msgctx->encoder_out;
+    dtlv_size_t     mark = encoder->datalen;
+
+    dtlv_ctx_t      dtlv_ctx;
+    service_msgtype_t msgtype;
+    const char     *errmsg = udpctl_srvmsg_decode (avp_msg, &dtlv_ctx, &msgtype);
+
+    dtlv_avp_t     *gavp;
+    dtlv_avp_t     *gavp_srv;
+    svcs_errcode_t  ret = SVCS_ERR_SUCCESS;
+    if (dtlv_avp_encode_grouping (encoder, 0, UDPCTL_AVP_MESSAGE_RESULT, &gavp)
+        || dtlv_avp_encode_grouping (encoder, serv_id, COMMON_AVP_SVC_MESSAGE, &gavp_srv))
+        goto internal_error;
+
+    if (!errmsg)
+        ret = svcctl_service_message (UDPCTL_SERVICE_ID, serv_id, msgctx, msgtype, &dtlv_ctx, encoder);
+
+    if (dtlv_avp_encode_group_done (encoder, gavp_srv))
+        goto internal_error;
+
+    if (errmsg) {
+        if (dtlv_avp_encode_uint8 (encoder, COMMON_AVP_RESULT_CODE, RESULT_CODE_COMMAND_ERROR)
+            || dtlv_avp_encode_uint8 (encoder, COMMON_AVP_RESULT_EXT_CODE, UDPCTL_INVALID_COMMAND)
+            || dtlv_avp_encode_char (encoder, COMMON_AVP_RESULT_MESSAGE, errmsg))
+            goto internal_error;
+    }
+    else if (ret == SVCS_ERR_SUCCESS) {
+        if (dtlv_avp_encode_uint8 (encoder, COMMON_AVP_RESULT_CODE, RESULT_CODE_SUCCESS))
+            goto internal_error;
+    }
+    else {
+        if (dtlv_avp_encode_uint8 (encoder, COMMON_AVP_RESULT_CODE, RESULT_CODE_SERVICE_ERROR)
+            || dtlv_avp_encode_uint8 (encoder, COMMON_AVP_RESULT_EXT_CODE, ret))
+            goto internal_error;
+    }
+
+    if (dtlv_avp_encode_group_done (encoder, gavp) == DTLV_ERR_SUCCESS)
+        return UDPCTL_ERR_SUCCESS;
+
+  internal_error:
+    // drop partial answer, keep only the message result
+    encoder->datalen = mark;
+    dtlv_ctx_reset_encode (encoder);
+    if (dtlv_avp_encode_grouping (encoder, 0, UDPCTL_AVP_MESSAGE_RESULT, &gavp)
+        || dtlv_avp_encode_grouping (encoder, serv_id, COMMON_AVP_SVC_MESSAGE, &gavp_srv)
+        || dtlv_avp_encode_group_done (encoder, gavp_srv)
+        || dtlv_avp_encode_uint8 (encoder, COMMON_AVP_RESULT_CODE, RESULT_CODE_INTERNAL_ERROR)
+        || dtlv_avp_encode_group_done (encoder, gavp)) {
+        encoder->datalen = mark;
+        dtlv_ctx_reset_encode (encoder);
+        return UDPCTL_INTERNAL_ERROR;
+    }
+
+    return UDPCTL_ERR_SUCCESS;
+}
+
 
 #define d_udpctl_answer_dtlv_error(expr)	\
 	{	\
@@ -514,9 +789,15 @@ udpctl_init_message_context (udpctl_msgctx_t * msgctx, char *data_in, char *data
 	}
 
 
-udpctl_errcode_t ICACHE_FLASH_ATTR
-udpctl_sync_request (ipv4_addr_t * addr, ip_port_t * port, char *data_in, packet_size_t length_in, char *data_out,
-                     packet_size_t * length_out)
+/*
+ * [private] Process request and prepare answer
+ *  - data_out: answer buffer, its length is the answer body limit
+ *  - length_out: answer buffer length, result answer length (0 - when answer was streamed)
+ *  - send_func: when not NULL, answer is sent by stream fragments
+ */
+LOCAL udpctl_errcode_t ICACHE_FLASH_ATTR
+udpctl_request (ipv4_addr_t * addr, ip_port_t * port, char *data_in, packet_size_t length_in, char *data_out,
+                packet_size_t * length_out, udpctl_send_func send_func, void *send_arg)
 {
     if (!sdata) {
         d_log_eprintf (UDPCTL_SERVICE_NAME, "not started");
@@ -529,6 +810,8 @@ udpctl_sync_request (ipv4_addr_t * addr, ip_port_t * port, char *data_in, packet
     os_memcpy (&msgctx.rport, port, sizeof (ip_port_t));
     os_memcpy (&msgctx.raddr, addr, sizeof (ipv4_addr_t));
     msgctx.curr_time = lt_ctime ();
+    msgctx.send_func = send_func;
+    msgctx.send_arg = send_arg;
 
     res = udpctl_init_message_context (&msgctx, data_in, data_out, length_in, *length_out);
     if (res != UDPCTL_ERR_SUCCESS)
@@ -570,27 +853,11 @@ udpctl_sync_request (ipv4_addr_t * addr, ip_port_t * port, char *data_in, packet
             }
 
             dtlv_ctx_t      dtlv_ctx;
-            d_udpctl_answer_dtlv_error (dtlv_ctx_init_decode
-                                        (&dtlv_ctx, avp_array[0].avp->data,
-                                         d_avp_data_length (avp_array[0].havpd.length)));
-
             service_msgtype_t msgtype;
-            {
-                dtlv_davp_t     avp_msgtype;
-                if ((dtlv_avp_decode (&dtlv_ctx, &avp_msgtype) != DTLV_ERR_SUCCESS) ||
-                    (avp_msgtype.havpd.nscode.comp.code != COMMON_AVP_SVC_MESSAGE_TYPE)
-                    ) {
-                    d_udpctl_check_udpctl_error (udpctl_answer_err
-                                                 (&msgctx, RESULT_CODE_COMMAND_ERROR, res,
-                                                  "AVP Message-Type must be first"));
-                    goto answer_result;
-                }
-                if (dtlv_avp_get_uint16 (&avp_msgtype, &msgtype) != DTLV_ERR_SUCCESS) {
-                    d_udpctl_check_udpctl_error (udpctl_answer_err
-                                                 (&msgctx, RESULT_CODE_COMMAND_ERROR, res,
-                                                  "AVP Message-Type is invalid"));
-                    goto answer_result;
-                }
+            const char     *errmsg = udpctl_srvmsg_decode (&avp_array[0], &dtlv_ctx, &msgtype);
+            if (errmsg) {
+                d_udpctl_check_udpctl_error (udpctl_answer_err (&msgctx, RESULT_CODE_COMMAND_ERROR, res, errmsg));
+                goto answer_result;
             }
 
             res = UDPCTL_ERR_SUCCESS;
@@ -615,6 +882,41 @@ udpctl_sync_request (ipv4_addr_t * addr, ip_port_t * port, char *data_in, packet
             }
         }
         break;
+    case UCTL_CMD_CODE_SRVMSG_BATCH:
+        {
+            // keep room for the closing Result-Code and Result-Ext-Code
+            dtlv_size_t     reserved = 2 * d_avp_full_length (sizeof (uint32));
+            msgctx.encoder_out.buflen -= reserved;
+
+            dtlv_davp_t     avp_msg;
+            dtlv_errcode_t  dres;
+            while ((dres = dtlv_avp_decode (&msgctx.decoder_in, &avp_msg)) == DTLV_ERR_SUCCESS) {
+                if (avp_msg.havpd.nscode.comp.code != COMMON_AVP_SVC_MESSAGE)
+                    continue;
+                if (udpctl_srvmsg_batch_dispatch (&msgctx, &avp_msg) != UDPCTL_ERR_SUCCESS)
+                    break;
+            }
+            msgctx.encoder_out.buflen += reserved;
+
+            // messages are answered up to the first malformed one or until the answer is full
+            if (dres == DTLV_END_OF_DATA) {
+                d_udpctl_check_dtlv_error (dtlv_avp_encode_uint8
+                                           (&msgctx.encoder_out, COMMON_AVP_RESULT_CODE, RESULT_CODE_SUCCESS));
+            }
+            else if (dres == DTLV_ERR_SUCCESS) {
+                d_udpctl_check_dtlv_error (dtlv_avp_encode_uint8
+                                           (&msgctx.encoder_out, COMMON_AVP_RESULT_CODE, RESULT_CODE_INTERNAL_ERROR)
+                                           || dtlv_avp_encode_uint8 (&msgctx.encoder_out, COMMON_AVP_RESULT_EXT_CODE,
+                                                                     UDPCTL_INTERNAL_ERROR));
+            }
+            else {
+                d_udpctl_check_dtlv_error (dtlv_avp_encode_uint8
+                                           (&msgctx.encoder_out, COMMON_AVP_RESULT_CODE, RESULT_CODE_PROTOCOL_ERROR)
+                                           || dtlv_avp_encode_uint8 (&msgctx.encoder_out, COMMON_AVP_RESULT_EXT_CODE,
+                                                                     UDPCTL_DECODING_ERROR));
+            }
+        }
+        break;
     case UCTL_CMD_CODE_AUTH:
         if ((serv_id == UDPCTL_SERVICE_ID) && (msgctx.cli->state == UCTL_CLNT_STATE_NONE)) {
             msgctx.cli->state = UCTL_CLNT_STATE_AUTH;
@@ -634,10 +936,73 @@ udpctl_sync_request (ipv4_addr_t * addr, ip_port_t * port, char *data_in, packet
     }
 
   answer_result:
-    *length_out = udpctl_answer_result (&msgctx);
+    if (!msgctx.send_func)
+        *length_out = udpctl_answer_result (&msgctx);
+    else if (res != UDPCTL_INTERNAL_ERROR)
+        *length_out = udpctl_answer_stream (&msgctx);
+    else
+        *length_out = 0;
+    if (msgctx.cli)
+        udpctl_client_update (msgctx.cli, msgctx.curr_time);
     return res;
 }
 
+udpctl_errcode_t ICACHE_FLASH_ATTR
+udpctl_sync_request (ipv4_addr_t * addr, ip_port_t * port, char *data_in, packet_size_t length_in, char *data_out,
+                     packet_size_t * length_out)
+{
+    return udpctl_request (addr, port, data_in, length_in, data_out, length_out, NULL, NULL);
+}
+
+/*
+ * [public] Process request and send answer. Answer to request with STREAM flag is built in
+ *   UDPCTL_STREAM_SIZE buffer and sent by fragments, otherwise as single message.
+ *  - send_func: datagram sender
+ *  - send_arg: sender argument
+ */
+udpctl_errcode_t ICACHE_FLASH_ATTR
+udpctl_stream_request (ipv4_addr_t * addr, ip_port_t * port, char *data_in, packet_size_t length_in,
+                       udpctl_send_func send_func, void *send_arg)
+{
+    udpctl_errcode_t res;
+    udpctl_packet_t *packet_in = d_pointer_as (udpctl_packet_t, data_in);
+    char           *data_out = NULL;
+    if (data_in && (length_in >= sizeof (udpctl_packet_t)) && (packet_in->flags & PACKET_FLAG_STREAM)
+        && (packet_in->code != UCTL_CMD_CODE_AUTH))
+        data_out = os_malloc (UDPCTL_STREAM_SIZE);
+
+    if (data_out) {
+        packet_size_t   length_out = UDPCTL_STREAM_SIZE;
+        res = udpctl_request (addr, port, data_in, length_in, data_out, &length_out, send_func, send_arg);
+        os_free (data_out);
+        return res;
+    }
+
+    // not streamed or no memory for stream buffer
+    packet_size_t   length_out = UDPCTL_MESSAGE_SIZE;
+    char            data_out1[UDPCTL_MESSAGE_SIZE];
+    res = udpctl_request (addr, port, data_in, length_in, data_out1, &length_out, NULL, NULL);
+    if (res != UDPCTL_INTERNAL_ERROR) {
+        d_log_dprintf (UDPCTL_SERVICE_NAME, IPSTR ":%u sent len:%u", IP2STR (addr), *port, length_out);
+
+        sint16          cres = send_func (send_arg, data_out1, length_out);
+        if (cres)
+            d_log_wprintf (UDPCTL_SERVICE_NAME, IPSTR ":%u sent failed:%u", IP2STR (addr), *port, cres);
+    }
+
+    return res;
+}
+
+LOCAL sint16    ICACHE_FLASH_ATTR
+uctl_send (void *arg, char *data, packet_size_t length)
+{
+#ifdef ARCH_XTENSA
+    return espconn_sendto (d_pointer_as (struct espconn, arg), (uint8 *) data, length);
+#else
+    return os_conn_sent (d_pointer_as (ip_conn_t, arg), data, length);
+#endif
+}
+
 LOCAL void      ICACHE_FLASH_ATTR
 uctl_recv_cb (void *arg, char *pusrdata, unsigned short length)
 {
@@ -649,19 +1014,18 @@ uctl_recv_cb (void *arg, char *pusrdata, unsigned short length)
     ip_port_t       port = con_info->remote_port;
     os_memcpy (addr.bytes, con_info->remote_ip, sizeof (ipv4_addr_t));
 
-    packet_size_t   length_out = UDPCTL_MESSAGE_SIZE;
-    char            data_out[UDPCTL_MESSAGE_SIZE];
+    os_memcpy (conn->proto.udp->remote_ip, addr.bytes, sizeof (ipv4_addr_t));
+    conn->proto.udp->remote_port = port;
 
-    udpctl_errcode_t res = udpctl_sync_request (&addr, &port, pusrdata, length, data_out, &length_out);
-    if (res != UDPCTL_INTERNAL_ERROR) {
-        d_log_dprintf (UDPCTL_SERVICE_NAME, IPSTR ":%u sent len:%u", IP2STR (&addr), port, length_out);
+    udpctl_stream_request (&addr, &port, pusrdata, length, uctl_send, conn);
+#else
+    ip_conn_t      *conn = d_pointer_as (ip_conn_t, arg);
+    ipv4_addr_t     addr;
+    ip_port_t       port;
+    os_conn_remote_addr (conn, &addr);
+    os_conn_remote_port (conn, &port);
 
-        os_memcpy (conn->proto.udp->remote_ip, addr.bytes, sizeof (ipv4_addr_t));
-        conn->proto.udp->remote_port = port;
-        sint16          cres = espconn_sendto (conn, (uint8 *) data_out, length_out);
-        if (cres)
-            d_log_wprintf (UDPCTL_SERVICE_NAME, IPSTR ":%u sent failed:%u", IP2STR (&addr), port, cres);
-    }
+    udpctl_stream_request (&addr, &port, pusrdata, length, uctl_send, conn);
 #endif
 }
 
@@ -677,12 +1041,19 @@ udpctl_setup (void)
     sdata->srvconn.type = ESPCONN_UDP;
     sdata->srvconn.proto.udp = &sdata->srvudp;
     sdata->srvudp.local_port = sdata->conf.port;
+#else
+    if (sdata->srvconn.local_port)
+        os_conn_free (&sdata->srvconn);
+
+    sdata->srvconn.local_port = sdata->conf.port;
+#endif
     d_log_iprintf (UDPCTL_SERVICE_NAME, "listen port:%u, secret length:%u", sdata->conf.port, sdata->conf.secret_len);
     if (os_conn_create (&sdata->srvconn) || os_conn_set_recvcb (&sdata->srvconn, uctl_recv_cb)) {
         d_log_eprintf (UDPCTL_SERVICE_NAME, "conn setup failed");
         return;
     }
 
+#ifdef ARCH_XTENSA
     os_timer_disarm (&sdata->surveillance_timer);
     if ((sdata->conf.ntfaddr.addr != IPADDR_NONE) && sdata->conf.ntfaddr_port) {
         d_log_iprintf (UDPCTL_SERVICE_NAME, "ntfaddr" IPSTR ":%u surv.tx:%u", IP2STR (&sdata->conf.ntfaddr), sdata->conf.ntfaddr_port, sdata->conf.surveillance_tx);
@@ -703,6 +1074,13 @@ udpctl_on_start (const svcs_resource_t * svcres, dtlv_ctx_t * conf)
         );
     os_memset (sdata, 0, sizeof (udpctl_data_t));
     sdata->svcres = svcres;
+    sdata->wheel_time = lt_ctime ();
+
+    uint8           i;
+    for (i = UDPCTL_CLIENTS_MAX; i > 0; i--) {
+        sdata->clients[i - 1].wheel_next = sdata->client_free;
+        sdata->client_free = i;
+    }
 
 #ifdef ARCH_XTENSA
     os_timer_disarm (&sdata->surveillance_timer);
@@ -722,9 +1100,9 @@ udpctl_on_stop ()
 
 #ifdef ARCH_XTENSA
     os_timer_disarm (&sdata->surveillance_timer);
+#endif
     if (os_conn_free (&sdata->srvconn))
         d_log_eprintf (UDPCTL_SERVICE_NAME, "conn free error");
-#endif
     d_svcs_check_imdb_error (imdb_clsobj_delete (sdata->svcres->hmdb, sdata->svcres->hdata, sdata));
 
     sdata = NULL;
@@ -743,8 +1121,10 @@ udpctl_on_msg_info (dtlv_ctx_t * msg_out)
                              || dtlv_avp_encode_uint16 (msg_out, UDPCTL_AVP_SURVEILLANCE_TIMEOUT, sdata->conf.surveillance_tx)
                              || dtlv_avp_encode_list (msg_out, 0, UDPCTL_AVP_CLIENT, DTLV_TYPE_OBJECT, &gavp));
 
+    udpctl_wheel_sweep (lt_ctime ());
+
     int             i;
-    for (i = 0; i < MIN (UDPCTL_CLIENTS_MAX, sdata->conf.clients_limit); i++) {
+    for (i = 0; i < UDPCTL_CLIENTS_MAX; i++) {
         if (sdata->clients[i].state == UCTL_CLNT_STATE_NONE)
             continue;
 
@@ -839,9 +1219,14 @@ udpctl_on_cfgupd (dtlv_ctx_t * conf)
         }
     }
 
+    // ipad/opad states are hashed once per secret
+    hmacKeyReset (&sdata->hmac_key, SHA256, sdata->conf.secret, sdata->conf.secret_len);
+
 #ifdef ARCH_XTENSA
     if (!system_post_delayed_cb (task_udpctl_setup, NULL))
         d_log_eprintf (UDPCTL_SERVICE_NAME, "task setup failed");
+#else
+    udpctl_setup ();
 #endif
 
     return SVCS_ERR_SUCCESS;
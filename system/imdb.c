@@ -46,6 +46,14 @@
 // used only with variable storages
 #define IMDB_SLOT_SKIP_COUNT_MAX	16
 
+// count of segregated free list buckets for variable storages with Tx (Type#4), bucket N holds blocks with the
+// largest free slot in [2^N, 2^(N+1)) block units, the last bucket is unbounded
+#define IMDB_SLOT_BUCKETS		8
+#define IMDB_SLOT_BUCKET_NONE		0xFF
+
+#define IMDB_INDEX_ID_NONE		0xFF
+#define IMDB_INDEX_SLOT_DELETED		0xFFFF
+
 #define	IMDB_SERVICE_NAME		"imdb"
 
 #define d_obj2hndlr(obj)		(imdb_hndlr_t) (obj)
@@ -102,8 +110,11 @@ typedef union block_ptr_u {
 
 typedef struct imdb_bc_block_s {
     struct imdb_block_s *mptr;  // pointer to memory
-    uint32          wcnt;       // Fixme: No difference between read/write, used as a rcnt
-    uint32          rcnt;
+    size_t          block_addr; // cached block address, BLOCK_PTR_RAW_NONE for free buffer
+    struct imdb_bc_block_s *dirty_next; // dirty list ordered by block address
+    struct imdb_bc_block_s *dirty_prev;
+    uint32          wcnt;       // write lock count since last flush, block is dirty when not zero
+    uint32          rcnt;       // reference bit, cleared by CLOCK hand
 } imdb_bc_block_t;
 
 typedef struct imdb_bc_free_block_s {
@@ -124,6 +135,11 @@ typedef struct imdb_bc_s {
     uint8          *buffer_cache;
     size_t          bcmap_size;
     imdb_bc_free_block_t *bc_free_list;
+    imdb_bc_block_t *bc_blocks; // buffer descriptors, CLOCK ring in buffer order
+    uint32          bc_clock_hand;      // CLOCK replacement hand, index in bc_blocks
+    imdb_bc_block_t *bc_dirty_first;    // dirty list head (lowest block address)
+    uint32          compact_scn;        // file SCN when compaction found no movable page
+    size_t          ra_next;    // block address following the last cache miss
     char            bcmap[];
 } imdb_bc_t;
 
@@ -147,6 +163,11 @@ typedef enum imdb_lock_s {
 #define	d_stat_block_read(imdb)		{ (imdb)->stat.block_read++; }
 #define	d_stat_block_write(imdb)	{ (imdb)->stat.block_write++; }
 #define	d_stat_slot_coalesce(imdb)	{ (imdb)->stat.slot_coalesce++; }
+#define	d_stat_cache_hit(imdb)		{ (imdb)->stat.cache_hit++; }
+#define	d_stat_cache_miss(imdb)		{ (imdb)->stat.cache_miss++; }
+#define	d_stat_cache_evict(imdb)	{ (imdb)->stat.cache_evict++; }
+#define	d_stat_row_scan(imdb)		{ (imdb)->stat.row_scan++; }
+#define	d_stat_row_fetch(imdb)		{ (imdb)->stat.row_fetch++; }
 
 typedef enum imdb_data_slot_type_s {
     DATA_SLOT_TYPE_1 = 0,
@@ -155,16 +176,30 @@ typedef enum imdb_data_slot_type_s {
     DATA_SLOT_TYPE_4 = 3
 } imdb_data_slot_type_t;
 
+typedef struct imdb_index_s {
+    page_ptr_t      page;       // index page, BLOCK_PTR_RAW_NONE when index is not used
+    obj_size_t      key_offset;
+    uint8           key_len;
+    imdb_key_type_t key_type:8;
+    page_blocks_t   blocks;     // index page size in blocks
+    uint16          count;      // live entries
+    uint16          used;       // live and deleted entries
+} imdb_index_t;
+
 typedef struct imdb_class_s {
     imdb_class_def_t cdef;
     class_ptr_t     class_prev;
     class_ptr_t     class_next;
     page_ptr_t      page_last;
     page_ptr_t      page_fl_first;
+    block_ptr_t     fl_bucket[IMDB_SLOT_BUCKETS];       // segregated free lists of blocks (Type#4 only)
+    imdb_index_t    index[IMDB_CLASS_INDEX_MAX];        // secondary hash indexes
+    imdb_rowid_t    idx_pending;        // last inserted object, it is indexed by imdb_clsobj_insert_commit
     class_pages_t   page_count;
     obj_size_t      obj_bsize_min;
     imdb_data_slot_type_t ds_type:2;
-    uint8           reserved:6;
+    uint8           idx_count:2;
+    uint8           reserved:4;
 } imdb_class_t;
 
 
@@ -250,12 +285,39 @@ Free Slot (Footer used for variable length or with Tx)
 	  Slot Offset	- when data slot deleted, used to coalesce free slot area
 	  Skip Count	- used for variable length for migrate to the end of the LIFO Free-List
 
+Block Free-List Trailer (only for Type#4, reserved by block footer offset)
+
+       0 1 2 3 4 5 6 7 8 9 0 1 2 3 4 5 6 7 8 9 0 1 2 3 4 5 6 7 8 9 0 1
+      +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+      |                       Bucket Next Block                       |
+      +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+      |                       Bucket Prev Block                       |
+      +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+      |     Max Free Slot Length      |    Bucket     |   Reserved    |
+      +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+
+	  Blocks with free slots are linked into the class segregated free list by the length of the largest
+	  free slot, so the search skips whole blocks which can not hold the object.
+
+Index Entry (open addressing hash table, entries follow the block header in every block of index page)
+
+       0 1 2 3 4 5 6 7 8 9 0 1 2 3 4 5 6 7 8 9 0 1 2 3 4 5 6 7 8 9 0 1
+      +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+      |                        Object Block Id                        |
+      +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+      |       Object Slot Offset      |           Key Hash            |
+      +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+
+	  Index page is not linked into the class page list, it is referenced by class index definition.
+	  Empty entry has no block id, deleted entry has no block id and slot offset IMDB_INDEX_SLOT_DELETED.
+
 */
 
 typedef enum imdb_block_type_s {
     BLOCK_TYPE_NONE = 0,
     BLOCK_TYPE_PAGE = 1,
     BLOCK_TYPE_CLASS = 2,
+    BLOCK_TYPE_INDEX = 3,
 } imdb_block_type_t;
 
 #define SLOT_FLAG_FREE		1U
@@ -286,6 +348,12 @@ typedef enum imdb_block_type_s {
 			((class_block)->block.lock_flag = DATA_LOCK_NONE); \
 	}
 
+#define d_release_linked_block(imdb, class_block, linked_block) \
+	{ \
+		if ( ((imdb)->db_def.opt_media) && ((linked_block) != &(class_block)->block) ) \
+			((linked_block)->lock_flag = DATA_LOCK_NONE); \
+	}
+
 #define d_page_get_blockid_byidx(page_block, bidx, bsize) \
 	((page_block)->block.id.raw + (bidx-1)*(bsize))
 
@@ -311,6 +379,13 @@ typedef enum imdb_block_type_s {
 #define d_block_slot_free(block) \
 	( ((block)->free_offset)? d_pointer_add(imdb_slot_free_t, (block), d_bptr_size((block)->free_offset)): NULL)
 
+// check that class storage uses segregated free lists, IMDB_DISABLE_SLOT_BUCKETS keeps linear free slot walk
+#ifndef IMDB_DISABLE_SLOT_BUCKETS
+#define d_dstype_slot_bucketed(ds_type)		((ds_type) == DATA_SLOT_TYPE_4)
+#else
+#define d_dstype_slot_bucketed(ds_type)		((void) (ds_type), false)
+#endif
+
 // check that class slot has footer
 #define d_block_slot_has_footer(dbclass) 	((dbclass)->ds_type >= DATA_SLOT_TYPE_3)
 #define d_dstype_slot_has_footer(ds_type)	((ds_type) >= DATA_SLOT_TYPE_3)
@@ -360,6 +435,13 @@ typedef struct imdb_block_class_s {
     imdb_class_t    dbclass;
 } imdb_block_class_t;
 
+// first block of free page extent in media storage
+typedef struct imdb_block_free_s {
+    imdb_block_t    block;
+    size_t          fl_next;    // next free extent address
+    size_t          fl_blocks;  // extent size in blocks
+} imdb_block_free_t;
+
 //typedef       struct imdb_slot_data1_s {
 //} imdb_slot_data1_t;
 
@@ -392,12 +474,54 @@ typedef struct imdb_slot_free_s {
     uint16          length:14;
 } imdb_slot_free_t;
 
+typedef struct imdb_block_fl_s {
+    block_ptr_t     bucket_next;
+    block_ptr_t     bucket_prev;
+    uint16          slot_max;   // largest free slot length in block units
+    uint8           bucket;     // bucket index, IMDB_SLOT_BUCKET_NONE when block has no free slots
+    uint8           reserved;
+} imdb_block_fl_t;
+
+// return block Free-List Trailer
+#define d_block_fl_trailer(imdb, block) \
+	d_pointer_add(imdb_block_fl_t, (block), (imdb)->db_def.block_size - sizeof(imdb_block_fl_t))
+
+typedef struct imdb_index_entry_s {
+    size_t          block_id;   // object block, BLOCK_PTR_RAW_NONE for empty or deleted entry
+    uint16          slot_offset;        // object slot offset
+    uint16          hash;       // key hash
+} imdb_index_entry_t;
+
+#define d_index_block_entries(imdb) \
+	(((imdb)->db_def.block_size - sizeof (imdb_block_t)) / sizeof (imdb_index_entry_t))
+
+#define d_index_entry_byidx(block, eidx) \
+	d_pointer_add(imdb_index_entry_t, (block), sizeof (imdb_block_t) + (eidx) * sizeof (imdb_index_entry_t))
+
+// keep at least quarter of index entries empty
+#define d_index_used_limit(slots)	((slots) - ((slots) >> 2))
+
+#define d_index_entry_live(entry)	((entry)->block_id != BLOCK_PTR_RAW_NONE)
+#define d_index_entry_empty(entry)	(((entry)->block_id == BLOCK_PTR_RAW_NONE) && ((entry)->slot_offset != IMDB_INDEX_SLOT_DELETED))
+
+// return object data pointer by slot offset (Type#2, Type#4)
+#define d_slot_offset_dataptr(block, slot_offset) \
+	d_pointer_add(void, (block), d_bptr_size (slot_offset) + sizeof (imdb_slot_free_t))
+
+// release block lock regardless of block type
+#define d_unlock_block(imdb, block) \
+	{ \
+		if ((imdb)->db_def.opt_media) \
+			((block)->lock_flag = DATA_LOCK_NONE); \
+	}
+
 typedef struct imdb_cursor_s {
     imdb_t         *imdb;
     class_ptr_t     class;
     imdb_rowid_t    rowid_last;
     uint32          fetch_recs;
     imdb_access_path_t access_path;
+    imdb_query_t    query;
 } imdb_cursor_t;
 
 typedef struct imdb_free_slot_find_ctx_s {
@@ -418,11 +542,18 @@ LOCAL const obj_size_t data_slot_type_bsize[] = {
     d_size_bptr (sizeof (imdb_slot_data4_t) + sizeof (imdb_slot_footer_t)),
 };
 
+// imdb_pred_type_t, 0 - predicate length
+LOCAL const uint8 pred_type_size[] = { 1, 2, 4, 4, 0, 0 };
+
+#define d_pred_field_size(pred)	\
+	((pred_type_size[(pred)->type]) ? pred_type_size[(pred)->type] : (pred)->length)
+
 // imdb_block_type_t
 LOCAL const obj_size_t block_header_size[] = {
     sizeof (imdb_block_t),
     sizeof (imdb_block_page_t),
     sizeof (imdb_block_class_t),
+    sizeof (imdb_block_t),
 };
 
 // Insert Page into Class LIFO Free-List
@@ -508,6 +639,91 @@ imdb_block_slot_data_last (imdb_t * imdb, imdb_class_t * dbclass, imdb_block_t *
     }
 }
 
+#define d_bc_block_byptr(imdb_bc, mblock) \
+	(&(imdb_bc)->bc_blocks[d_pointer_diff ((mblock), (imdb_bc)->buffer_cache) / (imdb_bc)->base.db_def.block_size])
+
+/*
+[private] Find replacement victim by CLOCK policy. Locked blocks are skipped, referenced blocks get a second chance.
+  - imdb_bc:
+  - result: victim buffer descriptor or NULL when all blocks are locked
+*/
+LOCAL imdb_bc_block_t *ICACHE_FLASH_ATTR
+fdb_clock_victim (imdb_bc_t * imdb_bc)
+{
+    uint32          buffer_size = imdb_bc->base.db_def.buffer_size;
+    uint32          i;
+    // two sweeps are enough: the first one clears reference bits
+    for (i = 0; i < (buffer_size << 1); i++) {
+        imdb_bc_block_t *bc_block = &imdb_bc->bc_blocks[imdb_bc->bc_clock_hand];
+        imdb_bc->bc_clock_hand = (imdb_bc->bc_clock_hand + 1) % buffer_size;
+
+        if ((bc_block->block_addr == BLOCK_PTR_RAW_NONE) || (bc_block->mptr->lock_flag != DATA_LOCK_NONE))
+            continue;
+        if (!bc_block->rcnt)
+            return bc_block;
+        bc_block->rcnt = 0;
+    }
+
+    return NULL;
+}
+
+/*
+[private] Mark buffer as dirty. Dirty list is kept ordered by block address, so flush writes are sequential.
+  - imdb_bc:
+  - bc_block: buffer descriptor
+*/
+LOCAL void      ICACHE_FLASH_ATTR
+fdb_dirty_insert (imdb_bc_t * imdb_bc, imdb_bc_block_t * bc_block)
+{
+    imdb_bc_block_t *prev = NULL;
+    imdb_bc_block_t *next = imdb_bc->bc_dirty_first;
+    while (next && (next->block_addr < bc_block->block_addr)) {
+        prev = next;
+        next = next->dirty_next;
+    }
+
+    bc_block->dirty_prev = prev;
+    bc_block->dirty_next = next;
+    if (prev)
+        prev->dirty_next = bc_block;
+    else
+        imdb_bc->bc_dirty_first = bc_block;
+    if (next)
+        next->dirty_prev = bc_block;
+}
+
+/*
+[private] Remove buffer from dirty list
+  - imdb_bc:
+  - bc_block: buffer descriptor
+*/
+LOCAL void      ICACHE_FLASH_ATTR
+fdb_dirty_remove (imdb_bc_t * imdb_bc, imdb_bc_block_t * bc_block)
+{
+    if (bc_block->dirty_prev)
+        bc_block->dirty_prev->dirty_next = bc_block->dirty_next;
+    else
+        imdb_bc->bc_dirty_first = bc_block->dirty_next;
+    if (bc_block->dirty_next)
+        bc_block->dirty_next->dirty_prev = bc_block->dirty_prev;
+
+    bc_block->dirty_next = NULL;
+    bc_block->dirty_prev = NULL;
+}
+
+/*
+[private] Mark buffer as written under write lock, first write puts it into dirty list
+  - imdb_bc:
+  - bc_block: buffer descriptor
+*/
+INLINED void    ICACHE_FLASH_ATTR
+fdb_cache_setdirty (imdb_bc_t * imdb_bc, imdb_bc_block_t * bc_block)
+{
+    if (!bc_block->wcnt)
+        fdb_dirty_insert (imdb_bc, bc_block);
+    bc_block->wcnt++;
+}
+
 LOCAL imdb_errcode_t ICACHE_FLASH_ATTR
 fdb_cache_flush (imdb_bc_t * imdb_bc, imdb_bc_block_t * bc_block, size_t block_addr, bool fremove)
 {
@@ -524,6 +740,7 @@ fdb_cache_flush (imdb_bc_t * imdb_bc, imdb_bc_block_t * bc_block, size_t block_a
             d_log_cprintf (IMDB_SERVICE_NAME, sz_imdb_error[IMDB_FILE_WRITE_ERROR], block_addr, block_size, hres);
             return IMDB_FILE_WRITE_ERROR;
         }
+        fdb_dirty_remove (imdb_bc, bc_block);
         d_log_dprintf (IMDB_SERVICE_NAME, "fdb flush id=%p, block=%p", block_addr, bc_block->mptr);
     }
 
@@ -532,6 +749,7 @@ fdb_cache_flush (imdb_bc_t * imdb_bc, imdb_bc_block_t * bc_block, size_t block_a
         fl_block->fl_next_block = imdb_bc->bc_free_list;
         imdb_bc->bc_free_list = fl_block;
 
+        bc_block->block_addr = BLOCK_PTR_RAW_NONE;
         ih_hash8_remove (imdb_bc->hbcmap, (void *) &block_addr, 0);
     }
     else {
@@ -541,42 +759,180 @@ fdb_cache_flush (imdb_bc_t * imdb_bc, imdb_bc_block_t * bc_block, size_t block_a
     return IMDB_ERR_SUCCESS;
 }
 
-typedef struct fdb_lru_data_s {
-    size_t          rawid;
-    imdb_bc_block_t *candidate;
-} fdb_lru_data_t;
+/*
+[private] Take free buffer from the cache, the victim block is evicted when there are no free buffers
+  - imdb_bc:
+  - block_addr: block address to be loaded
+  - result: buffer pointer or NULL
+*/
+LOCAL imdb_block_t *ICACHE_FLASH_ATTR
+fdb_cache_buffer_get (imdb_bc_t * imdb_bc, size_t block_addr)
+{
+    if (!imdb_bc->bc_free_list) {
+        imdb_bc_block_t *victim = fdb_clock_victim (imdb_bc);
+        if (!victim) {
+            d_log_eprintf (IMDB_SERVICE_NAME, sz_imdb_error[IMDB_CACHE_CAPACITY], block_addr);
+            return NULL;
+        }
+        if (fdb_cache_flush (imdb_bc, victim, victim->block_addr, true) != IMDB_ERR_SUCCESS)
+            return NULL;
+        d_stat_cache_evict (&imdb_bc->base);
+    }
+
+    imdb_block_t   *mblock = d_pointer_as (imdb_block_t, imdb_bc->bc_free_list);
+    imdb_bc->bc_free_list = imdb_bc->bc_free_list->fl_next_block;
+    return mblock;
+}
+
+/*
+[private] Return buffer to the cache free list
+*/
+INLINED void    ICACHE_FLASH_ATTR
+fdb_cache_buffer_put (imdb_bc_t * imdb_bc, imdb_block_t * mblock)
+{
+    imdb_bc_free_block_t *free_block = d_pointer_as (imdb_bc_free_block_t, mblock);
+    free_block->fl_next_block = imdb_bc->bc_free_list;
+    imdb_bc->bc_free_list = free_block;
+}
 
-LOCAL void      ICACHE_FLASH_ATTR
-fdb_forall_cache_lru (const char *key, ih_size_t keylen, const char *value, ih_size_t valuelen, void *data)
+/*
+[private] Check checksum of the block read from media
+  - imdb_bc:
+  - mblock: block buffer
+  - block_addr: block address
+  - result: true when block is valid
+*/
+LOCAL bool      ICACHE_FLASH_ATTR
+fdb_block_verify (imdb_bc_t * imdb_bc, imdb_block_t * mblock, size_t block_addr)
 {
-    imdb_bc_block_t *bc_block = d_pointer_as (imdb_bc_block_t, value);
-    fdb_lru_data_t *lru_data = d_pointer_as (fdb_lru_data_t, data);
+    block_size_t    block_size = imdb_bc->base.db_def.block_size;
+#ifdef IMDB_BLOCK_CRC
+    uint16          crc = mblock->crc16;
+    mblock->crc16 = IMDB_BLOCK_CRC_DEFAULT;
+    mblock->crc16 = crc16 (d_pointer_as (unsigned char, mblock), block_size);
+#else
+    uint16          crc = IMDB_BLOCK_CRC_DEFAULT;
+#endif
+    if (mblock->crc16 != crc) {
+        d_log_eprintf (IMDB_SERVICE_NAME, sz_imdb_error[IMDB_FILE_CRC_ERROR], block_addr, block_size, mblock->crc16);
+        return false;
+    }
+
+    d_assert (mblock->lock_flag == DATA_LOCK_NONE, "block addr=%p, lock=%u", block_addr, mblock->lock_flag);
+    return true;
+}
 
-    //os_printf("-- cache %p:%p, r=%u,w=%u lock=%u\n", *((size_t*)key), bc_block->mptr, bc_block->rcnt, bc_block->wcnt, bc_block->mptr->lock_flag);
-    if (bc_block->rcnt > 3)
-        bc_block->rcnt = bc_block->rcnt >> 1;
-    if (bc_block->wcnt > 3)
-        bc_block->wcnt = bc_block->wcnt >> 1;
-    if (((!lru_data->candidate) || (lru_data->candidate->rcnt < bc_block->rcnt)) && (!bc_block->mptr->lock_flag)) {
-        lru_data->candidate = bc_block;
-        lru_data->rawid = *((size_t *) key);
+/*
+[private] Register loaded buffer in the block map
+  - imdb_bc:
+  - mblock: block buffer
+  - block_addr: block address
+  - result: buffer descriptor or NULL
+*/
+LOCAL imdb_bc_block_t *ICACHE_FLASH_ATTR
+fdb_cache_map (imdb_bc_t * imdb_bc, imdb_block_t * mblock, size_t block_addr)
+{
+    imdb_bc_block_t **bc_entry;
+    ih_errcode_t    res = ih_hash8_add (imdb_bc->hbcmap, (const char *) &block_addr, 0, (char **) &bc_entry, 0);
+    if (res != IH_ERR_SUCCESS) {
+        d_log_cprintf (IMDB_SERVICE_NAME, "block addr=%p, hash bcmap res=%u", block_addr, res);
+        return NULL;
     }
+
+    imdb_bc_block_t *bc_block = d_bc_block_byptr (imdb_bc, mblock);
+    *bc_entry = bc_block;
+    bc_block->rcnt = 0;
+    bc_block->wcnt = 0;
+    bc_block->block_addr = block_addr;
+    return bc_block;
 }
 
-typedef struct fdb_flush_data_s {
-    imdb_bc_t      *imdb_bc;
-} fdb_flush_data_t;
+/*
+[private] Read run of read-ahead blocks into adjacent cache buffers by one media read
+  - imdb_bc:
+  - mblock: first buffer of the run
+  - block_addr: first block address
+  - count: count of blocks in the run
+  - result: true when all blocks are loaded
+*/
+LOCAL bool      ICACHE_FLASH_ATTR
+fdb_cache_readahead_run (imdb_bc_t * imdb_bc, imdb_block_t * mblock, size_t block_addr, uint32 count)
+{
+    block_size_t    block_size = imdb_bc->base.db_def.block_size;
+    size_t          hres = fio_user_read (block_addr, (uint32 *) mblock, count * block_size);
+    uint32          i = 0;
+    if (hres == count * block_size) {
+        imdb_bc->base.stat.block_read += count;
+        imdb_bc->base.stat.block_readahead += count;
+        for (; i < count; i++) {
+            imdb_block_t   *rblock = d_pointer_add (imdb_block_t, mblock, i * block_size);
+            size_t          addr = block_addr + i * block_size;
+            imdb_bc_block_t *bc_block = NULL;
+            if (!fdb_block_verify (imdb_bc, rblock, addr) || !(bc_block = fdb_cache_map (imdb_bc, rblock, addr)))
+                break;
+            // protect blocks ahead from the replacement until they are scanned
+            bc_block->rcnt = 1;
+        }
+    }
+
+    for (; i < count; i++)
+        fdb_cache_buffer_put (imdb_bc, d_pointer_add (imdb_block_t, mblock, i * block_size));
 
+    return (hres == count * block_size);
+}
+
+/*
+[private] Read ahead blocks of sequential scan, when the block follows the last cache miss. Blocks are read
+straight into cache buffers, buffers adjacent in the cache are loaded by one media read.
+  - imdb_bc:
+  - block_addr: next scanned block address
+  - blocks: count of blocks left in the scanned page (including next block)
+*/
 LOCAL void      ICACHE_FLASH_ATTR
-fdb_forall_cache_flush (const char *key, ih_size_t keylen, const char *value, ih_size_t valuelen, void *data)
+fdb_cache_readahead (imdb_bc_t * imdb_bc, size_t block_addr, uint32 blocks)
 {
-    imdb_bc_block_t *bc_block = d_pointer_as (imdb_bc_block_t, value);
-    fdb_flush_data_t *flush_data = d_pointer_as (fdb_flush_data_t, data);
+    if ((imdb_bc->base.db_def.readahead_size < 2) || (block_addr != imdb_bc->ra_next))
+        return;
 
-    //os_printf("-- cache %p:%p, r=%u,w=%u lock=%u\n", *((size_t*)key), bc_block->mptr, bc_block->rcnt, bc_block->wcnt, bc_block->mptr->lock_flag);
-    if (bc_block->wcnt)
-        fdb_cache_flush (flush_data->imdb_bc, bc_block, *((size_t *) key), false);
-    bc_block->rcnt = 0;
+    block_size_t    block_size = imdb_bc->base.db_def.block_size;
+    // keep half of the cache for the blocks in use
+    uint32          ra_max = MIN (imdb_bc->base.db_def.readahead_size, imdb_bc->base.db_def.buffer_size >> 1);
+    uint32          ra_count = 0;
+    while ((ra_count < MIN (blocks, ra_max))) {
+        size_t          addr = block_addr + ra_count * block_size;
+        imdb_bc_block_t **bc_entry;
+        if (ih_hash8_search (imdb_bc->hbcmap, (const char *) &addr, 0, (char **) &bc_entry) != IH_ENTRY_NOTFOUND)
+            break;
+        ra_count++;
+    }
+    if (ra_count < 2)
+        return;
+
+    imdb_bc->ra_next = block_addr + ra_count * block_size;
+
+    imdb_block_t   *run = NULL;
+    uint32          run_count = 0;
+    uint32          i;
+    for (i = 0; i < ra_count; i++) {
+        imdb_block_t   *mblock = fdb_cache_buffer_get (imdb_bc, block_addr + i * block_size);
+        if (!mblock)
+            break;
+        if (run && (mblock != d_pointer_add (imdb_block_t, run, run_count * block_size))) {
+            if (!fdb_cache_readahead_run (imdb_bc, run, block_addr + (i - run_count) * block_size, run_count)) {
+                fdb_cache_buffer_put (imdb_bc, mblock);
+                return;
+            }
+            run = NULL;
+        }
+        if (!run) {
+            run = mblock;
+            run_count = 0;
+        }
+        run_count++;
+    }
+
+    if (run)
+        fdb_cache_readahead_run (imdb_bc, run, block_addr + (i - run_count) * block_size, run_count);
 }
 
 LOCAL imdb_block_t *ICACHE_FLASH_ATTR
@@ -584,28 +940,18 @@ fdb_cache_get (imdb_bc_t * imdb_bc, size_t block_addr, bool alloc_new, imdb_lock
 {
     d_assert (block_addr, "block_addr=0");
 
-    imdb_bc_block_t *bc_block;
+    imdb_bc_block_t *bc_block = NULL;
+    imdb_bc_block_t **bc_entry;
     imdb_block_t   *mblock = NULL;
-    ih_errcode_t    res = ih_hash8_search (imdb_bc->hbcmap, (const char *) &block_addr, 0, (char **) &bc_block);
+    ih_errcode_t    res = ih_hash8_search (imdb_bc->hbcmap, (const char *) &block_addr, 0, (char **) &bc_entry);
     if (res == IH_ENTRY_NOTFOUND) {
         block_size_t    block_size = imdb_bc->base.db_def.block_size;
-        if (!imdb_bc->bc_free_list) {
-            fdb_lru_data_t  data;
-            os_memset (&data, 0, sizeof (fdb_lru_data_t));
-
-            ih_hash8_forall (imdb_bc->hbcmap, fdb_forall_cache_lru, &data);
-
-            if (data.candidate) {
-                fdb_cache_flush (imdb_bc, data.candidate, data.rawid, true);
-            }
-            else {
-                d_log_eprintf (IMDB_SERVICE_NAME, sz_imdb_error[IMDB_CACHE_CAPACITY], block_addr);
-                return NULL;
-            }
-        }
+        d_stat_cache_miss (&imdb_bc->base);
+        mblock = fdb_cache_buffer_get (imdb_bc, block_addr);
+        if (!mblock)
+            return NULL;
 
-        mblock = d_pointer_as (imdb_block_t, imdb_bc->bc_free_list);
-        imdb_bc->bc_free_list = imdb_bc->bc_free_list->fl_next_block;
+        imdb_bc->ra_next = block_addr + block_size;
         if (alloc_new) {
 #ifdef IMDB_ZERO_MEM
             os_memset (mblock, 0, block_size);
@@ -622,36 +968,23 @@ fdb_cache_get (imdb_bc_t * imdb_bc, size_t block_addr, bool alloc_new, imdb_lock
                 goto get_error;
             }
 
-#ifdef IMDB_BLOCK_CRC
-            uint16          crc = mblock->crc16;
-            mblock->crc16 = IMDB_BLOCK_CRC_DEFAULT;
-            mblock->crc16 = crc16 (d_pointer_as (unsigned char, mblock), block_size);
-#else
-            uint16          crc = IMDB_BLOCK_CRC_DEFAULT;
-#endif
-            if (mblock->crc16 != crc) {
-                d_log_eprintf (IMDB_SERVICE_NAME, sz_imdb_error[IMDB_FILE_CRC_ERROR], block_addr, block_size,
-                               mblock->crc16);
+            if (!fdb_block_verify (imdb_bc, mblock, block_addr))
                 goto get_error;
-            }
-
-            d_assert (mblock->lock_flag == DATA_LOCK_NONE, "block addr=%p, lock=%u", block_addr, mblock->lock_flag);
         }
 
-        res = ih_hash8_add (imdb_bc->hbcmap, (const char *) &block_addr, 0, (char **) &bc_block, 0);
-        if (res != IH_ERR_SUCCESS) {
-            d_log_cprintf (IMDB_SERVICE_NAME, "block addr=%p, hash bcmap res=%u", block_addr, res);
+        bc_block = fdb_cache_map (imdb_bc, mblock, block_addr);
+        if (!bc_block)
             goto get_error;
-        }
-        bc_block->rcnt = 0;
-        bc_block->wcnt = 0;
-        bc_block->mptr = mblock;
         d_log_dprintf (IMDB_SERVICE_NAME, "fdb get id=%p, block=%p", block_addr, mblock);
     }
     else if (res != IH_ERR_SUCCESS) {
         d_log_cprintf (IMDB_SERVICE_NAME, "block addr=%p, hash bcmap res=%u", block_addr, res);
         return NULL;
     }
+    else {
+        bc_block = *bc_entry;
+        d_stat_cache_hit (&imdb_bc->base);
+    }
 
     if (bc_block->mptr->lock_flag > lock) {
         d_log_eprintf (IMDB_SERVICE_NAME, "block addr=%p, lock error %u:%u", block_addr, bc_block->mptr->lock_flag,
@@ -659,21 +992,16 @@ fdb_cache_get (imdb_bc_t * imdb_bc, size_t block_addr, bool alloc_new, imdb_lock
         return NULL;
     }
 
-    if (bc_block->mptr->lock_flag == DATA_LOCK_NONE)
-        bc_block->rcnt++;
+    bc_block->rcnt = 1;
     if (((lock == DATA_LOCK_WRITE) || (lock == DATA_LOCK_EXCLUSIVE)) && (bc_block->mptr->lock_flag <= DATA_LOCK_READ))
-        bc_block->wcnt++;
+        fdb_cache_setdirty (imdb_bc, bc_block);
 
     bc_block->mptr->lock_flag = lock;
 
     return bc_block->mptr;
 
   get_error:
-    {
-        imdb_bc_free_block_t *free_block = d_pointer_as (imdb_bc_free_block_t, mblock);
-        free_block->fl_next_block = imdb_bc->bc_free_list;
-        imdb_bc->bc_free_list = free_block;
-    }
+    fdb_cache_buffer_put (imdb_bc, mblock);
     return NULL;
 }
 
@@ -688,11 +1016,10 @@ fdb_cache_setlock (imdb_bc_t * imdb_bc, imdb_block_t * block, imdb_lock_t lock)
     }
 
     if ((lock >= DATA_LOCK_WRITE) && (block->lock_flag <= DATA_LOCK_READ)) {
-        imdb_bc_block_t *bc_block;
-        ih_errcode_t    res = ih_hash8_search (imdb_bc->hbcmap, (const char *) &block->id.raw, 0, (char **) &bc_block);
-        if (res != IH_ERR_SUCCESS)
+        imdb_bc_block_t *bc_block = d_bc_block_byptr (imdb_bc, block);
+        if (bc_block->block_addr != block->id.raw)
             return false;
-        bc_block->wcnt++;
+        fdb_cache_setdirty (imdb_bc, bc_block);
     }
 
     return true;
@@ -739,6 +1066,211 @@ fdb_header_write (imdb_file_t * hdr_file)
     return IMDB_ERR_SUCCESS;
 }
 
+/*
+[private] Drop block from buffer cache without writing, used for blocks of released pages
+  - imdb_bc:
+  - block_addr: block address
+*/
+LOCAL void      ICACHE_FLASH_ATTR
+fdb_cache_discard (imdb_bc_t * imdb_bc, size_t block_addr)
+{
+    imdb_bc_block_t **bc_entry;
+    if (ih_hash8_search (imdb_bc->hbcmap, (const char *) &block_addr, 0, (char **) &bc_entry) != IH_ERR_SUCCESS)
+        return;
+
+    imdb_bc_block_t *bc_block = *bc_entry;
+    if (bc_block->wcnt > 0)
+        fdb_dirty_remove (imdb_bc, bc_block);
+    bc_block->wcnt = 0;
+    bc_block->mptr->lock_flag = DATA_LOCK_NONE;
+    fdb_cache_flush (imdb_bc, bc_block, block_addr, true);
+}
+
+/*
+[private] Return page extent into file free page list. The list is ordered by address, adjacent extents are merged.
+  - imdb:
+  - hdr_file: file header, written by caller
+  - page_addr: extent address
+  - page_blocks: extent size in blocks
+  - result: imdb error code
+*/
+LOCAL imdb_errcode_t ICACHE_FLASH_ATTR
+fdb_page_free (imdb_t * imdb, imdb_file_t * hdr_file, size_t page_addr, size_t page_blocks)
+{
+    imdb_bc_t      *imdb_bc = d_pointer_as (imdb_bc_t, imdb);
+    block_size_t    bsize = imdb->db_def.block_size;
+    imdb_block_free_t *free_block;
+    imdb_block_free_t *free_next;
+    size_t          prev_addr = BLOCK_PTR_RAW_NONE;
+    size_t          next_addr = hdr_file->page_fl_first;
+
+    while ((next_addr != BLOCK_PTR_RAW_NONE) && (next_addr < page_addr)) {
+        free_block = d_pointer_as (imdb_block_free_t, fdb_cache_get (imdb_bc, next_addr, false, DATA_LOCK_READ));
+        if (!free_block)
+            return IMDB_BLOCK_ACCESS;
+        prev_addr = next_addr;
+        next_addr = free_block->fl_next;
+        free_block->block.lock_flag = DATA_LOCK_NONE;
+    }
+
+    hdr_file->page_fl_blocks += page_blocks;
+    if (prev_addr != BLOCK_PTR_RAW_NONE) {
+        free_block = d_pointer_as (imdb_block_free_t, fdb_cache_get (imdb_bc, prev_addr, false, DATA_LOCK_WRITE));
+        if (!free_block)
+            return IMDB_BLOCK_ACCESS;
+
+        if (prev_addr + free_block->fl_blocks * bsize == page_addr) {
+            // merge with previous extent
+            free_block->fl_blocks += page_blocks;
+            page_addr = prev_addr;
+        }
+        else {
+            free_block->fl_next = page_addr;
+            free_block->block.lock_flag = DATA_LOCK_NONE;
+            free_block = NULL;
+        }
+    }
+    else {
+        hdr_file->page_fl_first = page_addr;
+        free_block = NULL;
+    }
+
+    if (!free_block) {
+        free_block = d_pointer_as (imdb_block_free_t, fdb_cache_get (imdb_bc, page_addr, true, DATA_LOCK_WRITE));
+        if (!free_block)
+            return IMDB_BLOCK_ACCESS;
+        os_memset (free_block, 0, sizeof (imdb_block_free_t));
+        free_block->block.id.fptr = page_addr;
+        free_block->block.lock_flag = DATA_LOCK_WRITE;
+        free_block->fl_next = next_addr;
+        free_block->fl_blocks = page_blocks;
+    }
+
+    if ((next_addr != BLOCK_PTR_RAW_NONE) && (page_addr + free_block->fl_blocks * bsize == next_addr)) {
+        // merge with next extent
+        free_next = d_pointer_as (imdb_block_free_t, fdb_cache_get (imdb_bc, next_addr, false, DATA_LOCK_READ));
+        if (!free_next)
+            return IMDB_BLOCK_ACCESS;
+        free_block->fl_blocks += free_next->fl_blocks;
+        free_block->fl_next = free_next->fl_next;
+        fdb_cache_discard (imdb_bc, next_addr);
+    }
+    free_block->block.lock_flag = DATA_LOCK_NONE;
+
+    return IMDB_ERR_SUCCESS;
+}
+
+/*
+[private] Allocate page from file free page list by first-fit, page is taken from the end of extent.
+  - imdb:
+  - hdr_file: file header, written by caller
+  - page_blocks: page size in blocks
+  - addr_limit: use only extents below this address
+  - result: page address or BLOCK_PTR_RAW_NONE
+*/
+LOCAL size_t    ICACHE_FLASH_ATTR
+fdb_page_fl_alloc (imdb_t * imdb, imdb_file_t * hdr_file, size_t page_blocks, size_t addr_limit)
+{
+    imdb_bc_t      *imdb_bc = d_pointer_as (imdb_bc_t, imdb);
+    block_size_t    bsize = imdb->db_def.block_size;
+    size_t          prev_addr = BLOCK_PTR_RAW_NONE;
+    size_t          free_addr = hdr_file->page_fl_first;
+
+    while ((free_addr != BLOCK_PTR_RAW_NONE) && (free_addr < addr_limit)) {
+        imdb_block_free_t *free_block =
+            d_pointer_as (imdb_block_free_t, fdb_cache_get (imdb_bc, free_addr, false, DATA_LOCK_READ));
+        if (!free_block)
+            return BLOCK_PTR_RAW_NONE;
+
+        if (free_block->fl_blocks >= page_blocks) {
+            size_t          page_addr;
+            if (free_block->fl_blocks == page_blocks) {
+                size_t          next_addr = free_block->fl_next;
+                fdb_cache_discard (imdb_bc, free_addr);
+                if (prev_addr != BLOCK_PTR_RAW_NONE) {
+                    free_block =
+                        d_pointer_as (imdb_block_free_t, fdb_cache_get (imdb_bc, prev_addr, false, DATA_LOCK_WRITE));
+                    if (!free_block)
+                        return BLOCK_PTR_RAW_NONE;
+                    free_block->fl_next = next_addr;
+                    free_block->block.lock_flag = DATA_LOCK_NONE;
+                }
+                else
+                    hdr_file->page_fl_first = next_addr;
+                page_addr = free_addr;
+            }
+            else {
+                fdb_cache_setlock (imdb_bc, &free_block->block, DATA_LOCK_WRITE);
+                free_block->fl_blocks -= page_blocks;
+                page_addr = free_addr + free_block->fl_blocks * bsize;
+                free_block->block.lock_flag = DATA_LOCK_NONE;
+            }
+
+            hdr_file->page_fl_blocks -= page_blocks;
+            imdb->stat.page_reuse++;
+            return page_addr;
+        }
+
+        prev_addr = free_addr;
+        free_addr = free_block->fl_next;
+        free_block->block.lock_flag = DATA_LOCK_NONE;
+    }
+
+    return BLOCK_PTR_RAW_NONE;
+}
+
+/*
+[private] Release the last extent of file free page list when it ends at file high water mark
+  - imdb:
+  - hdr_file: file header, written by caller
+  - result: imdb error code
+*/
+LOCAL imdb_errcode_t ICACHE_FLASH_ATTR
+fdb_file_trim (imdb_t * imdb, imdb_file_t * hdr_file)
+{
+    imdb_bc_t      *imdb_bc = d_pointer_as (imdb_bc_t, imdb);
+    block_size_t    bsize = imdb->db_def.block_size;
+    size_t          prev_addr = BLOCK_PTR_RAW_NONE;
+    size_t          free_addr = hdr_file->page_fl_first;
+    size_t          free_blocks = 0;
+
+    while (free_addr != BLOCK_PTR_RAW_NONE) {
+        imdb_block_free_t *free_block =
+            d_pointer_as (imdb_block_free_t, fdb_cache_get (imdb_bc, free_addr, false, DATA_LOCK_READ));
+        if (!free_block)
+            return IMDB_BLOCK_ACCESS;
+        free_block->block.lock_flag = DATA_LOCK_NONE;
+        if (free_block->fl_next == BLOCK_PTR_RAW_NONE) {
+            free_blocks = free_block->fl_blocks;
+            break;
+        }
+        prev_addr = free_addr;
+        free_addr = free_block->fl_next;
+    }
+
+    if (!free_blocks || (free_addr + free_blocks * bsize != (hdr_file->file_hwm + 1) * bsize))
+        return IMDB_ERR_SUCCESS;
+
+    fdb_cache_discard (imdb_bc, free_addr);
+    if (prev_addr != BLOCK_PTR_RAW_NONE) {
+        imdb_block_free_t *free_block =
+            d_pointer_as (imdb_block_free_t, fdb_cache_get (imdb_bc, prev_addr, false, DATA_LOCK_WRITE));
+        if (!free_block)
+            return IMDB_BLOCK_ACCESS;
+        free_block->fl_next = BLOCK_PTR_RAW_NONE;
+        free_block->block.lock_flag = DATA_LOCK_NONE;
+    }
+    else
+        hdr_file->page_fl_first = BLOCK_PTR_RAW_NONE;
+
+    hdr_file->file_hwm -= free_blocks;
+    hdr_file->page_fl_blocks -= free_blocks;
+    imdb->stat.block_trim += free_blocks;
+    d_log_dprintf (IMDB_SERVICE_NAME, "trim: id=%p, blocks=%u, hwm=%u", free_addr, free_blocks, hdr_file->file_hwm);
+
+    return IMDB_ERR_SUCCESS;
+}
+
 /*
 [private] Shift offset to previous DataSlot and return data pointer (only for recycled storage). There are no bounds checks.
   - dbclass: 
@@ -881,7 +1413,14 @@ imdb_block_slot_init (imdb_t * imdb, imdb_data_slot_type_t ds_type, imdb_block_p
     obj_size_t      slen = d_block_lower_data_limit (block);
     imdb_slot_free_t *slot_free = d_pointer_add (imdb_slot_free_t, (block), slen);
     slot_free->flags = SLOT_FLAG_FREE;
-    block->footer_offset = 0;
+    if (d_dstype_slot_bucketed (ds_type)) {
+        imdb_block_fl_t *block_fl = d_block_fl_trailer (imdb, block);
+        os_memset (block_fl, 0, sizeof (imdb_block_fl_t));
+        block_fl->bucket = IMDB_SLOT_BUCKET_NONE;
+        block->footer_offset = d_size_bptr (sizeof (imdb_block_fl_t));
+    }
+    else
+        block->footer_offset = 0;
     slot_free->length = d_block_upper_data_blimit (imdb, block) - d_size_bptr (slen);
 
     if (d_dstype_slot_has_footer (ds_type)) {
@@ -896,38 +1435,160 @@ imdb_block_slot_init (imdb_t * imdb, imdb_data_slot_type_t ds_type, imdb_block_p
     d_imdb_block_fl_insert_slot (block, slot_free);
 }
 
-LOCAL imdb_block_t *ICACHE_FLASH_ATTR
-imdb_page_block_alloc (imdb_t * imdb, imdb_block_class_t * class_block, imdb_block_page_t * page_block);
+/*
+[private] Return segregated free list bucket for free slot length
+  - slot_bsize: free slot length in block units
+  - result: bucket index
+*/
+INLINED uint8   ICACHE_FLASH_ATTR
+imdb_slot_bucket (obj_size_t slot_bsize)
+{
+    uint8           bucket = 0;
+    while ((slot_bsize >>= 1) && (bucket < IMDB_SLOT_BUCKETS - 1))
+        bucket++;
+    return bucket;
+}
 
 /*
-[private] Recycle next block for target block.
+[private] Acquire block referenced by class structures, class block is returned without acquiring.
   - imdb:
   - class_block:
-  - page_block: results page for recycled block
-  - block: target block
-  - return: recycled block
+  - block_ptr: block pointer
+  - lock: lock type
+  - result: block or NULL
 */
 LOCAL imdb_block_t *ICACHE_FLASH_ATTR
-imdb_page_block_recycle (imdb_t * imdb, imdb_block_class_t * class_block, imdb_block_page_t ** page_block,
-                         imdb_block_t * block)
+imdb_linked_block_acquire (imdb_t * imdb, imdb_block_class_t * class_block, block_ptr_t block_ptr, imdb_lock_t lock)
 {
-    d_assert (class_block->dbclass.page_fl_first.mptr == NULL, "page_fl_first=%p",
-              class_block->dbclass.page_fl_first.mptr);
-
-    block_size_t    bsize = imdb->db_def.block_size;
-    imdb_block_t   *block_targ = NULL;
-    imdb_block_page_t *page_targ = *page_block;
-
-    page_blocks_t   bidx;
-    block_ptr_t     block_ptr;
+    if (block_ptr.raw == class_block->block.id.raw) {
+        if (lock >= DATA_LOCK_WRITE)
+            d_setwrite_block (imdb, class_block);
+        return &class_block->block;
+    }
 
-    if (block->block_index == class_block->dbclass.cdef.page_blocks) {
-        // try to recycle next page
-        d_release_block (imdb, &page_targ->block);
+    imdb_block_t   *block = d_acquire_block (imdb, block_ptr, lock);
+    if (!block)
+        d_log_eprintf (IMDB_SERVICE_NAME, sz_imdb_error[IMDB_BLOCK_ACCESS], block_ptr.raw);
+    return block;
+}
 
-        page_targ =
-            (page_targ->page.page_next.raw != BLOCK_PTR_RAW_NONE) ? d_acquire_page_block (imdb,
-                                                                                          page_targ->page.page_next,
+/*
+[private] Recalculate the largest free slot of block and move block to the matching segregated free list bucket.
+  - imdb:
+  - class_block:
+  - block: target block
+  - result: imdb error code
+*/
+LOCAL imdb_errcode_t ICACHE_FLASH_ATTR
+imdb_block_bucket_update (imdb_t * imdb, imdb_block_class_t * class_block, imdb_block_t * block)
+{
+    imdb_block_fl_t *block_fl = d_block_fl_trailer (imdb, block);
+    obj_size_t      slot_max = 0;
+    imdb_slot_free_t *slot_free = d_block_slot_free (block);
+    while (slot_free) {
+        slot_max = MAX (slot_max, slot_free->length);
+        slot_free = d_block_next_slot_free (block, slot_free);
+    }
+
+    d_setwrite_block (imdb, block);
+    block_fl->slot_max = slot_max;
+
+    uint8           bucket = (slot_max) ? imdb_slot_bucket (slot_max) : IMDB_SLOT_BUCKET_NONE;
+    if (bucket == block_fl->bucket)
+        return IMDB_ERR_SUCCESS;
+
+    // keep target block in buffer cache while neighbour blocks are acquired
+    imdb_lock_t     lock_flag = block->lock_flag;
+    if (imdb->db_def.opt_media && (lock_flag == DATA_LOCK_NONE))
+        block->lock_flag = DATA_LOCK_READ;
+
+    imdb_errcode_t  res = IMDB_ERR_SUCCESS;
+    imdb_block_t   *block_nb;
+    if (block_fl->bucket != IMDB_SLOT_BUCKET_NONE) {
+        // remove block from current bucket
+        if (block_fl->bucket_prev.raw != BLOCK_PTR_RAW_NONE) {
+            block_nb = imdb_linked_block_acquire (imdb, class_block, block_fl->bucket_prev, DATA_LOCK_WRITE);
+            if (!block_nb) {
+                res = IMDB_BLOCK_ACCESS;
+                goto update_done;
+            }
+            d_block_fl_trailer (imdb, block_nb)->bucket_next.raw = block_fl->bucket_next.raw;
+            d_release_linked_block (imdb, class_block, block_nb);
+        }
+        else {
+            d_setwrite_block (imdb, class_block);
+            class_block->dbclass.fl_bucket[block_fl->bucket].raw = block_fl->bucket_next.raw;
+        }
+
+        if (block_fl->bucket_next.raw != BLOCK_PTR_RAW_NONE) {
+            block_nb = imdb_linked_block_acquire (imdb, class_block, block_fl->bucket_next, DATA_LOCK_WRITE);
+            if (!block_nb) {
+                res = IMDB_BLOCK_ACCESS;
+                goto update_done;
+            }
+            d_block_fl_trailer (imdb, block_nb)->bucket_prev.raw = block_fl->bucket_prev.raw;
+            d_release_linked_block (imdb, class_block, block_nb);
+        }
+    }
+
+    block_fl->bucket = bucket;
+    block_fl->bucket_prev.raw = BLOCK_PTR_RAW_NONE;
+    block_fl->bucket_next.raw = BLOCK_PTR_RAW_NONE;
+    if (bucket != IMDB_SLOT_BUCKET_NONE) {
+        // insert block at the head of new bucket
+        block_fl->bucket_next.raw = class_block->dbclass.fl_bucket[bucket].raw;
+        if (block_fl->bucket_next.raw != BLOCK_PTR_RAW_NONE) {
+            block_nb = imdb_linked_block_acquire (imdb, class_block, block_fl->bucket_next, DATA_LOCK_WRITE);
+            if (!block_nb) {
+                res = IMDB_BLOCK_ACCESS;
+                goto update_done;
+            }
+            d_block_fl_trailer (imdb, block_nb)->bucket_prev.raw = block->id.raw;
+            d_release_linked_block (imdb, class_block, block_nb);
+        }
+
+        d_setwrite_block (imdb, class_block);
+        class_block->dbclass.fl_bucket[bucket].raw = block->id.raw;
+    }
+
+  update_done:
+    if (imdb->db_def.opt_media)
+        block->lock_flag = lock_flag;
+    return res;
+}
+
+LOCAL imdb_block_t *ICACHE_FLASH_ATTR
+imdb_page_block_alloc (imdb_t * imdb, imdb_block_class_t * class_block, imdb_block_page_t * page_block);
+
+/*
+[private] Recycle next block for target block.
+  - imdb:
+  - class_block:
+  - page_block: results page for recycled block
+  - block: target block
+  - return: recycled block
+*/
+LOCAL imdb_block_t *ICACHE_FLASH_ATTR
+imdb_page_block_recycle (imdb_t * imdb, imdb_block_class_t * class_block, imdb_block_page_t ** page_block,
+                         imdb_block_t * block)
+{
+    d_assert (class_block->dbclass.page_fl_first.mptr == NULL, "page_fl_first=%p",
+              class_block->dbclass.page_fl_first.mptr);
+
+    block_size_t    bsize = imdb->db_def.block_size;
+    imdb_block_t   *block_targ = NULL;
+    imdb_block_page_t *page_targ = *page_block;
+
+    page_blocks_t   bidx;
+    block_ptr_t     block_ptr;
+
+    if (block->block_index == class_block->dbclass.cdef.page_blocks) {
+        // try to recycle next page
+        d_release_page_block (imdb, page_targ);
+
+        page_targ =
+            (page_targ->page.page_next.raw != BLOCK_PTR_RAW_NONE) ? d_acquire_page_block (imdb,
+                                                                                          page_targ->page.page_next,
                                                                                           DATA_LOCK_WRITE) :
             d_pointer_as (imdb_block_page_t, class_block);
         if (!page_targ) {
@@ -1063,8 +1724,9 @@ imdb_slot_free_extract (imdb_t * imdb, imdb_block_class_t * class_block,
             else {
                 d_setwrite_block (imdb, class_block);
                 class_block->dbclass.page_fl_first.raw = find_ctx->page_block->page.page_fl_next.raw;
-                if (!class_block->dbclass.page_fl_first.raw && class_block->dbclass.cdef.opt_recycle) {
-                    // recycle next block
+                if (!class_block->dbclass.page_fl_first.raw && class_block->dbclass.cdef.opt_recycle
+                    && (class_block->dbclass.page_count >= class_block->dbclass.cdef.pages_max)) {
+                    // recycle next block, while pages may grow next insert allocates new page
                     if (!imdb_page_block_recycle (imdb, class_block, &find_ctx->page_block, find_ctx->block))
                         return IMDB_INTERNAL_ERROR;
                 }
@@ -1192,6 +1854,153 @@ imdb_slot_free_find (imdb_t * imdb, imdb_block_class_t * class_block, obj_size_t
     return IMDB_ERR_SUCCESS;
 }
 
+/*
+[private]: Find FreeSlot in Class segregated free lists (Type#4). Takes the first block from the smallest bucket
+  which may hold the slot, inside the block the slot is chosen by best-fit.
+  - imdb:
+  - class_block: 
+  - slot_bsize: search user data size in block units
+  - find_ctx: FreeSlot search context
+*/
+LOCAL imdb_errcode_t ICACHE_FLASH_ATTR
+imdb_slot_bucket_find (imdb_t * imdb, imdb_block_class_t * class_block, obj_size_t slot_bsize,
+                       imdb_free_slot_find_ctx_t * find_ctx)
+{
+    if (slot_bsize >
+        d_size_bptr (imdb->db_def.block_size - block_header_size[BLOCK_TYPE_PAGE] - sizeof (imdb_block_fl_t)))
+        return IMDB_INVALID_OBJSIZE;
+
+    uint32          skipscan = 0;
+    uint8           bucket;
+    for (bucket = imdb_slot_bucket (slot_bsize); bucket < IMDB_SLOT_BUCKETS; bucket++) {
+        block_ptr_t     block_ptr;
+        block_ptr.raw = class_block->dbclass.fl_bucket[bucket].raw;
+        // find suitable block
+        while (block_ptr.raw != BLOCK_PTR_RAW_NONE) {
+            imdb_block_t   *block = imdb_linked_block_acquire (imdb, class_block, block_ptr, DATA_LOCK_READ);
+            if (!block)
+                return IMDB_BLOCK_ACCESS;
+
+            imdb_block_fl_t *block_fl = d_block_fl_trailer (imdb, block);
+            if (slot_bsize <= block_fl->slot_max) {
+                find_ctx->block = block;
+                goto block_found;
+            }
+            skipscan++;
+
+            block_ptr.raw = block_fl->bucket_next.raw;
+            d_release_linked_block (imdb, class_block, block);
+        }
+    }
+
+    // allocate next block in last page or new page
+    imdb_block_page_t *page_block = d_pointer_as (imdb_block_page_t, class_block);
+    if (class_block->dbclass.page_last.raw != class_block->block.id.raw) {
+        page_block = d_acquire_page_block (imdb, class_block->dbclass.page_last, DATA_LOCK_WRITE);
+        if (!page_block) {
+            d_log_eprintf (IMDB_SERVICE_NAME, sz_imdb_error[IMDB_BLOCK_ACCESS], class_block->dbclass.page_last.raw);
+            return IMDB_BLOCK_ACCESS;
+        }
+    }
+
+    if (page_block->page.alloc_hwm < class_block->dbclass.cdef.page_blocks) {
+        find_ctx->block = imdb_page_block_alloc (imdb, class_block, page_block);
+        d_release_page_block (imdb, page_block);
+        if (!find_ctx->block)
+            return IMDB_INTERNAL_ERROR;
+    }
+    else {
+        d_release_page_block (imdb, page_block);
+        if (class_block->dbclass.page_count >= class_block->dbclass.cdef.pages_max)
+            return IMDB_ALLOC_PAGES_MAX;
+
+        imdb_block_page_t *new_page = imdb_page_alloc (imdb, class_block);
+        if (!new_page) {
+            d_log_eprintf (IMDB_SERVICE_NAME, sz_imdb_error[IMDB_NOMEM]);
+            return IMDB_NOMEM;
+        }
+        find_ctx->block = &new_page->block;
+    }
+
+  block_found:
+    {
+        // find best-fit slot
+        imdb_slot_free_t *slot_free = d_block_slot_free (find_ctx->block);
+        imdb_slot_free_t *slot_free_prev = NULL;
+        find_ctx->slot_free = NULL;
+        while (slot_free) {
+            d_assert (slot_free->flags == SLOT_FLAG_FREE, "flags=%u", slot_free->flags);
+            if ((slot_bsize <= slot_free->length)
+                && (!find_ctx->slot_free || (slot_free->length < find_ctx->slot_free->length))) {
+                find_ctx->slot_free = slot_free;
+                find_ctx->slot_free_prev = slot_free_prev;
+                if (slot_free->length == slot_bsize)
+                    break;
+            }
+            slot_free_prev = slot_free;
+            slot_free = d_block_next_slot_free (find_ctx->block, slot_free);
+        }
+    }
+
+    if (!find_ctx->slot_free) {
+        d_log_eprintf (IMDB_SERVICE_NAME, sz_imdb_error[IMDB_CORRUPT], find_ctx->block, "bucket slot_max");
+        return IMDB_CORRUPT;
+    }
+
+    d_stat_slot_data (imdb, skipscan);
+    return IMDB_ERR_SUCCESS;
+}
+
+/*
+[private] Extract DataSlot from target FreeSlot of segregated free list block (Type#4), then move block
+  to the bucket matching the rest of its free space.
+  - imdb:
+  - class_block: 
+  - find_ctx: FreeSlot search context
+  - slot_bsize: search user data size in block units
+  - extra_bsize: extra (header) size in block units need for split
+*/
+LOCAL imdb_errcode_t ICACHE_FLASH_ATTR
+imdb_slot_bucket_extract (imdb_t * imdb, imdb_block_class_t * class_block,
+                          imdb_free_slot_find_ctx_t * find_ctx, obj_size_t slot_bsize, obj_size_t extra_bsize)
+{
+    d_setwrite_block (imdb, find_ctx->block);
+
+    imdb_slot_free_t *slot_free = find_ctx->slot_free;
+    d_assert (slot_free->flags == SLOT_FLAG_FREE, "flags=%u", slot_free->flags);
+
+    imdb_slot_free_t *slot_free_next = NULL;
+    if (slot_free->length >= slot_bsize + extra_bsize + class_block->dbclass.obj_bsize_min) {
+        d_stat_slot_split (imdb);
+        slot_free_next = d_pointer_add (imdb_slot_free_t, slot_free, d_bptr_size (slot_bsize));
+        slot_free_next->flags = SLOT_FLAG_FREE;
+        slot_free_next->length = slot_free->length - slot_bsize;
+        slot_free_next->next_offset = slot_free->next_offset;
+
+        imdb_slot_footer_t *slot_footer = d_block_slot_free_footer (slot_free);
+        slot_footer->length = slot_free_next->length;
+        slot_footer->skip_count = 0;
+
+        slot_free->length = slot_bsize;
+    }
+    else {
+        slot_free_next = d_block_next_slot_free (find_ctx->block, slot_free);
+    }
+
+    block_size_t    next_offset =
+        (slot_free_next) ? d_size_bptr (d_pointer_diff (slot_free_next, find_ctx->block)) : 0;
+    if (find_ctx->slot_free_prev)
+        find_ctx->slot_free_prev->next_offset = next_offset;
+    else
+        find_ctx->block->free_offset = next_offset;
+
+    d_log_dprintf (IMDB_SERVICE_NAME, "slot_extract: bucket block=%p, slot=%p, len=%u", find_ctx->block, slot_free,
+                   slot_free->length);
+
+    slot_free->flags = SLOT_FLAG_DATA;
+    return imdb_block_bucket_update (imdb, class_block, find_ctx->block);
+}
+
 /*
 [private]: Get FreeSlot or recycle block
   - dbclass: 
@@ -1202,7 +2011,22 @@ LOCAL imdb_errcode_t ICACHE_FLASH_ATTR
 imdb_slot_free_get_or_recycle (imdb_t * imdb, imdb_block_class_t * class_block, obj_size_t slot_bsize,
                                imdb_free_slot_find_ctx_t * find_ctx)
 {
-    d_assert (class_block->dbclass.page_fl_first.raw, "page_fl_first=%p", class_block->dbclass.page_fl_first.raw);
+    if (!class_block->dbclass.page_fl_first.raw) {
+        // ring is full, but may grow: allocate new page before recycle
+        d_assert (class_block->dbclass.page_count < class_block->dbclass.cdef.pages_max, "page_count=%u",
+                  class_block->dbclass.page_count);
+        imdb_block_page_t *new_page = imdb_page_alloc (imdb, class_block);
+        if (!new_page) {
+            d_log_eprintf (IMDB_SERVICE_NAME, sz_imdb_error[IMDB_NOMEM]);
+            return IMDB_NOMEM;
+        }
+
+        find_ctx->page_block = new_page;
+        find_ctx->block = d_pointer_as (imdb_block_t, new_page);
+        find_ctx->slot_free = d_block_slot_free (find_ctx->block);
+        return IMDB_ERR_SUCCESS;
+    }
+
     find_ctx->page_block = d_acquire_page_block (imdb, class_block->dbclass.page_fl_first, DATA_LOCK_WRITE);
     if (!find_ctx->page_block) {
         d_log_eprintf (IMDB_SERVICE_NAME, sz_imdb_error[IMDB_BLOCK_ACCESS], class_block->dbclass.page_fl_first.raw);
@@ -1231,7 +2055,21 @@ imdb_slot_free_get_or_recycle (imdb_t * imdb, imdb_block_class_t * class_block,
     find_ctx->block->free_offset = 0;
     find_ctx->page_block->page.block_fl_first = 0;
 
-    if (class_block->dbclass.page_count < class_block->dbclass.cdef.pages_max) {        // allocate new page
+    // ring order must follow the page list, so pages are filled up before the next one is allocated
+    if (find_ctx->page_block->page.alloc_hwm < class_block->dbclass.cdef.page_blocks) { // allocate next block in this page
+        d_assert (find_ctx->page_block->page.alloc_hwm == find_ctx->block->block_index, "hwm=%u, bidx=%u",
+                  find_ctx->page_block->page.alloc_hwm, find_ctx->block->block_index);
+        d_release_block (imdb, find_ctx->block);
+        find_ctx->block = imdb_page_block_alloc (imdb, class_block, find_ctx->page_block);
+        if (!find_ctx->block)
+            return IMDB_INTERNAL_ERROR;
+    }
+    else if (class_block->dbclass.page_count < class_block->dbclass.cdef.pages_max) {  // allocate new page
+        d_release_block (imdb, find_ctx->block);
+        d_release_page_block (imdb, find_ctx->page_block);
+        // full page leaves Page Free List, ring has only the page being written there
+        d_setwrite_block (imdb, class_block);
+        class_block->dbclass.page_fl_first.raw = BLOCK_PTR_RAW_NONE;
         imdb_block_page_t *new_page = imdb_page_alloc (imdb, class_block);
         if (!new_page) {
             d_log_eprintf (IMDB_SERVICE_NAME, sz_imdb_error[IMDB_NOMEM]);
@@ -1241,19 +2079,10 @@ imdb_slot_free_get_or_recycle (imdb_t * imdb, imdb_block_class_t * class_block,
         find_ctx->page_block = new_page;
         find_ctx->block = d_pointer_as (imdb_block_t, new_page);
     }
-    else {
-        if (find_ctx->page_block->page.alloc_hwm < class_block->dbclass.cdef.page_blocks) {     // allocate next block in this page
-            d_assert (find_ctx->page_block->page.alloc_hwm == find_ctx->block->block_index, "hwm=%u, bidx=%u",
-                      find_ctx->page_block->page.alloc_hwm, find_ctx->block->block_index);
-            find_ctx->block = imdb_page_block_alloc (imdb, class_block, find_ctx->page_block);
-            if (!find_ctx->block)
-                return IMDB_INTERNAL_ERROR;
-        }
-        else {                  // recycle next block;
-            d_setwrite_block (imdb, class_block);
-            class_block->dbclass.page_fl_first.raw = BLOCK_PTR_RAW_NONE;
-            find_ctx->block = imdb_page_block_recycle (imdb, class_block, &find_ctx->page_block, find_ctx->block);
-        }
+    else {                      // recycle next block;
+        d_setwrite_block (imdb, class_block);
+        class_block->dbclass.page_fl_first.raw = BLOCK_PTR_RAW_NONE;
+        find_ctx->block = imdb_page_block_recycle (imdb, class_block, &find_ctx->page_block, find_ctx->block);
     }
     find_ctx->slot_free = d_block_slot_free (find_ctx->block);
 
@@ -1280,7 +2109,10 @@ imdb_page_init (imdb_t * imdb, imdb_block_class_t * class_block, imdb_block_page
 
     d_stat_block_init (imdb);
     imdb_block_slot_init (imdb, class_block->dbclass.ds_type, page_block, block);
-    d_imdb_page_fl_insert_block (page_block, block);
+    if (d_dstype_slot_bucketed (class_block->dbclass.ds_type))
+        imdb_block_bucket_update (imdb, class_block, block);
+    else
+        d_imdb_page_fl_insert_block (page_block, block);
 
 #ifdef IMDB_BLOCK_CRC
 #else
@@ -1336,7 +2168,12 @@ imdb_page_block_alloc (imdb_t * imdb, imdb_block_class_t * class_block, imdb_blo
 
     imdb_block_slot_init (imdb, class_block->dbclass.ds_type, page_block, block);
     d_setwrite_block (imdb, page_block);
-    d_imdb_page_fl_insert_block (page_block, block);
+    if (d_dstype_slot_bucketed (class_block->dbclass.ds_type)) {
+        if (imdb_block_bucket_update (imdb, class_block, block) != IMDB_ERR_SUCCESS)
+            return NULL;
+    }
+    else
+        d_imdb_page_fl_insert_block (page_block, block);
 
 #ifdef IMDB_BLOCK_CRC
 #else
@@ -1347,21 +2184,30 @@ imdb_page_block_alloc (imdb_t * imdb, imdb_block_class_t * class_block, imdb_blo
 }
 
 LOCAL imdb_block_page_t *ICACHE_FLASH_ATTR
-imdb_internal_page_alloc (imdb_t * imdb, imdb_class_def_t * cdef, bool fclass)
+imdb_internal_page_alloc (imdb_t * imdb, page_blocks_t page_blocks, bool fclass)
 {
-    size_t          psize = cdef->page_blocks * imdb->db_def.block_size;
+    size_t          psize = page_blocks * imdb->db_def.block_size;
 
     imdb_block_page_t *page_block = NULL;
     if (imdb->db_def.opt_media) {
         imdb_file_t     hdr_file;
         imdb->stat.header_read++;
-        if (fdb_header_read (&hdr_file) || (hdr_file.file_size - hdr_file.file_hwm <= cdef->page_blocks))
+        if (fdb_header_read (&hdr_file))
             return NULL;
 
-        size_t          block_addr = (hdr_file.file_hwm + 1) * imdb->db_def.block_size;
-        hdr_file.file_hwm += cdef->page_blocks;
-        if (fclass)
+        // reuse released pages first
+        size_t          block_addr = fdb_page_fl_alloc (imdb, &hdr_file, page_blocks, (size_t) - 1);
+        if (block_addr == BLOCK_PTR_RAW_NONE) {
+            if (hdr_file.file_size - hdr_file.file_hwm <= page_blocks)
+                return NULL;
+            block_addr = (hdr_file.file_hwm + 1) * imdb->db_def.block_size;
+            hdr_file.file_hwm += page_blocks;
+        }
+        if (fclass) {
+            if (hdr_file.class_first == BLOCK_PTR_RAW_NONE)
+                hdr_file.class_first = block_addr;
             hdr_file.class_last = block_addr;
+        }
 
         imdb->stat.header_write++;
         if (fdb_header_write (&hdr_file))
@@ -1388,7 +2234,7 @@ imdb_internal_page_alloc (imdb_t * imdb, imdb_class_def_t * cdef, bool fclass)
 
     if (page_block) {
         d_stat_page_alloc (imdb);
-        d_stat_block_alloc (imdb, cdef->page_blocks);
+        d_stat_block_alloc (imdb, page_blocks);
     }
     return page_block;
 }
@@ -1403,7 +2249,7 @@ imdb_internal_page_alloc (imdb_t * imdb, imdb_class_def_t * cdef, bool fclass)
 LOCAL imdb_block_class_t *ICACHE_FLASH_ATTR
 imdb_class_page_alloc (imdb_t * imdb, imdb_class_def_t * cdef)
 {
-    imdb_block_class_t *class_block = d_pointer_as (imdb_block_class_t, imdb_internal_page_alloc (imdb, cdef, true));
+    imdb_block_class_t *class_block = d_pointer_as (imdb_block_class_t, imdb_internal_page_alloc (imdb, cdef->page_blocks, true));
     if (!class_block)
         return NULL;
     imdb_class_t   *dbclass = &class_block->dbclass;
@@ -1424,7 +2270,8 @@ imdb_class_page_alloc (imdb_t * imdb, imdb_class_def_t * cdef)
     os_memcpy (&dbclass->cdef, cdef, sizeof (imdb_class_def_t));
 
     imdb_page_init (imdb, class_block, page_block, BLOCK_TYPE_CLASS);
-    d_imdb_class_fl_insert_page (class_block, page_block);
+    if (!d_dstype_slot_bucketed (dbclass->ds_type))
+        d_imdb_class_fl_insert_page (class_block, page_block);
 
     return class_block;
 }
@@ -1438,12 +2285,13 @@ LOCAL imdb_block_page_t *ICACHE_FLASH_ATTR
 imdb_page_alloc (imdb_t * imdb, imdb_block_class_t * class_block)
 {
     imdb_block_page_t *page_block =
-        d_pointer_as (imdb_block_page_t, imdb_internal_page_alloc (imdb, &class_block->dbclass.cdef, false));
+        d_pointer_as (imdb_block_page_t, imdb_internal_page_alloc (imdb, class_block->dbclass.cdef.page_blocks, false));
     if (!page_block)
         return NULL;
 
     imdb_page_init (imdb, class_block, page_block, BLOCK_TYPE_PAGE);
-    d_imdb_class_fl_insert_page (class_block, page_block);
+    if (!d_dstype_slot_bucketed (class_block->dbclass.ds_type))
+        d_imdb_class_fl_insert_page (class_block, page_block);
 
     imdb_page_t    *page = &page_block->page;
     class_block->dbclass.page_count++;
@@ -1496,7 +2344,10 @@ imdb_class_instance_alloc (imdb_t * imdb, imdb_block_class_t * class_block, void
     imdb_free_slot_find_ctx_t find_ctx;
     os_memset (&find_ctx, 0, sizeof (imdb_free_slot_find_ctx_t));
 
-    if (dbclass->cdef.opt_recycle) {
+    if (d_dstype_slot_bucketed (dbclass->ds_type)) {
+        d_imdb_check_error (imdb_slot_bucket_find (imdb, class_block, slot_bsize, &find_ctx));
+    }
+    else if (dbclass->cdef.opt_recycle) {
         d_imdb_check_error (imdb_slot_free_get_or_recycle (imdb, class_block, slot_bsize, &find_ctx));
     }
     else {
@@ -1506,11 +2357,17 @@ imdb_class_instance_alloc (imdb_t * imdb, imdb_block_class_t * class_block, void
     d_log_dprintf (IMDB_SERVICE_NAME, "alloc: free slot found - page=%p, block=%p, slot=%p, len=%u",
                    find_ctx.page_block, find_ctx.block, find_ctx.slot_free, find_ctx.slot_free->length);
 
-    imdb_slot_free_extract (imdb, class_block, &find_ctx, slot_bsize, extra_bsize);
+    if (d_dstype_slot_bucketed (dbclass->ds_type)) {
+        d_imdb_check_error (imdb_slot_bucket_extract (imdb, class_block, &find_ctx, slot_bsize, extra_bsize));
+    }
+    else {
+        imdb_slot_free_extract (imdb, class_block, &find_ctx, slot_bsize, extra_bsize);
+    }
     d_log_dprintf (IMDB_SERVICE_NAME, "alloc: data slot=%p, rid=%p:%u:%u", find_ctx.slot_free,
-                   find_ctx.page_block->block.id.raw, find_ctx.block->block_index, d_pointer_diff (find_ctx.slot_free,
-                                                                                                   find_ctx.block));
-    d_release_page_block (imdb, find_ctx.page_block);
+                   d_block_get_page_blockid (find_ctx.block, imdb->db_def.block_size), find_ctx.block->block_index,
+                   d_pointer_diff (find_ctx.slot_free, find_ctx.block));
+    if (find_ctx.page_block)
+        d_release_page_block (imdb, find_ctx.page_block);
 
     switch (dbclass->ds_type) {
     case DATA_SLOT_TYPE_1:
@@ -1527,468 +2384,2135 @@ imdb_class_instance_alloc (imdb_t * imdb, imdb_block_class_t * class_block, void
         d_assert (false, "ds_type=%u", dbclass->ds_type);
     }
 
-    d_release_block (imdb, find_ctx.block);
+    if (d_dstype_slot_bucketed (dbclass->ds_type)) {
+        d_release_linked_block (imdb, class_block, find_ctx.block);
+    }
+    else {
+        d_release_block (imdb, find_ctx.block);
+    }
 
     return IMDB_ERR_SUCCESS;
 }
 
 /*
-[public] Initialize imdb instance
-  - hndlr: result handler to imdb instance
-  - hcurmdb: handler
-  - result: imdb error code
+[private] Calculate index key hash (FNV-1a folded to 16 bits)
+  - index: index definition
+  - key: key pointer
+  - result: key hash
 */
-imdb_errcode_t  ICACHE_FLASH_ATTR
-imdb_init (imdb_def_t * imdb_def, imdb_hndlr_t * himdb)
+LOCAL uint16    ICACHE_FLASH_ATTR
+imdb_index_hash (imdb_index_t * index, const char *key)
 {
-    imdb_t         *imdb;
+    uint32          res = 2166136261U;
+    uint8           i;
+    for (i = 0; i < index->key_len; i++) {
+        if ((index->key_type == KEY_TYPE_STRING) && !key[i])
+            break;
+        res ^= (uint8) key[i];
+        res *= 16777619U;
+    }
 
-    if (imdb_def->opt_media) {
-        uint8           bucket_size = MAX (MIN (256, imdb_def->buffer_size << 2), 8);
-        size_t          bcmap_size =
-            d_hash8_fixedmap_size (sizeof (size_t), sizeof (imdb_bc_block_t), bucket_size, imdb_def->buffer_size);
-        imdb_bc_t      *imdb_bc;
-        imdb_bc = os_malloc (sizeof (imdb_bc_t) + bcmap_size);
-        os_memset (imdb_bc, 0, sizeof (imdb_bc_t));
-        imdb_bc->bcmap_size = bcmap_size;
-        // hash-map block_id->bc_addr
-        ih_init8 (imdb_bc->bcmap, bcmap_size, bucket_size, sizeof (size_t), sizeof (imdb_bc_block_t), &imdb_bc->hbcmap);
-        // create buffer cache
-        imdb_bc->buffer_cache = os_malloc (imdb_def->buffer_size * imdb_def->block_size);
-        imdb_bc->bc_free_list = d_pointer_as (imdb_bc_free_block_t, imdb_bc->buffer_cache);
+    return (uint16) ((res >> 16) ^ res);
+}
 
-        {                       // make free list
-            imdb_bc_free_block_t *fl = imdb_bc->bc_free_list;
-            imdb_bc_free_block_t *max_ptr =
-                d_pointer_add (imdb_bc_free_block_t, fl, imdb_def->buffer_size * imdb_def->block_size);
-            while (true) {
-                imdb_bc_free_block_t *flnext = d_pointer_add (imdb_bc_free_block_t, fl, imdb_def->block_size);
-                if (flnext >= max_ptr) {
-                    fl->fl_next_block = NULL;
-                    break;
-                }
-                fl->fl_next_block = flnext;
-                fl = flnext;
-            }
-        }
+/*
+[private] Compare index keys
+  - index: index definition
+  - key1, key2: key pointers
+  - result: true when keys are equal
+*/
+LOCAL bool      ICACHE_FLASH_ATTR
+imdb_index_key_equal (imdb_index_t * index, const char *key1, const char *key2)
+{
+    if (index->key_type == KEY_TYPE_STRING)
+        return (os_strncmp (key1, key2, index->key_len) == 0);
+    else
+        return (os_memcmp (key1, key2, index->key_len) == 0);
+}
 
-        d_log_wprintf (IMDB_SERVICE_NAME, "buffers:%p, len:%u, maplen:%u", imdb_bc->buffer_cache,
-                       imdb_def->buffer_size * imdb_def->block_size, bcmap_size);
+/*
+[inline] Return rowid of the object (Type#2, Type#4)
+  - ds_type: class data slot type
+  - ptr: object pointer
+  - rowid: result row id
+*/
+INLINED void    ICACHE_FLASH_ATTR
+imdb_slot_rowid (imdb_data_slot_type_t ds_type, void *ptr, imdb_rowid_t * rowid)
+{
+    imdb_slot_data4_t *slot_data4 = d_pointer_add (imdb_slot_data4_t, ptr, -sizeof (imdb_slot_data4_t));
+    imdb_block_t   *block = d_pointer_add (imdb_block_t, slot_data4, -d_bptr_size (slot_data4->block_offset));
+    // Type#2 and Type#4 slots have the same block offset position
+    rowid->block_id = block->id.raw;
+    rowid->ds_type = ds_type;
+    rowid->slot_offset = slot_data4->block_offset;
+}
 
-        imdb = &imdb_bc->base;
-        d_stat_alloc (imdb, sizeof (imdb_bc_t) + bcmap_size + imdb_def->buffer_size * imdb_def->block_size);
-    }
-    else {
-        st_zalloc (imdb, imdb_t);
-        d_stat_alloc (imdb, sizeof (imdb_t));
-    }
+/*
+[private] Allocate and clear index page
+  - imdb:
+  - page_blocks: page size in blocks
+  - result: page pointer, BLOCK_PTR_RAW_NONE on allocation error
+*/
+LOCAL size_t    ICACHE_FLASH_ATTR
+imdb_index_page_alloc (imdb_t * imdb, page_blocks_t page_blocks)
+{
+    block_size_t    bsize = imdb->db_def.block_size;
+    imdb_block_t   *block = d_pointer_as (imdb_block_t, imdb_internal_page_alloc (imdb, page_blocks, false));
+    if (!block)
+        return BLOCK_PTR_RAW_NONE;
 
-    if (!imdb_def->block_size) {
-        imdb_def->block_size = IMDB_BLOCK_SIZE_DEFAULT;
-    }
-    else {
-        imdb_def->block_size = MAX (IMDB_BLOCK_SIZE_MIN, d_size_align (imdb_def->block_size));
+    size_t          page_addr = block->id.raw;
+    page_blocks_t   bidx;
+    for (bidx = 1; bidx <= page_blocks; bidx++) {
+        size_t          block_addr = page_addr + (bidx - 1) * bsize;
+        if ((bidx > 1) && imdb->db_def.opt_media) {
+            block = fdb_cache_get (d_pointer_as (imdb_bc_t, imdb), block_addr, true, DATA_LOCK_WRITE);
+            if (!block)
+                return BLOCK_PTR_RAW_NONE;
+        }
+        else if (bidx > 1) {
+            block = d_pointer_as (imdb_block_t, block_addr);
+        }
+
+        os_memset (block, 0, bsize);
+        block->id.raw = block_addr;
+        block->block_index = bidx;
+        block->btype = BLOCK_TYPE_INDEX;
+#ifdef IMDB_BLOCK_CRC
+#else
+        block->crc16 = IMDB_BLOCK_CRC_DEFAULT;
+#endif
+        d_stat_block_init (imdb);
+        d_unlock_block (imdb, block);
     }
-    os_memcpy (&imdb->db_def, imdb_def, sizeof (imdb_def_t));
-    imdb->obj_bsize_max = d_size_bptr (imdb->db_def.block_size - block_header_size[BLOCK_TYPE_CLASS]);
-    imdb->class_first.raw = BLOCK_PTR_RAW_NONE;
-    imdb->class_last.raw = BLOCK_PTR_RAW_NONE;
 
-    d_log_dprintf (IMDB_SERVICE_NAME, "init: instance init %p (bsz=%u)", imdb, imdb->db_def.block_size);
-    d_log_dprintf (IMDB_SERVICE_NAME,
-                   "init: structures size:\n\timdb\t: %lu,\n\tclass\t: %lu,\n\tpage\t: %lu,\n\tblock\t: %lu,\n\tslot\t: %lu:%lu",
-                   sizeof (imdb_t), sizeof (imdb_class_t), sizeof (imdb_page_t), sizeof (imdb_block_t),
-                   sizeof (imdb_slot_free_t), sizeof (imdb_slot_footer_t));
-
-    *himdb = d_obj2hndlr (imdb);
+    return page_addr;
+}
 
-    if (imdb_def->opt_media) {
-        // read header
-        imdb_file_t     hdr_file;
-        imdb->stat.header_read++;
-        imdb_errcode_t  hres = fdb_header_read (&hdr_file);
-        if ((hres != IMDB_ERR_SUCCESS) || (hdr_file.block_size != imdb_def->block_size)) {
-            hdr_file.version = IMDB_FILE_HEADER_VERSION;
-            hdr_file.block_size = imdb_def->block_size;
-            hdr_file.class_last = BLOCK_PTR_RAW_NONE;
-            hdr_file.file_size = MIN (imdb_def->file_size, fio_user_size () / imdb_def->block_size);
-            hdr_file.file_hwm = 0;
-            hdr_file.scn = 0;
-            d_log_wprintf (IMDB_SERVICE_NAME, "create new file: %ubl", hdr_file.file_size);
-            imdb->stat.header_write++;
-            fdb_header_write (&hdr_file);
-        }
-        else {
-            d_log_wprintf (IMDB_SERVICE_NAME, "read data file [SCN:%u,size:%ubl]", hdr_file.scn, hdr_file.file_size);
-            imdb->class_first.fptr = (hdr_file.file_hwm) ? imdb_def->block_size : BLOCK_PTR_RAW_NONE;
-            imdb->class_last.fptr = hdr_file.class_last;
-        }
+/*
+[private] Release index page
+  - imdb:
+  - page_ptr: index page
+  - page_blocks: page size in blocks
+  - result: imdb error code
+*/
+LOCAL imdb_errcode_t ICACHE_FLASH_ATTR
+imdb_index_page_free (imdb_t * imdb, page_ptr_t page_ptr, page_blocks_t page_blocks)
+{
+    d_stat_page_free (imdb);
+    if (!imdb->db_def.opt_media) {
+        d_stat_free (imdb, page_blocks * imdb->db_def.block_size);
+        os_free (page_ptr.mptr);
+        return IMDB_ERR_SUCCESS;
     }
 
-    return IMDB_ERR_SUCCESS;
+    imdb_file_t     hdr_file;
+    imdb->stat.header_read++;
+    d_imdb_check_error (fdb_header_read (&hdr_file));
+
+    page_blocks_t   bidx;
+    for (bidx = 1; bidx <= page_blocks; bidx++)
+        fdb_cache_discard (d_pointer_as (imdb_bc_t, imdb), page_ptr.raw + (bidx - 1) * imdb->db_def.block_size);
+    d_imdb_check_error (fdb_page_free (imdb, &hdr_file, page_ptr.raw, page_blocks));
+    d_imdb_check_error (fdb_file_trim (imdb, &hdr_file));
+
+    // header must not reference blocks which are not written yet
+    d_imdb_check_error (imdb_flush (d_obj2hndlr (imdb)));
+    imdb->stat.header_write++;
+    return fdb_header_write (&hdr_file);
 }
 
-imdb_errcode_t  ICACHE_FLASH_ATTR
-imdb_flush (imdb_hndlr_t hmdb)
+/*
+[private] Put entry into index page without capacity checks
+  - imdb:
+  - page_ptr: index page
+  - slots: total index entries
+  - entry: source entry
+  - reused: result, true when deleted entry was reused
+  - result: imdb error code
+*/
+LOCAL imdb_errcode_t ICACHE_FLASH_ATTR
+imdb_index_entry_put (imdb_t * imdb, page_ptr_t page_ptr, uint32 slots, imdb_index_entry_t * entry, bool * reused)
 {
-    d_imdb_check_hndlr (hmdb);
-    imdb_t         *imdb = d_hndlr2obj (imdb_t, hmdb);
-    if (imdb->db_def.opt_media) {
-        fdb_flush_data_t data;
-        data.imdb_bc = d_pointer_as (imdb_bc_t, imdb);
-        if (ih_hash8_forall (data.imdb_bc->hbcmap, fdb_forall_cache_flush, &data) != IH_ERR_SUCCESS)
-            return IMDB_INTERNAL_ERROR;
-    }
+    uint32          bentries = d_index_block_entries (imdb);
+    uint32          slot = entry->hash % slots;
+    while (true) {
+        block_ptr_t     block_ptr;
+        block_ptr.raw = page_ptr.raw + (slot / bentries) * imdb->db_def.block_size;
+        imdb_block_t   *block = d_acquire_block (imdb, block_ptr, DATA_LOCK_WRITE);
+        if (!block) {
+            d_log_eprintf (IMDB_SERVICE_NAME, sz_imdb_error[IMDB_BLOCK_ACCESS], block_ptr.raw);
+            return IMDB_BLOCK_ACCESS;
+        }
 
-    return IMDB_ERR_SUCCESS;
+        imdb_index_entry_t *ientry = d_index_entry_byidx (block, slot % bentries);
+        if (!d_index_entry_live (ientry)) {
+            *reused = !d_index_entry_empty (ientry);
+            os_memcpy (ientry, entry, sizeof (imdb_index_entry_t));
+            d_unlock_block (imdb, block);
+            return IMDB_ERR_SUCCESS;
+        }
+        d_unlock_block (imdb, block);
+
+        slot = (slot + 1) % slots;
+    }
 }
 
 /*
-[public] Destroy imdb instance and all storages
-  - hndlr: handler to imdb instance
+[private] Reallocate index page for the given entries count, deleted entries are dropped
+  - imdb:
+  - class_block:
+  - idx_id: index identifier
+  - count: expected live entries
   - result: imdb error code
-  */
-imdb_errcode_t  ICACHE_FLASH_ATTR
-imdb_done (imdb_hndlr_t hmdb)
+*/
+LOCAL imdb_errcode_t ICACHE_FLASH_ATTR
+imdb_index_rebuild (imdb_t * imdb, imdb_block_class_t * class_block, imdb_index_id_t idx_id, uint32 count)
 {
-    d_imdb_check_hndlr (hmdb);
-    imdb_t         *imdb = d_hndlr2obj (imdb_t, hmdb);
-
-    if (imdb->db_def.opt_media) {
-        imdb_flush (hmdb);
-        imdb_bc_t      *imdb_bc = d_pointer_as (imdb_bc_t, imdb);
-        os_free (imdb_bc->buffer_cache);
-        d_stat_free (imdb,
-                     sizeof (imdb_bc_t) + imdb_bc->bcmap_size + imdb->db_def.buffer_size * imdb->db_def.block_size);
+    imdb_index_t   *index = &class_block->dbclass.index[idx_id];
+    uint32          bentries = d_index_block_entries (imdb);
+    uint32          page_blocks = MAX (1, (count * 2 + bentries - 1) / bentries);
+    page_blocks = MIN (page_blocks, 0xFFFF / bentries);
+
+    page_ptr_t      page_new;
+    page_new.raw = imdb_index_page_alloc (imdb, page_blocks);
+    if (page_new.raw == BLOCK_PTR_RAW_NONE) {
+        d_log_eprintf (IMDB_SERVICE_NAME, sz_imdb_error[IMDB_NOMEM]);
+        return IMDB_NOMEM;
     }
-    else {
-        imdb_block_class_t *class_block = imdb->class_first.mptr;
-        while (class_block) {
-            imdb_hndlr_t    hclass = d_obj2hndlr (class_block);
-            class_block = class_block->dbclass.class_next.mptr;
-            imdb_class_destroy (hmdb, hclass);
+
+    uint32          slots = page_blocks * bentries;
+    uint16          live = 0;
+    page_blocks_t   bidx;
+    uint32          eidx;
+    bool            reused;
+    if (index->page.raw != BLOCK_PTR_RAW_NONE) {
+        for (bidx = 1; bidx <= index->blocks; bidx++) {
+            block_ptr_t     block_ptr;
+            block_ptr.raw = index->page.raw + (bidx - 1) * imdb->db_def.block_size;
+            imdb_block_t   *block = d_acquire_block (imdb, block_ptr, DATA_LOCK_READ);
+            if (!block) {
+                d_log_eprintf (IMDB_SERVICE_NAME, sz_imdb_error[IMDB_BLOCK_ACCESS], block_ptr.raw);
+                return IMDB_BLOCK_ACCESS;
+            }
+
+            imdb_errcode_t  res = IMDB_ERR_SUCCESS;
+            for (eidx = 0; (eidx < bentries) && (res == IMDB_ERR_SUCCESS); eidx++) {
+                imdb_index_entry_t *entry = d_index_entry_byidx (block, eidx);
+                if (d_index_entry_live (entry)) {
+                    res = imdb_index_entry_put (imdb, page_new, slots, entry, &reused);
+                    live++;
+                }
+            }
+            d_unlock_block (imdb, block);
+            d_imdb_check_error (res);
         }
-        d_stat_free (imdb, sizeof (imdb_t));
+
+        d_imdb_check_error (imdb_index_page_free (imdb, index->page, index->blocks));
+        imdb->stat.index_rebuild++;
     }
 
-    d_assert (imdb->stat.mem_alloc == imdb->stat.mem_free, "alloc=%u, free=%u", imdb->stat.mem_alloc,
-              imdb->stat.mem_free);
-    d_log_dprintf (IMDB_SERVICE_NAME, "done: instance done %p (mem=%lu)", imdb,
-                   imdb->stat.mem_alloc - imdb->stat.mem_free);
+    d_setwrite_block (imdb, class_block);
+    index->page.raw = page_new.raw;
+    index->blocks = page_blocks;
+    index->count = live;
+    index->used = live;
 
-    os_free (imdb);
     return IMDB_ERR_SUCCESS;
 }
 
 /*
-[public] Query imdb instance information (statistics, etc)
-  - hndlr: handler to imdb instance
-  - imdb_info: result pointer to class_info structure
+[private] Add object into index
+  - imdb:
+  - class_block:
+  - idx_id: index identifier
+  - hash: object key hash
+  - rowid: object row id
   - result: imdb error code
 */
-imdb_errcode_t  ICACHE_FLASH_ATTR
-imdb_info (imdb_hndlr_t hmdb, imdb_info_t * imdb_info, imdb_class_info_t info_array[], uint8 array_len)
+LOCAL imdb_errcode_t ICACHE_FLASH_ATTR
+imdb_index_entry_add (imdb_t * imdb, imdb_block_class_t * class_block, imdb_index_id_t idx_id, uint16 hash,
+                      imdb_rowid_t * rowid)
 {
-    d_imdb_check_hndlr (hmdb);
-
-    imdb_t         *imdb = d_hndlr2obj (imdb_t, hmdb);
-    os_memcpy (&imdb_info->stat, &imdb->stat, sizeof (imdb_stat_t));
-    os_memcpy (&imdb_info->db_def, &imdb->db_def, sizeof (imdb_def_t));
-
-    imdb_info->size_class = sizeof (imdb_block_class_t);
-    imdb_info->size_page = sizeof (imdb_block_page_t);
-    imdb_info->size_block = sizeof (imdb_block_t);
-    imdb_info->size_rowid = sizeof (imdb_rowid_t);
-    imdb_info->size_cursor = sizeof (imdb_cursor_t);
-
-    imdb_info->class_count = 0;
-    class_ptr_t     class_ptr;
-    class_ptr.raw = imdb->class_first.raw;
-    while (class_ptr.raw != BLOCK_PTR_RAW_NONE) {
-        imdb_block_class_t *class_block = d_acquire_class_block (imdb, class_ptr);
-        if (!class_block) {
-            d_log_eprintf (IMDB_SERVICE_NAME, sz_imdb_error[IMDB_BLOCK_ACCESS], class_ptr.raw);
-            return IMDB_BLOCK_ACCESS;
-        }
+    imdb_index_t   *index = &class_block->dbclass.index[idx_id];
+    uint32          slots = index->blocks * d_index_block_entries (imdb);
+    if (index->used + 1 > d_index_used_limit (slots)) {
+        imdb_errcode_t  res = imdb_index_rebuild (imdb, class_block, idx_id, index->count + 1);
+        if ((res != IMDB_ERR_SUCCESS) && (index->used + 2 > slots))
+            return res;
+        slots = index->blocks * d_index_block_entries (imdb);
+    }
 
-        imdb_info->class_count++;
-        if (array_len >= imdb_info->class_count) {
-            imdb_class_info (hmdb, d_obj2hndlr (class_block->block.id.raw), &info_array[imdb_info->class_count - 1]);
-        }
-        d_release_class_block (imdb, class_block);
+    imdb_index_entry_t entry;
+    entry.block_id = rowid->block_id;
+    entry.slot_offset = rowid->slot_offset;
+    entry.hash = hash;
+    bool            reused = false;
+    d_imdb_check_error (imdb_index_entry_put (imdb, index->page, slots, &entry, &reused));
 
-        class_ptr.raw = class_block->dbclass.class_next.raw;
-    }
+    d_setwrite_block (imdb, class_block);
+    index->count++;
+    if (!reused)
+        index->used++;
 
     return IMDB_ERR_SUCCESS;
 }
 
-
 /*
- * [public] Find class by name
- *  - hmdb: Handler to imdb instance
- *  - name: class name
- *  - hclass: Result Class instance handler
- *  - result: imdb error code
- */
-imdb_errcode_t
-imdb_class_find (imdb_hndlr_t hmdb, const char *name, imdb_hndlr_t * hclass)
+[private] Remove object from index
+  - imdb:
+  - class_block:
+  - idx_id: index identifier
+  - hash: object key hash
+  - rowid: object row id
+  - result: imdb error code
+*/
+LOCAL imdb_errcode_t ICACHE_FLASH_ATTR
+imdb_index_entry_remove (imdb_t * imdb, imdb_block_class_t * class_block, imdb_index_id_t idx_id, uint16 hash,
+                         imdb_rowid_t * rowid)
 {
-    d_imdb_check_hndlr (hmdb);
-    imdb_t         *imdb = d_hndlr2obj (imdb_t, hmdb);
-
-    *hclass = 0;
-    class_ptr_t     class_ptr;
-    class_ptr.raw = imdb->class_first.raw;
-    while (class_ptr.raw != BLOCK_PTR_RAW_NONE) {
-        imdb_block_class_t *class_block = d_acquire_class_block (imdb, class_ptr);
-        if (!class_block) {
-            d_log_eprintf (IMDB_SERVICE_NAME, sz_imdb_error[IMDB_BLOCK_ACCESS], class_ptr.raw);
+    imdb_index_t   *index = &class_block->dbclass.index[idx_id];
+    uint32          bentries = d_index_block_entries (imdb);
+    uint32          slots = index->blocks * bentries;
+    uint32          slot = hash % slots;
+    uint32          n = 0;
+    bool            fprobe = true;      // probe hash chain first, then scan whole index when key was changed
+    while (n < slots) {
+        block_ptr_t     block_ptr;
+        block_ptr.raw = index->page.raw + (slot / bentries) * imdb->db_def.block_size;
+        imdb_block_t   *block = d_acquire_block (imdb, block_ptr, DATA_LOCK_READ);
+        if (!block) {
+            d_log_eprintf (IMDB_SERVICE_NAME, sz_imdb_error[IMDB_BLOCK_ACCESS], block_ptr.raw);
             return IMDB_BLOCK_ACCESS;
         }
-        class_ptr.raw = class_block->dbclass.class_next.raw;
-        int             cmpres = os_strncmp (class_block->dbclass.cdef.name, name, sizeof (class_name_t));
-        d_release_class_block (imdb, class_block);
 
-        if (cmpres == 0) {
-            *hclass = d_obj2hndlr (class_block->block.id.raw);
+        imdb_index_entry_t *ientry = d_index_entry_byidx (block, slot % bentries);
+        if (fprobe && d_index_entry_empty (ientry)) {
+            d_unlock_block (imdb, block);
+            fprobe = false;
+            slot = 0;
+            n = 0;
+            continue;
+        }
+        if ((ientry->block_id == rowid->block_id) && (ientry->slot_offset == rowid->slot_offset)) {
+            d_setwrite_block (imdb, block);
+            ientry->block_id = BLOCK_PTR_RAW_NONE;
+            ientry->slot_offset = IMDB_INDEX_SLOT_DELETED;
+            d_unlock_block (imdb, block);
+
+            d_setwrite_block (imdb, class_block);
+            index->count--;
             return IMDB_ERR_SUCCESS;
         }
+        d_unlock_block (imdb, block);
 
+        slot = (slot + 1) % slots;
+        n++;
     }
 
+    d_log_wprintf (IMDB_SERVICE_NAME, "index %u entry not found, rid=%p:%u", idx_id, rowid->block_id,
+                   rowid->slot_offset);
     return IMDB_ERR_SUCCESS;
 }
 
+// inserted object must be committed before the next insert or index access of the class
+#define d_imdb_assert_committed(dbclass) \
+	d_assert ((dbclass)->idx_pending.block_id == BLOCK_PTR_RAW_NONE, "class \"%s\" insert is not committed", \
+		(dbclass)->cdef.name)
+
 /*
- * [public] Create class storage for object.
- *   - hmdb: Handler to imdb instance
- *   - cdef: Class definition
- *   - hclass: Result Class instance handler
- *   - result: imdb error code
- */
-imdb_errcode_t  ICACHE_FLASH_ATTR
-imdb_class_create (imdb_hndlr_t hmdb, imdb_class_def_t * cdef, imdb_hndlr_t * hclass)
+[private] Add the last inserted object into class indexes, its key is written by caller after insert.
+  - imdb:
+  - class_block:
+  - result: imdb error code
+*/
+LOCAL imdb_errcode_t ICACHE_FLASH_ATTR
+imdb_index_pending_add (imdb_t * imdb, imdb_block_class_t * class_block)
 {
-    d_imdb_check_hndlr (hmdb);
-    imdb_t         *imdb = d_hndlr2obj (imdb_t, hmdb);
-
-    cdef->page_blocks = MAX (IMDB_FIRST_PAGE_BLOCKS_MIN, cdef->page_blocks);
-    cdef->obj_size = d_size_align (cdef->obj_size);
-    obj_size_t      obj_bsize_min = d_size_bptr (cdef->obj_size);
-    if ((obj_bsize_min > imdb->obj_bsize_max) || (obj_bsize_min == 0 && !cdef->opt_variable)) {
-        return IMDB_INVALID_OBJSIZE;
-    }
+    imdb_class_t   *dbclass = &class_block->dbclass;
+    imdb_rowid_t    rowid;
+    os_memcpy (&rowid, &dbclass->idx_pending, sizeof (imdb_rowid_t));
+    d_setwrite_block (imdb, class_block);
+    dbclass->idx_pending.block_id = BLOCK_PTR_RAW_NONE;
 
-    if (cdef->opt_recycle && cdef->page_blocks <= 2) {
-        return IMDB_INVALID_RECYCLE_STORAGE;
-    }
+    block_ptr_t     block_ptr;
+    block_ptr.raw = rowid.block_id;
+    imdb_block_t   *block = imdb_linked_block_acquire (imdb, class_block, block_ptr, DATA_LOCK_READ);
+    if (!block)
+        return IMDB_BLOCK_ACCESS;
 
-    if (cdef->pct_free > IMDB_PCT_FREE_MAX) {
-        cdef->pct_free = IMDB_PCT_FREE_MAX;
+    const char     *dataptr = d_slot_offset_dataptr (block, rowid.slot_offset);
+    uint16          idx_hash[IMDB_CLASS_INDEX_MAX];
+    imdb_index_id_t idx_id;
+    for (idx_id = 0; idx_id < IMDB_CLASS_INDEX_MAX; idx_id++) {
+        imdb_index_t   *index = &dbclass->index[idx_id];
+        if (index->page.raw != BLOCK_PTR_RAW_NONE)
+            idx_hash[idx_id] = imdb_index_hash (index, dataptr + index->key_offset);
     }
+    d_release_linked_block (imdb, class_block, block);
 
-    imdb_block_class_t *class_block = imdb_class_page_alloc (imdb, cdef);
-    if (!class_block) {
-        d_log_eprintf (IMDB_SERVICE_NAME, sz_imdb_error[IMDB_NOMEM]);
-        return IMDB_NOMEM;
+    for (idx_id = 0; idx_id < IMDB_CLASS_INDEX_MAX; idx_id++) {
+        if (dbclass->index[idx_id].page.raw != BLOCK_PTR_RAW_NONE)
+            d_imdb_check_error (imdb_index_entry_add (imdb, class_block, idx_id, idx_hash[idx_id], &rowid));
     }
-    size_t          rawid = class_block->block.id.raw;
-
-    class_block->dbclass.class_next.raw = BLOCK_PTR_RAW_NONE;
-    class_block->dbclass.class_prev.raw = BLOCK_PTR_RAW_NONE;
-    class_block->dbclass.obj_bsize_min = obj_bsize_min;
 
-    if (imdb->class_last.raw != BLOCK_PTR_RAW_NONE) {
-        class_block->dbclass.class_prev.raw = imdb->class_last.raw;
-
-        imdb_block_class_t *class_last = d_acquire_class_block (imdb, imdb->class_last);
-        if (!class_last) {
-            d_log_cprintf (IMDB_SERVICE_NAME, sz_imdb_error[IMDB_BLOCK_ACCESS], imdb->class_last.raw);
-            return IMDB_BLOCK_ACCESS;
-        }
+    return IMDB_ERR_SUCCESS;
+}
 
-        class_last->dbclass.class_next.raw = rawid;
-        d_release_class_block (imdb, class_last);
+/*
+[private] Remove deleting object from class indexes.
+  - imdb:
+  - class_block:
+  - rowid: object row id
+  - idx_hash: object key hashes, calculated before object was released
+  - result: imdb error code
+*/
+LOCAL imdb_errcode_t ICACHE_FLASH_ATTR
+imdb_index_obj_remove (imdb_t * imdb, imdb_block_class_t * class_block, imdb_rowid_t * rowid, uint16 idx_hash[])
+{
+    imdb_class_t   *dbclass = &class_block->dbclass;
+    if ((dbclass->idx_pending.block_id == rowid->block_id) && (dbclass->idx_pending.slot_offset == rowid->slot_offset)) {
+        d_setwrite_block (imdb, class_block);
+        dbclass->idx_pending.block_id = BLOCK_PTR_RAW_NONE;
+        return IMDB_ERR_SUCCESS;
     }
-    else
-        imdb->class_first.raw = rawid;
-    imdb->class_last.raw = rawid;
 
-    d_release_class_block (imdb, class_block);
-    *hclass = d_obj2hndlr (rawid);
-    d_log_iprintf (IMDB_SERVICE_NAME, "created \"%s\" %p (type=%u,pbs=%u,os=%u)", cdef->name, *hclass,
-                   class_block->dbclass.ds_type, cdef->page_blocks, cdef->obj_size);
+    imdb_index_id_t idx_id;
+    for (idx_id = 0; idx_id < IMDB_CLASS_INDEX_MAX; idx_id++) {
+        if (dbclass->index[idx_id].page.raw != BLOCK_PTR_RAW_NONE)
+            d_imdb_check_error (imdb_index_entry_remove (imdb, class_block, idx_id, idx_hash[idx_id], rowid));
+    }
 
     return IMDB_ERR_SUCCESS;
 }
 
-
 /*
-[public] Destroy class storage for object and deallocate memory.
-  - hcls: handler to class instance
+[public] Initialize imdb instance
+  - hndlr: result handler to imdb instance
+  - hcurmdb: handler
   - result: imdb error code
 */
 imdb_errcode_t  ICACHE_FLASH_ATTR
-imdb_class_destroy (imdb_hndlr_t hmdb, imdb_hndlr_t hclass)
+imdb_init (imdb_def_t * imdb_def, imdb_hndlr_t * himdb)
 {
-    d_imdb_check_hndlr (hmdb);
-    d_imdb_check_hndlr (hclass);
-
-    imdb_t         *imdb = d_hndlr2obj (imdb_t, hmdb);
-    class_ptr_t     class_ptr;
-    class_ptr.raw = (size_t) hclass;
+    imdb_t         *imdb;
 
-    imdb_block_class_t *class_block = d_acquire_class_block (imdb, class_ptr);
-    if (!class_block) {
-        d_log_eprintf (IMDB_SERVICE_NAME, sz_imdb_error[IMDB_BLOCK_ACCESS], class_ptr.raw);
-        return IMDB_BLOCK_ACCESS;
+    if (imdb_def->opt_media) {
+        uint8           bucket_size = MAX (MIN (256, imdb_def->buffer_size << 2), 8);
+        size_t          bcmap_size =
+            d_hash8_fixedmap_size (sizeof (size_t), sizeof (imdb_bc_block_t *), bucket_size, imdb_def->buffer_size);
+        imdb_bc_t      *imdb_bc;
+        imdb_bc = os_malloc (sizeof (imdb_bc_t) + bcmap_size);
+        os_memset (imdb_bc, 0, sizeof (imdb_bc_t));
+        imdb_bc->bcmap_size = bcmap_size;
+        // hash-map block_id->bc_addr
+        ih_init8 (imdb_bc->bcmap, bcmap_size, bucket_size, sizeof (size_t), sizeof (imdb_bc_block_t *),
+                  &imdb_bc->hbcmap);
+        // create buffer cache
+        imdb_bc->buffer_cache = os_malloc (imdb_def->buffer_size * imdb_def->block_size);
+        imdb_bc->bc_free_list = d_pointer_as (imdb_bc_free_block_t, imdb_bc->buffer_cache);
+        // buffer descriptors
+        imdb_bc->bc_blocks = os_malloc (imdb_def->buffer_size * sizeof (imdb_bc_block_t));
+        {
+            uint32          i;
+            for (i = 0; i < imdb_def->buffer_size; i++) {
+                imdb_bc_block_t *bc_block = &imdb_bc->bc_blocks[i];
+                os_memset (bc_block, 0, sizeof (imdb_bc_block_t));
+                bc_block->mptr = d_pointer_add (imdb_block_t, imdb_bc->buffer_cache, i * imdb_def->block_size);
+                bc_block->block_addr = BLOCK_PTR_RAW_NONE;
+            }
+        }
+
+        {                       // make free list
+            imdb_bc_free_block_t *fl = imdb_bc->bc_free_list;
+            imdb_bc_free_block_t *max_ptr =
+                d_pointer_add (imdb_bc_free_block_t, fl, imdb_def->buffer_size * imdb_def->block_size);
+            while (true) {
+                imdb_bc_free_block_t *flnext = d_pointer_add (imdb_bc_free_block_t, fl, imdb_def->block_size);
+                if (flnext >= max_ptr) {
+                    fl->fl_next_block = NULL;
+                    break;
+                }
+                fl->fl_next_block = flnext;
+                fl = flnext;
+            }
+        }
+
+        d_log_wprintf (IMDB_SERVICE_NAME, "buffers:%p, len:%u, maplen:%u", imdb_bc->buffer_cache,
+                       imdb_def->buffer_size * imdb_def->block_size, bcmap_size);
+
+        imdb = &imdb_bc->base;
+        d_stat_alloc (imdb, sizeof (imdb_bc_t) + bcmap_size +
+                      imdb_def->buffer_size * (imdb_def->block_size + sizeof (imdb_bc_block_t)));
+    }
+    else {
+        st_zalloc (imdb, imdb_t);
+        d_stat_alloc (imdb, sizeof (imdb_t));
+    }
+
+    if (!imdb_def->block_size) {
+        imdb_def->block_size = IMDB_BLOCK_SIZE_DEFAULT;
+    }
+    else {
+        imdb_def->block_size = MAX (IMDB_BLOCK_SIZE_MIN, d_size_align (imdb_def->block_size));
+    }
+    os_memcpy (&imdb->db_def, imdb_def, sizeof (imdb_def_t));
+    imdb->obj_bsize_max = d_size_bptr (imdb->db_def.block_size - block_header_size[BLOCK_TYPE_CLASS]);
+    imdb->class_first.raw = BLOCK_PTR_RAW_NONE;
+    imdb->class_last.raw = BLOCK_PTR_RAW_NONE;
+
+    d_log_dprintf (IMDB_SERVICE_NAME, "init: instance init %p (bsz=%u)", imdb, imdb->db_def.block_size);
+    d_log_dprintf (IMDB_SERVICE_NAME,
+                   "init: structures size:\n\timdb\t: %lu,\n\tclass\t: %lu,\n\tpage\t: %lu,\n\tblock\t: %lu,\n\tslot\t: %lu:%lu",
+                   sizeof (imdb_t), sizeof (imdb_class_t), sizeof (imdb_page_t), sizeof (imdb_block_t),
+                   sizeof (imdb_slot_free_t), sizeof (imdb_slot_footer_t));
+
+    *himdb = d_obj2hndlr (imdb);
+
+    if (imdb_def->opt_media) {
+        // read header
+        imdb_file_t     hdr_file;
+        imdb->stat.header_read++;
+        imdb_errcode_t  hres = fdb_header_read (&hdr_file);
+        if ((hres != IMDB_ERR_SUCCESS) || (hdr_file.version != IMDB_FILE_HEADER_VERSION)
+            || (hdr_file.block_size != imdb_def->block_size)) {
+            hdr_file.version = IMDB_FILE_HEADER_VERSION;
+            hdr_file.block_size = imdb_def->block_size;
+            hdr_file.class_first = BLOCK_PTR_RAW_NONE;
+            hdr_file.class_last = BLOCK_PTR_RAW_NONE;
+            hdr_file.file_size = MIN (imdb_def->file_size, fio_user_size () / imdb_def->block_size);
+            hdr_file.file_hwm = 0;
+            hdr_file.page_fl_first = BLOCK_PTR_RAW_NONE;
+            hdr_file.page_fl_blocks = 0;
+            hdr_file.scn = 0;
+            d_log_wprintf (IMDB_SERVICE_NAME, "create new file: %ubl", hdr_file.file_size);
+            imdb->stat.header_write++;
+            fdb_header_write (&hdr_file);
+        }
+        else {
+            d_log_wprintf (IMDB_SERVICE_NAME, "read data file [SCN:%u,size:%ubl,free:%ubl]", hdr_file.scn,
+                           hdr_file.file_size, hdr_file.page_fl_blocks);
+            imdb->class_first.fptr = hdr_file.class_first;
+            imdb->class_last.fptr = hdr_file.class_last;
+        }
+    }
+
+    return IMDB_ERR_SUCCESS;
+}
+
+/*
+[public] Write dirty blocks of media storage in block address order
+  - hmdb: handler to imdb instance
+  - max_blocks: maximum blocks to write, 0 - all dirty blocks
+  - result: imdb error code
+*/
+imdb_errcode_t  ICACHE_FLASH_ATTR
+imdb_flush_budget (imdb_hndlr_t hmdb, uint32 max_blocks)
+{
+    d_imdb_check_hndlr (hmdb);
+    imdb_t         *imdb = d_hndlr2obj (imdb_t, hmdb);
+    if (!imdb->db_def.opt_media)
+        return IMDB_ERR_SUCCESS;
+
+    imdb_bc_t      *imdb_bc = d_pointer_as (imdb_bc_t, imdb);
+    uint32          bcnt = 0;
+    while (imdb_bc->bc_dirty_first && (!max_blocks || (bcnt < max_blocks))) {
+        imdb_bc_block_t *bc_block = imdb_bc->bc_dirty_first;
+        d_imdb_check_error (fdb_cache_flush (imdb_bc, bc_block, bc_block->block_addr, false));
+        bcnt++;
+    }
+
+    return IMDB_ERR_SUCCESS;
+}
+
+/*
+[public] Write all dirty blocks of media storage
+  - hmdb: handler to imdb instance
+  - result: imdb error code
+*/
+imdb_errcode_t  ICACHE_FLASH_ATTR
+imdb_flush (imdb_hndlr_t hmdb)
+{
+    d_imdb_check_error (imdb_flush_budget (hmdb, 0));
+
+    imdb_t         *imdb = d_hndlr2obj (imdb_t, hmdb);
+    if (imdb->db_def.opt_media && !fio_user_sync ()) {
+        d_log_eprintf (IMDB_SERVICE_NAME, sz_imdb_error[IMDB_FILE_WRITE_ERROR], 0, fio_user_size (), 0);
+        return IMDB_FILE_WRITE_ERROR;
+    }
+
+    return IMDB_ERR_SUCCESS;
+}
+
+/*
+[private] Find class page or class index page which ends at the given file address
+  - imdb:
+  - page_end: page end address
+  - [out] class_ptr: class of found page
+  - [out] page_ptr: found page, BLOCK_PTR_RAW_NONE when there is no such page
+  - [out] idx_id: index identifier of found index page, IMDB_INDEX_ID_NONE for class page
+  - result: imdb error code
+*/
+LOCAL imdb_errcode_t ICACHE_FLASH_ATTR
+fdb_page_find_byend (imdb_t * imdb, size_t page_end, class_ptr_t * class_ptr, page_ptr_t * page_ptr,
+                     imdb_index_id_t * idx_id)
+{
+    block_size_t    bsize = imdb->db_def.block_size;
+    page_ptr->raw = BLOCK_PTR_RAW_NONE;
+    *idx_id = IMDB_INDEX_ID_NONE;
+    class_ptr->raw = imdb->class_first.raw;
+    while (class_ptr->raw != BLOCK_PTR_RAW_NONE) {
+        imdb_block_class_t *class_block = d_acquire_class_block (imdb, *class_ptr);
+        if (!class_block) {
+            d_log_eprintf (IMDB_SERVICE_NAME, sz_imdb_error[IMDB_BLOCK_ACCESS], class_ptr->raw);
+            return IMDB_BLOCK_ACCESS;
+        }
+
+        imdb_index_id_t iid;
+        for (iid = 0; iid < IMDB_CLASS_INDEX_MAX; iid++) {
+            imdb_index_t   *index = &class_block->dbclass.index[iid];
+            if ((index->page.raw != BLOCK_PTR_RAW_NONE) && (index->page.raw + index->blocks * bsize == page_end)) {
+                page_ptr->raw = index->page.raw;
+                *idx_id = iid;
+                d_release_class_block (imdb, class_block);
+                return IMDB_ERR_SUCCESS;
+            }
+        }
+
+        size_t          psize = class_block->dbclass.cdef.page_blocks * bsize;
+        class_ptr_t     class_next;
+        class_next.raw = class_block->dbclass.class_next.raw;
+        page_ptr_t      page_cur;
+        page_cur.raw = class_ptr->raw;
+        page_ptr_t      page_next;
+        page_next.raw = class_block->page.page_next.raw;
+        d_release_class_block (imdb, class_block);
+
+        // iterate page
+        while (true) {
+            if (page_cur.raw + psize == page_end) {
+                page_ptr->raw = page_cur.raw;
+                return IMDB_ERR_SUCCESS;
+            }
+
+            page_cur.raw = page_next.raw;
+            if (page_cur.raw == BLOCK_PTR_RAW_NONE)
+                break;
+
+            imdb_block_page_t *page_block = d_acquire_page_block (imdb, page_cur, DATA_LOCK_READ);
+            if (!page_block) {
+                d_log_eprintf (IMDB_SERVICE_NAME, sz_imdb_error[IMDB_BLOCK_ACCESS], page_cur.raw);
+                return IMDB_BLOCK_ACCESS;
+            }
+            page_next.raw = page_block->page.page_next.raw;
+            d_release_page_block (imdb, page_block);
+        }
+
+        class_ptr->raw = class_next.raw;
+    }
+
+    return IMDB_ERR_SUCCESS;
+}
+
+/*
+[inline] Return relocated address when it belongs to moving page
+*/
+INLINED size_t  ICACHE_FLASH_ATTR
+fdb_addr_relocate (size_t addr, size_t addr_from, size_t addr_to, size_t psize)
+{
+    return ((addr >= addr_from) && (addr < addr_from + psize)) ? addr - addr_from + addr_to : addr;
+}
+
+/*
+[private] Relocate class index entries and pending object of moving page
+  - imdb:
+  - class_block:
+  - addr_from: old page address
+  - addr_to: new page address
+  - psize: page size in bytes
+  - result: imdb error code
+*/
+LOCAL imdb_errcode_t ICACHE_FLASH_ATTR
+fdb_index_relocate (imdb_t * imdb, imdb_block_class_t * class_block, size_t addr_from, size_t addr_to, size_t psize)
+{
+    imdb_class_t   *dbclass = &class_block->dbclass;
+    size_t          addr = fdb_addr_relocate (dbclass->idx_pending.block_id, addr_from, addr_to, psize);
+    if (addr != dbclass->idx_pending.block_id) {
+        d_setwrite_block (imdb, class_block);
+        dbclass->idx_pending.block_id = addr;
+    }
+
+    uint32          bentries = d_index_block_entries (imdb);
+    imdb_index_id_t idx_id;
+    for (idx_id = 0; idx_id < IMDB_CLASS_INDEX_MAX; idx_id++) {
+        imdb_index_t   *index = &dbclass->index[idx_id];
+        if (index->page.raw == BLOCK_PTR_RAW_NONE)
+            continue;
+
+        page_blocks_t   bidx;
+        for (bidx = 1; bidx <= index->blocks; bidx++) {
+            block_ptr_t     block_ptr;
+            block_ptr.raw = index->page.raw + (bidx - 1) * imdb->db_def.block_size;
+            imdb_block_t   *block = d_acquire_block (imdb, block_ptr, DATA_LOCK_READ);
+            if (!block) {
+                d_log_eprintf (IMDB_SERVICE_NAME, sz_imdb_error[IMDB_BLOCK_ACCESS], block_ptr.raw);
+                return IMDB_BLOCK_ACCESS;
+            }
+
+            uint32          eidx;
+            for (eidx = 0; eidx < bentries; eidx++) {
+                imdb_index_entry_t *entry = d_index_entry_byidx (block, eidx);
+                if (!d_index_entry_live (entry))
+                    continue;
+                addr = fdb_addr_relocate (entry->block_id, addr_from, addr_to, psize);
+                if (addr != entry->block_id) {
+                    d_setwrite_block (imdb, block);
+                    entry->block_id = addr;
+                }
+            }
+            d_unlock_block (imdb, block);
+        }
+    }
+
+    return IMDB_ERR_SUCCESS;
+}
+
+/*
+[private] Move class index page into free page extent below it and release old page
+  - imdb:
+  - hdr_file: file header, written by caller
+  - class_block:
+  - idx_id: index identifier
+  - [out] moved: false when there is no suitable free extent
+  - result: imdb error code
+*/
+LOCAL imdb_errcode_t ICACHE_FLASH_ATTR
+fdb_index_move (imdb_t * imdb, imdb_file_t * hdr_file, imdb_block_class_t * class_block, imdb_index_id_t idx_id,
+                bool * moved)
+{
+    imdb_bc_t      *imdb_bc = d_pointer_as (imdb_bc_t, imdb);
+    block_size_t    bsize = imdb->db_def.block_size;
+    imdb_index_t   *index = &class_block->dbclass.index[idx_id];
+    page_ptr_t      page_ptr;
+    page_ptr.raw = index->page.raw;
+
+    *moved = false;
+    size_t          page_new = fdb_page_fl_alloc (imdb, hdr_file, index->blocks, page_ptr.raw);
+    if (page_new == BLOCK_PTR_RAW_NONE)
+        return IMDB_ERR_SUCCESS;
+
+    d_log_dprintf (IMDB_SERVICE_NAME, "index_move: id=%p -> %p", page_ptr.raw, page_new);
+
+    page_blocks_t   bidx;
+    for (bidx = 1; bidx <= index->blocks; bidx++) {
+        size_t          addr_old = page_ptr.raw + (bidx - 1) * bsize;
+        size_t          addr_new = page_new + (bidx - 1) * bsize;
+
+        imdb_block_t   *block_old = fdb_cache_get (imdb_bc, addr_old, false, DATA_LOCK_READ);
+        if (!block_old)
+            return IMDB_BLOCK_ACCESS;
+        imdb_block_t   *block_new = fdb_cache_get (imdb_bc, addr_new, true, DATA_LOCK_WRITE);
+        if (!block_new) {
+            block_old->lock_flag = DATA_LOCK_NONE;
+            return IMDB_BLOCK_ACCESS;
+        }
+
+        os_memcpy (block_new, block_old, bsize);
+        block_new->id.fptr = addr_new;
+        block_new->lock_flag = DATA_LOCK_NONE;
+        fdb_cache_discard (imdb_bc, addr_old);
+    }
+
+    d_setwrite_block (imdb, class_block);
+    index->page.raw = page_new;
+
+    imdb->stat.page_move++;
+    *moved = true;
+
+    return fdb_page_free (imdb, hdr_file, page_ptr.raw, index->blocks);
+}
+
+/*
+[private] Move class page into free page extent below it and release old page
+  - imdb:
+  - hdr_file: file header, written by caller
+  - class_block:
+  - page_ptr: moving page, must not be class page
+  - [out] moved: false when there is no suitable free extent
+  - result: imdb error code
+*/
+LOCAL imdb_errcode_t ICACHE_FLASH_ATTR
+fdb_page_move (imdb_t * imdb, imdb_file_t * hdr_file, imdb_block_class_t * class_block, page_ptr_t page_ptr,
+               bool * moved)
+{
+    imdb_bc_t      *imdb_bc = d_pointer_as (imdb_bc_t, imdb);
+    block_size_t    bsize = imdb->db_def.block_size;
+    page_blocks_t   page_blocks = class_block->dbclass.cdef.page_blocks;
+    size_t          psize = page_blocks * bsize;
+
+    *moved = false;
+    size_t          page_new = fdb_page_fl_alloc (imdb, hdr_file, page_blocks, page_ptr.raw);
+    if (page_new == BLOCK_PTR_RAW_NONE)
+        return IMDB_ERR_SUCCESS;
+
+    d_log_dprintf (IMDB_SERVICE_NAME, "page_move: id=%p -> %p", page_ptr.raw, page_new);
+
+    block_ptr_t     page_prev;
+    block_ptr_t     page_next;
+    block_ptr_t     block_ptr;
+    imdb_block_t   *block_nb;
+    page_blocks_t   alloc_hwm = 1;
+    page_blocks_t   bidx;
+    for (bidx = 1; bidx <= alloc_hwm; bidx++) {
+        size_t          addr_old = page_ptr.raw + (bidx - 1) * bsize;
+        size_t          addr_new = page_new + (bidx - 1) * bsize;
+
+        imdb_block_t   *block_old = fdb_cache_get (imdb_bc, addr_old, false, DATA_LOCK_READ);
+        if (!block_old)
+            return IMDB_BLOCK_ACCESS;
+        imdb_block_t   *block_new = fdb_cache_get (imdb_bc, addr_new, true, DATA_LOCK_WRITE);
+        if (!block_new) {
+            block_old->lock_flag = DATA_LOCK_NONE;
+            return IMDB_BLOCK_ACCESS;
+        }
+
+        os_memcpy (block_new, block_old, bsize);
+        block_new->id.fptr = addr_new;
+        block_new->lock_flag = DATA_LOCK_WRITE;
+        fdb_cache_discard (imdb_bc, addr_old);
+
+        if (bidx == 1) {
+            imdb_block_page_t *page_block = d_pointer_as (imdb_block_page_t, block_new);
+            alloc_hwm = page_block->page.alloc_hwm;
+            page_prev.raw = page_block->page.page_prev.raw;
+            page_next.raw = page_block->page.page_next.raw;
+        }
+
+        if (d_dstype_slot_bucketed (class_block->dbclass.ds_type)) {
+            imdb_block_fl_t *block_fl = d_block_fl_trailer (imdb, block_new);
+            if (block_fl->bucket != IMDB_SLOT_BUCKET_NONE) {
+                // links inside moving page are shifted, links from outside are updated
+                block_ptr.raw = block_fl->bucket_prev.raw;
+                if (block_ptr.raw == BLOCK_PTR_RAW_NONE) {
+                    d_setwrite_block (imdb, class_block);
+                    class_block->dbclass.fl_bucket[block_fl->bucket].raw = addr_new;
+                }
+                else if (fdb_addr_relocate (block_ptr.raw, page_ptr.raw, page_new, psize) != block_ptr.raw) {
+                    block_fl->bucket_prev.raw = fdb_addr_relocate (block_ptr.raw, page_ptr.raw, page_new, psize);
+                }
+                else {
+                    block_nb = imdb_linked_block_acquire (imdb, class_block, block_ptr, DATA_LOCK_WRITE);
+                    if (!block_nb)
+                        return IMDB_BLOCK_ACCESS;
+                    d_block_fl_trailer (imdb, block_nb)->bucket_next.raw = addr_new;
+                    d_release_linked_block (imdb, class_block, block_nb);
+                }
+
+                block_ptr.raw = block_fl->bucket_next.raw;
+                if (fdb_addr_relocate (block_ptr.raw, page_ptr.raw, page_new, psize) != block_ptr.raw) {
+                    block_fl->bucket_next.raw = fdb_addr_relocate (block_ptr.raw, page_ptr.raw, page_new, psize);
+                }
+                else if (block_ptr.raw != BLOCK_PTR_RAW_NONE) {
+                    block_nb = imdb_linked_block_acquire (imdb, class_block, block_ptr, DATA_LOCK_WRITE);
+                    if (!block_nb)
+                        return IMDB_BLOCK_ACCESS;
+                    d_block_fl_trailer (imdb, block_nb)->bucket_prev.raw = addr_new;
+                    d_release_linked_block (imdb, class_block, block_nb);
+                }
+            }
+        }
+
+        block_new->lock_flag = DATA_LOCK_NONE;
+    }
+
+    // page list, not class page always has previous page
+    block_nb = imdb_linked_block_acquire (imdb, class_block, page_prev, DATA_LOCK_WRITE);
+    if (!block_nb)
+        return IMDB_BLOCK_ACCESS;
+    d_pointer_as (imdb_block_page_t, block_nb)->page.page_next.raw = page_new;
+    d_release_linked_block (imdb, class_block, block_nb);
+
+    if (page_next.raw != BLOCK_PTR_RAW_NONE) {
+        block_nb = imdb_linked_block_acquire (imdb, class_block, page_next, DATA_LOCK_WRITE);
+        if (!block_nb)
+            return IMDB_BLOCK_ACCESS;
+        d_pointer_as (imdb_block_page_t, block_nb)->page.page_prev.raw = page_new;
+        d_release_linked_block (imdb, class_block, block_nb);
+    }
+
+    d_setwrite_block (imdb, class_block);
+    if (class_block->dbclass.page_last.raw == page_ptr.raw)
+        class_block->dbclass.page_last.raw = page_new;
+
+    // page free list
+    if (class_block->dbclass.page_fl_first.raw == page_ptr.raw) {
+        class_block->dbclass.page_fl_first.raw = page_new;
+    }
+    else {
+        block_ptr.raw = class_block->dbclass.page_fl_first.raw;
+        while (block_ptr.raw != BLOCK_PTR_RAW_NONE) {
+            block_nb = imdb_linked_block_acquire (imdb, class_block, block_ptr, DATA_LOCK_READ);
+            if (!block_nb)
+                return IMDB_BLOCK_ACCESS;
+            imdb_block_page_t *page_block = d_pointer_as (imdb_block_page_t, block_nb);
+            block_ptr.raw = page_block->page.page_fl_next.raw;
+            if (block_ptr.raw == page_ptr.raw) {
+                d_setwrite_block (imdb, block_nb);
+                page_block->page.page_fl_next.raw = page_new;
+                block_ptr.raw = BLOCK_PTR_RAW_NONE;
+            }
+            d_release_linked_block (imdb, class_block, block_nb);
+        }
+    }
+
+    d_imdb_check_error (fdb_index_relocate (imdb, class_block, page_ptr.raw, page_new, psize));
+
+    imdb->stat.page_move++;
+    *moved = true;
+
+    return fdb_page_free (imdb, hdr_file, page_ptr.raw, page_blocks);
+}
+
+/*
+[public] Compact media storage: move pages from the end of file into released pages and shrink file high water mark.
+  Class pages are never moved, because class handlers refer them.
+  - hmdb: handler to imdb instance
+  - max_pages: maximum pages to move
+  - result: imdb error code
+*/
+imdb_errcode_t  ICACHE_FLASH_ATTR
+imdb_compact (imdb_hndlr_t hmdb, uint32 max_pages)
+{
+    d_imdb_check_hndlr (hmdb);
+    imdb_t         *imdb = d_hndlr2obj (imdb_t, hmdb);
+    if (!imdb->db_def.opt_media)
+        return IMDB_ERR_SUCCESS;
+
+    imdb_bc_t      *imdb_bc = d_pointer_as (imdb_bc_t, imdb);
+    imdb_file_t     hdr_file;
+    imdb->stat.header_read++;
+    d_imdb_check_error (fdb_header_read (&hdr_file));
+    if ((hdr_file.page_fl_first == BLOCK_PTR_RAW_NONE) || (hdr_file.scn == imdb_bc->compact_scn))
+        return IMDB_ERR_SUCCESS;
+
+    block_size_t    bsize = imdb->db_def.block_size;
+    size_t          file_hwm = hdr_file.file_hwm;
+    uint32          pcnt = 0;
+    bool            moved = true;
+    imdb_errcode_t  res = IMDB_ERR_SUCCESS;
+    while ((hdr_file.page_fl_first != BLOCK_PTR_RAW_NONE) && (pcnt < max_pages)) {
+        res = fdb_file_trim (imdb, &hdr_file);
+        if (res != IMDB_ERR_SUCCESS)
+            break;
+
+        class_ptr_t     class_ptr;
+        page_ptr_t      page_ptr;
+        imdb_index_id_t idx_id;
+        res = fdb_page_find_byend (imdb, (hdr_file.file_hwm + 1) * bsize, &class_ptr, &page_ptr, &idx_id);
+        if ((res != IMDB_ERR_SUCCESS) || (page_ptr.raw == BLOCK_PTR_RAW_NONE) || (page_ptr.raw == class_ptr.raw)) {
+            moved = false;
+            break;
+        }
+
+        imdb_block_class_t *class_block = d_acquire_class_block (imdb, class_ptr);
+        if (!class_block) {
+            d_log_eprintf (IMDB_SERVICE_NAME, sz_imdb_error[IMDB_BLOCK_ACCESS], class_ptr.raw);
+            res = IMDB_BLOCK_ACCESS;
+            break;
+        }
+        if (idx_id != IMDB_INDEX_ID_NONE)
+            res = fdb_index_move (imdb, &hdr_file, class_block, idx_id, &moved);
+        else
+            res = fdb_page_move (imdb, &hdr_file, class_block, page_ptr, &moved);
+        d_release_class_block (imdb, class_block);
+        if ((res != IMDB_ERR_SUCCESS) || !moved)
+            break;
+        pcnt++;
+
+        res = fdb_file_trim (imdb, &hdr_file);
+        if (res != IMDB_ERR_SUCCESS)
+            break;
+    }
+
+    if (pcnt || (file_hwm != hdr_file.file_hwm)) {
+        // header must not reference blocks which are not written yet
+        d_imdb_check_error (imdb_flush (hmdb));
+        imdb->stat.header_write++;
+        d_imdb_check_error (fdb_header_write (&hdr_file));
+        d_log_iprintf (IMDB_SERVICE_NAME, "compact: moved %u pages, hwm=%u, free=%ubl", pcnt, hdr_file.file_hwm,
+                       hdr_file.page_fl_blocks);
+    }
+
+    if (!moved)
+        imdb_bc->compact_scn = hdr_file.scn;
+
+    return res;
+}
+
+/*
+[public] Destroy imdb instance and all storages
+  - hndlr: handler to imdb instance
+  - result: imdb error code
+  */
+imdb_errcode_t  ICACHE_FLASH_ATTR
+imdb_done (imdb_hndlr_t hmdb)
+{
+    d_imdb_check_hndlr (hmdb);
+    imdb_t         *imdb = d_hndlr2obj (imdb_t, hmdb);
+
+    if (imdb->db_def.opt_media) {
+        imdb_flush (hmdb);
+        imdb_bc_t      *imdb_bc = d_pointer_as (imdb_bc_t, imdb);
+        os_free (imdb_bc->buffer_cache);
+        os_free (imdb_bc->bc_blocks);
+        d_stat_free (imdb, sizeof (imdb_bc_t) + imdb_bc->bcmap_size +
+                     imdb->db_def.buffer_size * (imdb->db_def.block_size + sizeof (imdb_bc_block_t)));
+    }
+    else {
+        imdb_block_class_t *class_block = imdb->class_first.mptr;
+        while (class_block) {
+            imdb_hndlr_t    hclass = d_obj2hndlr (class_block);
+            class_block = class_block->dbclass.class_next.mptr;
+            imdb_class_destroy (hmdb, hclass);
+        }
+        d_stat_free (imdb, sizeof (imdb_t));
+    }
+
+    d_assert (imdb->stat.mem_alloc == imdb->stat.mem_free, "alloc=%u, free=%u", imdb->stat.mem_alloc,
+              imdb->stat.mem_free);
+    d_log_dprintf (IMDB_SERVICE_NAME, "done: instance done %p (mem=%lu)", imdb,
+                   imdb->stat.mem_alloc - imdb->stat.mem_free);
+
+    os_free (imdb);
+    return IMDB_ERR_SUCCESS;
+}
+
+/*
+[public] Query imdb instance information (statistics, etc)
+  - hndlr: handler to imdb instance
+  - imdb_info: result pointer to class_info structure
+  - result: imdb error code
+*/
+imdb_errcode_t  ICACHE_FLASH_ATTR
+imdb_info (imdb_hndlr_t hmdb, imdb_info_t * imdb_info, imdb_class_info_t info_array[], uint8 array_len)
+{
+    d_imdb_check_hndlr (hmdb);
+
+    imdb_t         *imdb = d_hndlr2obj (imdb_t, hmdb);
+    os_memcpy (&imdb_info->stat, &imdb->stat, sizeof (imdb_stat_t));
+    os_memcpy (&imdb_info->db_def, &imdb->db_def, sizeof (imdb_def_t));
+
+    imdb_info->size_class = sizeof (imdb_block_class_t);
+    imdb_info->size_page = sizeof (imdb_block_page_t);
+    imdb_info->size_block = sizeof (imdb_block_t);
+    imdb_info->size_rowid = sizeof (imdb_rowid_t);
+    imdb_info->size_cursor = sizeof (imdb_cursor_t);
+
+    imdb_info->class_count = 0;
+    class_ptr_t     class_ptr;
+    class_ptr.raw = imdb->class_first.raw;
+    while (class_ptr.raw != BLOCK_PTR_RAW_NONE) {
+        imdb_block_class_t *class_block = d_acquire_class_block (imdb, class_ptr);
+        if (!class_block) {
+            d_log_eprintf (IMDB_SERVICE_NAME, sz_imdb_error[IMDB_BLOCK_ACCESS], class_ptr.raw);
+            return IMDB_BLOCK_ACCESS;
+        }
+
+        imdb_info->class_count++;
+        if (array_len >= imdb_info->class_count) {
+            imdb_class_info (hmdb, d_obj2hndlr (class_block->block.id.raw), &info_array[imdb_info->class_count - 1]);
+        }
+        d_release_class_block (imdb, class_block);
+
+        class_ptr.raw = class_block->dbclass.class_next.raw;
+    }
+
+    return IMDB_ERR_SUCCESS;
+}
+
+
+/*
+ * [public] Find class by name
+ *  - hmdb: Handler to imdb instance
+ *  - name: class name
+ *  - hclass: Result Class instance handler
+ *  - result: imdb error code
+ */
+imdb_errcode_t
+imdb_class_find (imdb_hndlr_t hmdb, const char *name, imdb_hndlr_t * hclass)
+{
+    d_imdb_check_hndlr (hmdb);
+    imdb_t         *imdb = d_hndlr2obj (imdb_t, hmdb);
+
+    *hclass = 0;
+    class_ptr_t     class_ptr;
+    class_ptr.raw = imdb->class_first.raw;
+    while (class_ptr.raw != BLOCK_PTR_RAW_NONE) {
+        imdb_block_class_t *class_block = d_acquire_class_block (imdb, class_ptr);
+        if (!class_block) {
+            d_log_eprintf (IMDB_SERVICE_NAME, sz_imdb_error[IMDB_BLOCK_ACCESS], class_ptr.raw);
+            return IMDB_BLOCK_ACCESS;
+        }
+        class_ptr.raw = class_block->dbclass.class_next.raw;
+        int             cmpres = os_strncmp (class_block->dbclass.cdef.name, name, sizeof (class_name_t));
+        d_release_class_block (imdb, class_block);
+
+        if (cmpres == 0) {
+            *hclass = d_obj2hndlr (class_block->block.id.raw);
+            return IMDB_ERR_SUCCESS;
+        }
+
+    }
+
+    return IMDB_ERR_SUCCESS;
+}
+
+/*
+ * [public] Create class storage for object.
+ *   - hmdb: Handler to imdb instance
+ *   - cdef: Class definition
+ *   - hclass: Result Class instance handler
+ *   - result: imdb error code
+ */
+imdb_errcode_t  ICACHE_FLASH_ATTR
+imdb_class_create (imdb_hndlr_t hmdb, imdb_class_def_t * cdef, imdb_hndlr_t * hclass)
+{
+    d_imdb_check_hndlr (hmdb);
+    imdb_t         *imdb = d_hndlr2obj (imdb_t, hmdb);
+
+    cdef->page_blocks = MAX (IMDB_FIRST_PAGE_BLOCKS_MIN, cdef->page_blocks);
+    cdef->obj_size = d_size_align (cdef->obj_size);
+    obj_size_t      obj_bsize_min = d_size_bptr (cdef->obj_size);
+    if ((obj_bsize_min > imdb->obj_bsize_max) || (obj_bsize_min == 0 && !cdef->opt_variable)) {
+        return IMDB_INVALID_OBJSIZE;
+    }
+
+    if (cdef->opt_recycle && cdef->page_blocks <= 2) {
+        return IMDB_INVALID_RECYCLE_STORAGE;
+    }
+
+    if (cdef->pct_free > IMDB_PCT_FREE_MAX) {
+        cdef->pct_free = IMDB_PCT_FREE_MAX;
+    }
+
+    imdb_block_class_t *class_block = imdb_class_page_alloc (imdb, cdef);
+    if (!class_block) {
+        d_log_eprintf (IMDB_SERVICE_NAME, sz_imdb_error[IMDB_NOMEM]);
+        return IMDB_NOMEM;
+    }
+    size_t          rawid = class_block->block.id.raw;
+
+    class_block->dbclass.class_next.raw = BLOCK_PTR_RAW_NONE;
+    class_block->dbclass.class_prev.raw = BLOCK_PTR_RAW_NONE;
+    class_block->dbclass.obj_bsize_min = obj_bsize_min;
+
+    if (imdb->class_last.raw != BLOCK_PTR_RAW_NONE) {
+        class_block->dbclass.class_prev.raw = imdb->class_last.raw;
+
+        imdb_block_class_t *class_last = d_acquire_class_block (imdb, imdb->class_last);
+        if (!class_last) {
+            d_log_cprintf (IMDB_SERVICE_NAME, sz_imdb_error[IMDB_BLOCK_ACCESS], imdb->class_last.raw);
+            return IMDB_BLOCK_ACCESS;
+        }
+
+        d_setwrite_block (imdb, class_last);
+        class_last->dbclass.class_next.raw = rawid;
+        d_release_class_block (imdb, class_last);
+    }
+    else
+        imdb->class_first.raw = rawid;
+    imdb->class_last.raw = rawid;
+
+    d_release_class_block (imdb, class_block);
+    *hclass = d_obj2hndlr (rawid);
+    d_log_iprintf (IMDB_SERVICE_NAME, "created \"%s\" %p (type=%u,pbs=%u,os=%u)", cdef->name, *hclass,
+                   class_block->dbclass.ds_type, cdef->page_blocks, cdef->obj_size);
+
+    return IMDB_ERR_SUCCESS;
+}
+
+
+/*
+[public] Destroy class storage for object and deallocate memory.
+  - hcls: handler to class instance
+  - result: imdb error code
+*/
+imdb_errcode_t  ICACHE_FLASH_ATTR
+imdb_class_destroy (imdb_hndlr_t hmdb, imdb_hndlr_t hclass)
+{
+    d_imdb_check_hndlr (hmdb);
+    d_imdb_check_hndlr (hclass);
+
+    imdb_t         *imdb = d_hndlr2obj (imdb_t, hmdb);
+    class_ptr_t     class_ptr;
+    class_ptr.raw = (size_t) hclass;
+
+    imdb_block_class_t *class_block = d_acquire_class_block (imdb, class_ptr);
+    if (!class_block) {
+        d_log_eprintf (IMDB_SERVICE_NAME, sz_imdb_error[IMDB_BLOCK_ACCESS], class_ptr.raw);
+        return IMDB_BLOCK_ACCESS;
+    }
+
+    imdb_class_t   *dbclass = &class_block->dbclass;
+
+    if (dbclass->class_prev.raw != BLOCK_PTR_RAW_NONE) {
+        imdb_block_class_t *class_prev = d_acquire_class_block (imdb, dbclass->class_prev);
+        if (!class_prev) {
+            d_log_cprintf (IMDB_SERVICE_NAME, sz_imdb_error[IMDB_BLOCK_ACCESS], dbclass->class_prev.raw);
+            return IMDB_BLOCK_ACCESS;
+        }
+        d_setwrite_block (imdb, class_prev);
+        class_prev->dbclass.class_next.raw = dbclass->class_next.raw;
+        d_release_class_block (imdb, class_prev);
+    }
+    else {
+        imdb->class_first.raw = dbclass->class_next.raw;
+    }
+    if (dbclass->class_next.raw != BLOCK_PTR_RAW_NONE) {
+        imdb_block_class_t *class_next = d_acquire_class_block (imdb, dbclass->class_next);
+        if (!class_next) {
+            d_log_cprintf (IMDB_SERVICE_NAME, sz_imdb_error[IMDB_BLOCK_ACCESS], dbclass->class_next.raw);
+            return IMDB_BLOCK_ACCESS;
+        }
+        d_setwrite_block (imdb, class_next);
+        class_next->dbclass.class_prev.raw = dbclass->class_prev.raw;
+        d_release_class_block (imdb, class_next);
+    }
+    else {
+        imdb->class_last.raw = dbclass->class_prev.raw;
+    }
+
+    class_name_t    cname;
+    os_memcpy (cname, dbclass->cdef.name, sizeof (class_name_t));
+    class_pages_t   pcnt = 0;
+    uint32          bcnt = 0;
+    imdb_index_id_t idx_id;
+    for (idx_id = 0; idx_id < IMDB_CLASS_INDEX_MAX; idx_id++) {
+        imdb_index_t   *index = &dbclass->index[idx_id];
+        if (index->page.raw == BLOCK_PTR_RAW_NONE)
+            continue;
+        d_imdb_check_error (imdb_index_page_free (imdb, index->page, index->blocks));
+        pcnt++;
+        bcnt += index->blocks;
+    }
+    // iterate page
+    if (imdb->db_def.opt_media) {
+        imdb_bc_t      *imdb_bc = d_pointer_as (imdb_bc_t, imdb);
+        block_size_t    bsize = imdb->db_def.block_size;
+        page_blocks_t   page_blocks = dbclass->cdef.page_blocks;
+        imdb_file_t     hdr_file;
+        imdb->stat.header_read++;
+        d_imdb_check_error (fdb_header_read (&hdr_file));
+
+        page_ptr_t      page_ptr;
+        page_ptr.raw = class_ptr.raw;
+        imdb_block_page_t *page_targ = d_pointer_as (imdb_block_page_t, class_block);
+        while (page_targ) {
+            page_ptr_t      page_next;
+            page_next.raw = page_targ->page.page_next.raw;
+            page_blocks_t   bidx;
+            page_blocks_t   alloc_hwm = page_targ->page.alloc_hwm;
+            for (bidx = 1; bidx <= alloc_hwm; bidx++)
+                fdb_cache_discard (imdb_bc, page_ptr.raw + (bidx - 1) * bsize);
+            d_imdb_check_error (fdb_page_free (imdb, &hdr_file, page_ptr.raw, page_blocks));
+
+            d_stat_page_free (imdb);
+            pcnt++;
+            bcnt += page_blocks;
+            page_ptr.raw = page_next.raw;
+            if (page_ptr.raw != BLOCK_PTR_RAW_NONE) {
+                page_targ = d_acquire_page_block (imdb, page_ptr, DATA_LOCK_READ);
+                if (!page_targ) {
+                    d_log_cprintf (IMDB_SERVICE_NAME, sz_imdb_error[IMDB_BLOCK_ACCESS], page_ptr.raw);
+                    return IMDB_BLOCK_ACCESS;
+                }
+                d_release_page_block (imdb, page_targ);
+            }
+            else
+                page_targ = NULL;
+        }
+
+        d_imdb_check_error (fdb_file_trim (imdb, &hdr_file));
+        hdr_file.class_first = imdb->class_first.raw;
+        hdr_file.class_last = imdb->class_last.raw;
+        // header must not reference blocks which are not written yet
+        d_imdb_check_error (imdb_flush (hmdb));
+        imdb->stat.header_write++;
+        d_imdb_check_error (fdb_header_write (&hdr_file));
+    }
+    else {
+        imdb_block_page_t *page_targ = d_pointer_as (imdb_block_page_t, class_block);
+        while (page_targ) {
+            void           *ptr = page_targ;
+            d_stat_page_free (imdb);
+            d_stat_free (imdb, dbclass->cdef.page_blocks * imdb->db_def.block_size);
+            pcnt++;
+            bcnt += dbclass->cdef.page_blocks;
+            page_targ = page_targ->page.page_next.mptr;
+            os_free (ptr);
+        }
+    }
+    d_log_iprintf (IMDB_SERVICE_NAME, "destroyed \"%s\" %08x (page_cnt=%u,blk_cnt=%u)", cname, hclass, pcnt, bcnt);
+
+    return IMDB_ERR_SUCCESS;
+}
+
+/*
+[public] insert object into storage.
+  - hclass: handler to class instance
+  - ptr: result pointer to object
+  - length: object size (0 for fixed objects)
+  - result: imdb error code
+ */
+imdb_errcode_t  ICACHE_FLASH_ATTR
+imdb_clsobj_insert (imdb_hndlr_t hmdb, imdb_hndlr_t hclass, void **ptr, size_t length)
+{
+    d_imdb_check_hndlr (hmdb);
+    d_imdb_check_hndlr (hclass);
+
+    imdb_t         *imdb = d_hndlr2obj (imdb_t, hmdb);
+    block_ptr_t     block_ptr;
+    block_ptr.raw = (size_t) hclass;
+    imdb_block_class_t *class_block = d_acquire_class_block (imdb, block_ptr);
+    if (!class_block) {
+        d_log_eprintf (IMDB_SERVICE_NAME, sz_imdb_error[IMDB_BLOCK_ACCESS], block_ptr.raw);
+        return IMDB_BLOCK_ACCESS;
+    }
+
+    d_imdb_assert_committed (&class_block->dbclass);
+    imdb_errcode_t  res = imdb_class_instance_alloc (imdb, class_block, ptr, length);
+    if ((res == IMDB_ERR_SUCCESS) && class_block->dbclass.idx_count) {
+        d_setwrite_block (imdb, class_block);
+        imdb_slot_rowid (class_block->dbclass.ds_type, *ptr, &class_block->dbclass.idx_pending);
+    }
+    d_release_class_block (imdb, class_block);
+
+    return res;
+}
+
+/*
+[public] Commit inserted object, it is added into class indexes. Insert into indexed class must be committed
+when the object key is written, before the next insert or index access of the class.
+  - hmdb: handler to imdb instance
+  - hclass: handler to class instance
+  - ptr: pointer to inserted object
+  - result: imdb error code
+ */
+imdb_errcode_t  ICACHE_FLASH_ATTR
+imdb_clsobj_insert_commit (imdb_hndlr_t hmdb, imdb_hndlr_t hclass, void *ptr)
+{
+    d_imdb_check_hndlr (hmdb);
+    d_imdb_check_hndlr (hclass);
+
+    imdb_t         *imdb = d_hndlr2obj (imdb_t, hmdb);
+    block_ptr_t     block_ptr;
+    block_ptr.raw = (size_t) hclass;
+    imdb_block_class_t *class_block = d_acquire_class_block (imdb, block_ptr);
+    if (!class_block) {
+        d_log_eprintf (IMDB_SERVICE_NAME, sz_imdb_error[IMDB_BLOCK_ACCESS], block_ptr.raw);
+        return IMDB_BLOCK_ACCESS;
+    }
+
+    imdb_class_t   *dbclass = &class_block->dbclass;
+    imdb_rowid_t    rowid;
+    imdb_slot_rowid (dbclass->ds_type, ptr, &rowid);
+
+    imdb_errcode_t  res = IMDB_ERR_SUCCESS;
+    if (dbclass->idx_pending.block_id == BLOCK_PTR_RAW_NONE) {
+        // class has no indexes or object is committed already
+    }
+    else if ((dbclass->idx_pending.block_id == rowid.block_id) && (dbclass->idx_pending.slot_offset == rowid.slot_offset))
+        res = imdb_index_pending_add (imdb, class_block);
+    else
+        res = IMDB_INVALID_OPERATION;
+    d_release_class_block (imdb, class_block);
+
+    return res;
+}
+
+/*
+ * [public] write lock object block, need manual unlock.
+ *   - hmdb: Handler to imdb instance
+ *   - rowid: object row id
+ *   - ptr: if not NULL returns pointer to updating object
+ *   - result: imdb error code
+ */
+imdb_errcode_t  ICACHE_FLASH_ATTR
+imdb_clsobj_update_init (imdb_hndlr_t hmdb, imdb_rowid_t * rowid, void **ptr)
+{
+    *ptr = NULL;
+    d_imdb_check_hndlr (hmdb);
+    imdb_t         *imdb = d_hndlr2obj (imdb_t, hmdb);
+    if (imdb->db_def.opt_media) {
+        imdb_block_t   *block = fdb_cache_get ((imdb_bc_t *) (imdb), rowid->block_id, false, DATA_LOCK_WRITE);
+        if (!block) {
+            d_log_eprintf (IMDB_SERVICE_NAME, sz_imdb_error[IMDB_BLOCK_ACCESS], rowid->block_id);
+            return IMDB_BLOCK_ACCESS;
+        }
+
+        if (ptr)
+            *ptr = d_pointer_add (void, block, d_bptr_size (rowid->slot_offset) +
+                              (rowid->ds_type == DATA_SLOT_TYPE_1) ? 0 : sizeof (imdb_slot_free_t));
+    }
+
+    return IMDB_ERR_SUCCESS;
+}
+
+/*
+ * [public] write lock and unlock object block.
+ *   - hmdb: Handler to imdb instance
+ *   - rowid: object row id
+ *   - ptr: if not NULL returns pointer to updating object
+ *   - result: imdb error code
+ */
+imdb_errcode_t  ICACHE_FLASH_ATTR
+imdb_clsobj_update (imdb_hndlr_t hmdb, imdb_rowid_t * rowid, void **ptr)
+{
+    d_imdb_check_hndlr (hmdb);
+    imdb_t         *imdb = d_hndlr2obj (imdb_t, hmdb);
+    if (imdb->db_def.opt_media) {
+        imdb_block_t   *block = fdb_cache_get ((imdb_bc_t *) (imdb), rowid->block_id, false, DATA_LOCK_WRITE);
+        if (!block) {
+            d_log_eprintf (IMDB_SERVICE_NAME, sz_imdb_error[IMDB_BLOCK_ACCESS], rowid->block_id);
+            return IMDB_BLOCK_ACCESS;
+        }
+        block->lock_flag = DATA_LOCK_NONE;
+
+        if (ptr)
+            *ptr = d_pointer_add (void, block, d_bptr_size (rowid->slot_offset) +
+                              ((rowid->ds_type == DATA_SLOT_TYPE_1) ? 0 : sizeof (imdb_slot_free_t)));
+    }
+
+    return IMDB_ERR_SUCCESS;
+}
+
+
+/*
+[private] Release data slot into block FreeList, coalesce it with neighbour free slots (Type#2, Type#4).
+  - imdb:
+  - class_block:
+  - block: slot block
+  - slot_free: releasing slot, length must be set
+  - slot_footer: slot footer, NULL for slots without footer
+  - slen: slot size in bytes
+  - result: imdb error code
+*/
+LOCAL imdb_errcode_t ICACHE_FLASH_ATTR
+imdb_slot_release (imdb_t * imdb, imdb_block_class_t * class_block, imdb_block_t * block,
+                   imdb_slot_free_t * slot_free, imdb_slot_footer_t * slot_footer, obj_size_t slen)
+{
+    imdb_class_t   *dbclass = &class_block->dbclass;
+    obj_size_t      block_offset = d_size_bptr (d_pointer_diff (slot_free, block));
+
+    d_stat_slot_free (imdb);
+    slot_free->flags = SLOT_FLAG_FREE;
+
+    d_log_dprintf (IMDB_SERVICE_NAME, "release: class=%p add free slot=%p, len=%u", class_block, slot_free,
+                   slot_free->length);
+
+    d_setwrite_block (imdb, block);
+
+    imdb_slot_free_t *slot_free_n = NULL;
+    imdb_slot_free_t *slot_free_p = NULL;
+    // coalesce with next free slot
+    if (block_offset + slot_free->length < d_block_upper_data_blimit (imdb, block)) {
+        slot_free_n = d_pointer_add (imdb_slot_free_t, slot_free, slen);
+        if (slot_free_n->flags == SLOT_FLAG_FREE) {
+            slot_free->length += slot_free_n->length;
+            slot_footer = d_pointer_add (imdb_slot_footer_t, slot_free_n, d_bptr_size (slot_free_n->length) - sizeof (imdb_slot_footer_t));
+            d_stat_slot_coalesce (imdb);
+        }
+        else
+            slot_free_n = NULL;
+    }
+
+    // coalesce with prev free slot
+    if (block_offset > d_block_lower_data_blimit (block)) {
+        imdb_slot_footer_t *slot_footer_p = d_pointer_add (imdb_slot_footer_t, slot_free, -sizeof (imdb_slot_footer_t));
+        if (slot_footer_p->flags == SLOT_FLAG_FREE) {
+            slot_free_p = d_pointer_add (imdb_slot_free_t, slot_free, -d_bptr_size (slot_footer_p->length) );
+            slot_free_p->length += slot_free->length;
+            slot_free = slot_free_p;
+            d_stat_slot_coalesce (imdb);
+        }
+    }
+
+    imdb_slot_free_t *fslot = d_block_slot_free (block);
+    if (fslot) { // block FL was not empty
+        if (slot_free_p || slot_free_n) {
+            // prev/next free slot may not in free list        
+            imdb_slot_free_t *fslot_prev = NULL;
+            while (fslot) {
+                if (fslot_prev == fslot) {
+                    d_log_eprintf (IMDB_SERVICE_NAME, sz_imdb_error[IMDB_CORRUPT], fslot_prev, "free list loop");
+                    return IMDB_CORRUPT;
+                }
+                if ((fslot == slot_free_p) || (fslot == slot_free_n)) {
+                    if (fslot_prev)
+                        fslot_prev->next_offset = fslot->next_offset;
+                    else
+                        block->free_offset = fslot->next_offset;
+                }
+                else 
+                    fslot_prev = fslot;
+                fslot = d_block_next_slot_free (block, fslot);
+            }
+        }
+
+        d_imdb_block_fl_insert_slot (block, slot_free);
+    }
+    else if (d_dstype_slot_bucketed (dbclass->ds_type)) {
+        d_imdb_block_fl_insert_slot (block, slot_free);
+    }
+    else {      // block FL was empty
+        d_imdb_block_fl_insert_slot (block, slot_free);
+
+        page_ptr_t      page_ptr;
+        page_ptr.raw = d_block_get_page_blockid (block, imdb->db_def.block_size);
+
+        imdb_block_page_t *page_block = d_acquire_page_block (imdb, page_ptr, DATA_LOCK_WRITE);
+        if (!page_block) {
+            d_log_cprintf (IMDB_SERVICE_NAME, sz_imdb_error[IMDB_BLOCK_ACCESS], page_ptr.raw);
+            return IMDB_BLOCK_ACCESS;
+        }
+
+        d_imdb_page_fl_insert_block (page_block, block);
+        if (!block->block_fl_next) {    // page FL was empty            
+            d_setwrite_block (imdb, class_block);
+            d_imdb_class_fl_insert_page (class_block, page_block);
+        }
+        d_release_block (imdb, &page_block->block);
+    }
+
+    if (slot_footer) {
+        os_memset (slot_footer, 0, sizeof (imdb_slot_footer_t));
+        slot_footer->flags = SLOT_FLAG_FREE;
+        slot_footer->length = slot_free->length;
+    }
+
+    if (d_dstype_slot_bucketed (dbclass->ds_type))
+        return imdb_block_bucket_update (imdb, class_block, block);
+
+    return IMDB_ERR_SUCCESS;
+}
+
+/*
+ * [public] delete object from storage.
+ *   - hmdb: Handler to imdb instance
+ *   - hclass: handler to class instance
+ *   - ptr: pointer to deleting object
+ *   - result: imdb error code
+ */
+imdb_errcode_t  ICACHE_FLASH_ATTR
+imdb_clsobj_delete (imdb_hndlr_t hmdb, imdb_hndlr_t hclass, void *ptr)
+{
+    d_imdb_check_hndlr (hmdb);
+    d_imdb_check_hndlr (hclass);
+
+    imdb_t         *imdb = d_hndlr2obj (imdb_t, hmdb);
+    class_ptr_t     class_ptr;
+    class_ptr.raw = (size_t) hclass;
+
+    imdb_block_class_t *class_block = d_acquire_class_block (imdb, class_ptr);
+    if (!class_block) {
+        d_log_eprintf (IMDB_SERVICE_NAME, sz_imdb_error[IMDB_BLOCK_ACCESS], class_ptr.raw);
+        return IMDB_BLOCK_ACCESS;
+    }
+
+    imdb_class_t   *dbclass = &class_block->dbclass;
+
+    imdb_slot_free_t *slot_free = NULL;
+    imdb_slot_footer_t *slot_footer = NULL;
+    imdb_block_t   *block = NULL;
+
+    obj_size_t      slen = 0;
+    switch (dbclass->ds_type) {
+    case DATA_SLOT_TYPE_1:
+    case DATA_SLOT_TYPE_3:
+        return IMDB_INVALID_OPERATION;
+        break;
+    case DATA_SLOT_TYPE_2:
+        {
+            imdb_slot_data2_t *slot_data2 = d_pointer_add (imdb_slot_data2_t, ptr, -sizeof (imdb_slot_data2_t));
+            if (slot_data2->flags != SLOT_FLAG_DATA) {
+                d_log_eprintf (IMDB_SERVICE_NAME, sz_imdb_error[IMDB_CORRUPT], slot_data2, "flag != data");
+                return IMDB_CORRUPT;
+            }
+
+            block = d_pointer_add (imdb_block_t, slot_data2, -d_bptr_size (slot_data2->block_offset));
+            slen = dbclass->cdef.obj_size + sizeof (imdb_slot_data2_t);
+            slot_free = (imdb_slot_free_t *) slot_data2;
+            slot_free->length = d_size_bptr (slen);
+        }
+        break;
+    case DATA_SLOT_TYPE_4:
+        {
+            imdb_slot_data4_t *slot_data4 = d_pointer_add (imdb_slot_data4_t, ptr, -sizeof (imdb_slot_data4_t));
+            if (slot_data4->flags != SLOT_FLAG_DATA) {
+                d_log_eprintf (IMDB_SERVICE_NAME, sz_imdb_error[IMDB_CORRUPT], slot_data4, "flag != data");
+                return IMDB_CORRUPT;
+            }
+            slen = d_bptr_size (slot_data4->length);
+            slot_footer = d_pointer_add (imdb_slot_footer_t, slot_data4, slen - sizeof (imdb_slot_footer_t));
+
+            if (slot_footer->flags != SLOT_FLAG_DATA) {
+                d_log_eprintf (IMDB_SERVICE_NAME, sz_imdb_error[IMDB_CORRUPT], slot_footer, "flag != data");
+                return IMDB_CORRUPT;
+            }
+
+            block = d_pointer_add (imdb_block_t, slot_data4, -d_bptr_size (slot_data4->block_offset));
+            slot_free = d_pointer_as (imdb_slot_free_t, slot_data4);
+        }
+        break;
+    default:
+        d_assert (false, "ds_type=%u", dbclass->ds_type);
+    }
+
+    // object key is lost after slot release
+    imdb_rowid_t    rowid;
+    uint16          idx_hash[IMDB_CLASS_INDEX_MAX];
+    if (dbclass->idx_count) {
+        imdb_slot_rowid (dbclass->ds_type, ptr, &rowid);
+        imdb_index_id_t idx_id;
+        for (idx_id = 0; idx_id < IMDB_CLASS_INDEX_MAX; idx_id++) {
+            imdb_index_t   *index = &dbclass->index[idx_id];
+            if (index->page.raw != BLOCK_PTR_RAW_NONE)
+                idx_hash[idx_id] = imdb_index_hash (index, d_pointer_add (char, ptr, index->key_offset));
+        }
+    }
+
+    imdb_errcode_t  res = imdb_slot_release (imdb, class_block, block, slot_free, slot_footer, slen);
+    if ((res == IMDB_ERR_SUCCESS) && dbclass->idx_count)
+        res = imdb_index_obj_remove (imdb, class_block, &rowid, idx_hash);
+
+    d_release_class_block (imdb, class_block);
+
+    return res;
+}
+
+/**
+[public] change size of existing variable length object into storage (Type#4). Object is shrunk in place,
+  the released tail goes to block FreeList. Growing object is moved into new slot together with its index entries.
+  - hclass: handler to class instance
+  - ptr_old: pointer to existing object
+  - ptr: result pointer to new object
+  - length: object size
+  - result: imdb error code
+*/
+imdb_errcode_t  ICACHE_FLASH_ATTR
+imdb_clsobj_resize (imdb_hndlr_t hmdb, imdb_hndlr_t hclass, void *ptr_old, void **ptr, size_t length)
+{
+    d_imdb_check_hndlr (hmdb);
+    d_imdb_check_hndlr (hclass);
+
+    imdb_t         *imdb = d_hndlr2obj (imdb_t, hmdb);
+    class_ptr_t     class_ptr;
+    class_ptr.raw = (size_t) hclass;
+
+    imdb_block_class_t *class_block = d_acquire_class_block (imdb, class_ptr);
+    if (!class_block) {
+        d_log_eprintf (IMDB_SERVICE_NAME, sz_imdb_error[IMDB_BLOCK_ACCESS], class_ptr.raw);
+        return IMDB_BLOCK_ACCESS;
     }
 
     imdb_class_t   *dbclass = &class_block->dbclass;
+    imdb_errcode_t  res = IMDB_ERR_SUCCESS;
+    if (!dbclass->cdef.opt_variable || !d_dstype_slot_bucketed (dbclass->ds_type)) {
+        res = IMDB_INVALID_OPERATION;
+        goto resize_done;
+    }
 
-    if (dbclass->class_prev.raw != BLOCK_PTR_RAW_NONE) {
-        imdb_block_class_t *class_prev = d_acquire_class_block (imdb, dbclass->class_prev);
-        if (!class_prev) {
-            d_log_cprintf (IMDB_SERVICE_NAME, sz_imdb_error[IMDB_BLOCK_ACCESS], dbclass->class_prev.raw);
-            return IMDB_BLOCK_ACCESS;
+    imdb_slot_data4_t *slot_data4 = d_pointer_add (imdb_slot_data4_t, ptr_old, -sizeof (imdb_slot_data4_t));
+    if (slot_data4->flags != SLOT_FLAG_DATA) {
+        d_log_eprintf (IMDB_SERVICE_NAME, sz_imdb_error[IMDB_CORRUPT], slot_data4, "flag != data");
+        res = IMDB_CORRUPT;
+        goto resize_done;
+    }
+
+    obj_size_t      extra_bsize = data_slot_type_bsize[dbclass->ds_type];
+    obj_size_t      slot_bsize = d_size_bptr_align (length);
+    if (slot_bsize > imdb->obj_bsize_max) {
+        res = IMDB_INVALID_OBJSIZE;
+        goto resize_done;
+    }
+    slot_bsize += extra_bsize;
+
+    imdb_block_t   *block = d_pointer_add (imdb_block_t, slot_data4, -d_bptr_size (slot_data4->block_offset));
+    if (slot_bsize <= slot_data4->length) {
+        *ptr = ptr_old;
+
+        // split tail only when it may hold the smallest object
+        obj_size_t      tail_bsize = slot_data4->length - slot_bsize;
+        if (tail_bsize < extra_bsize + dbclass->obj_bsize_min)
+            goto resize_done;
+
+        d_log_dprintf (IMDB_SERVICE_NAME, "resize: class=%p shrink slot=%p, len=%u->%u", class_block, slot_data4,
+                       slot_data4->length, slot_bsize);
+
+        d_setwrite_block (imdb, block);
+        imdb_slot_footer_t *slot_footer =
+            d_pointer_add (imdb_slot_footer_t, slot_data4, d_bptr_size (slot_data4->length) - sizeof (imdb_slot_footer_t));
+        slot_data4->length = slot_bsize;
+
+        imdb_slot_footer_t *data_footer =
+            d_pointer_add (imdb_slot_footer_t, slot_data4, d_bptr_size (slot_bsize) - sizeof (imdb_slot_footer_t));
+        os_memset (data_footer, 0, sizeof (imdb_slot_footer_t));
+        data_footer->flags = SLOT_FLAG_DATA;
+        data_footer->length = slot_bsize;
+
+        imdb_slot_free_t *slot_free = d_pointer_add (imdb_slot_free_t, slot_data4, d_bptr_size (slot_bsize));
+        os_memset (slot_free, 0, sizeof (imdb_slot_free_t));
+        slot_free->length = tail_bsize;
+
+        d_stat_slot_split (imdb);
+        res = imdb_slot_release (imdb, class_block, block, slot_free, slot_footer, d_bptr_size (tail_bsize));
+        goto resize_done;
+    }
+
+    // keep old object in buffer cache while new slot is allocated
+    imdb_lock_t     lock_flag = block->lock_flag;
+    if (imdb->db_def.opt_media && (lock_flag == DATA_LOCK_NONE))
+        block->lock_flag = DATA_LOCK_READ;
+
+    imdb_rowid_t    rowid_old;
+    uint16          idx_hash[IMDB_CLASS_INDEX_MAX];
+    imdb_slot_rowid (dbclass->ds_type, ptr_old, &rowid_old);
+    bool            fpending = (dbclass->idx_pending.block_id == rowid_old.block_id)
+        && (dbclass->idx_pending.slot_offset == rowid_old.slot_offset);
+    imdb_index_id_t idx_id;
+    for (idx_id = 0; idx_id < IMDB_CLASS_INDEX_MAX; idx_id++) {
+        imdb_index_t   *index = &dbclass->index[idx_id];
+        if (index->page.raw != BLOCK_PTR_RAW_NONE)
+            idx_hash[idx_id] = imdb_index_hash (index, d_pointer_add (char, ptr_old, index->key_offset));
+    }
+
+    res = imdb_class_instance_alloc (imdb, class_block, ptr, length);
+    if (imdb->db_def.opt_media)
+        block->lock_flag = lock_flag;
+    if (res != IMDB_ERR_SUCCESS)
+        goto resize_done;
+
+    d_log_dprintf (IMDB_SERVICE_NAME, "resize: class=%p move slot=%p->%p, len=%u->%u", class_block, ptr_old, *ptr,
+                   slot_data4->length, slot_bsize);
+
+    os_memcpy (*ptr, ptr_old, d_bptr_size (slot_data4->length - extra_bsize));
+
+    if (fpending) {
+        // key of the last inserted object may be not written yet
+        d_setwrite_block (imdb, class_block);
+        imdb_slot_rowid (dbclass->ds_type, *ptr, &dbclass->idx_pending);
+    }
+    else if (dbclass->idx_count) {
+        imdb_rowid_t    rowid;
+        imdb_slot_rowid (dbclass->ds_type, *ptr, &rowid);
+        res = imdb_index_obj_remove (imdb, class_block, &rowid_old, idx_hash);
+        for (idx_id = 0; (res == IMDB_ERR_SUCCESS) && (idx_id < IMDB_CLASS_INDEX_MAX); idx_id++) {
+            if (dbclass->index[idx_id].page.raw != BLOCK_PTR_RAW_NONE)
+                res = imdb_index_entry_add (imdb, class_block, idx_id, idx_hash[idx_id], &rowid);
         }
-        class_prev->dbclass.class_next.raw = dbclass->class_next.raw;
-        d_release_class_block (imdb, class_prev);
+    }
+
+    if (res == IMDB_ERR_SUCCESS) {
+        imdb_slot_footer_t *slot_footer =
+            d_pointer_add (imdb_slot_footer_t, slot_data4, d_bptr_size (slot_data4->length) - sizeof (imdb_slot_footer_t));
+        res = imdb_slot_release (imdb, class_block, block, d_pointer_as (imdb_slot_free_t, slot_data4), slot_footer,
+                                 d_bptr_size (slot_data4->length));
+    }
+
+  resize_done:
+    d_release_class_block (imdb, class_block);
+
+    return res;
+}
+
+/*
+[public] Return object length.
+  - hclass: handler to class instance
+  - ptr: pointer to deleting object
+  - result: imdb error code
+*/
+imdb_errcode_t  ICACHE_FLASH_ATTR
+imdb_clsobj_length (imdb_hndlr_t hmdb, imdb_hndlr_t hclass, void *ptr, size_t * length)
+{
+    d_imdb_check_hndlr (hmdb);
+    d_imdb_check_hndlr (hclass);
+
+    imdb_t         *imdb = d_hndlr2obj (imdb_t, hmdb);
+    class_ptr_t     class_ptr;
+    class_ptr.raw = (size_t) hclass;
+
+    imdb_block_class_t *class_block = d_acquire_class_block (imdb, class_ptr);
+    if (!class_block) {
+        d_log_eprintf (IMDB_SERVICE_NAME, sz_imdb_error[IMDB_BLOCK_ACCESS], class_ptr.raw);
+        return IMDB_BLOCK_ACCESS;
+    }
+
+    if (class_block->dbclass.cdef.opt_variable) {
+        imdb_slot_data4_t *data_slot4 = d_pointer_add (imdb_slot_data4_t, ptr, -sizeof (imdb_slot_data4_t));
+        d_assert (data_slot4->flags == SLOT_FLAG_DATA, "flags=%u", data_slot4->flags);
+        *length = d_bptr_size (data_slot4->length);
     }
     else {
-        imdb->class_first.raw = dbclass->class_next.raw;
+        *length = class_block->dbclass.cdef.obj_size;
     }
-    if (dbclass->class_next.raw != BLOCK_PTR_RAW_NONE) {
-        imdb_block_class_t *class_next = d_acquire_class_block (imdb, dbclass->class_next);
-        if (!class_next) {
-            d_log_cprintf (IMDB_SERVICE_NAME, sz_imdb_error[IMDB_BLOCK_ACCESS], dbclass->class_next.raw);
+
+    d_release_class_block (imdb, class_block);
+
+    return IMDB_ERR_SUCCESS;
+}
+
+/*
+[private] Return the largest free slot of segregated free lists class (Type#4), the slot of whole block
+  is kept when new block still may be allocated.
+  - imdb:
+  - class_block:
+  - slot_bsize: in: slot size of empty block, out: the largest slot size in block units
+  - result: imdb error code
+*/
+LOCAL imdb_errcode_t ICACHE_FLASH_ATTR
+imdb_slot_bucket_max (imdb_t * imdb, imdb_block_class_t * class_block, obj_size_t * slot_bsize)
+{
+    imdb_class_t   *dbclass = &class_block->dbclass;
+    if (dbclass->page_count < dbclass->cdef.pages_max)
+        return IMDB_ERR_SUCCESS;
+
+    imdb_block_page_t *page_block = d_pointer_as (imdb_block_page_t, class_block);
+    if (dbclass->page_last.raw != class_block->block.id.raw) {
+        page_block = d_acquire_page_block (imdb, dbclass->page_last, DATA_LOCK_READ);
+        if (!page_block) {
+            d_log_eprintf (IMDB_SERVICE_NAME, sz_imdb_error[IMDB_BLOCK_ACCESS], dbclass->page_last.raw);
             return IMDB_BLOCK_ACCESS;
         }
-        class_next->dbclass.class_prev.raw = dbclass->class_prev.raw;
-        d_release_class_block (imdb, class_next);
     }
+    page_blocks_t   alloc_hwm = page_block->page.alloc_hwm;
+    d_release_page_block (imdb, page_block);
+    if (alloc_hwm < dbclass->cdef.page_blocks)
+        return IMDB_ERR_SUCCESS;
 
-    class_name_t    cname;
-    os_memcpy (cname, dbclass->cdef.name, sizeof (class_name_t));
-    class_pages_t   pcnt = 0;
-    uint32          bcnt = 0;
-    // iterate page
-    if (imdb->db_def.opt_media) {
-        d_release_class_block (imdb, class_block);
-        // Fixme: TODO: Must use freelist for mdeia storage
-    }
-    else {
-        imdb_block_page_t *page_targ = d_pointer_as (imdb_block_page_t, class_block);
-        while (page_targ) {
-            void           *ptr = page_targ;
-            d_stat_page_free (imdb);
-            d_stat_free (imdb, dbclass->cdef.page_blocks * imdb->db_def.block_size);
-            pcnt++;
-            bcnt += dbclass->cdef.page_blocks;
-            page_targ = page_targ->page.page_next.mptr;
-            os_free (ptr);
+    // the highest non-empty bucket holds the largest slot
+    *slot_bsize = 0;
+    uint8           bucket;
+    for (bucket = IMDB_SLOT_BUCKETS; (bucket > 0) && !*slot_bsize; bucket--) {
+        block_ptr_t     block_ptr;
+        block_ptr.raw = dbclass->fl_bucket[bucket - 1].raw;
+        while (block_ptr.raw != BLOCK_PTR_RAW_NONE) {
+            imdb_block_t   *block = imdb_linked_block_acquire (imdb, class_block, block_ptr, DATA_LOCK_READ);
+            if (!block)
+                return IMDB_BLOCK_ACCESS;
+
+            imdb_block_fl_t *block_fl = d_block_fl_trailer (imdb, block);
+            *slot_bsize = MAX (*slot_bsize, block_fl->slot_max);
+            block_ptr.raw = block_fl->bucket_next.raw;
+            d_release_linked_block (imdb, class_block, block);
         }
     }
-    d_log_iprintf (IMDB_SERVICE_NAME, "destroyed \"%s\" %08x (page_cnt=%u,blk_cnt=%u)", cname, hclass, pcnt, bcnt);
 
     return IMDB_ERR_SUCCESS;
 }
 
 /*
-[public] insert object into storage.
+[public] Return the largest object length, the class storage may hold now.
   - hclass: handler to class instance
-  - ptr: result pointer to object
-  - length: object size (0 for fixed objects)
+  - length: result max object length
   - result: imdb error code
- */
+*/
 imdb_errcode_t  ICACHE_FLASH_ATTR
-imdb_clsobj_insert (imdb_hndlr_t hmdb, imdb_hndlr_t hclass, void **ptr, size_t length)
+imdb_clsobj_length_max (imdb_hndlr_t hmdb, imdb_hndlr_t hclass, size_t * length)
 {
     d_imdb_check_hndlr (hmdb);
     d_imdb_check_hndlr (hclass);
 
     imdb_t         *imdb = d_hndlr2obj (imdb_t, hmdb);
-    block_ptr_t     block_ptr;
-    block_ptr.raw = (size_t) hclass;
-    imdb_block_class_t *class_block = d_acquire_class_block (imdb, block_ptr);
+    class_ptr_t     class_ptr;
+    class_ptr.raw = (size_t) hclass;
+
+    imdb_block_class_t *class_block = d_acquire_class_block (imdb, class_ptr);
     if (!class_block) {
-        d_log_eprintf (IMDB_SERVICE_NAME, sz_imdb_error[IMDB_BLOCK_ACCESS], block_ptr.raw);
+        d_log_eprintf (IMDB_SERVICE_NAME, sz_imdb_error[IMDB_BLOCK_ACCESS], class_ptr.raw);
+        return IMDB_BLOCK_ACCESS;
+    }
+
+    imdb_class_t   *dbclass = &class_block->dbclass;
+    imdb_errcode_t  res = IMDB_ERR_SUCCESS;
+    if (dbclass->cdef.opt_variable) {
+        // slot must fit into the first block of page
+        obj_size_t      extra_bsize = data_slot_type_bsize[dbclass->ds_type];
+        block_size_t    blimit = imdb->db_def.block_size - block_header_size[BLOCK_TYPE_PAGE];
+        if (d_dstype_slot_bucketed (dbclass->ds_type))
+            blimit -= sizeof (imdb_block_fl_t);
+        obj_size_t      slot_bsize = d_size_bptr (blimit);
+        if (d_dstype_slot_bucketed (dbclass->ds_type))
+            res = imdb_slot_bucket_max (imdb, class_block, &slot_bsize);
+        *length = (slot_bsize > extra_bsize) ? d_bptr_size (MIN (imdb->obj_bsize_max, slot_bsize - extra_bsize)) : 0;
+    }
+    else {
+        *length = dbclass->cdef.obj_size;
+    }
+
+    d_release_class_block (imdb, class_block);
+
+    return res;
+}
+
+/**
+[public] Return Information about class storage.
+  - hclass: handler to class instance
+  - class_info: result pointer to class_info structure
+  - result: imdb error code
+*/
+imdb_errcode_t  ICACHE_FLASH_ATTR
+imdb_class_info (imdb_hndlr_t hmdb, imdb_hndlr_t hclass, imdb_class_info_t * class_info)
+{
+    d_imdb_check_hndlr (hmdb);
+    d_imdb_check_hndlr (hclass);
+
+    imdb_t         *imdb = d_hndlr2obj (imdb_t, hmdb);
+    class_ptr_t     class_ptr;
+    class_ptr.raw = (size_t) hclass;
+
+    imdb_block_class_t *class_block = d_acquire_class_block (imdb, class_ptr);
+    if (!class_block) {
+        d_log_eprintf (IMDB_SERVICE_NAME, sz_imdb_error[IMDB_BLOCK_ACCESS], class_ptr.raw);
         return IMDB_BLOCK_ACCESS;
     }
 
-    imdb_errcode_t  res = imdb_class_instance_alloc (imdb, class_block, ptr, length);
+    os_memset (class_info, 0, sizeof (imdb_class_info_t));
+    class_info->hclass = hclass;
+    os_memcpy (&class_info->cdef, &(class_block->dbclass.cdef), sizeof (imdb_class_def_t));
+
+    imdb_block_page_t *page_targ = NULL;
+    imdb_block_t   *block_targ = NULL;
+    imdb_slot_free_t *slot_free = NULL;
+    block_size_t    bsize = imdb->db_def.block_size;
+    if (d_dstype_slot_bucketed (class_block->dbclass.ds_type)) {
+        block_ptr_t     block_ptr;
+        uint8           bucket;
+        // iterate buckets
+        for (bucket = 0; bucket < IMDB_SLOT_BUCKETS; bucket++) {
+            block_ptr.raw = class_block->dbclass.fl_bucket[bucket].raw;
+            // iterate block
+            while (block_ptr.raw != BLOCK_PTR_RAW_NONE) {
+                block_targ = imdb_linked_block_acquire (imdb, class_block, block_ptr, DATA_LOCK_READ);
+                if (!block_targ)
+                    return IMDB_BLOCK_ACCESS;
+
+                slot_free = d_block_slot_free (block_targ);
+                // iterate slot
+                while (slot_free) {
+                    class_info->slots_free++;
+                    class_info->slots_free_size += d_bptr_size (slot_free->length);
+                    slot_free = d_block_next_slot_free (block_targ, slot_free);
+                }
+                block_ptr.raw = d_block_fl_trailer (imdb, block_targ)->bucket_next.raw;
+
+                d_release_linked_block (imdb, class_block, block_targ);
+            }
+        }
+
+        // only last page may have not allocated blocks
+        block_ptr.raw = class_block->dbclass.page_last.raw;
+        page_targ = d_pointer_as (imdb_block_page_t, imdb_linked_block_acquire (imdb, class_block, block_ptr,
+                                                                                  DATA_LOCK_READ));
+        if (!page_targ)
+            return IMDB_BLOCK_ACCESS;
+        class_info->blocks_free += class_block->dbclass.cdef.page_blocks - page_targ->page.alloc_hwm;
+        d_release_page_block (imdb, page_targ);
+    }
+    else if (class_block->dbclass.page_fl_first.raw != BLOCK_PTR_RAW_NONE) {
+        page_targ = d_acquire_page_block (imdb, class_block->dbclass.page_fl_first, DATA_LOCK_READ);
+        if (!page_targ) {
+            d_log_eprintf (IMDB_SERVICE_NAME, sz_imdb_error[IMDB_BLOCK_ACCESS], class_block->dbclass.page_fl_first.raw);
+            return IMDB_BLOCK_ACCESS;
+        }
+        // iterate page
+        while (page_targ) {
+            page_blocks_t   bidx = page_targ->page.block_fl_first;
+
+            class_info->blocks_free += class_block->dbclass.cdef.page_blocks - page_targ->page.alloc_hwm;
+            // iterate block
+            while (bidx) {
+                block_ptr_t     block_ptr;
+                block_ptr.raw = d_page_get_blockid_byidx (page_targ, bidx, bsize);
+                block_targ = d_acquire_block (imdb, block_ptr, DATA_LOCK_READ);
+                if (!block_targ) {
+                    d_log_eprintf (IMDB_SERVICE_NAME, sz_imdb_error[IMDB_BLOCK_ACCESS], block_ptr.raw);
+                    return IMDB_BLOCK_ACCESS;
+                }
+
+                slot_free = d_block_slot_free (block_targ);
+                // iterate slot
+                while (slot_free) {
+                    class_info->slots_free++;
+                    class_info->slots_free_size += d_bptr_size (slot_free->length);
+                    if (d_dstype_slot_has_footer (class_block->dbclass.ds_type)) {
+                        imdb_slot_footer_t *slot_footer = d_block_slot_free_footer (slot_free);
+                        class_info->fl_skip_count += slot_footer->skip_count;
+                    }
+                    slot_free = d_block_next_slot_free (block_targ, slot_free);
+                }
+                bidx = block_targ->block_fl_next;
+
+                d_release_block (imdb, block_targ);
+            }
+
+            d_release_page_block (imdb, page_targ);
+            if (page_targ->page.page_fl_next.raw != BLOCK_PTR_RAW_NONE) {
+                page_targ = d_acquire_page_block (imdb, page_targ->page.page_fl_next, DATA_LOCK_READ);
+                if (!page_targ) {
+                    d_log_eprintf (IMDB_SERVICE_NAME, sz_imdb_error[IMDB_BLOCK_ACCESS],
+                                   page_targ->page.page_fl_next.raw);
+                    return IMDB_BLOCK_ACCESS;
+                }
+            }
+            else
+                page_targ = NULL;
+        }
+        if (page_targ)
+            d_release_page_block (imdb, page_targ);
+    }
+
+    class_info->pages = class_block->dbclass.page_count;
+    class_info->blocks = class_info->pages * class_block->dbclass.cdef.page_blocks;
+
     d_release_class_block (imdb, class_block);
 
-    return res;
+    return IMDB_ERR_SUCCESS;
 }
 
 /*
- * [public] write lock object block, need manual unlock.
- *   - hmdb: Handler to imdb instance
- *   - rowid: object row id
- *   - ptr: if not NULL returns pointer to updating object
- *   - result: imdb error code
- */
+[public] Create secondary hash index on object key, index is maintained by object insert and delete.
+  Key must be written right after object insert and must not be changed later.
+  Index of media storage is persistent, so existing index with the same definition is returned.
+  - hmdb: Handler to imdb instance
+  - hclass: handler to class instance
+  - key_offset: key offset in object fixed part
+  - key_len: key length in bytes
+  - key_type: key compare type
+  - idx_id: result index identifier
+  - result: imdb error code
+*/
 imdb_errcode_t  ICACHE_FLASH_ATTR
-imdb_clsobj_update_init (imdb_hndlr_t hmdb, imdb_rowid_t * rowid, void **ptr)
+imdb_index_create (imdb_hndlr_t hmdb, imdb_hndlr_t hclass, obj_size_t key_offset, uint8 key_len,
+                   imdb_key_type_t key_type, imdb_index_id_t * idx_id)
 {
-    *ptr = NULL;
     d_imdb_check_hndlr (hmdb);
+    d_imdb_check_hndlr (hclass);
+
     imdb_t         *imdb = d_hndlr2obj (imdb_t, hmdb);
-    if (imdb->db_def.opt_media) {
-        imdb_block_t   *block = fdb_cache_get ((imdb_bc_t *) (imdb), rowid->block_id, false, DATA_LOCK_WRITE);
-        if (!block) {
-            d_log_eprintf (IMDB_SERVICE_NAME, sz_imdb_error[IMDB_BLOCK_ACCESS], rowid->block_id);
-            return IMDB_BLOCK_ACCESS;
+    class_ptr_t     class_ptr;
+    class_ptr.raw = (size_t) hclass;
+
+    imdb_block_class_t *class_block = d_acquire_class_block (imdb, class_ptr);
+    if (!class_block) {
+        d_log_eprintf (IMDB_SERVICE_NAME, sz_imdb_error[IMDB_BLOCK_ACCESS], class_ptr.raw);
+        return IMDB_BLOCK_ACCESS;
+    }
+
+    imdb_class_t   *dbclass = &class_block->dbclass;
+    imdb_index_id_t iid_free = IMDB_INDEX_ID_NONE;
+    imdb_index_id_t iid;
+    for (iid = 0; iid < IMDB_CLASS_INDEX_MAX; iid++) {
+        imdb_index_t   *index = &dbclass->index[iid];
+        if (index->page.raw == BLOCK_PTR_RAW_NONE) {
+            if (iid_free == IMDB_INDEX_ID_NONE)
+                iid_free = iid;
         }
+        else if ((index->key_offset == key_offset) && (index->key_len == key_len) && (index->key_type == key_type))
+            break;
+    }
 
-        if (ptr)
-            *ptr = d_pointer_add (void, block, d_bptr_size (rowid->slot_offset) +
-                              (rowid->ds_type == DATA_SLOT_TYPE_1) ? 0 : sizeof (imdb_slot_free_t));
+    imdb_errcode_t  res = IMDB_ERR_SUCCESS;
+    if (iid < IMDB_CLASS_INDEX_MAX) {
+        d_release_class_block (imdb, class_block);
+        *idx_id = iid;
+        return IMDB_ERR_SUCCESS;
     }
+    // recycled objects are released without delete, so they can not be indexed
+    else if ((dbclass->ds_type != DATA_SLOT_TYPE_2) && (dbclass->ds_type != DATA_SLOT_TYPE_4))
+        res = IMDB_INVALID_OPERATION;
+    else if (!key_len || (key_offset + key_len > dbclass->cdef.obj_size))
+        res = IMDB_INVALID_OBJSIZE;
+    else if (iid_free == IMDB_INDEX_ID_NONE)
+        res = IMDB_INVALID_OPERATION;
+    d_imdb_assert_committed (dbclass);
+    d_release_class_block (imdb, class_block);
+    d_imdb_check_error (res);
 
-    return IMDB_ERR_SUCCESS;
-}
+    uint32          objcount = 0;
+    d_imdb_check_error (imdb_class_forall (hmdb, hclass, &objcount, imdb_forall_count));
 
-/*
- * [public] write lock and unlock object block.
- *   - hmdb: Handler to imdb instance
- *   - rowid: object row id
- *   - ptr: if not NULL returns pointer to updating object
- *   - result: imdb error code
- */
-imdb_errcode_t  ICACHE_FLASH_ATTR
-imdb_clsobj_update (imdb_hndlr_t hmdb, imdb_rowid_t * rowid, void **ptr)
-{
-    d_imdb_check_hndlr (hmdb);
-    imdb_t         *imdb = d_hndlr2obj (imdb_t, hmdb);
-    if (imdb->db_def.opt_media) {
-        imdb_block_t   *block = fdb_cache_get ((imdb_bc_t *) (imdb), rowid->block_id, false, DATA_LOCK_WRITE);
-        if (!block) {
-            d_log_eprintf (IMDB_SERVICE_NAME, sz_imdb_error[IMDB_BLOCK_ACCESS], rowid->block_id);
-            return IMDB_BLOCK_ACCESS;
+    class_block = d_acquire_class_block (imdb, class_ptr);
+    if (!class_block) {
+        d_log_eprintf (IMDB_SERVICE_NAME, sz_imdb_error[IMDB_BLOCK_ACCESS], class_ptr.raw);
+        return IMDB_BLOCK_ACCESS;
+    }
+    imdb_index_t    index;
+    os_memset (&index, 0, sizeof (imdb_index_t));
+    index.key_offset = key_offset;
+    index.key_len = key_len;
+    index.key_type = key_type;
+
+    d_setwrite_block (imdb, class_block);
+    os_memcpy (&class_block->dbclass.index[iid_free], &index, sizeof (imdb_index_t));
+    res = imdb_index_rebuild (imdb, class_block, iid_free, objcount);
+    if (res == IMDB_ERR_SUCCESS)
+        class_block->dbclass.idx_count++;
+    d_release_class_block (imdb, class_block);
+    d_imdb_check_error (res);
+
+    // index existing objects
+    imdb_hndlr_t    hcur;
+    d_imdb_check_error (imdb_class_query (hmdb, hclass, PATH_NONE, &hcur));
+    imdb_fetch_obj_t fobj;
+    uint16          rcnt;
+    while (res == IMDB_ERR_SUCCESS) {
+        res = imdb_class_fetch (hcur, 1, &rcnt, &fobj);
+        if ((res != IMDB_ERR_SUCCESS) && (res != IMDB_CURSOR_NO_DATA_FOUND))
+            break;
+        bool            fnext = (res == IMDB_ERR_SUCCESS);
+        res = IMDB_ERR_SUCCESS;
+        if (rcnt) {
+            uint16          hash = imdb_index_hash (&index, d_pointer_add (char, fobj.dataptr, key_offset));
+            class_block = d_acquire_class_block (imdb, class_ptr);
+            if (!class_block) {
+                d_log_eprintf (IMDB_SERVICE_NAME, sz_imdb_error[IMDB_BLOCK_ACCESS], class_ptr.raw);
+                res = IMDB_BLOCK_ACCESS;
+                break;
+            }
+            res = imdb_index_entry_add (imdb, class_block, iid_free, hash, &fobj.rowid);
+            d_release_class_block (imdb, class_block);
         }
-        block->lock_flag = DATA_LOCK_NONE;
+        if (!fnext)
+            break;
+    }
+    imdb_class_close (hcur);
 
-        if (ptr)
-            *ptr = d_pointer_add (void, block, d_bptr_size (rowid->slot_offset) +
-                              ((rowid->ds_type == DATA_SLOT_TYPE_1) ? 0 : sizeof (imdb_slot_free_t)));
+    if (res != IMDB_ERR_SUCCESS) {
+        d_log_eprintf (IMDB_SERVICE_NAME, "index %p:%u create error: %u", hclass, iid_free, res);
+        return res;
     }
 
+    *idx_id = iid_free;
+    d_log_iprintf (IMDB_SERVICE_NAME, "index %p:%u created (ko=%u,kl=%u,cnt=%u)", hclass, iid_free, key_offset,
+                   key_len, objcount);
+
     return IMDB_ERR_SUCCESS;
 }
 
-
 /*
- * [public] delete object from storage.
- *   - hmdb: Handler to imdb instance
- *   - hclass: handler to class instance
- *   - ptr: pointer to deleting object
- *   - result: imdb error code
- */
+[public] Call function for all objects with the given key.
+  Function may delete objects, but must not insert objects into the class.
+  - hmdb: Handler to imdb instance
+  - hclass: handler to class instance
+  - idx_id: index identifier
+  - key: key pointer
+  - data: function data
+  - forall_func: function, IMDB_CURSOR_BREAK stops the iteration
+  - result: imdb error code
+*/
 imdb_errcode_t  ICACHE_FLASH_ATTR
-imdb_clsobj_delete (imdb_hndlr_t hmdb, imdb_hndlr_t hclass, void *ptr)
+imdb_index_forall (imdb_hndlr_t hmdb, imdb_hndlr_t hclass, imdb_index_id_t idx_id, const void *key, void *data,
+                   imdb_forall_func forall_func)
 {
     d_imdb_check_hndlr (hmdb);
     d_imdb_check_hndlr (hclass);
@@ -2003,284 +4527,345 @@ imdb_clsobj_delete (imdb_hndlr_t hmdb, imdb_hndlr_t hclass, void *ptr)
         return IMDB_BLOCK_ACCESS;
     }
 
-    imdb_class_t   *dbclass = &class_block->dbclass;
-
-    imdb_slot_free_t *slot_free = NULL;
-    imdb_slot_footer_t *slot_footer = NULL;
-    imdb_block_t   *block = NULL;
-
-    obj_size_t      slen = 0;
-    obj_size_t      block_offset = 0;
-    switch (dbclass->ds_type) {
-    case DATA_SLOT_TYPE_1:
-    case DATA_SLOT_TYPE_3:
+    if ((idx_id >= IMDB_CLASS_INDEX_MAX) || (class_block->dbclass.index[idx_id].page.raw == BLOCK_PTR_RAW_NONE)) {
+        d_release_class_block (imdb, class_block);
         return IMDB_INVALID_OPERATION;
-        break;
-    case DATA_SLOT_TYPE_2:
-        {
-            imdb_slot_data2_t *slot_data2 = d_pointer_add (imdb_slot_data2_t, ptr, -sizeof (imdb_slot_data2_t));
-            if (slot_data2->flags != SLOT_FLAG_DATA) {
-                d_log_eprintf (IMDB_SERVICE_NAME, sz_imdb_error[IMDB_CORRUPT], slot_data2, "flag != data");
-                return IMDB_CORRUPT;
-            }
+    }
 
-            block = d_pointer_add (imdb_block_t, slot_data2, -d_bptr_size (slot_data2->block_offset));
-            slen = dbclass->cdef.obj_size + sizeof (imdb_slot_data2_t);
-            slot_free = (imdb_slot_free_t *) slot_data2;
-            slot_free->length = d_size_bptr (slen);
-            block_offset = slot_data2->block_offset;
+    d_imdb_assert_committed (&class_block->dbclass);
+    imdb_index_t    index;
+    os_memcpy (&index, &class_block->dbclass.index[idx_id], sizeof (imdb_index_t));
+    imdb_data_slot_type_t ds_type = class_block->dbclass.ds_type;
+    d_release_class_block (imdb, class_block);
+
+    uint16          hash = imdb_index_hash (&index, key);
+    uint32          bentries = d_index_block_entries (imdb);
+    uint32          slots = index.blocks * bentries;
+    uint32          slot = hash % slots;
+    uint32          n;
+    imdb_index_entry_t entry;
+    imdb_fetch_obj_t fobj;
+    for (n = 0; n < slots; n++) {
+        block_ptr_t     block_ptr;
+        block_ptr.raw = index.page.raw + (slot / bentries) * imdb->db_def.block_size;
+        imdb_block_t   *block = d_acquire_block (imdb, block_ptr, DATA_LOCK_READ);
+        if (!block) {
+            d_log_eprintf (IMDB_SERVICE_NAME, sz_imdb_error[IMDB_BLOCK_ACCESS], block_ptr.raw);
+            return IMDB_BLOCK_ACCESS;
         }
-        break;
-    case DATA_SLOT_TYPE_4:
-        {
-            imdb_slot_data4_t *slot_data4 = d_pointer_add (imdb_slot_data4_t, ptr, -sizeof (imdb_slot_data4_t));
-            if (slot_data4->flags != SLOT_FLAG_DATA) {
-                d_log_eprintf (IMDB_SERVICE_NAME, sz_imdb_error[IMDB_CORRUPT], slot_data4, "flag != data");
-                return IMDB_CORRUPT;
-            }
-            slen = d_bptr_size (slot_data4->length);
-            slot_footer = d_pointer_add (imdb_slot_footer_t, slot_data4, slen - sizeof (imdb_slot_footer_t));
+        os_memcpy (&entry, d_index_entry_byidx (block, slot % bentries), sizeof (imdb_index_entry_t));
+        d_unlock_block (imdb, block);
+        imdb->stat.index_probe++;
 
-            if (slot_footer->flags != SLOT_FLAG_DATA) {
-                d_log_eprintf (IMDB_SERVICE_NAME, sz_imdb_error[IMDB_CORRUPT], slot_footer, "flag != data");
-                return IMDB_CORRUPT;
-            }
+        if (d_index_entry_empty (&entry))
+            break;
 
-            block = d_pointer_add (imdb_block_t, slot_data4, -d_bptr_size (slot_data4->block_offset));
-            slot_free = d_pointer_as (imdb_slot_free_t, slot_data4);
-            block_offset = slot_data4->block_offset;
+        if (d_index_entry_live (&entry) && (entry.hash == hash)) {
+            block_ptr.raw = entry.block_id;
+            block = d_acquire_block (imdb, block_ptr, DATA_LOCK_READ);
+            if (!block) {
+                d_log_eprintf (IMDB_SERVICE_NAME, sz_imdb_error[IMDB_BLOCK_ACCESS], block_ptr.raw);
+                return IMDB_BLOCK_ACCESS;
+            }
+            fobj.dataptr = d_slot_offset_dataptr (block, entry.slot_offset);
+            bool            fmatch =
+                imdb_index_key_equal (&index, d_pointer_add (char, fobj.dataptr, index.key_offset), key);
+            d_unlock_block (imdb, block);
+
+            if (fmatch) {
+                fobj.rowid.block_id = entry.block_id;
+                fobj.rowid.ds_type = ds_type;
+                fobj.rowid.slot_offset = entry.slot_offset;
+                switch (forall_func (&fobj, data)) {
+                case IMDB_ERR_SUCCESS:
+                    break;
+                case IMDB_CURSOR_BREAK:
+                    return IMDB_ERR_SUCCESS;
+                default:
+                    return IMDB_CURSOR_FORALL_FUNC;
+                }
+            }
         }
-        break;
-    default:
-        d_assert (false, "ds_type=%u", dbclass->ds_type);
-    }
 
-    d_stat_slot_free (imdb);
-    slot_free->flags = SLOT_FLAG_FREE;
+        slot = (slot + 1) % slots;
+    }
 
-    d_log_dprintf (IMDB_SERVICE_NAME, "delete: class=%p add free slot=%p, len=%u", class_block, slot_free,
-                   slot_free->length);
+    return IMDB_ERR_SUCCESS;
+}
 
-    d_setwrite_block (imdb, block);
+LOCAL imdb_errcode_t ICACHE_FLASH_ATTR
+imdb_forall_index_find (imdb_fetch_obj_t * fobj, void *data)
+{
+    os_memcpy (data, fobj, sizeof (imdb_fetch_obj_t));
+    return IMDB_CURSOR_BREAK;
+}
 
-    imdb_slot_free_t *slot_free_n = NULL;
-    imdb_slot_free_t *slot_free_p = NULL;
-    // coalesce with next free slot
-    if (block_offset + slot_free->length < d_block_upper_data_blimit (imdb, block)) {
-        slot_free_n = d_pointer_add (imdb_slot_free_t, slot_free, slen);
-        if (slot_free_n->flags == SLOT_FLAG_FREE) {
-            slot_free->length += slot_free_n->length;
-            slot_footer = d_pointer_add (imdb_slot_footer_t, slot_free_n, d_bptr_size (slot_free_n->length) - sizeof (imdb_slot_footer_t));
-            d_stat_slot_coalesce (imdb);
-        }
-        else
-            slot_free_n = NULL;
-    }
+/*
+[public] Find first object with the given key.
+  - hmdb: Handler to imdb instance
+  - hclass: handler to class instance
+  - idx_id: index identifier
+  - key: key pointer
+  - fobj: result object
+  - result: imdb error code, IMDB_CURSOR_NO_DATA_FOUND when object is not found
+*/
+imdb_errcode_t  ICACHE_FLASH_ATTR
+imdb_index_find (imdb_hndlr_t hmdb, imdb_hndlr_t hclass, imdb_index_id_t idx_id, const void *key,
+                 imdb_fetch_obj_t * fobj)
+{
+    fobj->dataptr = NULL;
+    d_imdb_check_error (imdb_index_forall (hmdb, hclass, idx_id, key, fobj, imdb_forall_index_find));
 
-    // coalesce with prev free slot
-    if (block_offset > d_block_lower_data_blimit (block)) {
-        imdb_slot_footer_t *slot_footer_p = d_pointer_add (imdb_slot_footer_t, slot_free, -sizeof (imdb_slot_footer_t));
-        if (slot_footer_p->flags == SLOT_FLAG_FREE) {
-            slot_free_p = d_pointer_add (imdb_slot_free_t, slot_free, -d_bptr_size (slot_footer_p->length) );
-            slot_free_p->length += slot_free->length;
-            slot_free = slot_free_p;
-            d_stat_slot_coalesce (imdb);
-        }
-    }
+    return (fobj->dataptr) ? IMDB_ERR_SUCCESS : IMDB_CURSOR_NO_DATA_FOUND;
+}
 
-    imdb_slot_free_t *fslot = d_block_slot_free (block);
-    if (fslot) { // block FL was not empty
-        if (slot_free_p || slot_free_n) {
-            // prev/next free slot may not in free list        
-            imdb_slot_free_t *fslot_prev = NULL;
-            while (fslot) {
-                if (fslot_prev == fslot) {
-                    d_log_eprintf (IMDB_SERVICE_NAME, sz_imdb_error[IMDB_CORRUPT], fslot_prev, "free list loop");
-                    return IMDB_CORRUPT;
-                }
-                if ((fslot == slot_free_p) || (fslot == slot_free_n)) {
-                    if (fslot_prev)
-                        fslot_prev->next_offset = fslot->next_offset;
-                    else
-                        block->free_offset = fslot->next_offset;
-                }
-                else 
-                    fslot_prev = fslot;
-                fslot = d_block_next_slot_free (block, fslot);
-            }
-        }
+/*
+[private] Return object length available for query predicates and projection.
+  - class_block: pointer to class block
+  - dataptr: object data pointer
+  - result: object length in bytes
+*/
+LOCAL obj_size_t ICACHE_FLASH_ATTR
+imdb_cursor_obj_length (imdb_block_class_t * class_block, void *dataptr)
+{
+    if (!class_block->dbclass.cdef.opt_variable)
+        return class_block->dbclass.cdef.obj_size;
 
-        d_imdb_block_fl_insert_slot (block, slot_free);
-    }
-    else {      // block FL was empty
-        d_imdb_block_fl_insert_slot (block, slot_free);
+    imdb_slot_data4_t *data_slot4 = d_pointer_add (imdb_slot_data4_t, dataptr, -sizeof (imdb_slot_data4_t));
+    return d_bptr_size (data_slot4->length - data_slot_type_bsize[class_block->dbclass.ds_type]);
+}
 
-        page_ptr_t      page_ptr;
-        page_ptr.raw = d_block_get_page_blockid (block, imdb->db_def.block_size);
+/*
+[private] Evaluate query predicate on object.
+  - pred: predicate
+  - dataptr: object data pointer
+  - obj_length: object length, objects shorter than predicate field never match
+  - result: true when predicate satisfied
+*/
+LOCAL bool      ICACHE_FLASH_ATTR
+imdb_cursor_pred_match (const imdb_predicate_t * pred, const char *dataptr, obj_size_t obj_length)
+{
+    obj_size_t      fsize = d_pred_field_size (pred);
+    if (pred->offset + fsize > obj_length)
+        return false;
 
-        imdb_block_page_t *page_block = d_acquire_page_block (imdb, page_ptr, DATA_LOCK_WRITE);
-        if (!page_block) {
-            d_log_cprintf (IMDB_SERVICE_NAME, sz_imdb_error[IMDB_BLOCK_ACCESS], page_ptr.raw);
-            return IMDB_BLOCK_ACCESS;
+    const char     *field = dataptr + pred->offset;
+    sint32          cmp;
+    switch (pred->type) {
+    case PRED_TYPE_UINT8:
+    case PRED_TYPE_UINT16:
+    case PRED_TYPE_UINT32:
+        {
+            // field may be unaligned
+            uint32          val = 0;
+            if (fsize == sizeof (uint8)) {
+                val = *((const uint8 *) field);
+            }
+            else if (fsize == sizeof (uint16)) {
+                uint16          val16;
+                os_memcpy (&val16, field, sizeof (uint16));
+                val = val16;
+            }
+            else
+                os_memcpy (&val, field, sizeof (uint32));
+            cmp = (val < pred->value.uval) ? -1 : (val > pred->value.uval);
         }
-
-        d_imdb_page_fl_insert_block (page_block, block);
-        if (!block->block_fl_next) {    // page FL was empty            
-            d_setwrite_block (imdb, class_block);
-            d_imdb_class_fl_insert_page (class_block, page_block);
+        break;
+    case PRED_TYPE_SINT32:
+        {
+            sint32          val;
+            os_memcpy (&val, field, sizeof (sint32));
+            cmp = (val < pred->value.sval) ? -1 : (val > pred->value.sval);
         }
-        d_release_block (imdb, &page_block->block);
+        break;
+    case PRED_TYPE_STRING:
+        cmp = os_strncmp (field, (const char *) pred->value.ptr, fsize);
+        break;
+    case PRED_TYPE_BINARY:
+        cmp = os_memcmp (field, pred->value.ptr, fsize);
+        break;
+    default:
+        return false;
     }
 
-    if (slot_footer) {
-        os_memset (slot_footer, 0, sizeof (imdb_slot_footer_t));
-        slot_footer->flags = SLOT_FLAG_FREE;
-        slot_footer->length = slot_free->length;
+    switch (pred->op) {
+    case PRED_OP_EQ:
+        return (cmp == 0);
+    case PRED_OP_NE:
+        return (cmp != 0);
+    case PRED_OP_LT:
+        return (cmp < 0);
+    case PRED_OP_LE:
+        return (cmp <= 0);
+    case PRED_OP_GT:
+        return (cmp > 0);
+    case PRED_OP_GE:
+        return (cmp >= 0);
+    default:
+        return false;
     }
+}
+
+/*
+[private] Apply cursor query to fetched object. On projection object part is copied to projection buffer
+and fetched object refers to the copy.
+  - class_block: pointer to class block
+  - cur: pointer to cursor
+  - fobj: fetched object
+  - fidx: fetched object index in current fetch
+  - result: true when object satisfies query
+*/
+LOCAL bool      ICACHE_FLASH_ATTR
+imdb_cursor_obj_accept (imdb_block_class_t * class_block, imdb_cursor_t * cur, imdb_fetch_obj_t * fobj, uint16 fidx)
+{
+    d_stat_row_scan (cur->imdb);
+
+    imdb_query_t   *query = &cur->query;
+    if (query->pred_count || query->proj_length) {
+        obj_size_t      obj_length = imdb_cursor_obj_length (class_block, fobj->dataptr);
+        uint8           i;
+        for (i = 0; i < query->pred_count; i++) {
+            if (!imdb_cursor_pred_match (&query->pred[i], fobj->dataptr, obj_length))
+                return false;
+        }
 
-    d_release_class_block (imdb, class_block);
+        if (query->proj_length) {
+            char           *proj = d_pointer_add (char, query->proj_buffer, fidx * query->proj_length);
+            obj_size_t      len =
+                (obj_length > query->proj_offset) ? MIN (obj_length - query->proj_offset, query->proj_length) : 0;
+            os_memcpy (proj, d_pointer_add (char, fobj->dataptr, query->proj_offset), len);
+            if (len < query->proj_length)
+                os_memset (proj + len, 0, query->proj_length - len);
+            fobj->dataptr = proj;
+        }
+    }
 
-    return IMDB_ERR_SUCCESS;
+    d_stat_row_fetch (cur->imdb);
+    return true;
 }
 
-/**
-[public] change size of existing variable length object into storage.
-  - hclass: handler to class instance
-  - ptr_old: pointer to existing object
-  - ptr: result pointer to new object
-  - length: object size
-  - result: imdb error code
+/*
+[private] Return data end offset of recycled storage block. Data of the current block ends by its free slot.
+  - imdb:
+  - class_block: pointer to class block
+  - block: pointer to block
+  - result: data end offset in block units
 */
-imdb_errcode_t  ICACHE_FLASH_ATTR
-imdb_clsobj_resize (imdb_hndlr_t hmdb, imdb_hndlr_t hclass, void *ptr_old, void **ptr, size_t length)
+LOCAL block_size_t ICACHE_FLASH_ATTR
+imdb_recycle_data_end (imdb_t * imdb, imdb_block_class_t * class_block, imdb_block_t * block)
 {
-    return IMDB_INVALID_OPERATION;
+    if (block->free_offset)
+        return block->free_offset;
+
+    block_size_t    offset;
+    imdb_block_slot_data_last (imdb, &class_block->dbclass, block, &offset);
+    return offset;
 }
 
 /*
-[public] Return object length.
-  - hclass: handler to class instance
-  - ptr: pointer to deleting object
+[private] Shift to next or previous block of recycled storage. Blocks are ordered by the class page list
+and the last page is followed by the class page.
+  - imdb:
+  - class_block: pointer to class block
+  - block_id: current block id
+  - block_index: current block index in page
+  - fprev: shift to previous block
+  - [out] block_id_next: result block id
   - result: imdb error code
 */
-imdb_errcode_t  ICACHE_FLASH_ATTR
-imdb_clsobj_length (imdb_hndlr_t hmdb, imdb_hndlr_t hclass, void *ptr, size_t * length)
+LOCAL imdb_errcode_t ICACHE_FLASH_ATTR
+imdb_recycle_block_shift (imdb_t * imdb, imdb_block_class_t * class_block, size_t block_id,
+                          page_blocks_t block_index, bool fprev, size_t * block_id_next)
 {
-    d_imdb_check_hndlr (hmdb);
-    d_imdb_check_hndlr (hclass);
-
-    imdb_t         *imdb = d_hndlr2obj (imdb_t, hmdb);
-    class_ptr_t     class_ptr;
-    class_ptr.raw = (size_t) hclass;
+    block_size_t    bsize = imdb->db_def.block_size;
+    page_ptr_t      page_ptr;
+    page_ptr.raw = block_id - (block_index - 1) * bsize;
 
-    imdb_block_class_t *class_block = d_acquire_class_block (imdb, class_ptr);
-    if (!class_block) {
-        d_log_eprintf (IMDB_SERVICE_NAME, sz_imdb_error[IMDB_BLOCK_ACCESS], class_ptr.raw);
+    imdb_block_page_t *page_block = d_acquire_page_block (imdb, page_ptr, DATA_LOCK_READ);
+    if (!page_block) {
+        d_log_eprintf (IMDB_SERVICE_NAME, sz_imdb_error[IMDB_BLOCK_ACCESS], page_ptr.raw);
         return IMDB_BLOCK_ACCESS;
     }
 
-    if (class_block->dbclass.cdef.opt_variable) {
-        imdb_slot_data4_t *data_slot4 = d_pointer_add (imdb_slot_data4_t, ptr, -sizeof (imdb_slot_data4_t));
-        d_assert (data_slot4->flags == SLOT_FLAG_DATA, "flags=%u", data_slot4->flags);
-        *length = d_bptr_size (data_slot4->length);
+    if (!fprev) {
+        if (block_index < page_block->page.alloc_hwm)
+            *block_id_next = d_page_get_blockid_byidx (page_block, block_index + 1, bsize);
+        else
+            *block_id_next = (page_block->page.page_next.raw != BLOCK_PTR_RAW_NONE) ?
+                page_block->page.page_next.raw : class_block->block.id.raw;
+        d_release_linked_block (imdb, class_block, &page_block->block);
+        return IMDB_ERR_SUCCESS;
     }
-    else {
-        *length = class_block->dbclass.cdef.obj_size;
+
+    if (block_index > 1) {
+        *block_id_next = d_page_get_blockid_byidx (page_block, block_index - 1, bsize);
+        d_release_linked_block (imdb, class_block, &page_block->block);
+        return IMDB_ERR_SUCCESS;
     }
 
-    d_release_class_block (imdb, class_block);
+    page_ptr.raw = (page_block->page.page_prev.raw != BLOCK_PTR_RAW_NONE) ?
+        page_block->page.page_prev.raw : class_block->dbclass.page_last.raw;
+    d_release_linked_block (imdb, class_block, &page_block->block);
+
+    page_block = d_acquire_page_block (imdb, page_ptr, DATA_LOCK_READ);
+    if (!page_block) {
+        d_log_eprintf (IMDB_SERVICE_NAME, sz_imdb_error[IMDB_BLOCK_ACCESS], page_ptr.raw);
+        return IMDB_BLOCK_ACCESS;
+    }
+    *block_id_next = d_page_get_blockid_byidx (page_block, page_block->page.alloc_hwm, bsize);
+    d_release_linked_block (imdb, class_block, &page_block->block);
 
     return IMDB_ERR_SUCCESS;
 }
 
-/**
-[public] Return Information about class storage.
-  - hclass: handler to class instance
-  - class_info: result pointer to class_info structure
+/*
+[private] Position recycle scan cursor on the object. Rowid of recycled object is rejected.
+  - imdb:
+  - class_block: pointer to class block
+  - cur: pointer to cursor
+  - rowid: object rowid
   - result: imdb error code
 */
-imdb_errcode_t  ICACHE_FLASH_ATTR
-imdb_class_info (imdb_hndlr_t hmdb, imdb_hndlr_t hclass, imdb_class_info_t * class_info)
+LOCAL imdb_errcode_t ICACHE_FLASH_ATTR
+imdb_recycle_cur_seek (imdb_t * imdb, imdb_block_class_t * class_block, imdb_cursor_t * cur,
+                       const imdb_rowid_t * rowid)
 {
-    d_imdb_check_hndlr (hmdb);
-    d_imdb_check_hndlr (hclass);
-
-    imdb_t         *imdb = d_hndlr2obj (imdb_t, hmdb);
-    class_ptr_t     class_ptr;
-    class_ptr.raw = (size_t) hclass;
+    if (rowid->ds_type != class_block->dbclass.ds_type)
+        return IMDB_INVALID_OPERATION;
 
-    imdb_block_class_t *class_block = d_acquire_class_block (imdb, class_ptr);
-    if (!class_block) {
-        d_log_eprintf (IMDB_SERVICE_NAME, sz_imdb_error[IMDB_BLOCK_ACCESS], class_ptr.raw);
+    block_ptr_t     block_ptr;
+    block_ptr.raw = rowid->block_id;
+    imdb_block_t   *block = d_acquire_block (imdb, block_ptr, DATA_LOCK_READ);
+    if (!block) {
+        d_log_eprintf (IMDB_SERVICE_NAME, sz_imdb_error[IMDB_BLOCK_ACCESS], block_ptr.raw);
         return IMDB_BLOCK_ACCESS;
     }
 
-    os_memset (class_info, 0, sizeof (imdb_class_info_t));
-    class_info->hclass = hclass;
-    os_memcpy (&class_info->cdef, &(class_block->dbclass.cdef), sizeof (imdb_class_def_t));
-
-    imdb_block_page_t *page_targ = NULL;
-    imdb_block_t   *block_targ = NULL;
-    imdb_slot_free_t *slot_free = NULL;
-    block_size_t    bsize = imdb->db_def.block_size;
-    if (class_block->dbclass.page_fl_first.raw != BLOCK_PTR_RAW_NONE) {
-        page_targ = d_acquire_page_block (imdb, class_block->dbclass.page_fl_first, DATA_LOCK_READ);
-        if (!page_targ) {
-            d_log_eprintf (IMDB_SERVICE_NAME, sz_imdb_error[IMDB_BLOCK_ACCESS], class_block->dbclass.page_fl_first.raw);
-            return IMDB_BLOCK_ACCESS;
+    block_size_t    offset = rowid->slot_offset;
+    block_size_t    offset_lower = d_block_lower_data_blimit (block);
+    block_size_t    offset_end = offset;
+    bool            fvalid = (offset >= offset_lower) && (offset < imdb_recycle_data_end (imdb, class_block, block));
+    if (fvalid) {
+        if (class_block->dbclass.ds_type == DATA_SLOT_TYPE_1) {
+            fvalid = ((offset - offset_lower) % class_block->dbclass.obj_bsize_min == 0);
+            offset_end = offset + class_block->dbclass.obj_bsize_min;
         }
-        // iterate page
-        while (page_targ) {
-            page_blocks_t   bidx = page_targ->page.block_fl_first;
-
-            class_info->blocks_free += class_block->dbclass.cdef.page_blocks - page_targ->page.alloc_hwm;
-            // iterate block
-            while (bidx) {
-                block_ptr_t     block_ptr;
-                block_ptr.raw = d_page_get_blockid_byidx (page_targ, bidx, bsize);
-                block_targ = d_acquire_block (imdb, block_ptr, DATA_LOCK_READ);
-                if (!block_targ) {
-                    d_log_eprintf (IMDB_SERVICE_NAME, sz_imdb_error[IMDB_BLOCK_ACCESS], block_ptr.raw);
-                    return IMDB_BLOCK_ACCESS;
-                }
-
-                slot_free = d_block_slot_free (block_targ);
-                // iterate slot
-                while (slot_free) {
-                    class_info->slots_free++;
-                    class_info->slots_free_size += d_bptr_size (slot_free->length);
-                    if (d_dstype_slot_has_footer (class_block->dbclass.ds_type)) {
-                        imdb_slot_footer_t *slot_footer = d_block_slot_free_footer (slot_free);
-                        class_info->fl_skip_count += slot_footer->skip_count;
-                    }
-                    slot_free = d_block_next_slot_free (block_targ, slot_free);
-                }
-                bidx = block_targ->block_fl_next;
-
-                d_release_block (imdb, block_targ);
-            }
-
-            d_release_page_block (imdb, page_targ);
-            if (page_targ->page.page_fl_next.raw != BLOCK_PTR_RAW_NONE) {
-                page_targ = d_acquire_page_block (imdb, page_targ->page.page_fl_next, DATA_LOCK_READ);
-                if (!page_targ) {
-                    d_log_eprintf (IMDB_SERVICE_NAME, sz_imdb_error[IMDB_BLOCK_ACCESS],
-                                   page_targ->page.page_fl_next.raw);
-                    return IMDB_BLOCK_ACCESS;
-                }
-            }
-            else
-                page_targ = NULL;
+        else {
+            // data slot keeps own offset
+            imdb_slot_data4_t *data_slot4 = d_pointer_add (imdb_slot_data4_t, block, d_bptr_size (offset));
+            fvalid = (data_slot4->flags == SLOT_FLAG_DATA) && (data_slot4->block_offset == offset);
+            offset_end = offset + data_slot4->length;
         }
-        if (page_targ)
-            d_release_page_block (imdb, page_targ);
     }
+    d_release_linked_block (imdb, class_block, block);
 
-    class_info->pages = class_block->dbclass.page_count;
-    class_info->blocks = class_info->pages * class_block->dbclass.cdef.page_blocks;
-
-    d_release_class_block (imdb, class_block);
+    if (!fvalid) {
+        d_log_wprintf (IMDB_SERVICE_NAME, "seek: invalid rowid %p:%u", rowid->block_id, rowid->slot_offset);
+        return IMDB_INVALID_OPERATION;
+    }
 
+    cur->rowid_last.block_id = rowid->block_id;
+    cur->rowid_last.slot_offset = (cur->access_path == PATH_RECYCLE_SCAN_REW) ? offset_end : offset;
     return IMDB_ERR_SUCCESS;
 }
 
@@ -2289,28 +4874,37 @@ imdb_class_info (imdb_hndlr_t hmdb, imdb_hndlr_t hclass, imdb_class_info_t * cla
   - dbclass: pointer to class instance
   - cur: pointer to cursor
   - access_path: access path (FULL_SCAN, RECYCLE_SCAN, RECYCLE_SCAN_REW, etc.)
+  - query: query definition, may be NULL
   - result: imdb error code
 */
 LOCAL imdb_errcode_t ICACHE_FLASH_ATTR
 imdb_class_cur_open (imdb_t * imdb, imdb_block_class_t * class_block, imdb_cursor_t * cur,
-                     imdb_access_path_t access_path)
+                     imdb_access_path_t access_path, const imdb_query_t * query)
 {
     os_memset (cur, 0, sizeof (imdb_cursor_t));
     cur->access_path = access_path;
     cur->imdb = imdb;
     cur->class.raw = class_block->block.id.raw;
+    if (query)
+        os_memcpy (&cur->query, query, sizeof (imdb_query_t));
 
     cur->rowid_last.ds_type = class_block->dbclass.ds_type;
 
     switch (access_path) {
     case PATH_FULL_SCAN:
+        if (cur->query.rowid_start.block_id)
+            return IMDB_CURSOR_INVALID_PATH;
         cur->rowid_last.block_id = class_block->block.id.raw;
         break;
     case PATH_RECYCLE_SCAN:
-        // TODO: Not Finished
-        return IMDB_CURSOR_INVALID_PATH;
     case PATH_RECYCLE_SCAN_REW:
         {
+            if (!class_block->dbclass.cdef.opt_recycle)
+                return IMDB_CURSOR_INVALID_PATH;
+            if (cur->query.rowid_start.block_id)
+                return imdb_recycle_cur_seek (imdb, class_block, cur, &cur->query.rowid_start);
+
+            // current block is the ring end
             imdb_block_page_t *page_block =
                 d_acquire_page_block (imdb, class_block->dbclass.page_fl_first, DATA_LOCK_READ);
             if (!page_block) {
@@ -2318,26 +4912,27 @@ imdb_class_cur_open (imdb_t * imdb, imdb_block_class_t * class_block, imdb_curso
                                class_block->dbclass.page_fl_first.raw);
                 return IMDB_BLOCK_ACCESS;
             }
-            if (page_block->page.block_fl_first == 1) {
-                cur->rowid_last.block_id = page_block->block.id.raw;
-                cur->rowid_last.slot_offset = page_block->block.free_offset;
-                d_release_page_block (imdb, page_block);
+            page_blocks_t   bidx = page_block->page.block_fl_first;
+            size_t          block_id = d_page_get_blockid_byidx (page_block, bidx, imdb->db_def.block_size);
+            d_release_linked_block (imdb, class_block, &page_block->block);
+
+            if (access_path == PATH_RECYCLE_SCAN) {
+                // the ring starts right after the current block
+                cur->rowid_last.slot_offset = 0;
+                return imdb_recycle_block_shift (imdb, class_block, block_id, bidx, false,
+                                                 &cur->rowid_last.block_id);
             }
-            else {
-                d_release_page_block (imdb, page_block);
-                cur->rowid_last.block_id =
-                    d_page_get_blockid_byidx (page_block, page_block->page.block_fl_first, imdb->db_def.block_size);
 
-                block_ptr_t     block_ptr;
-                block_ptr.raw = cur->rowid_last.block_id;
-                imdb_block_t   *block = d_acquire_block (imdb, block_ptr, DATA_LOCK_READ);
-                if (!block) {
-                    d_log_eprintf (IMDB_SERVICE_NAME, sz_imdb_error[IMDB_BLOCK_ACCESS], cur->rowid_last.block_id);
-                    return IMDB_BLOCK_ACCESS;
-                }
-                cur->rowid_last.slot_offset = block->free_offset;
-                d_release_block (imdb, block);
+            block_ptr_t     block_ptr;
+            block_ptr.raw = block_id;
+            imdb_block_t   *block = d_acquire_block (imdb, block_ptr, DATA_LOCK_READ);
+            if (!block) {
+                d_log_eprintf (IMDB_SERVICE_NAME, sz_imdb_error[IMDB_BLOCK_ACCESS], block_ptr.raw);
+                return IMDB_BLOCK_ACCESS;
             }
+            cur->rowid_last.block_id = block_id;
+            cur->rowid_last.slot_offset = block->free_offset;
+            d_release_linked_block (imdb, class_block, block);
         }
         break;
     default:
@@ -2347,6 +4942,111 @@ imdb_class_cur_open (imdb_t * imdb, imdb_block_class_t * class_block, imdb_curso
     return IMDB_ERR_SUCCESS;
 }
 
+/*
+[private] Fetch next records from recycle scan cursor. Forward scan ends by the current block, reverse scan
+ends before the current block.
+  - class_block: pointer to class block
+  - cur: pointer to cursor
+  - count: fetch records limit
+  - rowcount: fetched records count
+  - fobj[]: fetched records
+  - result: imdb error code
+*/
+LOCAL imdb_errcode_t ICACHE_FLASH_ATTR
+imdb_class_cur_fetch_recycle (imdb_block_class_t * class_block, imdb_cursor_t * cur, uint16 count,
+                              uint16 * rowcount, imdb_fetch_obj_t fobj[])
+{
+    imdb_t         *imdb = cur->imdb;
+    bool            frew = (cur->access_path == PATH_RECYCLE_SCAN_REW);
+    // for safe results access, projected objects are copied
+    bool            foneblock = imdb->db_def.opt_media && !cur->query.proj_length;
+    imdb_fetch_obj_t *pfobj = &fobj[0];
+
+    while (cur->rowid_last.block_id != BLOCK_PTR_RAW_NONE) {
+        block_ptr_t     block_ptr;
+        block_ptr.raw = cur->rowid_last.block_id;
+        imdb_block_t   *block = d_acquire_block (imdb, block_ptr, DATA_LOCK_READ);
+        if (!block) {
+            d_log_eprintf (IMDB_SERVICE_NAME, sz_imdb_error[IMDB_BLOCK_ACCESS], block_ptr.raw);
+            return IMDB_BLOCK_ACCESS;
+        }
+
+        block_size_t    offset = cur->rowid_last.slot_offset;
+        block_size_t    offset_end = imdb_recycle_data_end (imdb, class_block, block);
+        if (offset == 0) {
+            if (frew && block->free_offset) {
+                // reverse scan reached the current block
+                d_release_linked_block (imdb, class_block, block);
+                cur->rowid_last.block_id = BLOCK_PTR_RAW_NONE;
+                return IMDB_CURSOR_NO_DATA_FOUND;
+            }
+            offset = (frew) ? offset_end : d_block_lower_data_blimit (block);
+        }
+
+        if (frew) {
+            block_size_t    offset_limit = d_block_lower_data_blimit (block);
+            while (offset > offset_limit) {
+                imdb_block_slot_prev (class_block, block, &offset, &pfobj->dataptr);
+                pfobj->rowid.block_id = block->id.raw;
+                pfobj->rowid.ds_type = class_block->dbclass.ds_type;
+                pfobj->rowid.slot_offset = offset;
+
+                cur->rowid_last.slot_offset = offset;
+                if (!imdb_cursor_obj_accept (class_block, cur, pfobj, *rowcount))
+                    continue;
+
+                pfobj++;
+                (*rowcount)++;
+                if (*rowcount == count) {
+                    d_release_linked_block (imdb, class_block, block);
+                    return IMDB_ERR_SUCCESS;
+                }
+            }
+        }
+        else {
+            while (offset < offset_end) {
+                pfobj->rowid.slot_offset = offset;
+                imdb_block_slot_next (imdb, class_block, block, &offset, &pfobj->dataptr);
+                cur->rowid_last.slot_offset = offset;
+                if (!pfobj->dataptr)
+                    continue;
+
+                pfobj->rowid.block_id = block->id.raw;
+                pfobj->rowid.ds_type = class_block->dbclass.ds_type;
+                if (!imdb_cursor_obj_accept (class_block, cur, pfobj, *rowcount))
+                    continue;
+
+                pfobj++;
+                (*rowcount)++;
+                if (*rowcount == count) {
+                    d_release_linked_block (imdb, class_block, block);
+                    return IMDB_ERR_SUCCESS;
+                }
+            }
+        }
+
+        size_t          block_id = block->id.raw;
+        page_blocks_t   block_index = block->block_index;
+        bool            fcurrent = (block->free_offset != 0);
+        d_release_linked_block (imdb, class_block, block);
+
+        if (!frew && fcurrent) {
+            // forward scan reached the ring end
+            cur->rowid_last.block_id = BLOCK_PTR_RAW_NONE;
+            return IMDB_CURSOR_NO_DATA_FOUND;
+        }
+
+        d_imdb_check_error (imdb_recycle_block_shift
+                            (imdb, class_block, block_id, block_index, frew, &cur->rowid_last.block_id));
+        cur->rowid_last.slot_offset = 0;
+
+        if (foneblock && *rowcount)
+            return IMDB_ERR_SUCCESS;
+    }
+
+    return IMDB_CURSOR_NO_DATA_FOUND;
+}
+
 /*
 [private] Fetch next record from cursor.
   - dbclass: pointer to class instance
@@ -2362,6 +5062,10 @@ imdb_class_cur_fetch (imdb_block_class_t * class_block, imdb_cursor_t * cur, uin
         return IMDB_CURSOR_NO_DATA_FOUND;
     }
 
+    if ((cur->access_path == PATH_RECYCLE_SCAN) || (cur->access_path == PATH_RECYCLE_SCAN_REW)) {
+        return imdb_class_cur_fetch_recycle (class_block, cur, count, rowcount, fobj);
+    }
+
     block_ptr_t     block_ptr;
     block_ptr.raw = cur->rowid_last.block_id;
 
@@ -2386,7 +5090,8 @@ imdb_class_cur_fetch (imdb_block_class_t * class_block, imdb_cursor_t * cur, uin
     }
     block_size_t    offset = cur->rowid_last.slot_offset;
 
-    bool            foneblock = cur->imdb->db_def.opt_media;    // for safe results access
+    // for safe results access, projected objects are copied
+    bool            foneblock = cur->imdb->db_def.opt_media && !cur->query.proj_length;
     block_size_t    offset_limit;
 
     imdb_fetch_obj_t *pfobj = &fobj[0];
@@ -2411,6 +5116,8 @@ imdb_class_cur_fetch (imdb_block_class_t * class_block, imdb_cursor_t * cur, uin
                     pfobj->rowid.ds_type = class_block->dbclass.ds_type;
 
                     cur->rowid_last.slot_offset = offset;
+                    if (!imdb_cursor_obj_accept (class_block, cur, pfobj, *rowcount))
+                        continue;
 
                     pfobj++;
                     (*rowcount)++;
@@ -2430,6 +5137,9 @@ imdb_class_cur_fetch (imdb_block_class_t * class_block, imdb_cursor_t * cur, uin
                     cur->rowid_last.block_id =
                         d_page_get_blockid_byidx (page_block, block->block_index + 1, cur->imdb->db_def.block_size);
                     block_ptr.raw = cur->rowid_last.block_id;
+                    if (cur->imdb->db_def.opt_media)
+                        fdb_cache_readahead (d_pointer_as (imdb_bc_t, cur->imdb), block_ptr.raw,
+                                             page_block->page.alloc_hwm - block->block_index);
                     block = d_acquire_block (cur->imdb, block_ptr, DATA_LOCK_READ);
                     if (!block) {
                         d_log_eprintf (IMDB_SERVICE_NAME, sz_imdb_error[IMDB_BLOCK_ACCESS], block_ptr.raw);
@@ -2458,87 +5168,6 @@ imdb_class_cur_fetch (imdb_block_class_t * class_block, imdb_cursor_t * cur, uin
             block = d_pointer_as (imdb_block_t, page_block);
         }
         break;
-    case PATH_RECYCLE_SCAN:
-        return IMDB_CURSOR_INVALID_PATH;
-        break;
-    case PATH_RECYCLE_SCAN_REW:
-        while (page_block) {
-            while (block) {
-                if (offset == 0) {
-                    if (block->free_offset) {
-                        // because recycle whole block
-                        return IMDB_CURSOR_NO_DATA_FOUND;
-                    }
-                    imdb_block_slot_data_last (cur->imdb, &class_block->dbclass, block, &offset);
-                }
-                offset_limit = d_block_lower_data_blimit (block);
-                while (offset > offset_limit) {
-                    pfobj->rowid.slot_offset = offset;
-                    imdb_block_slot_prev (class_block, block, &offset, &pfobj->dataptr);
-                    pfobj->rowid.block_id = block->id.raw;
-                    pfobj->rowid.ds_type = class_block->dbclass.ds_type;
-
-                    cur->rowid_last.slot_offset = offset;
-
-                    pfobj++;
-                    (*rowcount)++;
-
-                    if (*rowcount == count) {
-                        d_release_block (cur->imdb, block);
-                        d_release_page_block (cur->imdb, page_block);
-                        return IMDB_ERR_SUCCESS;
-                    }
-                }
-
-                d_release_block (cur->imdb, block);
-                if (foneblock && *rowcount) {
-                    d_release_page_block (cur->imdb, page_block);
-                    return IMDB_ERR_SUCCESS;
-                }
-
-                if (block->block_index > 2) {
-                    cur->rowid_last.block_id =
-                        d_page_get_blockid_byidx (page_block, block->block_index - 1, cur->imdb->db_def.block_size);
-                    block_ptr.raw = cur->rowid_last.block_id;
-                    block = d_acquire_block (cur->imdb, block_ptr, DATA_LOCK_READ);
-                    if (!block) {
-                        d_log_eprintf (IMDB_SERVICE_NAME, sz_imdb_error[IMDB_BLOCK_ACCESS], block_ptr.raw);
-                        return IMDB_BLOCK_ACCESS;
-                    }
-                }
-                else if (block->block_index == 2) {
-                    block = d_pointer_as (imdb_block_t, page_block);
-                    cur->rowid_last.block_id = block->id.raw;
-                }
-                else {
-                    cur->rowid_last.block_id = BLOCK_PTR_RAW_NONE;
-                    block = NULL;
-                }
-                cur->rowid_last.slot_offset = offset = 0;
-            }
-
-            d_release_page_block (cur->imdb, page_block);
-            page_ptr_t      page_ptr;
-            page_ptr.raw =
-                (page_block->page.page_prev.raw ==
-                 BLOCK_PTR_RAW_NONE) ? class_block->dbclass.page_last.raw : page_block->page.page_prev.raw;
-            cur->rowid_last.block_id = page_ptr.raw;
-            cur->rowid_last.slot_offset = offset = 0;
-            page_block = d_acquire_page_block (cur->imdb, page_ptr, DATA_LOCK_READ);
-            if (!page_block) {
-                d_log_eprintf (IMDB_SERVICE_NAME, sz_imdb_error[IMDB_BLOCK_ACCESS], page_ptr.raw);
-                return IMDB_BLOCK_ACCESS;
-            }
-
-            block_ptr.raw =
-                d_page_get_blockid_byidx (page_block, page_block->page.alloc_hwm, cur->imdb->db_def.block_size);
-            block = d_acquire_block (cur->imdb, block_ptr, DATA_LOCK_READ);
-            if (!block) {
-                d_log_eprintf (IMDB_SERVICE_NAME, sz_imdb_error[IMDB_BLOCK_ACCESS], block_ptr.raw);
-                return IMDB_BLOCK_ACCESS;
-            }
-        }
-        break;
     default:
         return IMDB_CURSOR_INVALID_PATH;
     }
@@ -2554,9 +5183,25 @@ imdb_class_cur_fetch (imdb_block_class_t * class_block, imdb_cursor_t * cur, uin
 */
 imdb_errcode_t  ICACHE_FLASH_ATTR
 imdb_class_query (imdb_hndlr_t hmdb, imdb_hndlr_t hclass, imdb_access_path_t access_path, imdb_hndlr_t * hcur)
+{
+    return imdb_class_query_ext (hmdb, hclass, access_path, NULL, hcur);
+}
+
+/*
+[public] Open cursor with predicates and projection. Objects not satisfying predicates are skipped by fetch.
+  - hclass: class instance handler
+  - query: query definition, NULL - fetch all objects
+  - hcur: pointer to cursor handler
+  - result: imdb error code
+*/
+imdb_errcode_t  ICACHE_FLASH_ATTR
+imdb_class_query_ext (imdb_hndlr_t hmdb, imdb_hndlr_t hclass, imdb_access_path_t access_path,
+                      const imdb_query_t * query, imdb_hndlr_t * hcur)
 {
     d_imdb_check_hndlr (hmdb);
     d_imdb_check_hndlr (hclass);
+    if (query && ((query->pred_count > IMDB_QUERY_PRED_MAX) || (query->proj_length && !query->proj_buffer)))
+        return IMDB_INVALID_OPERATION;
 
     imdb_cursor_t  *cur;
     st_zalloc (cur, imdb_cursor_t);
@@ -2570,9 +5215,24 @@ imdb_class_query (imdb_hndlr_t hmdb, imdb_hndlr_t hclass, imdb_access_path_t acc
     imdb_block_class_t *class_block = d_acquire_class_block (imdb, class_ptr);
     if (!class_block) {
         d_log_eprintf (IMDB_SERVICE_NAME, sz_imdb_error[IMDB_BLOCK_ACCESS], class_ptr.raw);
+        st_free (cur);
         return IMDB_BLOCK_ACCESS;
     }
 
+    if (query && !class_block->dbclass.cdef.opt_variable) {
+        // fixed size objects: fields must be inside object
+        obj_size_t      obj_size = class_block->dbclass.cdef.obj_size;
+        bool            fvalid = (query->proj_offset + query->proj_length <= obj_size);
+        uint8           i;
+        for (i = 0; i < query->pred_count; i++)
+            fvalid = fvalid && (query->pred[i].offset + d_pred_field_size (&query->pred[i]) <= obj_size);
+        if (!fvalid) {
+            d_release_class_block (imdb, class_block);
+            st_free (cur);
+            return IMDB_INVALID_OBJSIZE;
+        }
+    }
+
     imdb_access_path_t access_path2 = access_path;
     if (access_path2 == PATH_NONE) {
         if (class_block->dbclass.cdef.opt_recycle) {
@@ -2583,7 +5243,7 @@ imdb_class_query (imdb_hndlr_t hmdb, imdb_hndlr_t hclass, imdb_access_path_t acc
         }
     }
 
-    imdb_errcode_t  ret = imdb_class_cur_open (imdb, class_block, cur, access_path2);
+    imdb_errcode_t  ret = imdb_class_cur_open (imdb, class_block, cur, access_path2, query);
 
     d_release_class_block (imdb, class_block);
 
@@ -2615,6 +5275,12 @@ imdb_class_fetch (imdb_hndlr_t hcur, uint16 count, uint16 * rowcount, imdb_fetch
     }
 
     imdb_cursor_t  *cur = d_hndlr2obj (imdb_cursor_t, hcur);
+    if (cur->query.row_limit) {
+        if (cur->fetch_recs >= cur->query.row_limit)
+            return IMDB_CURSOR_NO_DATA_FOUND;
+        count = MIN (count, cur->query.row_limit - cur->fetch_recs);
+    }
+
     imdb_block_class_t *class_block = d_acquire_class_block (cur->imdb, cur->class);
     if (!class_block) {
         d_log_eprintf (IMDB_SERVICE_NAME, sz_imdb_error[IMDB_BLOCK_ACCESS], cur->class.raw);
@@ -2623,6 +5289,7 @@ imdb_class_fetch (imdb_hndlr_t hcur, uint16 count, uint16 * rowcount, imdb_fetch
 
     imdb_errcode_t  ret = imdb_class_cur_fetch (class_block, cur, count, rowcount, fobj);
     d_release_class_block (cur->imdb, class_block);
+    cur->fetch_recs += *rowcount;
 
     return ret;
 }
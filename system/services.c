@@ -87,6 +87,9 @@ typedef struct services_data_s {
     svcs_resource_t svcres;
     imdb_hndlr_t    hconf;
     imdb_hndlr_t    hsvcs;
+    imdb_index_id_t idx_conf;   // configuration service_id index
+    imdb_index_id_t idx_svc_id; // service_id index
+    imdb_index_id_t idx_svc_name;       // service name index
 } services_data_t;
 
 static services_data_t *sdata = NULL;
@@ -141,6 +144,7 @@ svcctl_forall_conf_validate (imdb_fetch_obj_t * fobj, void *data)
                                     sizeof (svcs_service_conf_t) + old_conf->varlen));
 
             new_conf->service_id = old_conf->service_id;
+            d_svcs_check_imdb_error (imdb_clsobj_insert_commit (sdata->svcres.hfdb, sdata->hconf, new_conf));
             new_conf->disabled = false;
             new_conf->struct_size = sizeof (svcs_service_conf_t);
             new_conf->cfgtype = old_conf->cfgtype;
@@ -179,8 +183,10 @@ svcctl_find_conf (service_ident_t service_id, svcs_service_conf_t ** conf, svcs_
     find_conf_ctx.cfgtype = cfgtype;
     find_conf_ctx.conf = NULL;
 
-    d_svcs_check_imdb_error (imdb_class_forall
-                             (sdata->svcres.hfdb, sdata->hconf, &find_conf_ctx, svcctl_forall_conf_find)
+    // cfgtype is changed in place, so only service_id is indexed
+    d_svcs_check_imdb_error (imdb_index_forall
+                             (sdata->svcres.hfdb, sdata->hconf, sdata->idx_conf, &service_id, &find_conf_ctx,
+                              svcctl_forall_conf_find)
         );
 
     if (update && find_conf_ctx.conf)
@@ -299,16 +305,33 @@ svcctl_find (service_ident_t service_id, const char *name, svcs_service_t ** svc
     if (!sdata)
         return SVCS_NOT_RUN;
 
-    svcs_find_ctx_t find_ctx;
-    find_ctx.service_id = service_id;
-    find_ctx.name = name;
-    find_ctx.svc = NULL;
+    *svc = NULL;
+    if (!service_id && !name) {
+        svcs_find_ctx_t find_ctx;
+        find_ctx.service_id = service_id;
+        find_ctx.name = name;
+        find_ctx.svc = NULL;
+
+        d_svcs_check_imdb_error (imdb_class_forall (sdata->svcres.hmdb, sdata->hsvcs, &find_ctx, svcctl_forall_find)
+            );
+        *svc = find_ctx.svc;
+        return (*svc) ? SVCS_ERR_SUCCESS : SVCS_NOT_EXISTS;
+    }
 
-    d_svcs_check_imdb_error (imdb_class_forall (sdata->svcres.hmdb, sdata->hsvcs, &find_ctx, svcctl_forall_find)
-        );
+    imdb_fetch_obj_t fobj;
+    imdb_errcode_t  imdb_res = (service_id) ?
+        imdb_index_find (sdata->svcres.hmdb, sdata->hsvcs, sdata->idx_svc_id, &service_id, &fobj) :
+        imdb_index_find (sdata->svcres.hmdb, sdata->hsvcs, sdata->idx_svc_name, name, &fobj);
+    if (imdb_res == IMDB_CURSOR_NO_DATA_FOUND)
+        return SVCS_NOT_EXISTS;
+    d_svcs_check_imdb_error (imdb_res);
 
-    *svc = find_ctx.svc;
-    return (*svc) ? SVCS_ERR_SUCCESS : SVCS_NOT_EXISTS;
+    svcs_service_t *found = d_pointer_as (svcs_service_t, fobj.dataptr);
+    if (service_id && name && os_strncmp (found->info.name, name, sizeof (service_name_t)) != 0)
+        return SVCS_NOT_EXISTS;
+
+    *svc = found;
+    return SVCS_ERR_SUCCESS;
 }
 
 
@@ -645,6 +668,14 @@ svcctl_start (imdb_hndlr_t hmdb, imdb_hndlr_t hfdb)
         sizeof (svcs_service_t) };
     d_svcs_check_svcs_error (imdb_class_create (hmdb, &cdef2, &sdata->hsvcs)
         );
+    d_svcs_check_svcs_error (imdb_index_create
+                             (hmdb, sdata->hsvcs, d_offsetof (svcs_service_t, info.service_id),
+                              sizeof (service_ident_t), KEY_TYPE_BINARY, &sdata->idx_svc_id)
+        );
+    d_svcs_check_svcs_error (imdb_index_create
+                             (hmdb, sdata->hsvcs, d_offsetof (svcs_service_t, info.name),
+                              sizeof (service_name_t), KEY_TYPE_STRING, &sdata->idx_svc_name)
+        );
 
     if (hfdb) {
         imdb_class_find (hfdb, SERVICES_IMDB_CLS_CONFIG, &sdata->hconf);
@@ -654,6 +685,10 @@ svcctl_start (imdb_hndlr_t hmdb, imdb_hndlr_t hfdb)
             };
             d_svcs_check_svcs_error (imdb_class_create (hfdb, &cdef3, &sdata->hconf));
         }
+        d_svcs_check_svcs_error (imdb_index_create
+                                 (hfdb, sdata->hconf, d_offsetof (svcs_service_conf_t, service_id),
+                                  sizeof (service_ident_t), KEY_TYPE_BINARY, &sdata->idx_conf)
+            );
 
         if (!system_get_safe_mode ()) {
             bool changed;
@@ -778,6 +813,7 @@ svcctl_service_install (service_ident_t service_id, const char *name, svcs_servi
     svc->info.enabled = sdef->enabled;
     svc->multicast = sdef->multicast;
     os_memcpy (svc->info.name, name, MIN (os_strlen (name), sizeof (service_name_t)));
+    d_svcs_check_imdb_error (imdb_clsobj_insert_commit (sdata->svcres.hmdb, sdata->hsvcs, svc));
 
     ret = SVCS_ERR_SUCCESS;
     if (svc->info.enabled) {
@@ -890,6 +926,7 @@ svcctl_service_conf_set (service_ident_t service_id, dtlv_ctx_t * conf)
                                   sizeof (svcs_service_conf_t) + conf->datalen));
 
         conf_data->service_id = service_id;
+        d_svcs_check_imdb_error (imdb_clsobj_insert_commit (sdata->svcres.hfdb, sdata->hconf, conf_data));
         conf_data->struct_size = sizeof (svcs_service_conf_t);
         conf_data->disabled = false;
         conf_data->cfgtype = SVCS_CFGTYPE_NEW;
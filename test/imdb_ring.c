@@ -0,0 +1,196 @@
+/*
+ * ESP8266 Things Shell imdb recycle ring order test
+ * Copyright (c) 2018 Denis Muratov <xeronm@gmail.com>.
+ * https://dtec.pro/gitbucket/git/esp8266/esp8266-tsh.git
+ *
+ * This file is part of ESP8266 Things Shell.
+ *
+ * ESP8266 Things Shell is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * ESP8266 Things Shell is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with ESP8266 Things Shell.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+/*
+ * Fills multi-page recycle classes with sequence numbered objects and checks that recycle scans return the ring
+ * from the oldest to the newest object (reverse scan - backward), including scans started from a rowid.
+ */
+
+#include "sysinit.h"
+#include "core/utils.h"
+#include "system/imdb.h"
+
+#define RING_BLOCK_SIZE		2048
+#define RING_PAGES_MIN		2
+#define RING_PAGES_MAX		4
+#define RING_PAGE_BLOCKS_MIN	3
+#define RING_PAGE_BLOCKS_MAX	4
+#define RING_INSERTS		3000
+#define RING_CHECK_EVERY	97
+#define RING_ROWS_MAX		1024
+#define RING_PAYLOAD_MAX	96
+
+typedef struct ring_obj_s {
+    uint32          seq;
+    char            payload[];
+} ring_obj_t;
+
+LOCAL imdb_fetch_obj_t ring_rows[RING_ROWS_MAX];
+
+/*
+ * [private] Fetch all rows of recycle scan
+ *  - path: PATH_RECYCLE_SCAN or PATH_RECYCLE_SCAN_REW
+ *  - rowid_start: start object, NULL - from the ring begin/end
+ *  - rowcount: fetched rows
+ *  - result: imdb error code
+ */
+LOCAL imdb_errcode_t ICACHE_FLASH_ATTR
+ring_scan (imdb_hndlr_t himdb, imdb_hndlr_t hclass, imdb_access_path_t path, imdb_rowid_t * rowid_start,
+           uint32 * rowcount)
+{
+    imdb_query_t    query;
+    os_memset (&query, 0, sizeof (imdb_query_t));
+    if (rowid_start)
+        query.rowid_start = *rowid_start;
+
+    imdb_hndlr_t    hcur;
+    imdb_errcode_t  res = imdb_class_query_ext (himdb, hclass, path, &query, &hcur);
+    if (res)
+        return res;
+
+    *rowcount = 0;
+    uint16          fetched;
+    do {
+        res = imdb_class_fetch (hcur, 16, &fetched, &ring_rows[*rowcount]);
+        *rowcount += fetched;
+    } while (!res && fetched && (*rowcount + 16 <= RING_ROWS_MAX));
+
+    imdb_class_close (hcur);
+    return (res == IMDB_CURSOR_NO_DATA_FOUND) ? IMDB_ERR_SUCCESS : res;
+}
+
+/*
+ * [private] Check rows are consecutive sequence numbers
+ *  - rowcount: rows count
+ *  - seq_first: expected first row sequence
+ *  - step: 1 - forward scan, -1 - reverse scan
+ *  - result: true when ordered
+ */
+LOCAL bool      ICACHE_FLASH_ATTR
+ring_ordered (uint32 rowcount, uint32 seq_first, int step)
+{
+    uint32          i;
+    for (i = 0; i < rowcount; i++) {
+        ring_obj_t     *obj = ring_rows[i].dataptr;
+        if (obj->seq != seq_first + i * step) {
+            fprintf (stderr, "row %u: seq %u, expected %u" LINE_END, i, obj->seq, seq_first + i * step);
+            return false;
+        }
+    }
+    return true;
+}
+
+/*
+ * [private] Check forward, reverse and rowid started scans
+ *  - seq_last: last inserted object sequence
+ *  - result: true when all scans follow the ring order
+ */
+LOCAL bool      ICACHE_FLASH_ATTR
+ring_check (imdb_hndlr_t himdb, imdb_hndlr_t hclass, uint32 seq_last)
+{
+    uint32          count;
+    uint32          count_rew;
+    if (ring_scan (himdb, hclass, PATH_RECYCLE_SCAN, NULL, &count) || !count)
+        return false;
+
+    uint32          seq_first = seq_last + 1 - count;
+    if (!ring_ordered (count, seq_first, 1))
+        return false;
+
+    imdb_rowid_t    rowid_mid = ring_rows[count / 2].rowid;
+    uint32          seq_mid = seq_first + count / 2;
+
+    if (ring_scan (himdb, hclass, PATH_RECYCLE_SCAN_REW, NULL, &count_rew) || (count_rew != count)
+        || !ring_ordered (count_rew, seq_last, -1))
+        return false;
+
+    if (ring_scan (himdb, hclass, PATH_RECYCLE_SCAN, &rowid_mid, &count_rew) || (count_rew != seq_last + 1 - seq_mid)
+        || !ring_ordered (count_rew, seq_mid, 1)) {
+        fprintf (stderr, "forward from seq %u: %u rows" LINE_END, seq_mid, count_rew);
+        return false;
+    }
+
+    if (ring_scan (himdb, hclass, PATH_RECYCLE_SCAN_REW, &rowid_mid, &count_rew)
+        || (count_rew != seq_mid + 1 - seq_first) || !ring_ordered (count_rew, seq_mid, -1)) {
+        fprintf (stderr, "reverse from seq %u: %u rows" LINE_END, seq_mid, count_rew);
+        return false;
+    }
+
+    return true;
+}
+
+/*
+ * [private] Fill recycle class of given geometry and check ring order while it wraps
+ *  - pages_max:
+ *  - page_blocks:
+ *  - result: true when passed
+ */
+LOCAL bool      ICACHE_FLASH_ATTR
+ring_test (uint16 pages_max, uint16 page_blocks)
+{
+    imdb_def_t      db_def = { RING_BLOCK_SIZE, BLOCK_CRC_NONE, false, 0, 0 };
+    imdb_class_def_t cdef = { "ring", true, true, false, 0, pages_max, page_blocks, 0 };
+    imdb_hndlr_t    himdb;
+    imdb_hndlr_t    hclass;
+    if (imdb_init (&db_def, &himdb) || imdb_class_create (himdb, &cdef, &hclass))
+        return false;
+
+    bool            passed = true;
+    unsigned int    seed = pages_max * 16 + page_blocks;
+    uint32          seq;
+    for (seq = 0; passed && (seq < RING_INSERTS); seq++) {
+        seed = seed * 1103515245 + 12345;
+        size_t          length = sizeof (ring_obj_t) + (seed >> 16) % RING_PAYLOAD_MAX;
+        ring_obj_t     *obj;
+        if (imdb_clsobj_insert (himdb, hclass, (void **) &obj, length)) {
+            fprintf (stderr, "insert %u failed" LINE_END, seq);
+            passed = false;
+            break;
+        }
+        obj->seq = seq;
+        os_memset (obj->payload, (uint8) seq, length - sizeof (ring_obj_t));
+
+        if ((seq % RING_CHECK_EVERY == 0) || (seq == RING_INSERTS - 1))
+            passed = ring_check (himdb, hclass, seq);
+    }
+
+    printf ("pages_max %u, page_blocks %u: %s" LINE_END, pages_max, page_blocks,
+            passed ? "passed" : "FAILED");
+    imdb_class_destroy (himdb, hclass);
+    imdb_done (himdb);
+
+    return passed;
+}
+
+int
+main (int argc, char **argv)
+{
+    int             failed = 0;
+    uint16          pages_max;
+    uint16          page_blocks;
+    for (pages_max = RING_PAGES_MIN; pages_max <= RING_PAGES_MAX; pages_max++)
+        for (page_blocks = RING_PAGE_BLOCKS_MIN; page_blocks <= RING_PAGE_BLOCKS_MAX; page_blocks++)
+            if (!ring_test (pages_max, page_blocks))
+                failed++;
+
+    return failed ? 1 : 0;
+}